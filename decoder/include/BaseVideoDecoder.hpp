@@ -47,7 +47,7 @@
 #include <queue>
 #include <vector>
 
-#include "BitstreamStatistic.hpp"
+#include "DecoderStatistics.hpp"
 #include "Dimensions.hpp"
 #include "Image.hpp"
 #include "SignaledConfiguration.hpp"
@@ -85,6 +85,12 @@ public:
 		virtual Dimensions get_dimensions() = 0;
 		virtual Colourspace get_colourspace() = 0;
 		virtual unsigned get_base_bitdepth() = 0;
+
+		// Wait until all pictures pushed so far have been consumed - for consumers that work asynchronously
+		virtual void flush(){};
+
+		// Where picture sizes are reported as access units are split, and statistics are read back from
+		virtual DecoderStatistics &statistics() = 0;
 	};
 
 	virtual void start() = 0;
@@ -108,8 +114,12 @@ private:
 
 // Factory function
 //
+// 'streaming' runs an external base decoder alongside enhancement decoding, reading its output through a FIFO so that
+// each picture is enhanced as soon as it is decoded, rather than after the whole base has been decoded to a file.
+//
 std::unique_ptr<BaseVideoDecoder> CreateBaseVideoDecoder(BaseVideoDecoder::Output &output, BaseCoding base,
                                                          Encapsulation encapulation, bool external,
-                                                         const std::string &prepared_yuv_file, bool keep_base);
+                                                         const std::string &prepared_yuv_file, bool keep_base,
+                                                         bool streaming = false);
 
 } // namespace lctm
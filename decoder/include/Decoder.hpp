@@ -41,6 +41,7 @@
 
 #pragma once
 
+#include "DecoderStatistics.hpp"
 #include "Dimensions.hpp"
 #include "Dithering.hpp"
 #include "Image.hpp"
@@ -57,19 +58,53 @@ class Decoder {
 public:
 	Decoder();
 
-	// Decode enhancment layer, and apply it to given base image
+	// Decode enhancment layer, and apply it to given base image - a picture with sizes reported by its base decoder gets a
+	// line of statistics on stdout
 	Image decode(const Image &base, Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS], const Image &src_image,
-	             bool report, bool dithering_switch, bool dithering_fixed, bool apply_enhancement);
+	             bool report, bool dithering_switch, bool dithering_fixed, bool apply_enhancement,
+	             const ReportStructure *picture_report = nullptr);
 
+	// Parse enhancement data for a picture, updating the configuration and filling in symbols
 	void initialize_decode(const Packet &enhancement_data, Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS]);
 
 	SignaledConfiguration get_configuration() { return configuration_; };
 	Dimensions get_dimensions() { return dimensions_; };
 
+	// Take the configuration of a picture parsed by another decoder, before decoding that picture's symbols
+	void set_configuration(const SignaledConfiguration &configuration, const Dimensions &dimensions) {
+		configuration_ = configuration;
+		dimensions_ = dimensions;
+	};
+
 	void set_idr(bool is_idr) {
 		configuration_.picture_configuration.coding_type = is_idr ? CodingType::CodingType_IDR : CodingType::CodingType_NonIDR;
 	};
 
+	// Number of worker threads the decoder may use (1 is fully serial)
+	void set_num_threads(unsigned num_threads) { num_threads_ = num_threads ? num_threads : 1; };
+
+	// Upsample all planes of each LOQ in one call to UpsamplingDPI, rather than plane by plane
+	void set_upsampling_dpi(bool upsampling_dpi) { upsampling_dpi_ = upsampling_dpi; };
+
+	// Decode the planes of a picture, and the two sub-layers of each plane, as parallel tasks on up to num_threads
+	// threads. Output is identical to serial decoding.
+	void set_parallel_planes(bool parallel_planes) { parallel_planes_ = parallel_planes; };
+
+	// Reconstruct output planes in bands of this many rows (rounded up to a multiple of 4), each band going from base
+	// conversion to output conversion before the next, so intermediate rows stay in cache rather than passing through whole
+	// plane surfaces. Bands are reconstructed as parallel tasks on up to num_threads threads. 0 reconstructs whole planes.
+	void set_stripe_rows(unsigned stripe_rows) { stripe_rows_ = stripe_rows; };
+
+	// Entropy decode coefficients into a block interleaved layout, rather than one surface per layer. Symbols from
+	// initialize_decode() are then only meaningful to a decoder with the same setting.
+	void set_interleaved_coefficients(bool interleaved_coefficients) { interleaved_coefficients_ = interleaved_coefficients; };
+
+	// Bitrate, PSNR and checksum state of this decoder - base decoders report picture sizes here
+	DecoderStatistics &statistics() { return statistics_; };
+
+	// Send this decoder's surface dumps to the given set, rather than whatever is current on the calling thread
+	void set_surface_dumps(SurfaceDumps *surface_dumps) { surface_dumps_ = surface_dumps; };
+
 private:
 	bool is_user_data_layer(unsigned loq, unsigned layer) const;
 
@@ -80,8 +115,63 @@ private:
 
 	Surface get_temporal_mask(Surface temporal_symbols);
 
-	// Generate residuals for a plane's LOQ, along with any embedded temporal signalling
-	Surface decode_residuals(unsigned plane, unsigned loq, Surface &temporal_mask, Surface symbols[MAX_NUM_LAYERS]);
+	// Generate residuals for a plane's LOQ, along with any embedded temporal signalling, and the occupancy of its transform
+	// blocks if the entropy decoder produced one (interleaved coefficients) - otherwise occupancy is left empty
+	Surface decode_residuals(unsigned plane, unsigned loq, Surface &temporal_mask, Surface symbols[MAX_NUM_LAYERS],
+	                         Surface &occupancy);
+
+	// Dequantize block interleaved coefficients in place, then inverse transform them - blocks with no occupancy are skipped
+	Surface decode_residuals_interleaved(unsigned plane, unsigned loq, const Surface &temporal_mask, const Surface &coefficients,
+	                                     const Surface &occupancy, unsigned passes, const int32_t invq_step_width[MAX_NUM_LAYERS][2],
+	                                     const int32_t invq_applied_offset[MAX_NUM_LAYERS][2]);
+
+	// Convert a plane of the base picture to internal format at enhancement depth
+	Surface convert_base_plane(const Image &ext_base, unsigned plane);
+	Surface convert_base(const Surface &base) const;
+
+	// Sub-layer 1 residuals for a plane, after deblocking
+	void decode_base_residuals(unsigned plane, Surface symbols[MAX_NUM_LAYERS], Surface &residuals, Surface &occupancy);
+
+	// Sub-layer 2 residuals for a plane - via the temporal buffer, when enabled, which may be updated even if the plane
+	// has no enhancement
+	void decode_full_residuals(unsigned plane, Surface symbols[MAX_NUM_LAYERS], bool enhancement_enabled, Surface &residuals,
+	                           Surface &occupancy);
+
+	// Are all planes of a LOQ upsampled in one pass?
+	bool upsample_planes_jointly(unsigned loq) const;
+
+	// Upsample a plane into the given LOQ, apply any predicted average, then add residuals (which may be empty). If the
+	// residuals' block occupancy is known, empty blocks are not added.
+	Surface upsample_and_add(unsigned plane, unsigned loq, const Surface &src, const Surface &residuals,
+	                         const Surface &occupancy = Surface());
+
+	// As upsample_and_add() for each plane of a picture
+	void upsample_and_add_planes(unsigned loq, unsigned num_planes, const Surface src[MAX_NUM_PLANES],
+	                             const Surface residuals[MAX_NUM_PLANES], const Surface occupancy[MAX_NUM_PLANES],
+	                             Surface dst[MAX_NUM_PLANES]);
+
+	// Dump an upsampled plane, then add residuals (which may be empty)
+	Surface add_residuals(unsigned plane, unsigned loq, Surface &upsampled, const Surface &residuals,
+	                      const Surface &occupancy = Surface());
+
+	// Is the picture reconstructed in bands of rows?
+	bool use_stripes() const;
+
+	// Upsample source rows [y_begin, y_end) into a LOQ and add residuals (which may be null) - 'src' points at source row
+	// 'src_y', 'dest' and 'residuals' at the first row generated
+	void reconstruct_rows(unsigned loq, int16_t *dest, const int16_t *src, unsigned src_y, unsigned src_width,
+	                      unsigned src_height, unsigned y_begin, unsigned y_end, const int16_t *residuals) const;
+
+	// Reconstruct rows [begin, end) of a plane of the preliminary output picture, from the rows of the base picture
+	// within reach of the upsampling kernels. Residuals may be empty.
+	Surface reconstruct_band(unsigned plane, const Image &ext_base, const Surface &base_residuals, const Surface &full_residuals,
+	                         unsigned begin, unsigned end) const;
+
+	// Crop and convert a band of a plane of the output picture, starting at row 'begin', into the output plane
+	void output_band(unsigned plane, const Surface &band, unsigned begin, unsigned height, SurfaceBuilder<uint8_t> &output) const;
+
+	// Dither, crop and convert a plane of the output picture to the output format
+	Surface output_plane(unsigned plane, Surface &full_reco, bool dithering_switch, bool dithering_fixed);
 
 	// Current configuration from syntax
 	SignaledConfiguration configuration_;
@@ -98,6 +188,20 @@ private:
 	int32_t quant_matrix_coeffs_[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS];
 
 	Dithering dithering_;
+
+	DecoderStatistics statistics_;
+
+	SurfaceDumps *surface_dumps_ = nullptr;
+
+	unsigned num_threads_ = 1;
+
+	bool upsampling_dpi_ = false;
+
+	bool interleaved_coefficients_ = false;
+
+	bool parallel_planes_ = false;
+
+	unsigned stripe_rows_ = 0;
 };
 
 } // namespace lctm
@@ -0,0 +1,87 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// DecoderStatistics.hpp
+//
+// Per decoder bitrate, PSNR and checksum state, and sizes of the pictures on their way from base decoder to output
+//
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include "BitstreamStatistic.hpp"
+#include "SignaledConfiguration.hpp"
+
+namespace lctm {
+
+class DecoderStatistics {
+public:
+	DecoderStatistics() {
+		memset(&psnr_, 0, sizeof(psnr_));
+		memset(md5_digest_, 0, sizeof(md5_digest_));
+	}
+
+	// Record the sizes of a picture as the base decoder splits its access unit - safe from any thread
+	void push_report(const ReportStructure &report) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		reports_[report.miTimeStamp] = report;
+	}
+
+	// Take the report for the picture with the given timestamp, to be passed along with that picture - false if there is
+	// none, eg: the base was not decoded by a BaseVideoDecoder
+	bool take_report(int timestamp, ReportStructure &report) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		const auto r = reports_.find(timestamp);
+		if (r == reports_.end())
+			return false;
+		report = r->second;
+		reports_.erase(r);
+		return true;
+	}
+
+	PsnrStatistic &psnr() { return psnr_; }
+
+	uint8_t (&md5_digest())[MAX_NUM_PLANES][16] { return md5_digest_; }
+
+private:
+	std::mutex mutex_;
+	std::map<int, ReportStructure> reports_;
+
+	PsnrStatistic psnr_;
+	uint8_t md5_digest_[MAX_NUM_PLANES][16];
+};
+
+} // namespace lctm
@@ -50,8 +50,18 @@ namespace lctm {
 
 class Deserializer : public Component {
 public:
+	// Where block interleaved data goes in symbols[plane][loq][]
+	enum { INTERLEAVED_COEFFICIENTS = 0, INTERLEAVED_OCCUPANCY = 1 };
+
+	// 'num_threads' > 1 entropy decodes the tiles of tiled encoded data on a pool of worker threads
+	//
+	// 'interleave_coefficients' decodes all the residual layers of a plane's LoQ into one block interleaved surface in
+	// symbols[plane][loq][INTERLEAVED_COEFFICIENTS] - the coefficients of each block are contiguous, blocks are in raster
+	// order. symbols[plane][loq][INTERLEAVED_OCCUPANCY] gets a byte per block that is non-zero if any of the block's
+	// coefficients are. Temporal signalling stays in its own layer.
 	Deserializer(const Packet &packet, SignaledConfiguration &dst_configuration,
-	             Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS]);
+	             Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS], unsigned num_threads = 1,
+	             bool interleave_coefficients = false);
 
 	bool has_more() const;
 	unsigned parse_block();
@@ -72,6 +82,8 @@ private:
 	BitstreamUnpacker b_;
 	SignaledConfiguration &dst_configuration_;
 	Surface (&symbols_)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS];
+	unsigned num_threads_;
+	bool interleave_coefficients_;
 };
 
 } // namespace lctm
@@ -45,11 +45,47 @@ namespace lctm {
 
 #define DITHER_BUFFER_SIZE (64 * 1024)
 
+//// Pseudo-random number generators - state is per instance, so decoders in one process do not disturb each other
+//
+// Linear congruential generator used to fill the dithering buffer, RAND_MAX assumed to be 32767
+class Random : public Component {
+
+public:
+	Random() : Component("Random") {}
+
+	int rand();
+	void srand(unsigned seed);
+
+private:
+	unsigned long next_ = 0;
+};
+
+// Additive feedback generator that picks dithering buffer offsets for each block - produces the same sequence as glibc
+// rand(), which the offsets were originally taken from, so output is unchanged
+class RandomAdditive : public Component {
+
+public:
+	RandomAdditive() : Component("RandomAdditive") { srand(1); }
+
+	int rand();
+	void srand(unsigned seed);
+
+private:
+	enum { DEGREE = 31, SEPARATION = 3 };
+
+	uint32_t state_[DEGREE];
+	unsigned front_ = SEPARATION;
+	unsigned rear_ = 0;
+};
+
 class Dithering : public Component {
 	bool mbDitheringInitialised;
 
 	int32_t maiDitheringBuffer[DITHER_BUFFER_SIZE];
 
+	Random buffer_random_;
+	RandomAdditive offset_random_;
+
 public:
 	Dithering() : Component("Dithering") { mbDitheringInitialised = false; }
 
@@ -63,13 +99,4 @@ public:
 
 };
 
-class Random : public Component {
-
-public:
-	Random() : Component("Random") {}
-
-	int rand();
-	void srand(unsigned seed);
-};
-
 } // namespace lctm
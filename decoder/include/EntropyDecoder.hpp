@@ -65,6 +65,9 @@ protected:
 	};
 
 	rle_pel_t decode_pel(SymbolSource &source) const;
+
+	void decode_span(SymbolSource &source, rle_pel_t &current, int16_t *dst, unsigned count, unsigned step,
+	                 uint8_t *occupied) const;
 };
 
 class EntropyDecoderResiduals : protected EntropyDecoderResidualsBase {
@@ -75,6 +78,12 @@ public:
 	// Decode per-surface data into plane of symbols when coding units are NOT used (i.e no temporal and tile_mode=0)
 	Surface process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b);
 
+	// As above, writing symbol (x,y) to dst[y * pitch + x * step] - e.g: one layer of block interleaved coefficients
+	//
+	// If 'occupancy' is given, occupancy[y * occupancy_pitch + x] is set to 1 for every non-zero symbol, and left alone otherwise
+	void process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b, int16_t *dst,
+	             unsigned pitch, unsigned step, uint8_t *occupancy = nullptr, unsigned occupancy_pitch = 0);
+
 private:
 };
 
@@ -87,6 +96,11 @@ public:
 	Surface process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b,
 	                unsigned transform_block_size);
 
+	// As above, writing symbol (x,y) to dst[y * pitch + x * step], and optionally marking 'occupancy'
+	void process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b,
+	             unsigned transform_block_size, int16_t *dst, unsigned pitch, unsigned step, uint8_t *occupancy = nullptr,
+	             unsigned occupancy_pitch = 0);
+
 private:
 };
 
@@ -103,6 +117,16 @@ public:
 	Surface process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b,
 	                unsigned transform_block_size, bool use_reduced_signalling);
 
+	// As above, into a packed temporal mask (see TemporalDecode.hpp) - runs are filled a word at a time
+	//
+	Surface process_packed(unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b,
+	                       unsigned transform_block_size, bool use_reduced_signalling);
+
+	// Decode into a region of a zeroed packed temporal mask, starting at block 'x' of each row - rows are 'pitch' words apart
+	//
+	void process_packed(unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b,
+	                    unsigned transform_block_size, bool use_reduced_signalling, uint64_t *dst, unsigned pitch, unsigned x);
+
 private:
 	unsigned decode_run(SymbolSource &source, bool symbol) const;
 };
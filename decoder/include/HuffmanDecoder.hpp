@@ -61,9 +61,29 @@ public:
 	const std::vector<HuffmanCode> &codes() { return codes_; }
 
 private:
+	// Number of bits used to index the first level lookup table
+	static const unsigned LOOKUP_BITS = 10;
+
+	// First level lookup table entry - 'bits' of zero means the code is longer than the table index
+	struct LookupEntry {
+		uint8_t symbol;
+		uint8_t bits;
+		uint16_t code;
+	};
+
+	void build_lookup();
+
 	unsigned single_symbol_ = 0;
 
 	std::vector<HuffmanCode> codes_;
+
+	// Lookup table indexed by next 'lookup_bits_' of stream
+	unsigned lookup_bits_ = 0;
+	std::vector<LookupEntry> lookup_;
+
+	// Codes that do not fit the lookup table, as indices into codes_, in increasing length order
+	unsigned max_code_length_ = 0;
+	std::vector<uint16_t> long_codes_;
 };
 
 } // namespace lctm
@@ -71,6 +71,10 @@ public:
 	InverseQuantize_SWM() : Component("InverseQuantize_SWM") {}
 	Surface process(const Surface &src_plane, unsigned transform_block_size, int32_t *invq_step_width,
 	                int32_t *applied_dequant_offset, const Surface &temporal_map);
+
+	// As process(), picking step widths from a packed temporal mask (see TemporalDecode.hpp)
+	Surface process_packed(const Surface &src_plane, int32_t *invq_step_width, int32_t *applied_dequant_offset,
+	                       const Surface &temporal_mask);
 };
 
 } // namespace lctm
@@ -48,6 +48,10 @@ public:
 	InverseTransformDD() : Component("InverseTransformDD") {}
 
 	Surface process(int width, int height, const Surface src_layers[4]);
+
+	// As process(), from block interleaved coefficients: all 4 coefficients of a block are contiguous, blocks in raster order
+	// If 'occupancy' is not empty, blocks with a zero occupancy byte are known to be all zero and are not transformed
+	Surface process_interleaved(int width, int height, const Surface &coefficients, const Surface &occupancy = Surface());
 };
 
 } // namespace lctm
@@ -48,6 +48,10 @@ public:
 	InverseTransformDDS() : Component("InverseTransformDDS") {}
 
 	Surface process(int width, int height, const Surface src_layers[16]);
+
+	// As process(), from block interleaved coefficients: all 16 coefficients of a block are contiguous, blocks in raster order
+	// If 'occupancy' is not empty, blocks with a zero occupancy byte are known to be all zero and are not transformed
+	Surface process_interleaved(int width, int height, const Surface &coefficients, const Surface &occupancy = Surface());
 };
 
 } // namespace lctm
@@ -48,6 +48,10 @@ public:
 	InverseTransformDDS_1D() : Component("InverseTransformDDS_1D") {}
 
 	Surface process(int width, int height, const Surface src_layers[]);
+
+	// As process(), from block interleaved coefficients: all 16 coefficients of a block are contiguous, blocks in raster order
+	// If 'occupancy' is not empty, blocks with a zero occupancy byte are known to be all zero and are not transformed
+	Surface process_interleaved(int width, int height, const Surface &coefficients, const Surface &occupancy = Surface());
 };
 
 } // namespace lctm
@@ -43,6 +43,54 @@
 
 namespace lctm {
 
+//// Packed temporal masks
+//
+// The decoder keeps temporal signalling packed one bit per transform block, set for intra. A packed mask is a surface that
+// is one byte wide per block, so it has the mask's dimensions, but whose rows hold 64 bit words: block x of a row is bit
+// x % 64 of word x / 64.
+//
+static inline unsigned temporal_mask_stride(unsigned width) { return ((width + 63) / 64) * sizeof(uint64_t); }
+
+static inline const uint64_t *temporal_mask_row(const SurfaceView<uint8_t> &packed, unsigned y) {
+	return reinterpret_cast<const uint64_t *>(packed.data(0, y));
+}
+
+static inline bool temporal_mask_intra(const uint64_t *row, unsigned x) { return (row[x / 64] >> (x % 64)) & 1; }
+
+// Mark blocks [begin, end) of a row as intra - whole words at a time
+static inline void temporal_mask_fill(uint64_t *row, unsigned begin, unsigned end) {
+	if (begin >= end)
+		return;
+
+	const unsigned first = begin / 64, last = (end - 1) / 64;
+	const uint64_t first_bits = ~0ull << (begin % 64);
+	const uint64_t last_bits = ~0ull >> (63 - (end - 1) % 64);
+
+	if (first == last) {
+		row[first] |= first_bits & last_bits;
+		return;
+	}
+
+	row[first] |= first_bits;
+	for (unsigned w = first + 1; w < last; ++w)
+		row[w] = ~0ull;
+	row[last] |= last_bits;
+}
+
+// Packed mask with every block the same type
+class TemporalMaskFill : public Component {
+public:
+	TemporalMaskFill() : Component("TemporalMaskFill") {}
+	Surface process(unsigned width, unsigned height, TemporalType type);
+};
+
+// Packed mask to a byte per block
+class TemporalMaskUnpack : public Component {
+public:
+	TemporalMaskUnpack() : Component("TemporalMaskUnpack") {}
+	Surface process(const Surface &packed);
+};
+
 class TemporalExtractMask : public Component {
 public:
 	TemporalExtractMask() : Component("TemporalExtractMask") {}
@@ -91,6 +139,19 @@ public:
 	Surface process(const Surface &src_plane, Surface &map_plane, unsigned transform_block_size);
 };
 
+// As ApplyTemporalMap followed by adding residuals, but updating the temporal buffer in place, from a packed mask
+//
+// Blocks the mask marks as intra are cleared, then residuals (which may be empty) are accumulated. If the residuals' block
+// occupancy is known, predicted blocks with no residuals are not touched at all.
+//
+class ApplyTemporalMapInPlace : public Component {
+public:
+	ApplyTemporalMapInPlace() : Component("ApplyTemporalMapInPlace") {}
+
+	void process(Surface &temporal_plane, const Surface &map_plane, unsigned transform_block_size, const Surface &residuals,
+	             const Surface &occupancy = Surface());
+};
+
 class UserDataClear : public Component {
 public:
 	UserDataClear() : Component("UserDataClear") {}
@@ -56,6 +56,37 @@ public:
 	Surface process(const Surface &src_plane, Upsample upsample, const unsigned *coefficients /* = nullptr */);
 };
 
+// Upsample, apply predicted average, and add residuals in one pass over the output plane
+//
+// Bit-exact with Upsampling + PredictedResidualSum/PredictedResidualAdjust + Add. 'residuals' may be empty.
+//
+class UpsamplingReconstruct : public Component {
+public:
+	UpsamplingReconstruct() : Component("UpsamplingReconstruct") {}
+	Surface process(const Surface &src_plane, const Surface &residuals, Upsample upsample, const unsigned *coefficients,
+	                bool predicted_average);
+
+	// As process(), for source rows [y_begin, y_end) of a plane 'height' rows high, giving output rows [2*y_begin, 2*y_end)
+	//
+	// 'src' points at source row 'src_y', and must hold the rows within 2 of the range (clamped to the plane). 'dest' and
+	// 'residuals' (which may be null) point at the first output row.
+	void process_rows(int16_t *dest, unsigned dest_stride, const int16_t *src, unsigned src_stride, unsigned src_y,
+	                  unsigned width, unsigned height, unsigned y_begin, unsigned y_end, const int16_t *residuals,
+	                  unsigned residuals_stride, Upsample upsample, const unsigned *coefficients, bool predicted_average);
+};
+
+class UpsamplingReconstruct_1D : public Component {
+public:
+	UpsamplingReconstruct_1D() : Component("UpsamplingReconstruct_1D") {}
+	Surface process(const Surface &src_plane, const Surface &residuals, Upsample upsample, const unsigned *coefficients,
+	                bool predicted_average);
+
+	// As process(), for rows [y_begin, y_end) - 'src', 'dest' and 'residuals' (which may be null) point at row 'y_begin'
+	void process_rows(int16_t *dest, unsigned dest_stride, const int16_t *src, unsigned src_stride, unsigned width,
+	                  unsigned y_begin, unsigned y_end, const int16_t *residuals, unsigned residuals_stride, Upsample upsample,
+	                  const unsigned *coefficients, bool predicted_average);
+};
+
 Image UpsampleImage(const Image &src, Upsample upsample, const unsigned upsampling_coefficients[4], ScalingMode scaling_mode);
 
 } // namespace lctm
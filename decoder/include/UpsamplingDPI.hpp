@@ -43,18 +43,25 @@
 
 namespace lctm {
 
+// Upsample all planes of a picture in one call, with the predicted average and the addition of residuals folded into
+// the same pass
+//
+// The picture is reconstructed in bands of rows that cover all planes, so each band's luma and chroma are produced
+// together - bands are spread over up to 'num_threads' threads. Empty source planes (e.g. monochrome) are skipped, and any
+// of 'residuals' may be empty. Bit-exact with per plane Upsampling + PredictedResidualAdjust + Add.
+//
 class UpsamplingDPI : public Component {
 public:
 	UpsamplingDPI() : Component("Upsampling") {}
-	void process(Surface dst_planes[3], const Surface src_planes[3], Upsample upsample, bool apply_predicted_average,
-	             unsigned *coefficients /* = nullptr */);
+	void process(Surface dst_planes[3], const Surface src_planes[3], const Surface residuals[3], Upsample upsample,
+	             bool apply_predicted_average, const unsigned *coefficients /* = nullptr */, unsigned num_threads = 1);
 };
 
 class UpsamplingDPI_1D : public Component {
 public:
 	UpsamplingDPI_1D() : Component("Upsampling_1D") {}
-	void process(Surface dst_planes[3], const Surface src_planes[3], Upsample upsample, bool apply_predicted_average,
-	             unsigned *coefficients /* = nullptr */);
+	void process(Surface dst_planes[3], const Surface src_planes[3], const Surface residuals[3], Upsample upsample,
+	             bool apply_predicted_average, const unsigned *coefficients /* = nullptr */, unsigned num_threads = 1);
 };
 
 } // namespace lctm
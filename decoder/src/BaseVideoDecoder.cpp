@@ -73,13 +73,6 @@
 
 using namespace std;
 
-// bitstream statistics
-#include "BitstreamStatistic.hpp"
-extern PsnrStatistic goPsnr;
-extern uint8_t gaucMd5Digest[][16];
-extern ReportStructure goReportStructure;
-extern std::priority_queue<ReportStructure, std::vector<ReportStructure, std::allocator<ReportStructure>>, ReportStructureComp> goReportQueue;
-
 using namespace vnova::utility;
 
 namespace lctm {
@@ -114,7 +107,7 @@ struct BufferCompare {
 class BaseVideoDecoderExternal : public BaseVideoDecoder {
 public:
 	BaseVideoDecoderExternal(BaseVideoDecoder::Output &output, Encapsulation encapsulation,
-	                         const std::string &prepared_yuv_file_name, bool keep_base);
+	                         const std::string &prepared_yuv_file_name, bool keep_base, bool streaming);
 	~BaseVideoDecoderExternal() override;
 
 	void start() override;
@@ -150,6 +143,9 @@ protected:
 	// Keep base files
 	bool keep_base_;
 
+	// Run the decoder alongside enhancement, reading its pictures from a FIFO as they are decoded
+	bool streaming_;
+
 	// Priority queues of buffers for base & pss ordered by timestamp
 	priority_queue<PssPacket, vector<PssPacket>, BufferCompare> enhancement_queue_;
 	vector<PssPacket> enhancement_vector_;
@@ -164,8 +160,9 @@ protected:
 };
 
 BaseVideoDecoderExternal::BaseVideoDecoderExternal(Output &output, Encapsulation encapsulation,
-                                                   const std::string &prepared_yuv_file_name, bool keep_base)
-    : output_(output), encapsulation_(encapsulation), prepared_yuv_file_name_(prepared_yuv_file_name), keep_base_(keep_base) {}
+                                                   const std::string &prepared_yuv_file_name, bool keep_base, bool streaming)
+    : output_(output), encapsulation_(encapsulation), prepared_yuv_file_name_(prepared_yuv_file_name), keep_base_(keep_base),
+      streaming_(streaming && !keep_base && prepared_yuv_file_name.empty()) {}
 
 BaseVideoDecoderExternal::~BaseVideoDecoderExternal() { stop(); }
 
@@ -182,7 +179,13 @@ void BaseVideoDecoderExternal::start() {
 		// Create a temporary file for base YUV
 		yuv_file_name_ = make_temporary_filename("_base.yuv");
 
-		INFO("Using temporary file for YUV data: '%s'", yuv_file_name_.c_str());
+		if (streaming_) {
+			if (!make_fifo(yuv_file_name_))
+				ERR("Cannot create FIFO for base YUV data: '%s'", yuv_file_name_.c_str());
+			INFO("Using FIFO for YUV data: '%s'", yuv_file_name_.c_str());
+		} else {
+			INFO("Using temporary file for YUV data: '%s'", yuv_file_name_.c_str());
+		}
 	} else {
 		INFO("Using prepared file for YUV data: '%s'", prepared_yuv_file_name_.c_str());
 	}
@@ -204,11 +207,12 @@ void BaseVideoDecoderExternal::push_au(const uint8_t *data, size_t data_size, ui
 
 		b.resize(new_size);
 
-		goReportStructure.miTimeStamp = (int)(pts);
-		goReportStructure.miPictureType = iPictureType;
-		goReportStructure.miBaseSize = (int)(new_size);
-		goReportStructure.miEnhancementSize = (int)(data_size - new_size);
-		goReportQueue.push(goReportStructure);
+		ReportStructure report = {};
+		report.miTimeStamp = (int)(pts);
+		report.miPictureType = iPictureType;
+		report.miBaseSize = (int)(new_size);
+		report.miEnhancementSize = (int)(data_size - new_size);
+		output_.statistics().push_report(report);
 
 		// Flush any previous buffer
 		if (!buffer_.empty())
@@ -225,6 +229,10 @@ void BaseVideoDecoderExternal::push_au(const uint8_t *data, size_t data_size, ui
 }
 
 void BaseVideoDecoderExternal::push_es(const uint8_t *data, size_t data_size, uint64_t pts, bool is_base_idr) {
+	// With a prepared YUV base there is no ES file - base data in the stream is dropped
+	if (base_coding() == BaseCoding::BaseCoding_YUV)
+		return;
+
 	// Fixup NALU start code - if first is 3 bytes, make it 4
 	if (data[0] == '\0' && data[1] == '\0' && data[2] == '\1') {
 		char const zero = '\0';
@@ -348,10 +356,26 @@ void BaseVideoDecoderExternal::flush() {
 	base_bit_depth_ = bit_depth;
 
 	UniquePtrFile yuv_file;
+	std::thread decoder_thread;
+	bool decoder_ok = true;
 
 	if (!prepared_yuv_file_name_.empty()) {
 		// We have been given decoded YUV already
 		yuv_file.reset(CHECK(fopen(prepared_yuv_file_name_.c_str(), "rb")));
+	} else if (streaming_) {
+		// Run the decoder esfile->fifo on its own thread - pictures are enhanced as they come out of the FIFO
+		//
+		// The FIFO is opened before the decoder starts, so that a decoder that fails straight away cannot leave this
+		// waiting for a writer - once the decoder has gone, the held writing end is released and reads see end of file.
+		int fd = -1, hold_fd = -1;
+		if (!open_fifo_reader(yuv_file_name_, fd, hold_fd))
+			ERR("Cannot open FIFO for base YUV data: '%s'", yuv_file_name_.c_str());
+		yuv_file.reset(CHECK(fdopen(fd, "rb")));
+
+		decoder_thread = std::thread([this, &decoder_ok, hold_fd] {
+			decoder_ok = run_decoder(es_file_name_, yuv_file_name_);
+			release_fifo_reader(hold_fd);
+		});
 	} else {
 		// Run the decoder esfile->yuvfile
 		//
@@ -364,16 +388,27 @@ void BaseVideoDecoderExternal::flush() {
 	// Buffer for the YUV frames
 	vector<uint8_t> base(base_size);
 
+	// Read the next base frame - when streaming, this waits for the decoder to produce it
+	auto read_base = [&]() {
+		const bool got_frame = fread(base.data(), 1, base.size(), yuv_file.get()) == base.size();
+		if (!got_frame && decoder_thread.joinable()) {
+			decoder_thread.join();
+			if (!decoder_ok)
+				ERR("Base decoder failed");
+		}
+		CHECK(got_frame);
+	};
+
 	if (iPictureCount > 0) {
 		// First frame: Copy data through, already deserialized previously
-		CHECK(fread(base.data(), 1, base.size(), yuv_file.get()) == base.size());
+		read_base();
 		output_.push_base_enhancement(base.data(), base.size(), symbols_initial, pss_initial.packet.timestamp(),
 		                              pss_initial.is_lcevc_idr);
 
 		// Consume queue in PTS order
 		while (!enhancement_vector_.empty()) {
 			// Read base
-			CHECK(fread(base.data(), 1, base.size(), yuv_file.get()) == base.size());
+			read_base();
 
 			// Get PSS from queue
 			Surface symbols[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS];
@@ -385,12 +420,27 @@ void BaseVideoDecoderExternal::flush() {
 			iPictureCount++;
 		}
 
+		// Statistics below need every picture to have been reconstructed
+		output_.flush();
+	}
+
+	if (decoder_thread.joinable()) {
+		// Drain any frames without enhancement, so the decoder can finish
+		while (fread(base.data(), 1, base.size(), yuv_file.get()) == base.size())
+			;
+		decoder_thread.join();
+		if (!decoder_ok)
+			WARN("Base decoder failed");
+	}
+
+	if (iPictureCount > 0) {
 		int iFrames = iPictureCount;
+		const PsnrStatistic &psnr = output_.statistics().psnr();
 
 		float fAccMse[3];
 		float fPsnr[3];
 		for (unsigned plane = 0; plane < yuv_desc.GetPlaneCount(); plane++) {
-			fAccMse[plane] = goPsnr.mfAccMse[plane] / iFrames;
+			fAccMse[plane] = psnr.mfAccMse[plane] / iFrames;
 			fPsnr[plane] = (float)(10.0f * log10((32767.0f * 32767.0f) / fAccMse[plane]));
 		}
 		REPORT("========= ========= ========= ========= ========= ========= ========= ========= ");
@@ -400,8 +450,8 @@ void BaseVideoDecoderExternal::flush() {
 		else
 			REPORT("PSNR -- Y %8.4f", fPsnr[0]);
 		REPORT("========= ========= ========= ========= ========= ========= ========= ========= ");
-		REPORT("BITS -- base %8d bps -- enha %8d bps ", (goPsnr.miBaseBytes * 8 * /* this->fps_ */ 60) / iFrames,
-		       (goPsnr.miEnhancementBytes * 8 * /* this->fps_ */ 60) / iFrames);
+		REPORT("BITS -- base %8d bps -- enha %8d bps ", (psnr.miBaseBytes * 8 * /* this->fps_ */ 60) / iFrames,
+		       (psnr.miEnhancementBytes * 8 * /* this->fps_ */ 60) / iFrames);
 		REPORT("========= ========= ========= ========= ========= ========= ========= ========= ");
 	}
 }
@@ -453,8 +503,8 @@ Packet BaseVideoDecoder::rbsp_encapsulate(const Packet &src) const {
 class BaseVideoDecoderExternalAVC : public BaseVideoDecoderExternal {
 public:
 	BaseVideoDecoderExternalAVC(BaseVideoDecoder::Output &output, Encapsulation encapsulation, const std::string &yuv_file,
-	                            bool keep_base)
-	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base) {}
+	                            bool keep_base, bool streaming)
+	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base, streaming) {}
 
 	BaseCoding base_coding() const override { return BaseCoding_AVC; };
 
@@ -477,8 +527,8 @@ public:
 class BaseVideoDecoderExternalHEVC : public BaseVideoDecoderExternal {
 public:
 	BaseVideoDecoderExternalHEVC(BaseVideoDecoder::Output &output, Encapsulation encapsulation, const std::string &yuv_file,
-	                             bool keep_base)
-	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base) {}
+	                             bool keep_base, bool streaming)
+	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base, streaming) {}
 
 	BaseCoding base_coding() const override { return BaseCoding_HEVC; };
 
@@ -504,8 +554,8 @@ public:
 class BaseVideoDecoderExternalVVC : public BaseVideoDecoderExternal {
 public:
 	BaseVideoDecoderExternalVVC(BaseVideoDecoder::Output &output, Encapsulation encapsulation, const std::string &yuv_file,
-	                            bool keep_base)
-	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base) {}
+	                            bool keep_base, bool streaming)
+	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base, streaming) {}
 
 	BaseCoding base_coding() const override { return BaseCoding_VVC; };
 
@@ -527,8 +577,8 @@ public:
 class BaseVideoDecoderExternalEVC : public BaseVideoDecoderExternal {
 public:
 	BaseVideoDecoderExternalEVC(BaseVideoDecoder::Output &output, Encapsulation encapsulation, const std::string &yuv_file,
-	                            bool keep_base)
-	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base) {}
+	                            bool keep_base, bool streaming)
+	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base, streaming) {}
 
 	BaseCoding base_coding() const override { return BaseCoding_EVC; };
 
@@ -550,8 +600,8 @@ public:
 class BaseVideoDecoderExternalYUV : public BaseVideoDecoderExternal {
 public:
 	BaseVideoDecoderExternalYUV(BaseVideoDecoder::Output &output, Encapsulation encapsulation, const std::string &yuv_file,
-	                             bool keep_base)
-	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base) {}
+	                             bool keep_base, bool streaming)
+	    : BaseVideoDecoderExternal(output, encapsulation, yuv_file, keep_base, streaming) {}
 
 	BaseCoding base_coding() const override { return BaseCoding_YUV; };
 
@@ -563,20 +613,21 @@ public:
 // Factory function
 //
 unique_ptr<BaseVideoDecoder> CreateBaseVideoDecoder(BaseVideoDecoder::Output &output, BaseCoding base, Encapsulation encapsulation,
-                                                    bool external, const std::string &yuv_file, bool keep_base) {
+                                                    bool external, const std::string &yuv_file, bool keep_base,
+                                                    bool streaming) {
 
 	try {
-		if (external || keep_base || !yuv_file.empty()) {
+		if (external || streaming || keep_base || !yuv_file.empty()) {
 			if (base == BaseCoding_AVC)
-				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalAVC(output, encapsulation, yuv_file, keep_base));
+				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalAVC(output, encapsulation, yuv_file, keep_base, streaming));
 			else if (base == BaseCoding_HEVC)
-				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalHEVC(output, encapsulation, yuv_file, keep_base));
+				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalHEVC(output, encapsulation, yuv_file, keep_base, streaming));
 			else if (base == BaseCoding_VVC)
-				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalVVC(output, encapsulation, yuv_file, keep_base));
+				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalVVC(output, encapsulation, yuv_file, keep_base, streaming));
 			else if (base == BaseCoding_EVC)
-				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalEVC(output, encapsulation, yuv_file, keep_base));
+				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalEVC(output, encapsulation, yuv_file, keep_base, streaming));
 			else if (base == BaseCoding_YUV)
-				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalYUV(output, encapsulation, yuv_file, keep_base));
+				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalYUV(output, encapsulation, yuv_file, keep_base, streaming));
 			else
 				ERR("Unknown base");
 		} else {
@@ -584,25 +635,25 @@ unique_ptr<BaseVideoDecoder> CreateBaseVideoDecoder(BaseVideoDecoder::Output &ou
 #if defined(LTM_ENABLE_CODECAPI_AVC)
 				return CreateBaseVideoDecoderCodecApi(output, encapsulation, base, "avc","","");
 #else
-				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalAVC(output, encapsulation, yuv_file, keep_base));
+				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalAVC(output, encapsulation, yuv_file, keep_base, streaming));
 #endif
 			} else if (base == BaseCoding_HEVC) {
 #if defined(LTM_ENABLE_CODECAPI_HEVC)
 				return CreateBaseVideoDecoderCodecApi(output, encapsulation,base, "hevc","","");
 #else
-				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalHEVC(output, encapsulation, yuv_file, keep_base));
+				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalHEVC(output, encapsulation, yuv_file, keep_base, streaming));
 #endif
 			} else if (base == BaseCoding_VVC) {
 #if defined(LTM_ENABLE_CODECAPI_VVC)
 				return CreateBaseVideoDecoderCodecApi(output, encapsulation, base, "vvc","","");
 #else
-				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalVVC(output, encapsulation, yuv_file, keep_base));
+				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalVVC(output, encapsulation, yuv_file, keep_base, streaming));
 #endif
 			} else if (base == BaseCoding_EVC) {
 #if defined(LTM_ENABLE_CODECAPI_EVC)
 				return CreateBaseVideoDecoderCodecApi(output, encapsulation, base, "evc","","");
 #else
-				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalEVC(output, encapsulation, yuv_file, keep_base));
+				return unique_ptr<BaseVideoDecoder>(new BaseVideoDecoderExternalEVC(output, encapsulation, yuv_file, keep_base, streaming));
 #endif
 			} else {
 				ERR("Unknown base");
@@ -39,6 +39,7 @@
 //
 #include "BaseVideoDecoderCodecApi.hpp"
 
+#include <mutex>
 #include <queue>
 #include <vector>
 
@@ -51,14 +52,6 @@
 
 using namespace std;
 
-// bitstream statistics
-#include "BitstreamStatistic.hpp"
-extern PsnrStatistic goPsnr;
-extern uint8_t gaucMd5Digest[][16];
-extern ReportStructure goReportStructure;
-extern std::priority_queue<ReportStructure, std::vector<ReportStructure, std::allocator<ReportStructure>>, ReportStructureComp>
-    goReportQueue;
-
 namespace lctm {
 
 // PSS data that is queued whilst base frames are decoded
@@ -162,11 +155,12 @@ void BaseVideoDecoderCodecApi::push_au(const uint8_t *data, size_t data_size, ui
 
 		b.resize(new_size);
 
-		goReportStructure.miTimeStamp = (int)(pts);
-		goReportStructure.miPictureType = iPictureType;
-		goReportStructure.miBaseSize = (int)(new_size);
-		goReportStructure.miEnhancementSize = (int)(data_size - new_size);
-		goReportQueue.push(goReportStructure);
+		ReportStructure report = {};
+		report.miTimeStamp = (int)(pts);
+		report.miPictureType = iPictureType;
+		report.miBaseSize = (int)(new_size);
+		report.miEnhancementSize = (int)(data_size - new_size);
+		output_.statistics().push_report(report);
 
 		// Flush any previous buffer
 		if (!buffer_.empty()) {
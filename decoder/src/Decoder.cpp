@@ -54,24 +54,20 @@
 #include "InverseTransformDDS_1D.hpp"
 #include "InverseTransformDD_1D.hpp"
 #include "LcevcMd5.hpp"
+#include "Misc.hpp"
+#include "Parallel.hpp"
 #include "PredictedResidual.hpp"
 #include "TemporalDecode.hpp"
 #include "Upsampling.hpp"
+#include "UpsamplingDPI.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
-#include <queue>
 #include <vector>
 
 using namespace std;
 
-// bitstream statistics
-#include "BitstreamStatistic.hpp"
-extern PsnrStatistic goPsnr;
-extern uint8_t gaucMd5Digest[][16];
-extern ReportStructure goReportStructure;
-extern priority_queue<ReportStructure, vector<ReportStructure, allocator<ReportStructure>>, ReportStructureComp> goReportQueue;
-
 namespace lctm {
 
 Decoder::Decoder() {
@@ -87,6 +83,40 @@ unsigned Decoder::num_residual_layers() const { return configuration_.global_con
 
 bool Decoder::is_tiled() const { return configuration_.global_configuration.tile_dimensions_type != TileDimensions_None; }
 
+// Does a block occupancy map have any non-empty blocks?
+//
+static bool any_occupied(const Surface &occupancy) {
+	const auto view = occupancy.view_as<uint8_t>();
+	for (unsigned y = 0; y < view.height(); ++y) {
+		const uint8_t *po = view.data(0, y);
+		for (unsigned x = 0; x < view.width(); ++x)
+			if (po[x])
+				return true;
+	}
+	return false;
+}
+
+// Add residuals to a plane in place, skipping the transform blocks that a block occupancy map says are empty
+//
+static void add_occupied_blocks(Surface &dst, const Surface &residuals, const Surface &occupancy, unsigned block_size) {
+	auto viewa = dst.view_as<int16_t>();
+	const auto viewb = residuals.view_as<int16_t>();
+	const auto viewo = occupancy.view_as<uint8_t>();
+	const unsigned width = dst.width();
+	for (unsigned y = 0; y < dst.height(); ++y) {
+		int16_t *__restrict pdst = (int16_t *)viewa.data(0, y);
+		const int16_t *__restrict psrcb = viewb.data(0, y);
+		const uint8_t *po = viewo.data(0, y / block_size);
+		for (unsigned x = 0; x < width; x += block_size) {
+			if (!po[x / block_size])
+				continue;
+			const unsigned n = LCEVC_MIN(block_size, width - x);
+			for (unsigned i = 0; i < n; ++i)
+				pdst[x + i] += psrcb[x + i];
+		}
+	}
+}
+
 // Does this layer has user_data embedded?
 //
 bool Decoder::is_user_data_layer(unsigned loq, unsigned layer) const {
@@ -99,28 +129,30 @@ bool Decoder::is_user_data_layer(unsigned loq, unsigned layer) const {
 	return false;
 }
 
-// Derive and return temporal mask
+// Derive and return packed temporal mask
 //
 Surface Decoder::get_temporal_mask(Surface temporal_symbols) {
 	if (!configuration_.global_configuration.temporal_enabled)
 		return Surface();
 	else if (configuration_.picture_configuration.temporal_signalling_present)
 		return temporal_symbols;
-	else if (configuration_.picture_configuration.temporal_refresh)
-		return Surface::build_from<uint8_t>()
-		    .fill(TEMPORAL_INTR, configuration_.global_configuration.resolution_width / transform_block_size(),
-		          configuration_.global_configuration.resolution_height / transform_block_size())
-		    .finish();
 	else
-		return Surface::build_from<uint8_t>()
-		    .fill(TEMPORAL_PRED, configuration_.global_configuration.resolution_width / transform_block_size(),
-		          configuration_.global_configuration.resolution_height / transform_block_size())
-		    .finish();
+		return TemporalMaskFill().process(configuration_.global_configuration.resolution_width / transform_block_size(),
+		                                  configuration_.global_configuration.resolution_height / transform_block_size(),
+		                                  configuration_.picture_configuration.temporal_refresh ? TEMPORAL_INTR : TEMPORAL_PRED);
+}
+
+// Dump a packed temporal mask as a byte per block
+//
+static void dump_temporal_mask(const Surface &temporal_mask, const std::string &name) {
+	if (Surface::get_dump_surfaces())
+		TemporalMaskUnpack().process(temporal_mask).dump(name);
 }
 
 // Decode residuals of an enhancement sub-layer
 //
-Surface Decoder::decode_residuals(unsigned plane, unsigned loq, Surface &temporal_mask, Surface symbols[MAX_NUM_LAYERS]) {
+Surface Decoder::decode_residuals(unsigned plane, unsigned loq, Surface &temporal_mask, Surface symbols[MAX_NUM_LAYERS],
+                                  Surface &occupancy) {
 #if defined __OPT_INPLACE__
 #else
 	Surface coefficients[MAX_NUM_LAYERS];
@@ -176,6 +208,13 @@ Surface Decoder::decode_residuals(unsigned plane, unsigned loq, Surface &tempora
 		}
 	}
 
+	if (interleaved_coefficients_) {
+		occupancy = symbols[Deserializer::INTERLEAVED_OCCUPANCY];
+		return decode_residuals_interleaved(plane, loq, temporal_mask, symbols[Deserializer::INTERLEAVED_COEFFICIENTS],
+		                                    symbols[Deserializer::INTERLEAVED_OCCUPANCY], passes, invq_step_width,
+		                                    invq_applied_offset);
+	}
+
 	for (unsigned layer = 0; layer < num_residual_layers(); ++layer) {
 #if defined __OPT_INPLACE__
 		auto view = symbols[layer].view_as<int16_t>();
@@ -246,8 +285,9 @@ Surface Decoder::decode_residuals(unsigned plane, unsigned loq, Surface &tempora
 				auto mask = temporal_mask.view_as<uint8_t>();
 				int16_t *__restrict pview = (int16_t *)view.data(0, 0);
 				for (unsigned y = 0; y < view.height(); ++y) {
+					const uint64_t *pmask = temporal_mask_row(mask, y);
 					for (unsigned x = 0; x < view.width(); ++x) {
-						unsigned sw_index = (mask.read(x, y) == TEMPORAL_PRED) ? 0 : 1;
+						unsigned sw_index = temporal_mask_intra(pmask, x) ? 1 : 0;
 						int16_t coef = *pview;
 
 						*pview++ = clamp_int16(coef * invq_step_width[layer][sw_index] +
@@ -257,12 +297,15 @@ Surface Decoder::decode_residuals(unsigned plane, unsigned loq, Surface &tempora
 				}
 			}
 #else
-			coefficients[layer] = InverseQuantize_SWM().process(syms, transform_block_size(), invq_step_width[layer],
-			                                                    invq_applied_offset[layer], temporal_mask);
+			coefficients[layer] =
+			    InverseQuantize_SWM().process_packed(syms, invq_step_width[layer], invq_applied_offset[layer], temporal_mask);
 #endif
 		}
 	}
 
+	// Planar layers carry no occupancy - every block is added
+	occupancy = Surface();
+
 	Surface residuals;
 
 #if defined __OPT_INPLACE__
@@ -310,14 +353,79 @@ Surface Decoder::decode_residuals(unsigned plane, unsigned loq, Surface &tempora
 	return residuals;
 }
 
+Surface Decoder::decode_residuals_interleaved(unsigned plane, unsigned loq, const Surface &temporal_mask, const Surface &coefficients,
+                                              const Surface &occupancy, unsigned passes, const int32_t invq_step_width[MAX_NUM_LAYERS][2],
+                                              const int32_t invq_applied_offset[MAX_NUM_LAYERS][2]) {
+	const unsigned num_layers = num_residual_layers();
+	const bool horizontal_only = (configuration_.global_configuration.scaling_mode[loq] == ScalingMode_1D);
+	const unsigned width = dimensions_.plane_width(plane, loq);
+	const unsigned height = dimensions_.plane_height(plane, loq);
+
+	// Embedded user data is in one layer of each block
+	unsigned user_data_layer = num_layers;
+	unsigned user_data_size = 0;
+	for (unsigned layer = 0; layer < num_layers; ++layer) {
+		if (is_user_data_layer(loq, layer)) {
+			user_data_layer = layer;
+			user_data_size = (configuration_.global_configuration.user_data_enabled == UserData_6bits) ? 6 : 2;
+		}
+	}
+
+	// Temporal mask is only needed to pick step widths when there are two passes
+	std::unique_ptr<SurfaceView<uint8_t>> mask;
+	if (passes > 1)
+		mask.reset(new SurfaceView<uint8_t>(temporal_mask));
+
+	// Dequantize in place - blocks are contiguous, so each block steps through the per layer parameters in order. Empty blocks
+	// are left as they are.
+	const auto view = coefficients.view_as<int16_t>();
+	const auto occupied = occupancy.view_as<uint8_t>();
+	const unsigned blocks = view.width() / num_layers;
+	for (unsigned y = 0; y < view.height(); ++y) {
+		int16_t *__restrict pview = (int16_t *)view.data(0, y);
+		const uint8_t *po = occupied.data(0, y);
+		for (unsigned x = 0; x < blocks; ++x) {
+			if (!po[x]) {
+				pview += num_layers;
+				continue;
+			}
+			const unsigned sw_index = (mask && temporal_mask_intra(temporal_mask_row(*mask, y), x)) ? 1 : 0;
+			for (unsigned layer = 0; layer < num_layers; ++layer) {
+				int16_t coef = *pview;
+				if (layer == user_data_layer) {
+					uint16_t value = coef;
+					value >>= user_data_size;
+					const bool sign = (value & 0x01) != 0;
+					value >>= 1;
+					coef = (int16_t)(sign ? (-value) : (value));
+				}
+				*pview++ = clamp_int16(coef * invq_step_width[layer][sw_index] +
+				                       (coef > 0 ? invq_applied_offset[layer][sw_index]
+				                                 : (coef < 0 ? -invq_applied_offset[layer][sw_index] : 0)));
+			}
+		}
+	}
+
+	// Inverse transform
+	if (!horizontal_only) {
+		if (configuration_.global_configuration.transform_block_size == 4)
+			return InverseTransformDDS().process_interleaved(width, height, coefficients, occupancy);
+		else
+			return InverseTransformDD().process_interleaved(width, height, coefficients, occupancy);
+	} else {
+		if (configuration_.global_configuration.transform_block_size == 4)
+			return InverseTransformDDS_1D().process_interleaved(width, height, coefficients, occupancy);
+		else
+			return InverseTransformDD_1D().process_interleaved(width, height, coefficients, occupancy);
+	}
+}
+
 void Decoder::initialize_decode(const Packet &enhancement_data, Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS]) {
+	SurfaceDumps::Scope dumps_scope(surface_dumps_);
+
 	// Parse the bitstream -- XXX check for seeing blocks in correct order
 	// Deserializer will popluate configuration_ and symbols during parsing
-
-	// Initialize quantization matrix
-	std::fill_n(&quant_matrix_coeffs_[0][0][0], MAX_NUM_PLANES * MAX_NUM_LOQS * MAX_NUM_LAYERS, -1);
-
-	Deserializer deserializer(enhancement_data, configuration_, symbols);
+	Deserializer deserializer(enhancement_data, configuration_, symbols, num_threads_, interleaved_coefficients_);
 
 	while (deserializer.has_more()) {
 		const unsigned block = deserializer.parse_block();
@@ -344,22 +452,374 @@ void Decoder::initialize_decode(const Packet &enhancement_data, Surface (&symbol
 					    dimensions_.layer_width(plane, LOQ_LEVEL_2);
 					configuration_.surface_configuration[plane][LOQ_LEVEL_2][num_residual_layers()].height =
 					    dimensions_.layer_height(plane, LOQ_LEVEL_2);
-
-					if (temporal_buffer_[plane].empty() ||
-					    dimensions_.plane_width(plane, LOQ_LEVEL_2) != temporal_buffer_[plane].width() ||
-					    dimensions_.plane_height(plane, LOQ_LEVEL_2) != temporal_buffer_[plane].height())
-						temporal_buffer_[plane] =
-						    Surface::build_from<int16_t>()
-						        .reserve(dimensions_.plane_width(plane, LOQ_LEVEL_2), dimensions_.plane_height(plane, LOQ_LEVEL_2))
-						        .finish();
 				}
 			}
 		}
 	}
 }
 
+Surface Decoder::upsample_and_add(unsigned plane, unsigned loq, const Surface &src, const Surface &residuals,
+                                  const Surface &occupancy) {
+	const GlobalConfiguration &gc = configuration_.global_configuration;
+
+	// Single pass when no intermediate surfaces are wanted - the residual add is skipped altogether if no block is occupied
+	if (!Surface::get_dump_surfaces()) {
+		const Surface &add = (!occupancy.empty() && !any_occupied(occupancy)) ? Surface() : residuals;
+		switch (gc.scaling_mode[loq]) {
+		case ScalingMode_1D:
+			return UpsamplingReconstruct_1D().process(src, add, gc.upsample, gc.upsampling_coefficients,
+			                                          gc.predicted_residual_enabled);
+		case ScalingMode_2D:
+			return UpsamplingReconstruct().process(src, add, gc.upsample, gc.upsampling_coefficients,
+			                                       gc.predicted_residual_enabled);
+		default:
+			break;
+		}
+	}
+
+	Surface upsampled;
+	switch (gc.scaling_mode[loq]) {
+	case ScalingMode_1D:
+		upsampled = Upsampling_1D().process(src, gc.upsample, gc.upsampling_coefficients);
+		if (gc.predicted_residual_enabled)
+			upsampled = PredictedResidualAdjust_1D().process(src, upsampled, PredictedResidualSum_1D().process(upsampled));
+		break;
+	case ScalingMode_2D:
+		upsampled = Upsampling().process(src, gc.upsample, gc.upsampling_coefficients);
+		if (gc.predicted_residual_enabled)
+			upsampled = PredictedResidualAdjust().process(src, upsampled, PredictedResidualSum().process(upsampled));
+		break;
+	case ScalingMode_None:
+		upsampled = src;
+		break;
+	default:
+		CHECK(0);
+	}
+
+	return add_residuals(plane, loq, upsampled, residuals, occupancy);
+}
+
+void Decoder::upsample_and_add_planes(unsigned loq, unsigned num_planes, const Surface src[MAX_NUM_PLANES],
+                                      const Surface residuals[MAX_NUM_PLANES], const Surface occupancy[MAX_NUM_PLANES],
+                                      Surface dst[MAX_NUM_PLANES]) {
+	const GlobalConfiguration &gc = configuration_.global_configuration;
+
+	if (!upsample_planes_jointly(loq)) {
+		for (unsigned plane = 0; plane < num_planes; ++plane)
+			dst[plane] = upsample_and_add(plane, loq, src[plane], residuals[plane], occupancy[plane]);
+		return;
+	}
+
+	// All planes at once, adding residuals in the same pass - skipped altogether if no block is occupied
+	Surface src_planes[3], add[3], upsampled[3];
+	for (unsigned plane = 0; plane < num_planes; ++plane) {
+		src_planes[plane] = src[plane];
+		if (occupancy[plane].empty() || any_occupied(occupancy[plane]))
+			add[plane] = residuals[plane];
+	}
+
+	if (gc.scaling_mode[loq] == ScalingMode_1D)
+		UpsamplingDPI_1D().process(upsampled, src_planes, add, gc.upsample, gc.predicted_residual_enabled,
+		                           gc.upsampling_coefficients, num_threads_);
+	else
+		UpsamplingDPI().process(upsampled, src_planes, add, gc.upsample, gc.predicted_residual_enabled,
+		                        gc.upsampling_coefficients, num_threads_);
+
+	for (unsigned plane = 0; plane < num_planes; ++plane)
+		dst[plane] = upsampled[plane];
+}
+
+Surface Decoder::add_residuals(unsigned plane, unsigned loq, Surface &upsampled, const Surface &residuals,
+                               const Surface &occupancy) {
+	upsampled.dump(format((loq == LOQ_LEVEL_1) ? "dec_base_pred_P%1d" : "dec_full_pred_P%1d", plane));
+
+	if (residuals.empty())
+		return upsampled;
+
+#if defined __OPT_INPLACE__
+	if (!occupancy.empty()) {
+		add_occupied_blocks(upsampled, residuals, occupancy, transform_block_size());
+		return upsampled;
+	}
+
+	{
+		auto viewa = upsampled.view_as<int16_t>();
+		auto viewb = residuals.view_as<int16_t>();
+		const int16_t *__restrict psrcb = viewb.data(0, 0);
+		int16_t *__restrict pdst = (int16_t *)viewa.data(0, 0);
+		for (unsigned y = 0; y < upsampled.height() * upsampled.width(); ++y) {
+			*pdst++ += (*psrcb++);
+		}
+	}
+	return upsampled;
+#else
+	return Add().process(upsampled, residuals);
+#endif
+}
+
+bool Decoder::upsample_planes_jointly(unsigned loq) const {
+	// Intermediate surfaces are only dumped by the per plane path
+	return upsampling_dpi_ && !Surface::get_dump_surfaces() &&
+	       configuration_.global_configuration.scaling_mode[loq] != ScalingMode_None;
+}
+
+Surface Decoder::convert_base_plane(const Image &ext_base, unsigned plane) {
+	const Surface base_plane = convert_base(ext_base.plane(plane));
+
+	if (configuration_.global_configuration.scaling_mode[LOQ_LEVEL_1] != ScalingMode_None)
+		base_plane.dump(format("dec_base_deco_P%1d", plane));
+
+	return base_plane;
+}
+
+Surface Decoder::convert_base(const Surface &base) const {
+	// Convert between base and enhancement bit depth
+	Surface base_plane;
+	unsigned base_bit_depth = configuration_.global_configuration.base_depth;
+	if (configuration_.global_configuration.enhancement_depth > configuration_.global_configuration.base_depth &&
+	    configuration_.global_configuration.level1_depth_flag) {
+		base_plane = ConvertBitShift().process(base, configuration_.global_configuration.base_depth,
+		                                       configuration_.global_configuration.enhancement_depth);
+		base_bit_depth = configuration_.global_configuration.enhancement_depth;
+	}
+
+	// Base + Correction
+	return ConvertToInternal().process(base_bit_depth == configuration_.global_configuration.base_depth ? base : base_plane,
+	                                   base_bit_depth);
+}
+
+void Decoder::decode_base_residuals(unsigned plane, Surface symbols[MAX_NUM_LAYERS], Surface &residuals, Surface &occupancy) {
+	// Base residuals
+	Surface unused_mask;
+	residuals = decode_residuals(plane, LOQ_LEVEL_1, unused_mask, symbols, occupancy);
+
+	// Deblocking
+	if (configuration_.picture_configuration.level_1_filtering_enabled &&
+	    configuration_.global_configuration.transform_block_size == 4) {
+		residuals = Deblocking().process(residuals, configuration_.global_configuration.level_1_filtering_first_coefficient,
+		                                 configuration_.global_configuration.level_1_filtering_second_coefficient);
+	}
+	residuals.dump(format("dec_base_resi_reco_P%1d", plane));
+}
+
+void Decoder::decode_full_residuals(unsigned plane, Surface symbols[MAX_NUM_LAYERS], bool enhancement_enabled, Surface &residuals,
+                                    Surface &occupancy) {
+	if (enhancement_enabled) {
+		// Enhacement residuals
+		Surface temporal_mask;
+		residuals = decode_residuals(plane, LOQ_LEVEL_2, temporal_mask, symbols, occupancy);
+		residuals.dump(format("dec_full_resi_reco_P%1d", plane));
+
+		if (configuration_.global_configuration.temporal_enabled) {
+			// Apply temporal map (intra / pred)
+			CHECK(!temporal_mask.empty());
+#if defined __OPT_INPLACE__
+			ApplyTemporalMapInPlace().process(temporal_buffer_[plane], temporal_mask, transform_block_size(), residuals, occupancy);
+#else
+			Surface mask = TemporalMaskUnpack().process(temporal_mask);
+			temporal_buffer_[plane] = ApplyTemporalMap().process(temporal_buffer_[plane], mask, transform_block_size());
+			temporal_buffer_[plane] = Add().process(temporal_buffer_[plane], residuals);
+#endif
+			temporal_buffer_[plane].dump(format("dec_full_temp_buff_P%1d", plane));
+			dump_temporal_mask(temporal_mask, format("dec_full_temp_mask_P%1d", plane));
+
+			// Temporal buffer carries residuals from earlier pictures, so occupancy no longer applies
+			residuals = temporal_buffer_[plane];
+			occupancy = Surface();
+		}
+
+	} else {
+		// No enhancement - but temporal layer can still be added
+		if (configuration_.global_configuration.temporal_enabled) {
+			Surface temporal_mask = get_temporal_mask(symbols[num_residual_layers()]);
+			CHECK(!temporal_mask.empty());
+
+			// Apply temporal map (intra / pred)
+#if defined __OPT_INPLACE__
+			ApplyTemporalMapInPlace().process(temporal_buffer_[plane], temporal_mask, transform_block_size(), Surface());
+#else
+			Surface mask = TemporalMaskUnpack().process(temporal_mask);
+			temporal_buffer_[plane] = ApplyTemporalMap().process(temporal_buffer_[plane], mask, transform_block_size());
+#endif
+			temporal_buffer_[plane].dump(format("dec_full_temp_buff_P%1d", plane));
+			dump_temporal_mask(temporal_mask, format("dec_full_temp_mask_P%1d", plane));
+
+			residuals = temporal_buffer_[plane];
+		}
+	}
+}
+
+//// Stripe reconstruction
+//
+// Each band of output rows is reconstructed from just the intermediate rows it is upsampled from, plus those within
+// reach of the kernel, and they in turn from the matching base rows - the rows at band edges are generated by both bands.
+// Residuals are decoded (and deblocked) as whole planes beforehand.
+//
+static unsigned vertical_scale(ScalingMode mode) { return (mode == ScalingMode_2D) ? 2 : 1; }
+static unsigned horizontal_scale(ScalingMode mode) { return (mode == ScalingMode_None) ? 1 : 2; }
+static unsigned vertical_reach(ScalingMode mode) { return (mode == ScalingMode_2D) ? 2 : 0; }
+
+// Copy rows [begin, end) of a surface
+static Surface copy_rows(const Surface &src, unsigned begin, unsigned end) {
+	const auto view = src.view_as<uint8_t>();
+	auto dest = Surface::build_from<uint8_t>();
+	dest.reserve_bpp(src.width(), end - begin, src.bpp());
+	for (unsigned y = begin; y < end; ++y)
+		memcpy(dest.data(0, y - begin), view.data(0, y), src.width() * src.bpp());
+	return dest.finish();
+}
+
+bool Decoder::use_stripes() const {
+	return stripe_rows_ && !Surface::get_dump_surfaces() && !upsample_planes_jointly(LOQ_LEVEL_1) &&
+	       !upsample_planes_jointly(LOQ_LEVEL_2);
+}
+
+void Decoder::reconstruct_rows(unsigned loq, int16_t *dest, const int16_t *src, unsigned src_y, unsigned src_width,
+                               unsigned src_height, unsigned y_begin, unsigned y_end, const int16_t *residuals) const {
+	const GlobalConfiguration &gc = configuration_.global_configuration;
+	const unsigned dest_width = src_width * horizontal_scale(gc.scaling_mode[loq]);
+
+	switch (gc.scaling_mode[loq]) {
+	case ScalingMode_1D:
+		UpsamplingReconstruct_1D().process_rows(dest, dest_width, src + src_width * (y_begin - src_y), src_width, src_width, y_begin,
+		                                        y_end, residuals, dest_width, gc.upsample, gc.upsampling_coefficients,
+		                                        gc.predicted_residual_enabled);
+		break;
+	case ScalingMode_2D:
+		UpsamplingReconstruct().process_rows(dest, dest_width, src, src_width, src_y, src_width, src_height, y_begin, y_end,
+		                                     residuals, dest_width, gc.upsample, gc.upsampling_coefficients,
+		                                     gc.predicted_residual_enabled);
+		break;
+	case ScalingMode_None:
+		for (unsigned y = 0; y < y_end - y_begin; ++y) {
+			const int16_t *__restrict psrc = src + src_width * (y_begin - src_y + y);
+			int16_t *__restrict pdst = dest + dest_width * y;
+			if (residuals) {
+				const int16_t *__restrict pres = residuals + dest_width * y;
+				for (unsigned x = 0; x < dest_width; ++x)
+					pdst[x] = psrc[x] + pres[x];
+			} else {
+				memcpy(pdst, psrc, dest_width * sizeof(int16_t));
+			}
+		}
+		break;
+	default:
+		CHECK(0);
+	}
+}
+
+Surface Decoder::reconstruct_band(unsigned plane, const Image &ext_base, const Surface &base_residuals,
+                                  const Surface &full_residuals, unsigned begin, unsigned end) const {
+	const GlobalConfiguration &gc = configuration_.global_configuration;
+	const ScalingMode mode1 = gc.scaling_mode[LOQ_LEVEL_1], mode2 = gc.scaling_mode[LOQ_LEVEL_2];
+
+	const Surface &base = ext_base.plane(plane);
+	const unsigned inter_width = base.width() * horizontal_scale(mode1);
+	const unsigned inter_height = base.height() * vertical_scale(mode1);
+	const unsigned full_width = inter_width * horizontal_scale(mode2);
+
+	// Intermediate rows generating the band, and those within reach of the kernel
+	const unsigned inter_begin = begin / vertical_scale(mode2);
+	const unsigned inter_end = (end + vertical_scale(mode2) - 1) / vertical_scale(mode2);
+	const unsigned inter_lo = inter_begin - std::min(inter_begin, vertical_reach(mode2));
+	const unsigned inter_hi = std::min(inter_height, inter_end + vertical_reach(mode2));
+	CHECK(inter_end * vertical_scale(mode2) == end);
+
+	// Base rows generating those intermediate rows, and those within reach of the kernel
+	const unsigned base_begin = inter_lo / vertical_scale(mode1);
+	const unsigned base_end = (inter_hi + vertical_scale(mode1) - 1) / vertical_scale(mode1);
+	const unsigned base_lo = base_begin - std::min(base_begin, vertical_reach(mode1));
+	const unsigned base_hi = std::min(base.height(), base_end + vertical_reach(mode1));
+
+	const Surface base_band = convert_base(copy_rows(base, base_lo, base_hi));
+	const auto base_view = base_band.view_as<int16_t>();
+
+	//// Upsample base rows to intermediate rows, and add sub-layer 1 residuals
+	//
+	const unsigned inter_y = base_begin * vertical_scale(mode1);
+	auto inter = Surface::build_from<int16_t>();
+	inter.reserve(inter_width, (base_end - base_begin) * vertical_scale(mode1));
+	{
+		const auto residuals = (base_residuals.empty() ? base_band : base_residuals).view_as<int16_t>();
+		reconstruct_rows(LOQ_LEVEL_1, inter.data(0, 0), base_view.data(0, 0), base_lo, base.width(), base.height(), base_begin,
+		                 base_end, base_residuals.empty() ? nullptr : residuals.data(0, inter_y));
+	}
+
+	//// Upsample intermediate rows to output rows, and add sub-layer 2 residuals
+	//
+	auto full = Surface::build_from<int16_t>();
+	full.reserve(full_width, end - begin);
+	{
+		const auto residuals = (full_residuals.empty() ? base_band : full_residuals).view_as<int16_t>();
+		reconstruct_rows(LOQ_LEVEL_2, full.data(0, 0), inter.data(0, 0), inter_y, inter_width, inter_height, inter_begin, inter_end,
+		                 full_residuals.empty() ? nullptr : residuals.data(0, begin));
+	}
+
+	return full.finish();
+}
+
+void Decoder::output_band(unsigned plane, const Surface &band, unsigned begin, unsigned height,
+                          SurfaceBuilder<uint8_t> &output) const {
+	const SequenceConfiguration &sc = configuration_.sequence_configuration;
+
+	unsigned left = 0, top = 0, right = 0, bottom = 0;
+	if (sc.conformance_window) {
+		const unsigned cw = dimensions_.crop_unit_width(plane), ch = dimensions_.crop_unit_height(plane);
+		left = sc.conf_win_left_offset * cw;
+		top = sc.conf_win_top_offset * ch;
+		right = sc.conf_win_right_offset * cw;
+		bottom = sc.conf_win_bottom_offset * ch;
+	}
+
+	// Rows of the band within the conformance window
+	const unsigned end = begin + band.height();
+	const unsigned crop_begin = std::max(begin, top), crop_end = std::min(end, height - bottom);
+	if (crop_begin >= crop_end)
+		return;
+
+	Surface o = band;
+	if (left || right || crop_begin != begin || crop_end != end)
+		o = Conform().process(band, left, crop_begin - begin, right, end - crop_end);
+
+	const Surface converted = ConvertFromInternal().process(o, configuration_.global_configuration.enhancement_depth);
+	const auto view = converted.view_as<uint8_t>();
+	for (unsigned y = 0; y < converted.height(); ++y)
+		memcpy(output.data(0, crop_begin - top + y), view.data(0, y), converted.width() * converted.bpp());
+}
+
+Surface Decoder::output_plane(unsigned plane, Surface &full_reco, bool dithering_switch, bool dithering_fixed) {
+	Surface outp_reco;
+
+	// INFO("dither flag %4d type %4d stre %4d", configuration_.picture_configuration.dithering_control,
+	// configuration_.picture_configuration.dithering_type, configuration_.picture_configuration.dithering_strength);
+	if (dithering_switch && configuration_.picture_configuration.dithering_control && (plane == 0)) {
+		outp_reco = dithering_.process(full_reco, transform_block_size());
+		if (dithering_fixed) {
+			// PSNR calculation after dithering if using fixed seed
+			full_reco = outp_reco;
+		}
+	} else
+		outp_reco = full_reco;
+
+	Surface o;
+	if (configuration_.sequence_configuration.conformance_window) {
+		// Apply conformance windowing
+		const unsigned cw = dimensions_.crop_unit_width(plane), ch = dimensions_.crop_unit_height(plane);
+		o = Conform().process(outp_reco, configuration_.sequence_configuration.conf_win_left_offset * cw,
+		                      configuration_.sequence_configuration.conf_win_top_offset * ch,
+		                      configuration_.sequence_configuration.conf_win_right_offset * cw,
+		                      configuration_.sequence_configuration.conf_win_bottom_offset * ch);
+	} else {
+		o = outp_reco;
+	}
+	return ConvertFromInternal().process(o, configuration_.global_configuration.enhancement_depth);
+}
+
 Image Decoder::decode(const Image &ext_base, Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS],
-                      const Image &src_image, bool report, bool dithering_switch, bool dithering_fixed, bool apply_enhancement) {
+                      const Image &src_image, bool report, bool dithering_switch, bool dithering_fixed, bool apply_enhancement,
+                      const ReportStructure *picture_report) {
+
+	SurfaceDumps::Scope dumps_scope(surface_dumps_);
 
 	CHECK(configuration_.global_configuration.transform_block_size == 4 ||
 	      configuration_.global_configuration.transform_block_size == 2);
@@ -374,66 +834,46 @@ Image Decoder::decode(const Image &ext_base, Surface (&symbols)[MAX_NUM_PLANES][
 
 	const bool is_idr = configuration_.picture_configuration.coding_type == CodingType::CodingType_IDR;
 
+	// Initialize quantization matrix
+	std::fill_n(&quant_matrix_coeffs_[0][0][0], MAX_NUM_PLANES * MAX_NUM_LOQS * MAX_NUM_LAYERS, -1);
+
+	// Temporal buffers follow the signalled picture size - otherwise they persist, and are updated in place
+	for (unsigned plane = 0; plane < configuration_.global_configuration.num_image_planes; ++plane) {
+		if (configuration_.global_configuration.temporal_enabled &&
+		    plane < configuration_.global_configuration.num_processed_planes) {
+			if (temporal_buffer_[plane].empty() || dimensions_.plane_width(plane, LOQ_LEVEL_2) != temporal_buffer_[plane].width() ||
+			    dimensions_.plane_height(plane, LOQ_LEVEL_2) != temporal_buffer_[plane].height())
+				temporal_buffer_[plane] =
+				    Surface::build_from<int16_t>()
+				        .fill(0, dimensions_.plane_width(plane, LOQ_LEVEL_2), dimensions_.plane_height(plane, LOQ_LEVEL_2))
+				        .finish();
+		}
+	}
+
 	// Verify dimensions of base image
 	CHECK(ext_base.description().width() == dimensions_.base_width());
 	CHECK(ext_base.description().height() == dimensions_.base_height());
 
 	// Process each plane...
 	//
+	const unsigned num_planes = ext_base.description().num_planes();
+
 	Surface base_reco[MAX_NUM_PLANES];
 	Surface full_reco[MAX_NUM_PLANES];
-	Surface outp_reco[MAX_NUM_PLANES];
 
-	for (unsigned plane = 0; plane < ext_base.description().num_planes(); ++plane) {
-		const bool enhancement_enabled = configuration_.picture_configuration.enhancement_enabled &&
-		                                 plane < configuration_.global_configuration.num_processed_planes;
+	// Decoded base and residuals to be added to preliminary intermediate picture
+	Surface base_planes[MAX_NUM_PLANES];
+	Surface base_residuals[MAX_NUM_PLANES];
 
-		// Convert between base and enhancement bit depth
-		Surface base_plane;
-		unsigned base_bit_depth = configuration_.global_configuration.base_depth;
-		if (configuration_.global_configuration.enhancement_depth > configuration_.global_configuration.base_depth &&
-		    configuration_.global_configuration.level1_depth_flag) {
-			base_plane = ConvertBitShift().process(ext_base.plane(plane), configuration_.global_configuration.base_depth,
-			                                       configuration_.global_configuration.enhancement_depth);
-			base_bit_depth = configuration_.global_configuration.enhancement_depth;
-		}
+	// Residuals to be added to preliminary output picture - either directly decoded, or via temporal buffer
+	Surface full_residuals[MAX_NUM_PLANES];
 
-		// Base + Correction
-		base_plane = ConvertToInternal().process(
-		    base_bit_depth == configuration_.global_configuration.base_depth ? ext_base.plane(plane) : base_plane, base_bit_depth);
+	// Block occupancy of residuals, if known - lets the adds skip empty transform blocks
+	Surface base_occupancy[MAX_NUM_PLANES];
+	Surface full_occupancy[MAX_NUM_PLANES];
 
-		//// Upsample from decoded base picture to preliminary intermediate picture
-		//
-		Surface base_upsampled;
-		switch (configuration_.global_configuration.scaling_mode[LOQ_LEVEL_1]) {
-		case ScalingMode_1D:
-			base_upsampled = Upsampling_1D().process(base_plane, configuration_.global_configuration.upsample,
-			                                         configuration_.global_configuration.upsampling_coefficients);
-			if (configuration_.global_configuration.predicted_residual_enabled) {
-				base_upsampled = PredictedResidualAdjust_1D().process(base_plane, base_upsampled,
-				                                                      PredictedResidualSum_1D().process(base_upsampled));
-			}
-			base_plane.dump(format("dec_base_deco_P%1d", plane));
-			break;
-		case ScalingMode_2D:
-			base_upsampled = Upsampling().process(base_plane, configuration_.global_configuration.upsample,
-			                                      configuration_.global_configuration.upsampling_coefficients);
-			if (configuration_.global_configuration.predicted_residual_enabled) {
-				base_upsampled =
-				    PredictedResidualAdjust().process(base_plane, base_upsampled, PredictedResidualSum().process(base_upsampled));
-			}
-			base_plane.dump(format("dec_base_deco_P%1d", plane));
-			break;
-		case ScalingMode_None:
-			base_upsampled = base_plane;
-			break;
-		default:
-			CHECK(0);
-		}
-
-		base_upsampled.dump(format("dec_base_pred_P%1d", plane));
-
-		// Work out quantization matrix for each LoQ
+	// Work out quantization matrix for each plane and LoQ
+	for (unsigned plane = 0; plane < num_planes; ++plane) {
 		for (unsigned loq = 0; loq < MAX_NUM_LOQS; ++loq) {
 			const bool horizontal_only = (configuration_.global_configuration.scaling_mode[loq] == ScalingMode_1D ? true : false);
 			for (unsigned layer = 0; layer < num_residual_layers(); ++layer) {
@@ -442,219 +882,145 @@ Image Decoder::decode(const Image &ext_base, Surface (&symbols)[MAX_NUM_PLANES][
 				                            layer, is_idr, quant_matrix_coeffs_[plane][loq][layer]);
 			}
 		}
-
-		//// Enhancement sub-layer 1 decoding
-		//
-		if (enhancement_enabled && apply_enhancement) {
-			// Base residuals
-			Surface unused_mask;
-			Surface residuals = decode_residuals(plane, LOQ_LEVEL_1, unused_mask, symbols[plane][LOQ_LEVEL_1]);
-
-			// Deblocking
-			if (configuration_.picture_configuration.level_1_filtering_enabled &&
-			    configuration_.global_configuration.transform_block_size == 4) {
-				residuals = Deblocking().process(residuals, configuration_.global_configuration.level_1_filtering_first_coefficient,
-				                                 configuration_.global_configuration.level_1_filtering_second_coefficient);
-			}
-
-			// Add to (upsampled) base
-			residuals.dump(format("dec_base_resi_reco_P%1d", plane));
-#if defined __OPT_INPLACE__
-			{
-				auto viewa = base_upsampled.view_as<int16_t>();
-				auto viewb = residuals.view_as<int16_t>();
-				const int16_t *__restrict psrcb = viewb.data(0, 0);
-				int16_t *__restrict pdst = (int16_t *)viewa.data(0, 0);
-				for (unsigned y = 0; y < base_upsampled.height() * base_upsampled.width(); ++y) {
-					*pdst++ += (*psrcb++);
-				}
-			}
-			base_reco[plane] = base_upsampled;
-#else
-			base_reco[plane] = Add().process(base_upsampled, residuals);
-#endif
-		} else {
-			base_reco[plane] = base_upsampled;
-		}
 	}
 
-	//// Upsample from combined intermediate picture to preliminary output picture
-	//
-	Surface upsampled_planes[MAX_NUM_PLANES];
-	for (unsigned plane = 0; plane < ext_base.description().num_planes(); ++plane) {
-		switch (configuration_.global_configuration.scaling_mode[LOQ_LEVEL_2]) {
-		case ScalingMode_1D:
-			upsampled_planes[plane] = Upsampling_1D().process(base_reco[plane], configuration_.global_configuration.upsample,
-			                                                  configuration_.global_configuration.upsampling_coefficients);
-			if (configuration_.global_configuration.predicted_residual_enabled) {
-				upsampled_planes[plane] = PredictedResidualAdjust_1D().process(
-				    base_reco[plane], upsampled_planes[plane], PredictedResidualSum_1D().process(upsampled_planes[plane]));
-			}
-			break;
-		case ScalingMode_2D:
-			upsampled_planes[plane] = Upsampling().process(base_reco[plane], configuration_.global_configuration.upsample,
-			                                               configuration_.global_configuration.upsampling_coefficients);
-			if (configuration_.global_configuration.predicted_residual_enabled) {
-				upsampled_planes[plane] = PredictedResidualAdjust().process(
-				    base_reco[plane], upsampled_planes[plane], PredictedResidualSum().process(upsampled_planes[plane]));
-			}
-			break;
-		case ScalingMode_None:
-			upsampled_planes[plane] = base_reco[plane];
-			break;
-		default:
-			CHECK(0);
-		}
-		upsampled_planes[plane].dump(format("dec_full_pred_P%1d", plane));
-	}
+	// Planes are independent until output, and within a plane the sub-layer 2 residuals do not depend on the sub-layer 1
+	// reconstruction. So each plane has two tasks: base conversion, sub-layer 1 decoding and upsampling to the intermediate
+	// picture - and sub-layer 2 decoding (including the temporal buffer). Surface dumps share writers, so stay serial.
+	const unsigned num_threads = (parallel_planes_ && !Surface::get_dump_surfaces()) ? num_threads_ : 1;
+
+	// In stripe mode, the base planes are converted and upsampled a band at a time, after all residuals are decoded
+	const bool stripes = use_stripes();
 
-	for (unsigned plane = 0; plane < ext_base.description().num_planes(); ++plane) {
+	parallel_for(2 * num_planes, num_threads, [&](unsigned task) {
+		const unsigned plane = task % num_planes;
 		const bool enhancement_enabled = configuration_.picture_configuration.enhancement_enabled &&
 		                                 plane < configuration_.global_configuration.num_processed_planes;
 
-		//// Enhancement sub-layer 2 decoding
-		//
-		if (enhancement_enabled && apply_enhancement) {
-			// Enhacement residuals
-			Surface temporal_mask;
-			Surface residuals = decode_residuals(plane, LOQ_LEVEL_2, temporal_mask, symbols[plane][LOQ_LEVEL_2]);
-			residuals.dump(format("dec_full_resi_reco_P%1d", plane));
-
-			if (configuration_.global_configuration.temporal_enabled) {
-				// Apply temporal map (intra / pred)
-				CHECK(!temporal_mask.empty());
-				if (temporal_buffer_[plane].empty()) {
-					temporal_buffer_[plane] = Surface::build_from<int16_t>()
-					                              .generate(upsampled_planes[plane].width(), upsampled_planes[plane].height(),
-					                                        [&](unsigned x, unsigned y) -> int16_t { return 0; })
-					                              .finish();
-				}
-				temporal_buffer_[plane] =
-				    ApplyTemporalMap().process(temporal_buffer_[plane], temporal_mask, transform_block_size());
-#if defined __OPT_INPLACE__
-				{
-					auto viewa = temporal_buffer_[plane].view_as<int16_t>();
-					auto viewb = residuals.view_as<int16_t>();
-					const int16_t *__restrict psrcb = viewb.data(0, 0);
-					int16_t *__restrict pdst = (int16_t *)viewa.data(0, 0);
-					for (unsigned y = 0; y < temporal_buffer_[plane].height() * temporal_buffer_[plane].width(); ++y) {
-						*pdst++ += (*psrcb++);
-					}
-				}
-#else
-				temporal_buffer_[plane] = Add().process(temporal_buffer_[plane], residuals);
-#endif
-				temporal_buffer_[plane].dump(format("dec_full_temp_buff_P%1d", plane));
-				temporal_mask.dump(format("dec_full_temp_mask_P%1d", plane));
+		if (task < num_planes) {
+			if (!stripes)
+				base_planes[plane] = convert_base_plane(ext_base, plane);
 
-#if defined __OPT_INPLACE__
-				{
-					auto viewa = upsampled_planes[plane].view_as<int16_t>();
-					auto viewb = temporal_buffer_[plane].view_as<int16_t>();
-					const int16_t *__restrict psrcb = viewb.data(0, 0);
-					int16_t *__restrict pdst = (int16_t *)viewa.data(0, 0);
-					for (unsigned y = 0; y < upsampled_planes[plane].height() * upsampled_planes[plane].width(); ++y) {
-						*pdst++ += (*psrcb++);
-					}
-				}
-				full_reco[plane] = upsampled_planes[plane];
-#else
-				full_reco[plane] = Add().process(upsampled_planes[plane], temporal_buffer_[plane]);
-#endif
-			} else {
-				// Temporal disabled
-#if defined __OPT_INPLACE__
-				{
-					auto viewa = upsampled_planes[plane].view_as<int16_t>();
-					auto viewb = residuals.view_as<int16_t>();
-					const int16_t *__restrict psrcb = viewb.data(0, 0);
-					int16_t *__restrict pdst = (int16_t *)viewa.data(0, 0);
-					for (unsigned y = 0; y < upsampled_planes[plane].height() * upsampled_planes[plane].width(); ++y) {
-						*pdst++ += (*psrcb++);
-					}
-				}
-				full_reco[plane] = upsampled_planes[plane];
-#else
-				full_reco[plane] = Add().process(upsampled_planes[plane], residuals);
-#endif
-			}
+			//// Enhancement sub-layer 1 decoding
+			//
+			if (enhancement_enabled && apply_enhancement)
+				decode_base_residuals(plane, symbols[plane][LOQ_LEVEL_1], base_residuals[plane], base_occupancy[plane]);
 
-		} else if (plane < configuration_.global_configuration.num_processed_planes && apply_enhancement) {
-			// No enhancement - but temporal layer can still be added
-			if (configuration_.global_configuration.temporal_enabled) {
-				Surface temporal_mask = get_temporal_mask(symbols[plane][LOQ_LEVEL_2][num_residual_layers()]);
-				CHECK(!temporal_mask.empty());
-				if (temporal_buffer_[plane].empty()) {
-					temporal_buffer_[plane] = Surface::build_from<int16_t>()
-					                              .generate(upsampled_planes[plane].width(), upsampled_planes[plane].height(),
-					                                        [&](unsigned x, unsigned y) -> int16_t { return 0; })
-					                              .finish();
-				}
+			//// Upsample from decoded base picture to preliminary intermediate picture, and add residuals
+			//
+			if (!stripes && !upsample_planes_jointly(LOQ_LEVEL_1))
+				base_reco[plane] = upsample_and_add(plane, LOQ_LEVEL_1, base_planes[plane], base_residuals[plane],
+				                                    base_occupancy[plane]);
+		} else {
+			//// Enhancement sub-layer 2 decoding
+			//
+			if (plane < configuration_.global_configuration.num_processed_planes && apply_enhancement)
+				decode_full_residuals(plane, symbols[plane][LOQ_LEVEL_2], enhancement_enabled, full_residuals[plane],
+				                      full_occupancy[plane]);
+		}
+	});
 
-				// Apply temporal map (intra / pred)
-				temporal_buffer_[plane] =
-				    ApplyTemporalMap().process(temporal_buffer_[plane], temporal_mask, transform_block_size());
-				temporal_buffer_[plane].dump(format("dec_full_temp_buff_P%1d", plane));
-				temporal_mask.dump(format("dec_full_temp_mask_P%1d", plane));
-#if defined __OPT_INPLACE__
-				{
-					auto viewa = upsampled_planes[plane].view_as<int16_t>();
-					auto viewb = temporal_buffer_[plane].view_as<int16_t>();
-					const int16_t *__restrict psrcb = viewb.data(0, 0);
-					int16_t *__restrict pdst = (int16_t *)viewa.data(0, 0);
-					for (unsigned y = 0; y < upsampled_planes[plane].height() * upsampled_planes[plane].width(); ++y) {
-						*pdst++ += (*psrcb++);
-					}
-				}
-				full_reco[plane] = upsampled_planes[plane];
-#else
-				full_reco[plane] = Add().process(upsampled_planes[plane], temporal_buffer_[plane]);
-#endif
-			} else {
-				// Temporal disabled
-				full_reco[plane] = upsampled_planes[plane];
+	Surface output[MAX_NUM_PLANES];
+
+	if (stripes) {
+		// Dithering is applied to the whole plane afterwards, as it consumes random numbers in raster order - and whole
+		// planes at internal precision are only kept for that, or for reporting
+		bool dither[MAX_NUM_PLANES] = {};
+		bool keep_full[MAX_NUM_PLANES] = {};
+		SurfaceBuilder<uint8_t> output_builder[MAX_NUM_PLANES];
+		SurfaceBuilder<int16_t> full_builder[MAX_NUM_PLANES];
+		unsigned full_height[MAX_NUM_PLANES] = {};
+
+		// Bands of each plane, as (plane, first row) - all but the last band of a plane are 'band_rows' high
+		const unsigned band_rows = (stripe_rows_ + 3) & ~3u;
+		std::vector<std::pair<unsigned, unsigned>> bands;
+
+		for (unsigned plane = 0; plane < num_planes; ++plane) {
+			const GlobalConfiguration &gc = configuration_.global_configuration;
+			const Surface &base = ext_base.plane(plane);
+			const unsigned width = base.width() * horizontal_scale(gc.scaling_mode[LOQ_LEVEL_1]) *
+			                       horizontal_scale(gc.scaling_mode[LOQ_LEVEL_2]);
+			full_height[plane] =
+			    base.height() * vertical_scale(gc.scaling_mode[LOQ_LEVEL_1]) * vertical_scale(gc.scaling_mode[LOQ_LEVEL_2]);
+
+			dither[plane] = dithering_switch && configuration_.picture_configuration.dithering_control && plane == 0;
+			keep_full[plane] = report || dither[plane];
+			if (keep_full[plane])
+				full_builder[plane].reserve(width, full_height[plane]);
+
+			unsigned output_width = width, output_height = full_height[plane];
+			if (configuration_.sequence_configuration.conformance_window) {
+				const SequenceConfiguration &sc = configuration_.sequence_configuration;
+				output_width -= (sc.conf_win_left_offset + sc.conf_win_right_offset) * dimensions_.crop_unit_width(plane);
+				output_height -= (sc.conf_win_top_offset + sc.conf_win_bottom_offset) * dimensions_.crop_unit_height(plane);
 			}
-		} else {
-			full_reco[plane] = upsampled_planes[plane];
+			if (!dither[plane])
+				output_builder[plane].reserve_bpp(output_width, output_height, gc.enhancement_depth > 8 ? 2 : 1);
+
+			// Residuals with no occupied blocks are not added
+			if (!base_occupancy[plane].empty() && !any_occupied(base_occupancy[plane]))
+				base_residuals[plane] = Surface();
+			if (!full_occupancy[plane].empty() && !any_occupied(full_occupancy[plane]))
+				full_residuals[plane] = Surface();
+
+			for (unsigned begin = 0; begin < full_height[plane]; begin += band_rows)
+				bands.push_back(std::make_pair(plane, begin));
 		}
-		// INFO("dither flag %4d type %4d stre %4d", configuration_.picture_configuration.dithering_control,
-		// configuration_.picture_configuration.dithering_type, configuration_.picture_configuration.dithering_strength);
-		if (dithering_switch && configuration_.picture_configuration.dithering_control && (plane == 0)) {
-			outp_reco[plane] = dithering_.process(full_reco[plane], transform_block_size());
-			if (dithering_fixed) {
-				// PSNR calculation after dithering if using fixed seed
-				full_reco[plane] = outp_reco[plane];
+
+		parallel_for((unsigned)bands.size(), num_threads_, [&](unsigned b) {
+			const unsigned plane = bands[b].first, begin = bands[b].second;
+			const unsigned end = std::min(begin + band_rows, full_height[plane]);
+
+			const Surface band = reconstruct_band(plane, ext_base, base_residuals[plane], full_residuals[plane], begin, end);
+
+			if (keep_full[plane]) {
+				const auto view = band.view_as<int16_t>();
+				for (unsigned y = begin; y < end; ++y)
+					memcpy(full_builder[plane].data(0, y), view.data(0, y - begin), band.width() * sizeof(int16_t));
 			}
-		} else
-			outp_reco[plane] = full_reco[plane];
-	}
 
-	Surface output[MAX_NUM_PLANES];
-	for (unsigned p = 0; p < ext_base.description().num_planes(); ++p) {
-
-		Surface o;
-		if (configuration_.sequence_configuration.conformance_window) {
-			// Apply conformance windowing
-			const unsigned cw = dimensions_.crop_unit_width(p), ch = dimensions_.crop_unit_height(p);
-			o = Conform().process(outp_reco[p], configuration_.sequence_configuration.conf_win_left_offset * cw,
-			                      configuration_.sequence_configuration.conf_win_top_offset * ch,
-			                      configuration_.sequence_configuration.conf_win_right_offset * cw,
-			                      configuration_.sequence_configuration.conf_win_bottom_offset * ch);
-		} else {
-			o = outp_reco[p];
+			if (!dither[plane])
+				output_band(plane, band, begin, full_height[plane], output_builder[plane]);
+		});
+
+		for (unsigned plane = 0; plane < num_planes; ++plane) {
+			if (keep_full[plane])
+				full_reco[plane] = full_builder[plane].finish();
+			if (dither[plane])
+				output[plane] = output_plane(plane, full_reco[plane], dithering_switch, dithering_fixed);
+			else
+				output[plane] = output_builder[plane].finish();
 		}
-		output[p] = ConvertFromInternal().process(o, configuration_.global_configuration.enhancement_depth);
+	} else {
+		if (upsample_planes_jointly(LOQ_LEVEL_1))
+			upsample_and_add_planes(LOQ_LEVEL_1, num_planes, base_planes, base_residuals, base_occupancy, base_reco);
+
+		if (upsample_planes_jointly(LOQ_LEVEL_2))
+			upsample_and_add_planes(LOQ_LEVEL_2, num_planes, base_reco, full_residuals, full_occupancy, full_reco);
+
+		// Finish each plane
+		parallel_for(num_planes, num_threads, [&](unsigned plane) {
+			//// Upsample from combined intermediate picture to preliminary output picture, and add residuals
+			//
+			if (!upsample_planes_jointly(LOQ_LEVEL_2))
+				full_reco[plane] =
+				    upsample_and_add(plane, LOQ_LEVEL_2, base_reco[plane], full_residuals[plane], full_occupancy[plane]);
+
+			output[plane] = output_plane(plane, full_reco[plane], dithering_switch, dithering_fixed);
+		});
 	}
 
 	const auto output_desc = ImageDescription(ext_base.description().format(), output[0].width(), output[0].height())
 	                             .with_depth(configuration_.global_configuration.enhancement_depth);
 
-	goReportStructure = goReportQueue.top();
-	goReportQueue.pop();
-	goPsnr.miBaseBytes += goReportStructure.miBaseSize;
-	goPsnr.miEnhancementBytes += goReportStructure.miEnhancementSize;
-	fprintf(stdout, "DEC. [pts. %4d] [type %4d] [base %8d] [enha %8d] ", goReportStructure.miTimeStamp,
-	        goReportStructure.miPictureType, goReportStructure.miBaseSize, goReportStructure.miEnhancementSize);
+	// Pictures that came from a base decoder get a line of statistics on stdout
+	PsnrStatistic &psnr = statistics_.psnr();
+	if (picture_report) {
+		psnr.miBaseBytes += picture_report->miBaseSize;
+		psnr.miEnhancementBytes += picture_report->miEnhancementSize;
+		fprintf(stdout, "DEC. [pts. %4d] [type %4d] [base %8d] [enha %8d] ", picture_report->miTimeStamp,
+		        picture_report->miPictureType, picture_report->miBaseSize, picture_report->miEnhancementSize);
+	}
 
 	// XXX THis should get hoisted into App.
 	if (report) {
@@ -666,11 +1032,11 @@ Image Decoder::decode(const Image &ext_base, Surface (&symbols)[MAX_NUM_PLANES][
 				const Surface src = ConvertToInternal().process(src_image.plane(plane), src_image.description().bit_depth());
 				const auto in = src.view_as<int16_t>();
 				PicturePsnr15bpp((int16_t *)in.data(), (int16_t *)out[plane].data(), plane, output_desc.width(plane),
-				                 output_desc.height(plane), goPsnr);
+				                 output_desc.height(plane), psnr);
 			}
-			fprintf(stdout, "[psnrY %8.4f] ", goPsnr.mfCurPsnr[0]);
+			fprintf(stdout, "[psnrY %8.4f] ", psnr.mfCurPsnr[0]);
 			if (src_image.description().num_planes() > 1)
-				fprintf(stdout, "[psnrU %8.4f] [psnrV %8.4f] \n", (goPsnr.mfCurPsnr[1]), (goPsnr.mfCurPsnr[2]));
+				fprintf(stdout, "[psnrU %8.4f] [psnrV %8.4f] \n", (psnr.mfCurPsnr[1]), (psnr.mfCurPsnr[2]));
 			else
 				fprintf(stdout, "\n");
 		}
@@ -685,28 +1051,29 @@ Image Decoder::decode(const Image &ext_base, Surface (&symbols)[MAX_NUM_PLANES][
 			oImageBuffer.s[plane] = full_reco[plane].width() * 2;
 			oImageBuffer.a[plane] = (void *)out[plane].data();
 		}
-		lcevc_md5_imgb(&oImageBuffer, gaucMd5Digest);
+		auto &md5_digest = statistics_.md5_digest();
+		lcevc_md5_imgb(&oImageBuffer, md5_digest);
 
 		// clang-format off
 		fprintf(stdout, "[MD5Y %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X] ",
-				gaucMd5Digest[0][0],  gaucMd5Digest[0][1],  gaucMd5Digest[0][2],  gaucMd5Digest[0][3],
-				gaucMd5Digest[0][4],  gaucMd5Digest[0][5],  gaucMd5Digest[0][6],  gaucMd5Digest[0][7],
-				gaucMd5Digest[0][8],  gaucMd5Digest[0][9],  gaucMd5Digest[0][10], gaucMd5Digest[0][11],
-				gaucMd5Digest[0][12], gaucMd5Digest[0][13], gaucMd5Digest[0][14], gaucMd5Digest[0][15]);
+				md5_digest[0][0],  md5_digest[0][1],  md5_digest[0][2],  md5_digest[0][3],
+				md5_digest[0][4],  md5_digest[0][5],  md5_digest[0][6],  md5_digest[0][7],
+				md5_digest[0][8],  md5_digest[0][9],  md5_digest[0][10], md5_digest[0][11],
+				md5_digest[0][12], md5_digest[0][13], md5_digest[0][14], md5_digest[0][15]);
 		if (output_desc.num_planes() > 1) {
 			fprintf(stdout, "[MD5U %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X] ",
-					gaucMd5Digest[1][0],  gaucMd5Digest[1][1],  gaucMd5Digest[1][2],  gaucMd5Digest[1][3],
-					gaucMd5Digest[1][4],  gaucMd5Digest[1][5],  gaucMd5Digest[1][6],  gaucMd5Digest[1][7],
-					gaucMd5Digest[1][8],  gaucMd5Digest[1][9],  gaucMd5Digest[1][10], gaucMd5Digest[1][11],
-					gaucMd5Digest[1][12], gaucMd5Digest[1][13], gaucMd5Digest[1][14], gaucMd5Digest[1][15]);
+					md5_digest[1][0],  md5_digest[1][1],  md5_digest[1][2],  md5_digest[1][3],
+					md5_digest[1][4],  md5_digest[1][5],  md5_digest[1][6],  md5_digest[1][7],
+					md5_digest[1][8],  md5_digest[1][9],  md5_digest[1][10], md5_digest[1][11],
+					md5_digest[1][12], md5_digest[1][13], md5_digest[1][14], md5_digest[1][15]);
 			fprintf(stdout, "[MD5V %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X] \n",
-					gaucMd5Digest[2][0],  gaucMd5Digest[2][1],  gaucMd5Digest[2][2],  gaucMd5Digest[2][3],
-					gaucMd5Digest[2][4],  gaucMd5Digest[2][5],  gaucMd5Digest[2][6],  gaucMd5Digest[2][7],
-					gaucMd5Digest[2][8],  gaucMd5Digest[2][9],  gaucMd5Digest[2][10], gaucMd5Digest[2][11],
-					gaucMd5Digest[2][12], gaucMd5Digest[2][13], gaucMd5Digest[2][14], gaucMd5Digest[2][15]);
+					md5_digest[2][0],  md5_digest[2][1],  md5_digest[2][2],  md5_digest[2][3],
+					md5_digest[2][4],  md5_digest[2][5],  md5_digest[2][6],  md5_digest[2][7],
+					md5_digest[2][8],  md5_digest[2][9],  md5_digest[2][10], md5_digest[2][11],
+					md5_digest[2][12], md5_digest[2][13], md5_digest[2][14], md5_digest[2][15]);
 		}
 		// clang-format on
-	} else {
+	} else if (picture_report) {
 		fprintf(stdout, "\n");
 	}
 
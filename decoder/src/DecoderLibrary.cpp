@@ -0,0 +1,675 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// DecoderLibrary.cpp
+//
+// The LCEVC decoder as a shared library (libltmdec), behind the loadable codec API in CodecApi.h
+//
+// The client runs the base decoder. It pushes each base access unit with push_packet(), and each decoded base picture
+// with push_image(), tagging both with PropertyID_Timestamp metadata - if neither is tagged, they pair up in push order.
+// Enhancement data is extracted from the access units, matched to base pictures by timestamp, and each picture is then
+// decoded as a task on a pool of threads shared by every context in the process. pull_image() returns enhanced pictures
+// in the order their bases were pushed.
+//
+#include "CodecApi.h"
+#include "CodecUtils.h"
+#include "Decoder.hpp"
+#include "Diagnostics.hpp"
+#include "Image.hpp"
+#include "Packet.hpp"
+#include "Parameters.hpp"
+#include "ScanEnhancement.hpp"
+#include "Surface.hpp"
+#include "Types.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include "git_version.h"
+#endif
+
+#ifndef GIT_VERSION
+#define GIT_VERSION ""
+#endif
+
+using namespace lctm;
+
+namespace {
+
+struct Metadata {
+	uint64_t timestamp = 0;
+	uint64_t poc = 0;
+	uint32_t qp = 0;
+	uint32_t frame_type = 0;
+};
+
+struct Error {
+	int32_t code = 0;
+	std::string message;
+	std::string file;
+	uint32_t line = 0;
+};
+
+void set_error(CodecError *error, const std::string &message, const char *file, uint32_t line) {
+	if (!error)
+		return;
+
+	Error *e = new Error;
+	e->code = 1;
+	e->message = message;
+	e->file = file;
+	e->line = line;
+	*error = (CodecError)e;
+}
+
+#define SET_ERROR(error, message) set_error(error, message, __FILE__, __LINE__)
+
+//// WorkerPool
+//
+// Threads shared by the decoding contexts of the process. Deliberately never destroyed, as contexts may be released
+// from static destructors.
+//
+class WorkerPool {
+public:
+	static WorkerPool &instance() {
+		static WorkerPool *pool = new WorkerPool(std::max(1u, std::thread::hardware_concurrency()));
+		return *pool;
+	}
+
+	void post(const std::function<void()> &task) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			tasks_.push_back(task);
+		}
+		wake_.notify_one();
+	}
+
+private:
+	WorkerPool(unsigned num_threads) {
+		for (unsigned t = 0; t < num_threads; ++t)
+			std::thread([this] { run(); }).detach();
+	}
+
+	void run() {
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				wake_.wait(lock, [this] { return !tasks_.empty(); });
+				task = std::move(tasks_.front());
+				tasks_.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::deque<std::function<void()>> tasks_;
+};
+
+//// Context
+//
+// One decoding session. Pictures are decoded strictly one after another, as the decoder carries temporal state from
+// picture to picture, but the pictures of different contexts run concurrently on the worker pool.
+//
+class Context {
+public:
+	Context(const Parameters &parameters);
+	~Context();
+
+	// Extract and keep the enhancement data from a base access unit
+	void push_packet(const uint8_t *data, size_t length, const Metadata *metadata);
+
+	// Queue a decoded base picture for enhancement
+	void push_image(const CodecImage &image, const Metadata *metadata);
+
+	// No more base pictures will be pushed
+	void end_of_stream();
+
+	// Wait for the next enhanced picture - false if there is none in flight. Throws if that picture failed to decode.
+	bool pull(std::shared_ptr<Image> &image, Metadata &metadata, bool &eos);
+
+private:
+	struct Enhancement {
+		Packet packet;
+		bool is_lcevc_idr = false;
+	};
+
+	struct Job {
+		Enhancement enhancement;
+		std::vector<Surface> base_planes;
+		unsigned base_bpp = 0;
+		Metadata metadata;
+	};
+
+	struct Output {
+		std::shared_ptr<Image> image;
+		Metadata metadata;
+		std::string error;
+	};
+
+	// Run the next job on a worker, then hand the context back to the pool if there is more to do
+	void run();
+
+	Output decode(const Job &job);
+
+	// Configuration
+	BaseCoding base_coding_ = BaseCoding_HEVC;
+	Encapsulation encapsulation_ = Encapsulation_NAL;
+	bool dithering_switch_ = true;
+	bool dithering_fixed_ = false;
+
+	// Only touched by the worker running this context's job
+	Decoder decoder_;
+	Surface symbols_[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS];
+	std::unique_ptr<SurfaceDumps> surface_dumps_;
+
+	// Only touched by the client
+	uint64_t packets_pushed_ = 0;
+	uint64_t images_pushed_ = 0;
+	std::map<uint64_t, Enhancement> enhancements_;
+
+	// Shared between client and worker
+	std::mutex mutex_;
+	std::condition_variable changed_;
+	std::deque<std::shared_ptr<Job>> jobs_;
+	std::deque<Output> outputs_;
+	unsigned in_flight_ = 0;
+	bool running_ = false;
+	bool eos_ = false;
+};
+
+Context::Context(const Parameters &parameters) {
+	base_coding_ = parameters["base"].get_enum<BaseCoding>(BaseCoding_HEVC);
+	encapsulation_ = parameters["encapsulation"].get_enum<Encapsulation>(Encapsulation_NAL);
+	dithering_switch_ = parameters["dithering"].get<bool>(true);
+	dithering_fixed_ = parameters["dithering_fixed"].get<bool>(false);
+
+	decoder_.set_num_threads(parameters["threads"].get<unsigned>(1));
+	decoder_.set_upsampling_dpi(parameters["upsampling_dpi"].get<bool>(false));
+	decoder_.set_parallel_planes(parameters["parallel_planes"].get<bool>(false));
+	decoder_.set_stripe_rows(parameters["stripe_rows"].get<unsigned>(0));
+	decoder_.set_interleaved_coefficients(parameters["interleaved_coefficients"].get<bool>(false));
+
+	// Surface dumps of this context go to their own files, named with the given prefix
+	surface_dumps_.reset(new SurfaceDumps(parameters["dump_prefix"].get<std::string>("")));
+	surface_dumps_->set_enabled(!parameters["dump_prefix"].empty());
+	decoder_.set_surface_dumps(surface_dumps_.get());
+}
+
+Context::~Context() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	changed_.wait(lock, [this] { return !running_; });
+}
+
+void Context::push_packet(const uint8_t *data, size_t length, const Metadata *metadata) {
+	const uint64_t timestamp = metadata ? metadata->timestamp : packets_pushed_;
+	const bool is_idr = metadata && metadata->frame_type == 0;
+	packets_pushed_++;
+
+	if (encapsulation_ == Encapsulation_None) {
+		// Access unit is the enhancement data itself
+		Enhancement &enhancement = enhancements_[timestamp];
+		enhancement.packet = Packet::build().contents(data, (unsigned)length).timestamp(timestamp).finish();
+		enhancement.is_lcevc_idr = is_idr;
+		return;
+	}
+
+	// scan_enhancement() edits the access unit in place
+	std::vector<uint8_t> access_unit(data, data + length);
+	scan_enhancement(access_unit.data(), access_unit.size(), encapsulation_, base_coding_, timestamp, is_idr,
+	                 [&](const Packet &packet, const bool is_lcevc_idr) {
+		                 Enhancement &enhancement = enhancements_[timestamp];
+		                 enhancement.packet = packet;
+		                 enhancement.is_lcevc_idr = is_lcevc_idr;
+	                 });
+}
+
+void Context::push_image(const CodecImage &image, const Metadata *metadata) {
+	const uint64_t timestamp = metadata ? metadata->timestamp : images_pushed_;
+	images_pushed_++;
+
+	const auto e = enhancements_.find(timestamp);
+	if (e == enhancements_.end())
+		ERR("No enhancement data for base picture with timestamp %" PRIu64, timestamp);
+
+	if (image.bpp != 1 && image.bpp != 2)
+		ERR("Base picture should have 1 or 2 bytes per sample, not %u", image.bpp);
+
+	std::shared_ptr<Job> job(new Job);
+	job->enhancement = e->second;
+	job->base_bpp = image.bpp;
+	job->metadata = metadata ? *metadata : Metadata();
+	job->metadata.timestamp = timestamp;
+	enhancements_.erase(e);
+
+	// Copy base planes - the client's buffers are only good for the duration of this call
+	const uint8_t *data[3] = {image.data_y, image.data_u, image.data_v};
+	for (unsigned p = 0; p < 3 && data[p]; ++p) {
+		const unsigned width = p ? image.width_uv : image.width_y;
+		const unsigned height = p ? image.height_uv : image.height_y;
+		const unsigned stride = p ? image.stride_uv : image.stride_y;
+		if (image.bpp == 1)
+			job->base_planes.push_back(
+			    Surface::build_from<int8_t>().contents((const int8_t *)data[p], width, height, stride).finish());
+		else
+			job->base_planes.push_back(
+			    Surface::build_from<int16_t>().contents((const int16_t *)data[p], width, height, stride).finish());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		jobs_.push_back(job);
+		in_flight_++;
+		if (running_)
+			return;
+		running_ = true;
+	}
+	WorkerPool::instance().post([this] { run(); });
+}
+
+void Context::end_of_stream() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	eos_ = true;
+}
+
+bool Context::pull(std::shared_ptr<Image> &image, Metadata &metadata, bool &eos) {
+	std::unique_lock<std::mutex> lock(mutex_);
+	changed_.wait(lock, [this] { return !outputs_.empty() || in_flight_ == 0; });
+
+	if (outputs_.empty()) {
+		eos = eos_;
+		return false;
+	}
+
+	Output output = std::move(outputs_.front());
+	outputs_.pop_front();
+	eos = false;
+
+	if (!output.error.empty())
+		throw std::runtime_error(output.error);
+
+	image = output.image;
+	metadata = output.metadata;
+	return true;
+}
+
+void Context::run() {
+	std::shared_ptr<Job> job;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job = jobs_.front();
+		jobs_.pop_front();
+	}
+
+	Output output = decode(*job);
+
+	// Nothing touches the context after the lock is dropped - the client may be waiting to delete it
+	std::lock_guard<std::mutex> lock(mutex_);
+	outputs_.push_back(std::move(output));
+	in_flight_--;
+	if (jobs_.empty())
+		running_ = false;
+	else
+		WorkerPool::instance().post([this] { run(); });
+	changed_.notify_all();
+}
+
+Context::Output Context::decode(const Job &job) {
+	Output output;
+	output.metadata = job.metadata;
+
+	try {
+		decoder_.initialize_decode(job.enhancement.packet, symbols_);
+		decoder_.set_idr(job.enhancement.is_lcevc_idr);
+
+		const GlobalConfiguration &gc = decoder_.get_configuration().global_configuration;
+		if ((gc.base_depth == 8) != (job.base_bpp == 1))
+			ERR("Base picture has %u bytes per sample, but base depth is %u", job.base_bpp, gc.base_depth);
+
+		const Surface &base_y = job.base_planes[0];
+		const ImageDescription base_desc =
+		    ImageDescription(gc.image_format, base_y.width(), base_y.height()).with_depth(gc.base_depth);
+		if (job.base_planes.size() < base_desc.num_planes())
+			ERR("Base picture has %u planes, expected %u", (unsigned)job.base_planes.size(), base_desc.num_planes());
+
+		std::vector<Surface> base_planes(job.base_planes.begin(), job.base_planes.begin() + base_desc.num_planes());
+		output.image = std::make_shared<Image>(decoder_.decode(Image("base", base_desc, job.metadata.timestamp, base_planes),
+		                                                       symbols_, Image(), false, dithering_switch_, dithering_fixed_, true));
+	} catch (const std::exception &e) {
+		output.error = e.what();
+	}
+
+	return output;
+}
+
+void set_codec_image(const Image &image, CodecImage &codec_image) {
+	memset(&codec_image, 0, sizeof(codec_image));
+
+	const Surface &y = image.plane(0);
+	const auto view_y = y.view_as<uint8_t>();
+	codec_image.bpp = y.bpp();
+	codec_image.width_y = y.width();
+	codec_image.height_y = y.height();
+	codec_image.stride_y = view_y.stride();
+	codec_image.data_y = view_y.data();
+
+	if (image.description().num_planes() < 3)
+		return;
+
+	const Surface &u = image.plane(1);
+	const auto view_u = u.view_as<uint8_t>();
+	const auto view_v = image.plane(2).view_as<uint8_t>();
+	codec_image.width_uv = u.width();
+	codec_image.height_uv = u.height();
+	codec_image.stride_uv = view_u.stride();
+	codec_image.data_u = view_u.data();
+	codec_image.data_v = view_v.data();
+}
+
+//// API context
+//
+// The decoding context, and the picture last given to the client - kept alive until the next pull or release
+//
+struct ApiContext {
+	std::unique_ptr<Context> context;
+	std::shared_ptr<Image> pulled;
+};
+
+int32_t create_context(CodecContext *cp, const char *json_configuration, CodecError *error) {
+	if (error)
+		*error = 0;
+
+	try {
+		const Parameters parameters = Parameters::build().set_json(json_configuration ? json_configuration : "{}").finish();
+		ApiContext *api_context = new ApiContext;
+		api_context->context.reset(new Context(parameters));
+		*cp = (CodecContext)api_context;
+		return 1;
+	} catch (const std::exception &e) {
+		SET_ERROR(error, e.what());
+		return 0;
+	}
+}
+
+int32_t push_packet(CodecContext c, const uint8_t *data, size_t length, CodecMetadata metadata, int8_t eos,
+                    CodecError *error) {
+	ApiContext *api_context = (ApiContext *)c;
+	if (error)
+		*error = 0;
+
+	// End of packets needs no action - end of stream is signalled by the base pictures
+	if (eos || !data)
+		return 1;
+
+	try {
+		api_context->context->push_packet(data, length, (const Metadata *)metadata);
+		return 1;
+	} catch (const std::exception &e) {
+		SET_ERROR(error, e.what());
+		return 0;
+	}
+}
+
+int32_t push_image(CodecContext c, const CodecImage *image, CodecMetadata metadata, int8_t eos, CodecError *error) {
+	ApiContext *api_context = (ApiContext *)c;
+	if (error)
+		*error = 0;
+
+	try {
+		if (image && image->data_y)
+			api_context->context->push_image(*image, (const Metadata *)metadata);
+		if (eos)
+			api_context->context->end_of_stream();
+		return 1;
+	} catch (const std::exception &e) {
+		SET_ERROR(error, e.what());
+		return 0;
+	}
+}
+
+int32_t pull_image(CodecContext c, CodecImage *image, CodecMetadata *metadata, int8_t *eos, CodecError *error) {
+	ApiContext *api_context = (ApiContext *)c;
+	if (error)
+		*error = 0;
+	if (metadata)
+		*metadata = 0;
+
+	api_context->pulled.reset();
+
+	try {
+		Metadata picture_metadata;
+		bool end = false;
+		const bool pulled = api_context->context->pull(api_context->pulled, picture_metadata, end);
+		if (eos)
+			*eos = end ? 1 : 0;
+		if (!pulled)
+			return 0;
+
+		set_codec_image(*api_context->pulled, *image);
+		if (metadata)
+			*metadata = (CodecMetadata) new Metadata(picture_metadata);
+		return 1;
+	} catch (const std::exception &e) {
+		SET_ERROR(error, e.what());
+		return 0;
+	}
+}
+
+int32_t create_metadata(CodecMetadata *metadata, CodecError *error) {
+	if (error)
+		*error = 0;
+	*metadata = (CodecMetadata) new Metadata;
+	return 1;
+}
+
+void release_context(CodecContext c) {
+	ApiContext *api_context = (ApiContext *)c;
+	delete api_context;
+}
+
+void release_error(CodecError e) { delete (Error *)e; }
+
+void release_metadata(CodecMetadata m) { delete (Metadata *)m; }
+
+// Properties of metadata
+const char *get_metadata_property_name(CodecMetadata, uint32_t id) {
+	switch (id) {
+	case PropertyID_Timestamp:
+		return "timestamp";
+	case PropertyID_PictureOrderCount:
+		return "picture_order_count";
+	case PropertyID_QP:
+		return "qp";
+	case PropertyID_FrameType:
+		return "frame_type";
+	default:
+		return 0;
+	}
+}
+
+uint64_t get_metadata_property_u64(CodecMetadata metadata, uint32_t id) {
+	const Metadata *m = (const Metadata *)metadata;
+	if (!m)
+		return 0;
+
+	switch (id) {
+	case PropertyID_Timestamp:
+		return m->timestamp;
+	case PropertyID_PictureOrderCount:
+		return m->poc;
+	case PropertyID_QP:
+		return m->qp;
+	case PropertyID_FrameType:
+		return m->frame_type;
+	default:
+		return 0;
+	}
+}
+
+void set_metadata_property_u64(CodecMetadata metadata, uint32_t id, uint64_t v) {
+	Metadata *m = (Metadata *)metadata;
+	if (!m)
+		return;
+
+	switch (id) {
+	case PropertyID_Timestamp:
+		m->timestamp = v;
+		break;
+	case PropertyID_PictureOrderCount:
+		m->poc = v;
+		break;
+	case PropertyID_QP:
+		m->qp = (uint32_t)v;
+		break;
+	case PropertyID_FrameType:
+		m->frame_type = (uint32_t)v;
+		break;
+	default:
+		break;
+	}
+}
+
+uint32_t get_metadata_property_u32(CodecMetadata metadata, uint32_t id) {
+	return (uint32_t)get_metadata_property_u64(metadata, id);
+}
+
+int32_t get_metadata_property_i32(CodecMetadata metadata, uint32_t id) {
+	return (int32_t)get_metadata_property_u64(metadata, id);
+}
+
+int64_t get_metadata_property_i64(CodecMetadata metadata, uint32_t id) {
+	return (int64_t)get_metadata_property_u64(metadata, id);
+}
+
+int8_t get_metadata_property_bool(CodecMetadata metadata, uint32_t id) {
+	return get_metadata_property_u64(metadata, id) != 0;
+}
+
+void set_metadata_property_u32(CodecMetadata metadata, uint32_t id, uint32_t v) { set_metadata_property_u64(metadata, id, v); }
+
+void set_metadata_property_i32(CodecMetadata metadata, uint32_t id, int32_t v) {
+	set_metadata_property_u64(metadata, id, (uint64_t)v);
+}
+
+void set_metadata_property_i64(CodecMetadata metadata, uint32_t id, uint64_t v) { set_metadata_property_u64(metadata, id, v); }
+
+void set_metadata_property_bool(CodecMetadata metadata, uint32_t id, uint8_t v) { set_metadata_property_u64(metadata, id, v); }
+
+// Properties of error
+int32_t get_error_code(CodecError error) { return error ? ((const Error *)error)->code : 0; }
+
+size_t copy_string(const std::string &str, char *data, size_t length) {
+	if (data && length) {
+		const size_t n = std::min(str.size(), length - 1);
+		memcpy(data, str.data(), n);
+		data[n] = '\0';
+	}
+	return str.size();
+}
+
+size_t get_error_message(CodecError error, char *data, size_t length) {
+	return error ? copy_string(((const Error *)error)->message, data, length) : 0;
+}
+
+size_t get_error_file(CodecError error, char *filename, size_t length) {
+	return error ? copy_string(((const Error *)error)->file, filename, length) : 0;
+}
+
+uint32_t get_error_line(CodecError error) { return error ? ((const Error *)error)->line : 0; }
+
+const char codec_name[] = "lcevc";
+const char codec_version_string[] = "LTM " GIT_VERSION;
+
+} // namespace
+
+CODEC_API_EXPORT uint32_t CodecAPI_Version() { return LOADABLE_CODEC_API_VERSION; }
+
+CODEC_API_EXPORT uint32_t CodecAPI_Query(int, const char *, uint32_t) { return 0; }
+
+CODEC_API_EXPORT Codec *CodecAPI_Create(const char *, CodecOperation operation, const char *) {
+	if (operation != CodecOperation_Decode)
+		return 0;
+
+	Codec *codec = LTMCodecAllocate(codec_name, codec_version_string, operation);
+
+	codec->create_context = create_context;
+	codec->push_packet = push_packet;
+	codec->push_image = push_image;
+	codec->pull_image = pull_image;
+	codec->create_metadata = create_metadata;
+
+	codec->release_context = release_context;
+	codec->release_error = release_error;
+	codec->release_metadata = release_metadata;
+
+	codec->get_metadata_property_name = get_metadata_property_name;
+	codec->get_metadata_property_u32 = get_metadata_property_u32;
+	codec->get_metadata_property_i32 = get_metadata_property_i32;
+	codec->get_metadata_property_u64 = get_metadata_property_u64;
+	codec->get_metadata_property_i64 = get_metadata_property_i64;
+	codec->get_metadata_property_bool = get_metadata_property_bool;
+
+	codec->set_metadata_property_u32 = set_metadata_property_u32;
+	codec->set_metadata_property_i32 = set_metadata_property_i32;
+	codec->set_metadata_property_u64 = set_metadata_property_u64;
+	codec->set_metadata_property_i64 = set_metadata_property_i64;
+	codec->set_metadata_property_bool = set_metadata_property_bool;
+
+	codec->get_error_code = get_error_code;
+	codec->get_error_message = get_error_message;
+	codec->get_error_file = get_error_file;
+	codec->get_error_line = get_error_line;
+
+	return codec;
+}
+
+CODEC_API_EXPORT void CodecAPI_Release(Codec *codec) {
+	if (!codec)
+		return;
+
+	LTMCodecFree(codec);
+}
@@ -43,8 +43,13 @@
 #include "Diagnostics.hpp"
 #include "Dimensions.hpp"
 #include "EntropyDecoder.hpp"
+#include "Parallel.hpp"
+#include "TemporalDecode.hpp"
 
 #include <climits>
+#include <cstring>
+#include <map>
+#include <tuple>
 
 namespace lctm {
 
@@ -82,8 +87,10 @@ static_assert((sizeof(resolution_table) / sizeof(resolution_table[0])) == 51, "R
 } // namespace
 
 Deserializer::Deserializer(const Packet &packet, SignaledConfiguration &dst_configuration,
-                           Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS])
-    : Component("Deserializer"), view_(packet), b_(view_), dst_configuration_(dst_configuration), symbols_(symbols) {}
+                           Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS], unsigned num_threads,
+                           bool interleave_coefficients)
+    : Component("Deserializer"), view_(packet), b_(view_), dst_configuration_(dst_configuration), symbols_(symbols),
+      num_threads_(num_threads), interleave_coefficients_(interleave_coefficients) {}
 
 // Top level of enhancement layer parsing
 //
@@ -734,6 +741,17 @@ void Deserializer::parse_encoded_data(SignaledConfiguration &dst_configuration,
 		if (dst_configuration.picture_configuration.enhancement_enabled ||
 		    dst_configuration.picture_configuration.temporal_signalling_present) {
 			for (unsigned loq = 0; loq < MAX_NUM_LOQS; ++loq) {
+				const unsigned num_residual_layers = dst_configuration.global_configuration.num_residual_layers;
+				const bool interleave = interleave_coefficients_ && first_layer(dst_configuration) == 0;
+				const unsigned layer_width = dst_configuration.surface_configuration[plane][loq][0].width;
+				const unsigned layer_height = dst_configuration.surface_configuration[plane][loq][0].height;
+				auto interleaved = Surface::build_from<int16_t>();
+				auto occupancy = Surface::build_from<uint8_t>();
+				if (interleave) {
+					interleaved.reserve(layer_width * num_residual_layers, layer_height);
+					occupancy.fill(0, layer_width, layer_height);
+				}
+
 				for (unsigned layer = first_layer(dst_configuration); layer < total_layers(dst_configuration, plane, loq);
 				     ++layer) {
 					const SurfaceConfiguration &surface_configuration = dst_configuration.surface_configuration[plane][loq][layer];
@@ -751,7 +769,24 @@ void Deserializer::parse_encoded_data(SignaledConfiguration &dst_configuration,
 					if (!is_temporal_layer(dst_configuration, plane, loq, layer)) {
 						const bool use_tiled_encoding_order = dst_configuration.global_configuration.temporal_enabled ||
 						                                      dst_configuration.global_configuration.tile_dimensions_type > 0;
-						if (use_tiled_encoding_order) {
+						if (interleave) {
+							// Write this layer straight into its slot of each block
+							CHECK(surface_configuration.width * num_residual_layers == interleaved.width() &&
+							      surface_configuration.height == interleaved.height());
+							if (layer_width && layer_height) {
+								int16_t *dst = interleaved.data() + layer;
+								const unsigned pitch = interleaved.stride() / sizeof(int16_t);
+								if (use_tiled_encoding_order)
+									EntropyDecoderResidualsTiled().process(
+									    layer_width, layer_height, entropy_enabled[plane][loq][layer], rle_only[plane][loq][layer], pb,
+									    dst_configuration.global_configuration.transform_block_size, dst, pitch, num_residual_layers,
+									    occupancy.data(), occupancy.stride());
+								else
+									EntropyDecoderResiduals().process(layer_width, layer_height, entropy_enabled[plane][loq][layer],
+									                                  rle_only[plane][loq][layer], pb, dst, pitch, num_residual_layers,
+									                                  occupancy.data(), occupancy.stride());
+							}
+						} else if (use_tiled_encoding_order) {
 							symbols[plane][loq][layer] = EntropyDecoderResidualsTiled().process(
 							    surface_configuration.width, surface_configuration.height, entropy_enabled[plane][loq][layer],
 							    rle_only[plane][loq][layer], pb, dst_configuration.global_configuration.transform_block_size);
@@ -761,12 +796,17 @@ void Deserializer::parse_encoded_data(SignaledConfiguration &dst_configuration,
 							    rle_only[plane][loq][layer], pb);
 						}
 					} else {
-						symbols[plane][loq][layer] = EntropyDecoderTemporal().process(
+						symbols[plane][loq][layer] = EntropyDecoderTemporal().process_packed(
 						    surface_configuration.width, surface_configuration.height, entropy_enabled[plane][loq][layer],
 						    rle_only[plane][loq][layer], pb, dst_configuration.global_configuration.transform_block_size,
 						    dst_configuration.global_configuration.temporal_tile_intra_signalling_enabled);
 					}
 				}
+
+				if (interleave) {
+					symbols[plane][loq][INTERLEAVED_COEFFICIENTS] = interleaved.finish();
+					symbols[plane][loq][INTERLEAVED_OCCUPANCY] = occupancy.finish();
+				}
 			}
 		}
 	}
@@ -777,63 +817,6 @@ void Deserializer::parse_encoded_data(SignaledConfiguration &dst_configuration,
 #endif
 }
 
-static Surface decode_layer(const SignaledConfiguration &dst_configuration, unsigned plane, unsigned loq, unsigned layer,
-                            unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b) {
-
-	if (!is_temporal_layer(dst_configuration, plane, loq, layer)) {
-		const bool use_tiled_encoding_order = dst_configuration.global_configuration.temporal_enabled ||
-		                                      dst_configuration.global_configuration.tile_dimensions_type > 0;
-		if (use_tiled_encoding_order) {
-			return EntropyDecoderResidualsTiled().process(width, height, entropy_enabled, rle_only, b,
-			                                              dst_configuration.global_configuration.transform_block_size);
-		} else {
-			return EntropyDecoderResiduals().process(width, height, entropy_enabled, rle_only, b);
-		}
-
-	} else {
-		return EntropyDecoderTemporal().process(width, height, entropy_enabled, rle_only, b,
-		                                        dst_configuration.global_configuration.transform_block_size,
-		                                        dst_configuration.global_configuration.temporal_tile_intra_signalling_enabled);
-	}
-}
-
-static Surface assemble_layer(SignaledConfiguration &dst_configuration, unsigned plane, unsigned loq, unsigned layer,
-                              unsigned width, unsigned height, unsigned tiles_x, unsigned tiles_y, unsigned tile_width,
-                              unsigned tile_height, const std::vector<Surface> &tiles) {
-
-	if (is_temporal_layer(dst_configuration, plane, layer, loq)) {
-		std::vector<SurfaceView<uint8_t>> src;
-		for (const auto &t : tiles)
-			src.push_back(SurfaceView<uint8_t>(t));
-
-		return Surface::build_from<uint8_t>()
-		    .generate(width, height,
-		              [&](unsigned x, unsigned y) -> uint8_t {
-			              const unsigned tx = x / tile_width;
-			              const unsigned ty = y / tile_height;
-			              CHECK(tx < tiles_x);
-			              CHECK(ty < tiles_y);
-			              return src[ty * tiles_x + tx].read(x % tile_width, y % tile_height);
-		              })
-		    .finish();
-	} else {
-		std::vector<SurfaceView<int16_t>> src;
-		for (const auto &t : tiles)
-			src.push_back(SurfaceView<int16_t>(t));
-
-		return Surface::build_from<int16_t>()
-		    .generate(width, height,
-		              [&](unsigned x, unsigned y) -> int16_t {
-			              const unsigned tx = x / tile_width;
-			              const unsigned ty = y / tile_height;
-			              CHECK(tx < tiles_x);
-			              CHECK(ty < tiles_y);
-			              return src[ty * tiles_x + tx].read(x % tile_width, y % tile_height);
-		              })
-		    .finish();
-	}
-}
-
 void Deserializer::parse_encoded_data_tiled(SignaledConfiguration &dst_configuration, BitstreamUnpacker &b, unsigned num_planes,
                                             Surface symbols[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS]) {
 
@@ -938,6 +921,22 @@ void Deserializer::parse_encoded_data_tiled(SignaledConfiguration &dst_configura
 #endif
 		CHECK(b.u(1, "alignment") == 0);
 
+	// Locate every tile's payload first - each tile is entropy coded independently, so once all the spans are known
+	// they can be decoded in any order
+	struct TileData {
+		unsigned plane;
+		unsigned loq;
+		unsigned layer;
+		unsigned x;
+		unsigned y;
+		unsigned width;
+		unsigned height;
+		bool entropy_enabled;
+		Packet data;
+	};
+	std::vector<TileData> tile_data;
+	tile_data.reserve(total_tiles);
+
 	if (dst_configuration.global_configuration.compression_type_size_per_tile == CompressionType::CompressionType_None) {
 		// Uncompressed tile sizes and data
 		int idx = 0;
@@ -945,7 +944,6 @@ void Deserializer::parse_encoded_data_tiled(SignaledConfiguration &dst_configura
 			for (unsigned loq = 0; loq < MAX_NUM_LOQS; ++loq) {
 				for (unsigned layer = first_layer(dst_configuration); layer < total_layers(dst_configuration, plane, loq);
 				     ++layer) {
-					std::vector<Surface> tiles;
 					for (unsigned ty = 0; ty < sizes[plane][loq].tiles_y; ++ty) {
 						for (unsigned tx = 0; tx < sizes[plane][loq].tiles_x; ++tx) {
 							// Where is tile going to go?
@@ -962,17 +960,10 @@ void Deserializer::parse_encoded_data_tiled(SignaledConfiguration &dst_configura
 								CHECK(data_size < INT_MAX);
 								data = b.bytes((unsigned)data_size);
 							}
-							PacketView view(data);
-							BitstreamUnpacker pb(view);
-							tiles.push_back(decode_layer(dst_configuration, plane, loq, layer, tx1 - tx0, ty1 - ty0,
-							                             entropy_enabled[idx], rle_only[plane][loq][layer], pb));
+							tile_data.push_back({plane, loq, layer, tx0, ty0, tx1 - tx0, ty1 - ty0, entropy_enabled[idx], data});
 							idx++;
 						}
 					}
-					symbols[plane][loq][layer] =
-					    assemble_layer(dst_configuration, plane, layer, loq, sizes[plane][loq].width, sizes[plane][loq].height,
-					                   sizes[plane][loq].tiles_x, sizes[plane][loq].tiles_y, dimensions.tile_width(plane, loq),
-					                   dimensions.tile_height(plane, loq), tiles);
 				}
 			}
 		}
@@ -1010,8 +1001,6 @@ void Deserializer::parse_encoded_data_tiled(SignaledConfiguration &dst_configura
 
 					const auto data_sizes = sz.view_as<uint16_t>();
 
-					std::vector<Surface> tiles;
-
 					for (unsigned ty = 0; ty < sizes[plane][loq].tiles_y; ++ty) {
 						for (unsigned tx = 0; tx < sizes[plane][loq].tiles_x; ++tx) {
 							// Where is tile going to go?
@@ -1026,20 +1015,119 @@ void Deserializer::parse_encoded_data_tiled(SignaledConfiguration &dst_configura
 								CHECK(data_size < INT_MAX && data_size > 0);
 								data = b.bytes((unsigned)data_size);
 							}
-							PacketView view(data);
-							BitstreamUnpacker pb(view);
-							tiles.push_back(decode_layer(dst_configuration, plane, loq, layer, tx1 - tx0, ty1 - ty0,
-							                             entropy_enabled[idx], rle_only[plane][loq][layer], pb));
+							tile_data.push_back({plane, loq, layer, tx0, ty0, tx1 - tx0, ty1 - ty0, entropy_enabled[idx], data});
 							idx++;
 						}
 					}
+				}
+			}
+		}
+	}
 
-					symbols[plane][loq][layer] =
-					    assemble_layer(dst_configuration, plane, layer, loq, sizes[plane][loq].width, sizes[plane][loq].height,
-					                   sizes[plane][loq].tiles_x, sizes[plane][loq].tiles_y, dimensions.tile_width(plane, loq),
-					                   dimensions.tile_height(plane, loq), tiles);
+	// Entropy decode all tiles of all planes, LoQs and layers - straight into their place in a surface per layer, or with
+	// interleaving, residual tiles go into block interleaved coefficients
+	const unsigned num_residual_layers = dst_configuration.global_configuration.num_residual_layers;
+	const bool interleave = interleave_coefficients_ && first_layer(dst_configuration) == 0;
+	SurfaceBuilder<int16_t> layers[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS];
+	SurfaceBuilder<uint8_t> temporal[MAX_NUM_PLANES][MAX_NUM_LOQS];
+	SurfaceBuilder<int16_t> interleaved[MAX_NUM_PLANES][MAX_NUM_LOQS];
+	SurfaceBuilder<uint8_t> occupancy[MAX_NUM_PLANES][MAX_NUM_LOQS];
+	for (unsigned plane = 0; plane < dst_configuration.global_configuration.num_processed_planes; ++plane) {
+		for (unsigned loq = 0; loq < MAX_NUM_LOQS; ++loq) {
+			const unsigned width = sizes[plane][loq].width, height = sizes[plane][loq].height;
+			for (unsigned layer = first_layer(dst_configuration); layer < total_layers(dst_configuration, plane, loq); ++layer) {
+				if (is_temporal_layer(dst_configuration, plane, loq, layer)) {
+					// Packed mask - tiles only set the bits of intra blocks
+					temporal[plane][loq].reserve(width, height, temporal_mask_stride(width));
+					memset(temporal[plane][loq].data(), 0, height * temporal[plane][loq].stride());
+				} else if (!interleave) {
+					layers[plane][loq][layer].reserve(width, height);
 				}
 			}
+			if (interleave) {
+				interleaved[plane][loq].reserve(width * num_residual_layers, height);
+				occupancy[plane][loq].fill(0, width, height);
+			}
+		}
+	}
+
+	// Work items - tiles that write to the same memory are decoded by one worker, in order: with interleaving, all the
+	// residual layers of a tile, as they share blocks, and the temporal tiles of a row of tiles, as they share words
+	std::vector<std::vector<unsigned>> work;
+	std::map<std::tuple<bool, unsigned, unsigned, unsigned, unsigned>, unsigned> shared_work;
+	for (unsigned t = 0; t < tile_data.size(); ++t) {
+		const TileData &td = tile_data[t];
+		const bool is_temporal = is_temporal_layer(dst_configuration, td.plane, td.loq, td.layer);
+		if (!is_temporal && !interleave) {
+			work.push_back({t});
+			continue;
+		}
+
+		const auto key = std::make_tuple(is_temporal, td.plane, td.loq, is_temporal ? 0 : td.x, td.y);
+		if (shared_work.find(key) == shared_work.end()) {
+			shared_work[key] = static_cast<unsigned>(work.size());
+			work.push_back({});
+		}
+		work[shared_work[key]].push_back(t);
+	}
+
+#if BITSTREAM_DEBUG
+	// Keep the bitstream trace in syntax order
+	const unsigned num_threads = 1;
+#else
+	const unsigned num_threads = num_threads_;
+#endif
+
+	parallel_for(static_cast<unsigned>(work.size()), num_threads, [&](unsigned w) {
+		for (const unsigned t : work[w]) {
+			const TileData &td = tile_data[t];
+			if (!td.width || !td.height)
+				continue;
+
+			PacketView view(td.data);
+			BitstreamUnpacker pb(view);
+			if (is_temporal_layer(dst_configuration, td.plane, td.loq, td.layer)) {
+				const SurfaceBuilder<uint8_t> &dst = temporal[td.plane][td.loq];
+				const unsigned pitch = dst.stride() / sizeof(uint64_t);
+				EntropyDecoderTemporal().process_packed(
+				    td.width, td.height, td.entropy_enabled, rle_only[td.plane][td.loq][td.layer], pb,
+				    dst_configuration.global_configuration.transform_block_size,
+				    dst_configuration.global_configuration.temporal_tile_intra_signalling_enabled,
+				    reinterpret_cast<uint64_t *>(dst.data()) + td.y * pitch, pitch, td.x);
+			} else if (interleave) {
+				const SurfaceBuilder<int16_t> &dst = interleaved[td.plane][td.loq];
+				const SurfaceBuilder<uint8_t> &occ = occupancy[td.plane][td.loq];
+				const unsigned pitch = dst.stride() / sizeof(int16_t);
+				EntropyDecoderResidualsTiled().process(
+				    td.width, td.height, td.entropy_enabled, rle_only[td.plane][td.loq][td.layer], pb,
+				    dst_configuration.global_configuration.transform_block_size,
+				    dst.data() + td.y * pitch + td.x * num_residual_layers + td.layer, pitch, num_residual_layers,
+				    occ.data() + td.y * occ.stride() + td.x, occ.stride());
+			} else {
+				const SurfaceBuilder<int16_t> &dst = layers[td.plane][td.loq][td.layer];
+				const unsigned pitch = dst.stride() / sizeof(int16_t);
+				EntropyDecoderResidualsTiled().process(td.width, td.height, td.entropy_enabled,
+				                                       rle_only[td.plane][td.loq][td.layer], pb,
+				                                       dst_configuration.global_configuration.transform_block_size,
+				                                       dst.data() + td.y * pitch + td.x, pitch, 1);
+			}
+		}
+	});
+
+	// Hand over the layers
+	for (unsigned plane = 0; plane < dst_configuration.global_configuration.num_processed_planes; ++plane) {
+		for (unsigned loq = 0; loq < MAX_NUM_LOQS; ++loq) {
+			for (unsigned layer = first_layer(dst_configuration); layer < total_layers(dst_configuration, plane, loq); ++layer) {
+				if (is_temporal_layer(dst_configuration, plane, loq, layer))
+					symbols[plane][loq][layer] = temporal[plane][loq].finish();
+				else if (!interleave)
+					symbols[plane][loq][layer] = layers[plane][loq][layer].finish();
+			}
+
+			if (interleave) {
+				symbols[plane][loq][INTERLEAVED_COEFFICIENTS] = interleaved[plane][loq].finish();
+				symbols[plane][loq][INTERLEAVED_OCCUPANCY] = occupancy[plane][loq].finish();
+			}
 		}
 	}
 }
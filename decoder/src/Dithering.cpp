@@ -42,25 +42,49 @@
 
 namespace lctm {
 
-//// Pseudo-random number generator
-// RAND_MAX assumed to be 32767
-static unsigned long random_next;
-
+//// Pseudo-random number generators
+//
 int Random::rand() {
-	random_next = random_next * 1103515245 + 12345;
-	return ((unsigned)(random_next / 65536) % 32768);
+	next_ = next_ * 1103515245 + 12345;
+	return ((unsigned)(next_ / 65536) % 32768);
+}
+
+void Random::srand(unsigned seed) { next_ = seed; }
+
+int RandomAdditive::rand() {
+	state_[front_] += state_[rear_];
+	const int r = (int)(state_[front_] >> 1);
+	front_ = (front_ + 1) % DEGREE;
+	rear_ = (rear_ + 1) % DEGREE;
+	return r;
 }
 
-void Random::srand(unsigned seed) { random_next = seed; }
+void RandomAdditive::srand(unsigned seed) {
+	// Fill state from a Park-Miller generator, using Schrage's method to avoid overflow
+	int32_t word = seed ? (int32_t)seed : 1;
+	state_[0] = (uint32_t)word;
+	for (unsigned i = 1; i < DEGREE; ++i) {
+		const int32_t hi = word / 127773, lo = word % 127773;
+		word = 16807 * lo - 2836 * hi;
+		if (word < 0)
+			word += 2147483647;
+		state_[i] = (uint32_t)word;
+	}
+
+	front_ = SEPARATION;
+	rear_ = 0;
+	for (unsigned i = 0; i < 10 * DEGREE; ++i)
+		rand();
+}
 
 void Dithering::make_buffer(int strength, int enhancement_depth, bool fixed_seed) {
 	strength = strength * (1 << (15 - enhancement_depth)); // scale to the internal 15 bit per pixel representation
 	if (fixed_seed)
-		Random().srand(45721);
+		buffer_random_.srand(45721);
 	else
-		Random().srand((unsigned)time(nullptr));
+		buffer_random_.srand((unsigned)time(nullptr));
 	for (unsigned i = 0; i < DITHER_BUFFER_SIZE; i++)
-		maiDitheringBuffer[i] = abs(Random().rand()) % (2 * strength + 1) - strength;
+		maiDitheringBuffer[i] = abs(buffer_random_.rand()) % (2 * strength + 1) - strength;
 }
 
 Surface Dithering::process(/* const */ Surface &src_plane, unsigned block_size) {
@@ -73,7 +97,7 @@ Surface Dithering::process(/* const */ Surface &src_plane, unsigned block_size)
 	for (unsigned y = 0; y < height; y += block_size) {
 		for (unsigned x = 0; x < width; x += block_size) {
 			// initialize to a random position in DitheringBuffer
-			const int32_t *dither_buffer = &(maiDitheringBuffer[rand() % (DITHER_BUFFER_SIZE - block_size * block_size)]);
+			const int32_t *dither_buffer = &(maiDitheringBuffer[offset_random_.rand() % (DITHER_BUFFER_SIZE - block_size * block_size)]);
 			for (unsigned h = 0; h < block_size; h++) {
 				for (unsigned k = 0; k < block_size; k++) {
 					*dst_plane.data(x + k, y + h) = src_view.read(x + k, y + h) + *dither_buffer++;
@@ -44,6 +44,8 @@
 
 #include "Diagnostics.hpp"
 
+#include <cstring>
+
 namespace lctm {
 
 //// SymbolSource
@@ -176,52 +178,83 @@ EntropyDecoderResidualsBase::rle_pel_t EntropyDecoderResidualsBase::decode_pel(S
 	return r;
 }
 
+// Decode 'count' symbols to dst[0], dst[step], ... - runs of zeros are written in bulk, and any non-zero symbol
+// marks the matching entry of 'occupied' (if given)
+//
+void EntropyDecoderResidualsBase::decode_span(SymbolSource &source, rle_pel_t &current, int16_t *dst, unsigned count,
+                                              unsigned step, uint8_t *occupied) const {
+	unsigned x = 0;
+	while (x < count) {
+		if (current.zero_runlength > 0) {
+			// Extend the run of zeros
+			const unsigned n = LCEVC_MIN(current.zero_runlength, count - x);
+			if (step == 1) {
+				memset(dst + x, 0, n * sizeof(int16_t));
+			} else {
+				int16_t *__restrict pdst = dst + x * step;
+				for (unsigned i = 0; i < n; ++i, pdst += step)
+					*pdst = 0;
+			}
+			current.zero_runlength -= n;
+			x += n;
+		} else {
+			// Write PEL value
+			current = decode_pel(source);
+			dst[x * step] = current.pel;
+			if (occupied && current.pel)
+				occupied[x] = 1;
+			++x;
+		}
+	}
+}
+
 // Decoding full frame raster order
 Surface EntropyDecoderResiduals::process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only,
                                          BitstreamUnpacker &b) {
-	// Set up source of symbols - empty layers are have a constant value of 0x40
-	const auto symbol_source(create_symbol_source(STATE_COUNT, entropy_enabled, rle_only, b, 0x40));
-
 	// Make the new surface
 	auto dest = Surface::build_from<int16_t>();
 	dest.reserve(width, height);
 
+	if (width && height)
+		process(width, height, entropy_enabled, rle_only, b, dest.data(), dest.stride() / sizeof(int16_t), 1);
+
+	return dest.finish();
+}
+
+void EntropyDecoderResiduals::process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b,
+                                      int16_t *dst, unsigned pitch, unsigned step, uint8_t *occupancy, unsigned occupancy_pitch) {
+	// Set up source of symbols - empty layers are have a constant value of 0x40
+	const auto symbol_source(create_symbol_source(STATE_COUNT, entropy_enabled, rle_only, b, 0x40));
+
 	// Current PEL/run value
 	rle_pel_t current = {0, 0};
 
 	// Read any huffman tables
 	symbol_source->start();
 
-	for (unsigned y = 0; y < height; ++y) {
-		int16_t *__restrict pdst = dest.data(0, y);
-		for (unsigned x = 0; x < width; ++x) {
-			if (current.zero_runlength > 0) {
-				// Extend the run of zeros
-				// dest.write(x, y, 0);
-				*pdst++ = 0;
-				--current.zero_runlength;
-			} else {
-				// Write PEL value
-				current = decode_pel(*symbol_source);
-				// dest.write(x, y, current.pel);
-				*pdst++ = current.pel;
-			}
-		}
-	}
-
-	return dest.finish();
+	for (unsigned y = 0; y < height; ++y)
+		decode_span(*symbol_source, current, dst + y * pitch, width, step, occupancy ? occupancy + y * occupancy_pitch : nullptr);
 }
 
 // Decoding in coding unit order
 Surface EntropyDecoderResidualsTiled::process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only,
                                               BitstreamUnpacker &b, unsigned transform_block_size) {
-	// Set up source of symbols - empty layers are have a constant value of 0x40
-	const auto symbol_source(create_symbol_source(STATE_COUNT, entropy_enabled, rle_only, b, 0x40));
-
 	// Make the new surface
 	auto dest = Surface::build_from<int16_t>();
 	dest.reserve(width, height);
 
+	if (width && height)
+		process(width, height, entropy_enabled, rle_only, b, transform_block_size, dest.data(), dest.stride() / sizeof(int16_t), 1);
+
+	return dest.finish();
+}
+
+void EntropyDecoderResidualsTiled::process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only,
+                                           BitstreamUnpacker &b, unsigned transform_block_size, int16_t *dst, unsigned pitch,
+                                           unsigned step, uint8_t *occupancy, unsigned occupancy_pitch) {
+	// Set up source of symbols - empty layers are have a constant value of 0x40
+	const auto symbol_source(create_symbol_source(STATE_COUNT, entropy_enabled, rle_only, b, 0x40));
+
 	// Divisor for block->tiles
 	const unsigned d = 32 / transform_block_size;
 
@@ -235,28 +268,11 @@ Surface EntropyDecoderResidualsTiled::process(unsigned width, unsigned height, b
 		for (unsigned tx = 0; tx < width; tx += d) {
 
 			// For each transform in tile
-			// for (unsigned y = ty; y < std::min(ty + d, height); ++y) {
-			for (unsigned y = ty; y < LCEVC_MIN(ty + d, height); ++y) {
-				//				int16_t *__restrict pdst = dest.data(tx, y);
-				// for (unsigned x = tx; x < std::min(tx + d, width); ++x) {
-				for (unsigned x = tx; x < LCEVC_MIN(tx + d, width); ++x) {
-					if (current.zero_runlength > 0) {
-						// Extend the run of zeros
-						dest.write(x, y, 0);
-						//						*pdst++ = 0;
-						--current.zero_runlength;
-					} else {
-						// Write PEL value
-						current = decode_pel(*symbol_source);
-						dest.write(x, y, current.pel);
-						//						*pdst++ = current.pel;
-					}
-				}
-			}
+			for (unsigned y = ty; y < LCEVC_MIN(ty + d, height); ++y)
+				decode_span(*symbol_source, current, dst + y * pitch + tx * step, LCEVC_MIN(tx + d, width) - tx, step,
+				            occupancy ? occupancy + y * occupancy_pitch + tx : nullptr);
 		}
 	}
-
-	return dest.finish();
 }
 
 //// EntropyDecoderTemporal
@@ -276,14 +292,30 @@ unsigned EntropyDecoderTemporal::decode_run(SymbolSource &source, bool symbol) c
 
 Surface EntropyDecoderTemporal::process(unsigned width, unsigned height, bool entropy_enabled, bool rle_only, BitstreamUnpacker &b,
                                         unsigned transform_block_size, bool use_reduced_signalling) {
-	const auto symbol_source(create_symbol_source(STATE_COUNT, entropy_enabled, rle_only, b, 0));
+	return TemporalMaskUnpack().process(
+	    process_packed(width, height, entropy_enabled, rle_only, b, transform_block_size, use_reduced_signalling));
+}
 
-	// Make the new surface
+Surface EntropyDecoderTemporal::process_packed(unsigned width, unsigned height, bool entropy_enabled, bool rle_only,
+                                               BitstreamUnpacker &b, unsigned transform_block_size, bool use_reduced_signalling) {
+	// Make the new surface - all predicted, so only intra runs are written
 	auto dest = Surface::build_from<uint8_t>();
-	dest.reserve(width, height);
+	dest.reserve(width, height, temporal_mask_stride(width));
+	memset(dest.data(), 0, height * dest.stride());
+
+	process_packed(width, height, entropy_enabled, rle_only, b, transform_block_size, use_reduced_signalling,
+	               reinterpret_cast<uint64_t *>(dest.data()), dest.stride() / sizeof(uint64_t), 0);
+
+	return dest.finish();
+}
+
+void EntropyDecoderTemporal::process_packed(unsigned width, unsigned height, bool entropy_enabled, bool rle_only,
+                                            BitstreamUnpacker &b, unsigned transform_block_size, bool use_reduced_signalling,
+                                            uint64_t *dst, unsigned pitch, unsigned x0) {
+	const auto symbol_source(create_symbol_source(STATE_COUNT, entropy_enabled, rle_only, b, 0));
 
 	if (!entropy_enabled)
-		return dest.fill(TemporalType::TEMPORAL_PRED, width, height).finish();
+		return;
 
 	// Divisor for block->tiles
 	const unsigned d = 32 / transform_block_size;
@@ -299,41 +331,44 @@ Surface EntropyDecoderTemporal::process(unsigned width, unsigned height, bool en
 	// For each tile ..
 	for (unsigned ty = 0; ty < height; ty += d) {
 		for (unsigned tx = 0; tx < width; tx += d) {
+			const unsigned tile_right = LCEVC_MIN(tx + d, width);
 
 			bool intra_tile = false;
-			// For each transform in tile
-			// for (unsigned y = ty; y < std::min(ty + d, height); ++y) {
+			// For each row of transforms in tile
 			for (unsigned y = ty; y < LCEVC_MIN(ty + d, height); ++y) {
-				uint8_t *__restrict pdst = dest.data(tx, y);
-				// for (unsigned x = tx; x < std::min(tx + d, width); ++x) {
-				for (unsigned x = tx; x < LCEVC_MIN(tx + d, width); ++x) {
+				uint64_t *row = dst + y * pitch;
+				unsigned x = tx;
+				while (x < tile_right) {
 					if (use_reduced_signalling && intra_tile) {
 						// The whole tile was flagged as intra
-						*pdst++ = TemporalType::TEMPORAL_INTR;
-					} else {
-						// Get next symbol
-						while (count == 0) {
-							// Flip symbol and get next count
-							symbol = !symbol;
-							count = decode_run(*symbol_source, symbol);
-						}
-
-						// Check for intra tile
-						if (use_reduced_signalling && symbol && tx == x && ty == y)
-							intra_tile = true;
-
-						// Write to dst
-						// dest.write(x, y, symbol ? TemporalType::TEMPORAL_INTR : TemporalType::TEMPORAL_PRED);
-						*pdst++ = (symbol ? TemporalType::TEMPORAL_INTR : TemporalType::TEMPORAL_PRED);
-
-						count--;
+						temporal_mask_fill(row, x0 + x, x0 + tile_right);
+						break;
 					}
+
+					// Get next symbol
+					while (count == 0) {
+						// Flip symbol and get next count
+						symbol = !symbol;
+						count = decode_run(*symbol_source, symbol);
+					}
+
+					// Check for intra tile - the first transform of the tile carries the flag
+					unsigned n = LCEVC_MIN(count, tile_right - x);
+					if (use_reduced_signalling && tx == x && ty == y) {
+						intra_tile = symbol;
+						n = 1;
+					}
+
+					// Write the run, or as much of it as is on this row of the tile
+					if (symbol)
+						temporal_mask_fill(row, x0 + x, x0 + x + n);
+
+					x += n;
+					count -= n;
 				}
 			}
 		}
 	}
-
-	return dest.finish();
 }
 
 //// EntropyDecoderFlags
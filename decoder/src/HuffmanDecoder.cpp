@@ -124,41 +124,80 @@ void HuffmanDecoder::read_codes(BitstreamUnpacker &b) {
 		}
 		c->value = current_value++;
 	}
+
+	max_code_length_ = max_code_length;
+	build_lookup();
 }
 
-unsigned HuffmanDecoder::decode_symbol(BitstreamUnpacker &b) {
-	BitstreamUnpacker::ScopedContextLabel label(b, "entropy_symb");
+// Build the lookup table from the numbered codes
+//
+// Every code of up to 'lookup_bits_' fills all the entries that start with its value. Longer codes leave their
+// entries empty, and are found by searching 'long_codes_'.
+//
+void HuffmanDecoder::build_lookup() {
+	lookup_bits_ = LCEVC_MIN(max_code_length_, LOOKUP_BITS);
+	lookup_.assign(1U << lookup_bits_, LookupEntry{0, 0, 0});
+	long_codes_.clear();
+
+	for (unsigned i = 0; i < codes_.size(); ++i) {
+		const HuffmanCode &c = codes_[i];
+		if (c.bits > lookup_bits_ || c.bits == 0) {
+			long_codes_.push_back((uint16_t)i);
+			continue;
+		}
 
+		const unsigned shift = lookup_bits_ - c.bits;
+		const unsigned first = c.value << shift;
+		const unsigned last = (c.value + 1) << shift;
+		CHECK(last <= lookup_.size());
+		for (unsigned e = first; e < last; ++e)
+			lookup_[e] = LookupEntry{(uint8_t)c.symbol, (uint8_t)c.bits, (uint16_t)i};
+	}
+}
+
+unsigned HuffmanDecoder::decode_symbol(BitstreamUnpacker &b) {
 	if (codes_.empty())
 		return single_symbol_;
 
-	// Codes are sorted by increaing bit-length
-	//
-	// Check each code, adding bits to current value as necessary a match is found
+	// Codes that fit the table are resolved with one lookup
 	//
+	unsigned code = 0;
 	unsigned bits = 0;
-	unsigned value = 0;
-	for (auto &c : codes_) {
-		while (bits < c.bits) {
-			value = (value << 1) | b.u(1);
-			++bits;
-		}
-		if (value == c.value) {
-#if BITSTREAM_DEBUG
-			char acString[128];
-			sprintf(acString, "u(%2u, \"%s\")", bits, "entropy_symb.codebits");
-			fprintf(goBits, "%-64s => %4u (0x%02x)  [%8d]\n", acString, value, value, b.bit_offset());
-			fflush(goBits);
-			goStat.Update(acString, bits);
-#endif
-			c.count++;
-			return c.symbol;
+	const LookupEntry &entry = lookup_[b.peek(lookup_bits_)];
+
+	if (entry.bits) {
+		code = entry.code;
+		bits = entry.bits;
+	} else {
+		// Check each longer code against enough bits for the longest
+		//
+		const uint32_t value = b.peek(max_code_length_);
+		unsigned i = 0;
+		for (; i < long_codes_.size(); ++i) {
+			const HuffmanCode &c = codes_[long_codes_[i]];
+			if ((value >> (max_code_length_ - c.bits)) == c.value)
+				break;
 		}
+
+		// Failed to find matching symbol - something is wrong
+		CHECK(i < long_codes_.size());
+
+		code = long_codes_[i];
+		bits = codes_[code].bits;
 	}
 
-	// Failed to find matching symbol - something is wrong
-	CHECK(0);
-	return 0;
+	b.skip(bits);
+
+	HuffmanCode &c = codes_[code];
+#if BITSTREAM_DEBUG
+	char acString[128];
+	sprintf(acString, "u(%2u, \"%s\")", bits, "entropy_symb.codebits");
+	fprintf(goBits, "%-64s => %4u (0x%02x)  [%8d]\n", acString, c.value, c.value, b.bit_offset());
+	fflush(goBits);
+	goStat.Update(acString, bits);
+#endif
+	c.count++;
+	return c.symbol;
 }
 
 } // namespace lctm
@@ -351,4 +351,29 @@ Surface InverseQuantize_SWM::process(const Surface &src_plane, unsigned transfor
 #endif
 }
 
+Surface InverseQuantize_SWM::process_packed(const Surface &src_plane, int32_t *layer_step_width, int32_t *applied_dequant_offset,
+                                            const Surface &temporal_mask) {
+	const auto src = src_plane.view_as<int16_t>();
+	const auto mask = temporal_mask.view_as<uint8_t>();
+
+	auto dest = Surface::build_from<int16_t>();
+	dest.reserve(src_plane.width(), src_plane.height());
+	for (unsigned y = 0; y < src_plane.height(); ++y) {
+		const int16_t *__restrict psrc = src.data(0, y);
+		const uint64_t *pmask = temporal_mask_row(mask, y);
+		int16_t *__restrict pdst = dest.data(0, y);
+		for (unsigned x = 0; x < src_plane.width(); ++x) {
+			const unsigned sw_index = temporal_mask_intra(pmask, x) ? 1 : 0;
+			const int16_t c = psrc[x];
+			int16_t out = 0;
+			if (c > 0)
+				out = clamp_int16(c * layer_step_width[sw_index] + applied_dequant_offset[sw_index]);
+			else if (c < 0)
+				out = clamp_int16(c * layer_step_width[sw_index] - applied_dequant_offset[sw_index]);
+			pdst[x] = out;
+		}
+	}
+	return dest.finish();
+}
+
 } // namespace lctm
@@ -38,6 +38,16 @@
 
 #include "InverseTransformDDS.hpp"
 
+#include "CpuFeatures.hpp"
+#include "Misc.hpp"
+
+#include <cstring>
+#include <memory>
+
+#if LCEVC_SIMD_X86
+#include <immintrin.h>
+#endif
+
 namespace lctm {
 
 // Basis for the Inverse DDS
@@ -67,6 +77,89 @@ namespace lctm {
 // 		{+1, -1, -1, +1, -1, +1, +1, -1, -1, +1, +1, -1, +1, -1, -1, +1}, // 3,3
 // 	}};
 
+// The basis above is a 16 point Walsh-Hadamard transform: after the butterflies below, result 'm' is the sum of
+// c[k] * (-1)^popcount(k & m), and sample (dx, dy) of a block is result ((dx & 2) >> 1) | (dy & 2) | ((dx & 1) << 2) | ((dy & 1) << 3).
+//
+static const unsigned dds_output_index[4][4] = {
+    {0, 4, 1, 5},
+    {8, 12, 9, 13},
+    {2, 6, 3, 7},
+    {10, 14, 11, 15},
+};
+
+#if LCEVC_SIMD_X86
+// The SIMD kernels hold one block per 16 bit lane, so need no shuffles until the output is interleaved back into rows.
+// 16 bit wrap around matches the truncating store of the plain C version.
+//
+
+LCEVC_TARGET_SSE41 static unsigned inverse_dds_sse41(int16_t *const pd[4], const int16_t *const pc[16], unsigned blocks) {
+	unsigned x = 0;
+	for (; x + 8 <= blocks; x += 8) {
+		__m128i v[16];
+		for (unsigned k = 0; k < 16; ++k)
+			v[k] = _mm_loadu_si128((const __m128i *)(pc[k] + x));
+
+		for (unsigned b = 1; b < 16; b <<= 1)
+			for (unsigned k = 0; k < 16; ++k)
+				if (!(k & b)) {
+					const __m128i t = v[k];
+					v[k] = _mm_add_epi16(t, v[k | b]);
+					v[k | b] = _mm_sub_epi16(t, v[k | b]);
+				}
+
+		for (unsigned dy = 0; dy < 4; ++dy) {
+			const unsigned *m = dds_output_index[dy];
+			const __m128i a = _mm_unpacklo_epi16(v[m[0]], v[m[1]]);
+			const __m128i b = _mm_unpackhi_epi16(v[m[0]], v[m[1]]);
+			const __m128i c = _mm_unpacklo_epi16(v[m[2]], v[m[3]]);
+			const __m128i d = _mm_unpackhi_epi16(v[m[2]], v[m[3]]);
+			int16_t *dst = pd[dy] + 4 * x;
+			_mm_storeu_si128((__m128i *)(dst + 0), _mm_unpacklo_epi32(a, c));
+			_mm_storeu_si128((__m128i *)(dst + 8), _mm_unpackhi_epi32(a, c));
+			_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpacklo_epi32(b, d));
+			_mm_storeu_si128((__m128i *)(dst + 24), _mm_unpackhi_epi32(b, d));
+		}
+	}
+	return x;
+}
+
+// As SSE4.1 version, 16 blocks at a time - the unpacks work within 128 bit lanes, so the halves are recombined on store
+LCEVC_TARGET_AVX2 static unsigned inverse_dds_avx2(int16_t *const pd[4], const int16_t *const pc[16], unsigned blocks) {
+	unsigned x = 0;
+	for (; x + 16 <= blocks; x += 16) {
+		__m256i v[16];
+		for (unsigned k = 0; k < 16; ++k)
+			v[k] = _mm256_loadu_si256((const __m256i *)(pc[k] + x));
+
+		for (unsigned b = 1; b < 16; b <<= 1)
+			for (unsigned k = 0; k < 16; ++k)
+				if (!(k & b)) {
+					const __m256i t = v[k];
+					v[k] = _mm256_add_epi16(t, v[k | b]);
+					v[k | b] = _mm256_sub_epi16(t, v[k | b]);
+				}
+
+		for (unsigned dy = 0; dy < 4; ++dy) {
+			const unsigned *m = dds_output_index[dy];
+			const __m256i a = _mm256_unpacklo_epi16(v[m[0]], v[m[1]]);
+			const __m256i b = _mm256_unpackhi_epi16(v[m[0]], v[m[1]]);
+			const __m256i c = _mm256_unpacklo_epi16(v[m[2]], v[m[3]]);
+			const __m256i d = _mm256_unpackhi_epi16(v[m[2]], v[m[3]]);
+			const __m256i q0 = _mm256_unpacklo_epi32(a, c); // blocks 0,1  | 8,9
+			const __m256i q1 = _mm256_unpackhi_epi32(a, c); // blocks 2,3  | 10,11
+			const __m256i q2 = _mm256_unpacklo_epi32(b, d); // blocks 4,5  | 12,13
+			const __m256i q3 = _mm256_unpackhi_epi32(b, d); // blocks 6,7  | 14,15
+			int16_t *dst = pd[dy] + 4 * x;
+			_mm256_storeu_si256((__m256i *)(dst + 0), _mm256_permute2x128_si256(q0, q1, 0x20));
+			_mm256_storeu_si256((__m256i *)(dst + 16), _mm256_permute2x128_si256(q2, q3, 0x20));
+			_mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(q0, q1, 0x31));
+			_mm256_storeu_si256((__m256i *)(dst + 48), _mm256_permute2x128_si256(q2, q3, 0x31));
+		}
+	}
+	return x;
+}
+#endif
+
 Surface InverseTransformDDS::process(int width, int height, const Surface src_layers[]) {
 	const SurfaceView<int16_t> coeffs[16] = {
 	    SurfaceView<int16_t>(src_layers[0]),  SurfaceView<int16_t>(src_layers[1]),  SurfaceView<int16_t>(src_layers[2]),
@@ -79,29 +172,47 @@ Surface InverseTransformDDS::process(int width, int height, const Surface src_la
 	auto dst = Surface::build_from<int16_t>();
 	dst.reserve(width, height);
 #if defined __OPT_MATRIX__
+	const unsigned blocks = static_cast<unsigned>(width) / 4;
+#if LCEVC_SIMD_X86
+	const unsigned features = cpu_features();
+#endif
 	for (unsigned y = 0; y < static_cast<unsigned>(height) / 4; y++) {
 		unsigned dy = y * 4;
-		const int16_t *pc00 = coeffs[0].data(0, y);
-		const int16_t *pc01 = coeffs[1].data(0, y);
-		const int16_t *pc02 = coeffs[2].data(0, y);
-		const int16_t *pc03 = coeffs[3].data(0, y);
-		const int16_t *pc04 = coeffs[4].data(0, y);
-		const int16_t *pc05 = coeffs[5].data(0, y);
-		const int16_t *pc06 = coeffs[6].data(0, y);
-		const int16_t *pc07 = coeffs[7].data(0, y);
-		const int16_t *pc08 = coeffs[8].data(0, y);
-		const int16_t *pc09 = coeffs[9].data(0, y);
-		const int16_t *pc10 = coeffs[10].data(0, y);
-		const int16_t *pc11 = coeffs[11].data(0, y);
-		const int16_t *pc12 = coeffs[12].data(0, y);
-		const int16_t *pc13 = coeffs[13].data(0, y);
-		const int16_t *pc14 = coeffs[14].data(0, y);
-		const int16_t *pc15 = coeffs[15].data(0, y);
-		int16_t *pd00 = dst.data(0, dy + 0);
-		int16_t *pd01 = dst.data(0, dy + 1);
-		int16_t *pd02 = dst.data(0, dy + 2);
-		int16_t *pd03 = dst.data(0, dy + 3);
-		for (unsigned x = 0; x < static_cast<unsigned>(width) / 4; x++) {
+		unsigned x = 0;
+#if LCEVC_SIMD_X86
+		if (features) {
+			const int16_t *pc[16];
+			for (unsigned k = 0; k < 16; ++k)
+				pc[k] = coeffs[k].data(0, y);
+			int16_t *const pd[4] = {dst.data(0, dy + 0), dst.data(0, dy + 1), dst.data(0, dy + 2), dst.data(0, dy + 3)};
+			if (features & CpuFeature_AVX2)
+				x = inverse_dds_avx2(pd, pc, blocks);
+			else if (features & CpuFeature_SSE41)
+				x = inverse_dds_sse41(pd, pc, blocks);
+		}
+#endif
+		// Remaining blocks
+		const int16_t *pc00 = coeffs[0].data(0, y) + x;
+		const int16_t *pc01 = coeffs[1].data(0, y) + x;
+		const int16_t *pc02 = coeffs[2].data(0, y) + x;
+		const int16_t *pc03 = coeffs[3].data(0, y) + x;
+		const int16_t *pc04 = coeffs[4].data(0, y) + x;
+		const int16_t *pc05 = coeffs[5].data(0, y) + x;
+		const int16_t *pc06 = coeffs[6].data(0, y) + x;
+		const int16_t *pc07 = coeffs[7].data(0, y) + x;
+		const int16_t *pc08 = coeffs[8].data(0, y) + x;
+		const int16_t *pc09 = coeffs[9].data(0, y) + x;
+		const int16_t *pc10 = coeffs[10].data(0, y) + x;
+		const int16_t *pc11 = coeffs[11].data(0, y) + x;
+		const int16_t *pc12 = coeffs[12].data(0, y) + x;
+		const int16_t *pc13 = coeffs[13].data(0, y) + x;
+		const int16_t *pc14 = coeffs[14].data(0, y) + x;
+		const int16_t *pc15 = coeffs[15].data(0, y) + x;
+		int16_t *pd00 = dst.data(0, dy + 0) + 4 * x;
+		int16_t *pd01 = dst.data(0, dy + 1) + 4 * x;
+		int16_t *pd02 = dst.data(0, dy + 2) + 4 * x;
+		int16_t *pd03 = dst.data(0, dy + 3) + 4 * x;
+		for (; x < blocks; x++) {
 			// unsigned dx = x * 4;
 			int16_t c00 = *pc00++;
 			int16_t c01 = *pc01++;
@@ -247,4 +358,52 @@ Surface InverseTransformDDS::process(int width, int height, const Surface src_la
 	return dst.finish();
 }
 
+// One 4x4 block from its 16 contiguous coefficients - the Walsh-Hadamard butterflies, then reorder into the block
+//
+static inline void inverse_dds_block(const int16_t c[16], int16_t r[4][4]) {
+	int16_t w[16];
+	memcpy(w, c, sizeof(w));
+	for (unsigned b = 1; b < 16; b <<= 1)
+		for (unsigned k = 0; k < 16; ++k)
+			if (!(k & b)) {
+				const int16_t t = w[k];
+				w[k] = t + w[k | b];
+				w[k | b] = t - w[k | b];
+			}
+
+	for (unsigned dy = 0; dy < 4; ++dy)
+		for (unsigned dx = 0; dx < 4; ++dx)
+			r[dy][dx] = w[dds_output_index[dy][dx]];
+}
+
+Surface InverseTransformDDS::process_interleaved(int width, int height, const Surface &coefficients, const Surface &occupancy) {
+	const unsigned w = (unsigned)width, h = (unsigned)height;
+	const auto src = coefficients.view_as<int16_t>();
+	std::unique_ptr<SurfaceView<uint8_t>> occupied;
+	if (!occupancy.empty())
+		occupied.reset(new SurfaceView<uint8_t>(occupancy));
+	CHECK(src.width() >= 16 * ((w + 3) / 4) && src.height() >= (h + 3) / 4);
+
+	auto dst = Surface::build_from<int16_t>();
+	dst.reserve(w, h);
+
+	for (unsigned y = 0; y < h; y += 4) {
+		const int16_t *pc = src.data(0, y / 4);
+		const uint8_t *po = occupied ? occupied->data(0, y / 4) : nullptr;
+		const unsigned rows = LCEVC_MIN(4u, h - y);
+		for (unsigned x = 0; x < w; x += 4, pc += 16) {
+			int16_t r[4][4];
+			if (!po || po[x / 4])
+				inverse_dds_block(pc, r);
+			else
+				memset(r, 0, sizeof(r));
+			const unsigned cols = LCEVC_MIN(4u, w - x);
+			for (unsigned dy = 0; dy < rows; ++dy)
+				memcpy(dst.data(0, y + dy) + x, r[dy], cols * sizeof(int16_t));
+		}
+	}
+
+	return dst.finish();
+}
+
 } // namespace lctm
@@ -37,9 +37,168 @@
 
 #include "InverseTransformDDS_1D.hpp"
 
+#include "CpuFeatures.hpp"
+#include "Misc.hpp"
+
+#include <cstring>
+#include <memory>
+
+#if LCEVC_SIMD_X86
+#include <immintrin.h>
+#endif
+
 namespace lctm {
 
+#if LCEVC_SIMD_X86
+// A row of 4x4 blocks at a time, one block per 16 bit lane.
+//
+// Each group of four coefficients g = c[4g..4g+3] gets a 4 point Walsh-Hadamard transform w[g][m], with
+// m = (dx >> 1) | (dy & 2). The groups then combine according to (dx & 1, dy & 1):
+//
+//   (0,0) = w0 + (w1 + w3)   (1,0) = w0 - (w1 + w3)
+//   (0,1) = w2 + (w1 - w3)   (1,1) = w2 - (w1 - w3)
+//
+LCEVC_TARGET_SSE41 static unsigned inverse_dds_1d_sse41(int16_t *const pd[4], const int16_t *const pc[16], unsigned blocks) {
+	unsigned x = 0;
+	for (; x + 8 <= blocks; x += 8) {
+		__m128i w[16];
+		for (unsigned k = 0; k < 16; ++k)
+			w[k] = _mm_loadu_si128((const __m128i *)(pc[k] + x));
+
+		for (unsigned g = 0; g < 16; g += 4) {
+			const __m128i s01 = _mm_add_epi16(w[g + 0], w[g + 1]), d01 = _mm_sub_epi16(w[g + 0], w[g + 1]);
+			const __m128i s23 = _mm_add_epi16(w[g + 2], w[g + 3]), d23 = _mm_sub_epi16(w[g + 2], w[g + 3]);
+			w[g + 0] = _mm_add_epi16(s01, s23);
+			w[g + 1] = _mm_add_epi16(d01, d23);
+			w[g + 2] = _mm_sub_epi16(s01, s23);
+			w[g + 3] = _mm_sub_epi16(d01, d23);
+		}
+
+		for (unsigned dy = 0; dy < 4; ++dy) {
+			__m128i r[4];
+			for (unsigned m = (dy & 2); m < (dy & 2) + 2; ++m) {
+				const unsigned dx = (m & 1) << 1;
+				if (dy & 1) {
+					const __m128i d = _mm_sub_epi16(w[4 + m], w[12 + m]);
+					r[dx + 0] = _mm_add_epi16(w[8 + m], d);
+					r[dx + 1] = _mm_sub_epi16(w[8 + m], d);
+				} else {
+					const __m128i s = _mm_add_epi16(w[4 + m], w[12 + m]);
+					r[dx + 0] = _mm_add_epi16(w[0 + m], s);
+					r[dx + 1] = _mm_sub_epi16(w[0 + m], s);
+				}
+			}
+
+			const __m128i a = _mm_unpacklo_epi16(r[0], r[1]);
+			const __m128i b = _mm_unpackhi_epi16(r[0], r[1]);
+			const __m128i c = _mm_unpacklo_epi16(r[2], r[3]);
+			const __m128i d = _mm_unpackhi_epi16(r[2], r[3]);
+			int16_t *dst = pd[dy] + 4 * x;
+			_mm_storeu_si128((__m128i *)(dst + 0), _mm_unpacklo_epi32(a, c));
+			_mm_storeu_si128((__m128i *)(dst + 8), _mm_unpackhi_epi32(a, c));
+			_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpacklo_epi32(b, d));
+			_mm_storeu_si128((__m128i *)(dst + 24), _mm_unpackhi_epi32(b, d));
+		}
+	}
+	return x;
+}
+
+LCEVC_TARGET_AVX2 static unsigned inverse_dds_1d_avx2(int16_t *const pd[4], const int16_t *const pc[16], unsigned blocks) {
+	unsigned x = 0;
+	for (; x + 16 <= blocks; x += 16) {
+		__m256i w[16];
+		for (unsigned k = 0; k < 16; ++k)
+			w[k] = _mm256_loadu_si256((const __m256i *)(pc[k] + x));
+
+		for (unsigned g = 0; g < 16; g += 4) {
+			const __m256i s01 = _mm256_add_epi16(w[g + 0], w[g + 1]), d01 = _mm256_sub_epi16(w[g + 0], w[g + 1]);
+			const __m256i s23 = _mm256_add_epi16(w[g + 2], w[g + 3]), d23 = _mm256_sub_epi16(w[g + 2], w[g + 3]);
+			w[g + 0] = _mm256_add_epi16(s01, s23);
+			w[g + 1] = _mm256_add_epi16(d01, d23);
+			w[g + 2] = _mm256_sub_epi16(s01, s23);
+			w[g + 3] = _mm256_sub_epi16(d01, d23);
+		}
+
+		for (unsigned dy = 0; dy < 4; ++dy) {
+			__m256i r[4];
+			for (unsigned m = (dy & 2); m < (dy & 2) + 2; ++m) {
+				const unsigned dx = (m & 1) << 1;
+				if (dy & 1) {
+					const __m256i d = _mm256_sub_epi16(w[4 + m], w[12 + m]);
+					r[dx + 0] = _mm256_add_epi16(w[8 + m], d);
+					r[dx + 1] = _mm256_sub_epi16(w[8 + m], d);
+				} else {
+					const __m256i s = _mm256_add_epi16(w[4 + m], w[12 + m]);
+					r[dx + 0] = _mm256_add_epi16(w[0 + m], s);
+					r[dx + 1] = _mm256_sub_epi16(w[0 + m], s);
+				}
+			}
+
+			// Unpacks work within 128 bit lanes - recombine halves on store
+			const __m256i a = _mm256_unpacklo_epi16(r[0], r[1]);
+			const __m256i b = _mm256_unpackhi_epi16(r[0], r[1]);
+			const __m256i c = _mm256_unpacklo_epi16(r[2], r[3]);
+			const __m256i d = _mm256_unpackhi_epi16(r[2], r[3]);
+			const __m256i q0 = _mm256_unpacklo_epi32(a, c), q1 = _mm256_unpackhi_epi32(a, c);
+			const __m256i q2 = _mm256_unpacklo_epi32(b, d), q3 = _mm256_unpackhi_epi32(b, d);
+			int16_t *dst = pd[dy] + 4 * x;
+			_mm256_storeu_si256((__m256i *)(dst + 0), _mm256_permute2x128_si256(q0, q1, 0x20));
+			_mm256_storeu_si256((__m256i *)(dst + 16), _mm256_permute2x128_si256(q2, q3, 0x20));
+			_mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(q0, q1, 0x31));
+			_mm256_storeu_si256((__m256i *)(dst + 48), _mm256_permute2x128_si256(q2, q3, 0x31));
+		}
+	}
+	return x;
+}
+
+static Surface inverse_dds_1d_simd(unsigned width, unsigned height, const Surface src_layers[16], unsigned features) {
+	auto dst = Surface::build_from<int16_t>();
+	dst.reserve(width, height);
+
+	const unsigned blocks = width / 4;
+	for (unsigned y = 0; y < height / 4; ++y) {
+		const int16_t *pc[16];
+		for (unsigned k = 0; k < 16; ++k)
+			pc[k] = src_layers[k].view_as<int16_t>().data(0, y);
+		int16_t *const pd[4] = {dst.data(0, 4 * y + 0), dst.data(0, 4 * y + 1), dst.data(0, 4 * y + 2), dst.data(0, 4 * y + 3)};
+
+		unsigned x = 0;
+		if (features & CpuFeature_AVX2)
+			x = inverse_dds_1d_avx2(pd, pc, blocks);
+		else if (features & CpuFeature_SSE41)
+			x = inverse_dds_1d_sse41(pd, pc, blocks);
+
+		// Remaining blocks
+		for (; x < blocks; ++x) {
+			int32_t w[16];
+			for (unsigned g = 0; g < 16; g += 4) {
+				const int32_t c0 = pc[g + 0][x], c1 = pc[g + 1][x], c2 = pc[g + 2][x], c3 = pc[g + 3][x];
+				w[g + 0] = c0 + c1 + c2 + c3;
+				w[g + 1] = c0 - c1 + c2 - c3;
+				w[g + 2] = c0 + c1 - c2 - c3;
+				w[g + 3] = c0 - c1 - c2 + c3;
+			}
+			for (unsigned dy = 0; dy < 4; ++dy) {
+				for (unsigned dx = 0; dx < 4; ++dx) {
+					const unsigned m = (dx >> 1) | (dy & 2);
+					const int32_t t = (dy & 1) ? w[8 + m] : w[0 + m];
+					const int32_t u = (dy & 1) ? w[4 + m] - w[12 + m] : w[4 + m] + w[12 + m];
+					pd[dy][4 * x + dx] = (int16_t)((dx & 1) ? t - u : t + u);
+				}
+			}
+		}
+	}
+
+	return dst.finish();
+}
+#endif
+
 Surface InverseTransformDDS_1D::process(int width, int height, const Surface src_layers[]) {
+#if LCEVC_SIMD_X86
+	if (cpu_features() && (width % 4) == 0 && (height % 4) == 0)
+		return inverse_dds_1d_simd(width, height, src_layers, cpu_features());
+#endif
+
 	// clang-format off
 
 	const SurfaceView<int16_t, 2> srcs[16] = {
@@ -91,4 +250,55 @@ Surface InverseTransformDDS_1D::process(int width, int height, const Surface src
 	    .finish();
 }
 
+// One 4x4 block from its 16 contiguous coefficients - see the SIMD kernels above for the factorisation
+//
+static inline void inverse_dds_1d_block(const int16_t c[16], int16_t r[4][4]) {
+	int16_t w[16];
+	for (unsigned g = 0; g < 16; g += 4) {
+		w[g + 0] = c[g + 0] + c[g + 1] + c[g + 2] + c[g + 3];
+		w[g + 1] = c[g + 0] - c[g + 1] + c[g + 2] - c[g + 3];
+		w[g + 2] = c[g + 0] + c[g + 1] - c[g + 2] - c[g + 3];
+		w[g + 3] = c[g + 0] - c[g + 1] - c[g + 2] + c[g + 3];
+	}
+
+	for (unsigned dy = 0; dy < 4; ++dy) {
+		for (unsigned dx = 0; dx < 4; ++dx) {
+			const unsigned m = (dx >> 1) | (dy & 2);
+			const int16_t t = (dy & 1) ? w[8 + m] : w[0 + m];
+			const int16_t u = (dy & 1) ? w[4 + m] - w[12 + m] : w[4 + m] + w[12 + m];
+			r[dy][dx] = (dx & 1) ? t - u : t + u;
+		}
+	}
+}
+
+Surface InverseTransformDDS_1D::process_interleaved(int width, int height, const Surface &coefficients, const Surface &occupancy) {
+	const unsigned w = (unsigned)width, h = (unsigned)height;
+	const auto src = coefficients.view_as<int16_t>();
+	std::unique_ptr<SurfaceView<uint8_t>> occupied;
+	if (!occupancy.empty())
+		occupied.reset(new SurfaceView<uint8_t>(occupancy));
+	CHECK(src.width() >= 16 * ((w + 3) / 4) && src.height() >= (h + 3) / 4);
+
+	auto dst = Surface::build_from<int16_t>();
+	dst.reserve(w, h);
+
+	for (unsigned y = 0; y < h; y += 4) {
+		const int16_t *pc = src.data(0, y / 4);
+		const uint8_t *po = occupied ? occupied->data(0, y / 4) : nullptr;
+		const unsigned rows = LCEVC_MIN(4u, h - y);
+		for (unsigned x = 0; x < w; x += 4, pc += 16) {
+			int16_t r[4][4];
+			if (!po || po[x / 4])
+				inverse_dds_1d_block(pc, r);
+			else
+				memset(r, 0, sizeof(r));
+			const unsigned cols = LCEVC_MIN(4u, w - x);
+			for (unsigned dy = 0; dy < rows; ++dy)
+				memcpy(dst.data(0, y + dy) + x, r[dy], cols * sizeof(int16_t));
+		}
+	}
+
+	return dst.finish();
+}
+
 } // namespace lctm
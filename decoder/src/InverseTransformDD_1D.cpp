@@ -37,9 +37,105 @@
 
 #include "InverseTransformDD_1D.hpp"
 
+#include "CpuFeatures.hpp"
+#include "Misc.hpp"
+
+#include <cstring>
+#include <memory>
+
+#if LCEVC_SIMD_X86
+#include <immintrin.h>
+#endif
+
 namespace lctm {
 
+#if LCEVC_SIMD_X86
+// A row of 2x2 blocks at a time, one block per 16 bit lane:
+//
+//   (0,0) = c0 + (c1 + c2)   (1,0) = c0 - (c1 + c2)
+//   (0,1) = c3 + (c1 - c2)   (1,1) = c3 - (c1 - c2)
+//
+LCEVC_TARGET_SSE41 static unsigned inverse_dd_1d_sse41(int16_t *const pd[2], const int16_t *const pc[4], unsigned blocks) {
+	unsigned x = 0;
+	for (; x + 8 <= blocks; x += 8) {
+		const __m128i c0 = _mm_loadu_si128((const __m128i *)(pc[0] + x));
+		const __m128i c1 = _mm_loadu_si128((const __m128i *)(pc[1] + x));
+		const __m128i c2 = _mm_loadu_si128((const __m128i *)(pc[2] + x));
+		const __m128i c3 = _mm_loadu_si128((const __m128i *)(pc[3] + x));
+
+		const __m128i s12 = _mm_add_epi16(c1, c2), d12 = _mm_sub_epi16(c1, c2);
+		const __m128i r00 = _mm_add_epi16(c0, s12), r10 = _mm_sub_epi16(c0, s12);
+		const __m128i r01 = _mm_add_epi16(c3, d12), r11 = _mm_sub_epi16(c3, d12);
+
+		_mm_storeu_si128((__m128i *)(pd[0] + 2 * x + 0), _mm_unpacklo_epi16(r00, r10));
+		_mm_storeu_si128((__m128i *)(pd[0] + 2 * x + 8), _mm_unpackhi_epi16(r00, r10));
+		_mm_storeu_si128((__m128i *)(pd[1] + 2 * x + 0), _mm_unpacklo_epi16(r01, r11));
+		_mm_storeu_si128((__m128i *)(pd[1] + 2 * x + 8), _mm_unpackhi_epi16(r01, r11));
+	}
+	return x;
+}
+
+LCEVC_TARGET_AVX2 static unsigned inverse_dd_1d_avx2(int16_t *const pd[2], const int16_t *const pc[4], unsigned blocks) {
+	unsigned x = 0;
+	for (; x + 16 <= blocks; x += 16) {
+		const __m256i c0 = _mm256_loadu_si256((const __m256i *)(pc[0] + x));
+		const __m256i c1 = _mm256_loadu_si256((const __m256i *)(pc[1] + x));
+		const __m256i c2 = _mm256_loadu_si256((const __m256i *)(pc[2] + x));
+		const __m256i c3 = _mm256_loadu_si256((const __m256i *)(pc[3] + x));
+
+		const __m256i s12 = _mm256_add_epi16(c1, c2), d12 = _mm256_sub_epi16(c1, c2);
+		const __m256i r00 = _mm256_add_epi16(c0, s12), r10 = _mm256_sub_epi16(c0, s12);
+		const __m256i r01 = _mm256_add_epi16(c3, d12), r11 = _mm256_sub_epi16(c3, d12);
+
+		// Unpacks work within 128 bit lanes - recombine halves on store
+		const __m256i lo0 = _mm256_unpacklo_epi16(r00, r10), hi0 = _mm256_unpackhi_epi16(r00, r10);
+		const __m256i lo1 = _mm256_unpacklo_epi16(r01, r11), hi1 = _mm256_unpackhi_epi16(r01, r11);
+		_mm256_storeu_si256((__m256i *)(pd[0] + 2 * x + 0), _mm256_permute2x128_si256(lo0, hi0, 0x20));
+		_mm256_storeu_si256((__m256i *)(pd[0] + 2 * x + 16), _mm256_permute2x128_si256(lo0, hi0, 0x31));
+		_mm256_storeu_si256((__m256i *)(pd[1] + 2 * x + 0), _mm256_permute2x128_si256(lo1, hi1, 0x20));
+		_mm256_storeu_si256((__m256i *)(pd[1] + 2 * x + 16), _mm256_permute2x128_si256(lo1, hi1, 0x31));
+	}
+	return x;
+}
+
+static Surface inverse_dd_1d_simd(unsigned width, unsigned height, const Surface src_layers[4], unsigned features) {
+	const SurfaceView<int16_t> coeffs[4] = {SurfaceView<int16_t>(src_layers[0]), SurfaceView<int16_t>(src_layers[1]),
+	                                        SurfaceView<int16_t>(src_layers[2]), SurfaceView<int16_t>(src_layers[3])};
+
+	auto dst = Surface::build_from<int16_t>();
+	dst.reserve(width, height);
+
+	const unsigned blocks = width / 2;
+	for (unsigned y = 0; y < height / 2; ++y) {
+		const int16_t *const pc[4] = {coeffs[0].data(0, y), coeffs[1].data(0, y), coeffs[2].data(0, y), coeffs[3].data(0, y)};
+		int16_t *const pd[2] = {dst.data(0, 2 * y + 0), dst.data(0, 2 * y + 1)};
+
+		unsigned x = 0;
+		if (features & CpuFeature_AVX2)
+			x = inverse_dd_1d_avx2(pd, pc, blocks);
+		else if (features & CpuFeature_SSE41)
+			x = inverse_dd_1d_sse41(pd, pc, blocks);
+
+		// Remaining blocks
+		for (; x < blocks; ++x) {
+			const int16_t c0 = pc[0][x], c1 = pc[1][x], c2 = pc[2][x], c3 = pc[3][x];
+			pd[0][2 * x + 0] = c0 + c1 + c2;
+			pd[0][2 * x + 1] = c0 - c1 - c2;
+			pd[1][2 * x + 0] = c1 - c2 + c3;
+			pd[1][2 * x + 1] = -c1 + c2 + c3;
+		}
+	}
+
+	return dst.finish();
+}
+#endif
+
 Surface InverseTransformDD_1D::process(int width, int height, const Surface src_layers[4]) {
+#if LCEVC_SIMD_X86
+	if (cpu_features() && (width % 2) == 0 && (height % 2) == 0)
+		return inverse_dd_1d_simd(width, height, src_layers, cpu_features());
+#endif
+
 	// clang-format off
 	const SurfaceView<int16_t,1> srcs[4] = {
 		SurfaceView<int16_t,1>(src_layers[0]),
@@ -72,4 +168,43 @@ Surface InverseTransformDD_1D::process(int width, int height, const Surface src_
 	    .finish();
 }
 
+// One 2x2 block from its 4 contiguous coefficients
+//
+static inline void inverse_dd_1d_block(const int16_t c[4], int16_t r[2][2]) {
+	r[0][0] = c[0] + c[1] + c[2];
+	r[0][1] = c[0] - c[1] - c[2];
+	r[1][0] = c[1] - c[2] + c[3];
+	r[1][1] = -c[1] + c[2] + c[3];
+}
+
+Surface InverseTransformDD_1D::process_interleaved(int width, int height, const Surface &coefficients, const Surface &occupancy) {
+	const unsigned w = (unsigned)width, h = (unsigned)height;
+	const auto src = coefficients.view_as<int16_t>();
+	std::unique_ptr<SurfaceView<uint8_t>> occupied;
+	if (!occupancy.empty())
+		occupied.reset(new SurfaceView<uint8_t>(occupancy));
+	CHECK(src.width() >= 4 * ((w + 1) / 2) && src.height() >= (h + 1) / 2);
+
+	auto dst = Surface::build_from<int16_t>();
+	dst.reserve(w, h);
+
+	for (unsigned y = 0; y < h; y += 2) {
+		const int16_t *pc = src.data(0, y / 2);
+		const uint8_t *po = occupied ? occupied->data(0, y / 2) : nullptr;
+		const unsigned rows = LCEVC_MIN(2u, h - y);
+		for (unsigned x = 0; x < w; x += 2, pc += 4) {
+			int16_t r[2][2];
+			if (!po || po[x / 2])
+				inverse_dd_1d_block(pc, r);
+			else
+				memset(r, 0, sizeof(r));
+			const unsigned cols = LCEVC_MIN(2u, w - x);
+			for (unsigned dy = 0; dy < rows; ++dy)
+				memcpy(dst.data(0, y + dy) + x, r[dy], cols * sizeof(int16_t));
+		}
+	}
+
+	return dst.finish();
+}
+
 } // namespace lctm
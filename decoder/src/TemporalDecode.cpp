@@ -40,9 +40,39 @@
 #include "Misc.hpp"
 
 #include <algorithm>
+#include <cstring>
 
 namespace lctm {
 
+//// Packed temporal masks
+//
+Surface TemporalMaskFill::process(unsigned width, unsigned height, TemporalType type) {
+	auto dest = Surface::build_from<uint8_t>();
+	dest.reserve(width, height, temporal_mask_stride(width));
+	memset(dest.data(), 0, height * dest.stride());
+
+	if (type == TemporalType::TEMPORAL_INTR) {
+		for (unsigned y = 0; y < height; ++y)
+			temporal_mask_fill(reinterpret_cast<uint64_t *>(dest.data(0, y)), 0, width);
+	}
+
+	return dest.finish();
+}
+
+Surface TemporalMaskUnpack::process(const Surface &packed) {
+	const auto src = packed.view_as<uint8_t>();
+
+	auto dest = Surface::build_from<uint8_t>();
+	dest.reserve(packed.width(), packed.height());
+	for (unsigned y = 0; y < packed.height(); ++y) {
+		const uint64_t *psrc = temporal_mask_row(src, y);
+		uint8_t *__restrict pdst = dest.data(0, y);
+		for (unsigned x = 0; x < packed.width(); ++x)
+			pdst[x] = temporal_mask_intra(psrc, x) ? TemporalType::TEMPORAL_INTR : TemporalType::TEMPORAL_PRED;
+	}
+	return dest.finish();
+}
+
 // Extract the single-bit-per-transform signalling as a mask
 //
 Surface TemporalExtractMask::process(const Surface &symbols) {
@@ -370,6 +400,52 @@ Surface ApplyTemporalMap::process(const Surface &src_plane, Surface &map_plane,
 #endif
 }
 
+void ApplyTemporalMapInPlace::process(Surface &temporal_plane, const Surface &map_plane, unsigned transform_block_size,
+                                      const Surface &residuals, const Surface &occupancy) {
+	const unsigned block_w = tile_size(map_plane.width(), temporal_plane.width());
+	const unsigned block_h = tile_size(map_plane.height(), temporal_plane.height());
+	const unsigned shift_bw = log2(block_w);
+	const unsigned shift_bh = log2(block_h);
+
+	CHECK(temporal_plane.width() == map_plane.width() * block_w);
+	CHECK(temporal_plane.height() == map_plane.height() * block_h);
+	CHECK(temporal_plane.width() % transform_block_size == 0 && temporal_plane.height() % transform_block_size == 0);
+
+	const bool add_residuals = !residuals.empty();
+	const bool skip_empty = add_residuals && !occupancy.empty();
+
+	auto dst = temporal_plane.view_as<int16_t>();
+	const auto map = map_plane.view_as<uint8_t>();
+	const auto res = (add_residuals ? residuals : temporal_plane).view_as<int16_t>();
+	const auto occ = (skip_empty ? occupancy : map_plane).view_as<uint8_t>();
+
+	const size_t row_bytes = transform_block_size * sizeof(int16_t);
+
+	for (unsigned y = 0; y < temporal_plane.height(); y += transform_block_size) {
+		const uint64_t *mask_row = temporal_mask_row(map, y >> shift_bh);
+		for (unsigned x = 0; x < temporal_plane.width(); x += transform_block_size) {
+			const bool intra = temporal_mask_intra(mask_row, x >> shift_bw);
+			const bool occupied = skip_empty ? (occ.read(x / transform_block_size, y / transform_block_size) != 0) : add_residuals;
+
+			if (!intra && !occupied)
+				continue;
+
+			for (unsigned i = 0; i < transform_block_size; ++i) {
+				int16_t *__restrict pdst = (int16_t *)dst.data(x, y + i);
+				if (intra && occupied)
+					memcpy(pdst, res.data(x, y + i), row_bytes);
+				else if (intra)
+					memset(pdst, 0, row_bytes);
+				else {
+					const int16_t *__restrict psrc = res.data(x, y + i);
+					for (unsigned j = 0; j < transform_block_size; ++j)
+						pdst[j] += psrc[j];
+				}
+			}
+		}
+	}
+}
+
 // Filter out the embedded user_data
 //
 Surface UserDataClear::process(const Surface &symbols, UserDataMode user_data) {
@@ -38,11 +38,16 @@
 #include "Upsampling.hpp"
 
 #include "Convert.hpp"
+#include "CpuFeatures.hpp"
 #include "Misc.hpp"
 
 #include <algorithm>
 #include <vector>
 
+#if LCEVC_SIMD_X86
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 namespace lctm {
@@ -149,6 +154,147 @@ static void inline apply_kernel(int16_t *__restrict dest, unsigned dest_stride,
 	*dest = us_shift_clamp_s16(de);
 }
 
+// Vertical pass, row at a time
+//
+// Each source row 'y' produces output rows 2y and 2y+1 - the same samples as apply_kernel() down a column:
+//
+//   dest[2y]   = k3*src[y-2] + k2*src[y-1] + k1*src[y]   + k0*src[y+1]
+//   dest[2y+1] = k0*src[y-1] + k1*src[y]   + k2*src[y+1] + k3*src[y+2]
+//
+// with source rows clamped to the plane. Working along rows keeps all accesses sequential.
+//
+static void vertical_rows_c(int16_t *__restrict even, int16_t *__restrict odd, const int16_t *const rows[5], unsigned x,
+                            unsigned width, const UpsampleKernel &kernel) {
+	for (; x < width; ++x) {
+		const int32_t s0 = rows[0][x], s1 = rows[1][x], s2 = rows[2][x], s3 = rows[3][x], s4 = rows[4][x];
+		even[x] = us_shift_clamp_s16(0x2000 + kernel[3] * s0 + kernel[2] * s1 + kernel[1] * s2 + kernel[0] * s3);
+		odd[x] = us_shift_clamp_s16(0x2000 + kernel[0] * s1 + kernel[1] * s2 + kernel[2] * s3 + kernel[3] * s4);
+	}
+}
+
+#if LCEVC_SIMD_X86
+// Pair of 16 bit coefficients for _madd_epi16 against interleaved samples (a, b)
+static inline int32_t coefficient_pair(int32_t ka, int32_t kb) { return (int32_t)(((uint32_t)(uint16_t)kb << 16) | (uint16_t)ka); }
+
+// Round, shift, and truncate to 16 bits as us_shift_clamp_s16() - the sign extend keeps the saturating pack exact
+#define US_SHIFT_TRUNCATE_S16(v, shift_left, shift_right, round, s)                                                         \
+	shift_right(shift_left(shift_right(_##s##_add_epi32(v, round), 14), 16), 16)
+
+LCEVC_TARGET_SSE41 static unsigned vertical_rows_sse41(int16_t *__restrict even, int16_t *__restrict odd,
+                                                       const int16_t *const rows[5], unsigned width,
+                                                       const UpsampleKernel &kernel) {
+	const __m128i k32 = _mm_set1_epi32(coefficient_pair(kernel[3], kernel[2]));
+	const __m128i k10 = _mm_set1_epi32(coefficient_pair(kernel[1], kernel[0]));
+	const __m128i k01 = _mm_set1_epi32(coefficient_pair(kernel[0], kernel[1]));
+	const __m128i k23 = _mm_set1_epi32(coefficient_pair(kernel[2], kernel[3]));
+	const __m128i round = _mm_set1_epi32(0x2000);
+
+	unsigned x = 0;
+	for (; x + 8 <= width; x += 8) {
+		const __m128i s0 = _mm_loadu_si128((const __m128i *)(rows[0] + x));
+		const __m128i s1 = _mm_loadu_si128((const __m128i *)(rows[1] + x));
+		const __m128i s2 = _mm_loadu_si128((const __m128i *)(rows[2] + x));
+		const __m128i s3 = _mm_loadu_si128((const __m128i *)(rows[3] + x));
+		const __m128i s4 = _mm_loadu_si128((const __m128i *)(rows[4] + x));
+
+		const __m128i e_lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(s0, s1), k32),
+		                                   _mm_madd_epi16(_mm_unpacklo_epi16(s2, s3), k10));
+		const __m128i e_hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(s0, s1), k32),
+		                                   _mm_madd_epi16(_mm_unpackhi_epi16(s2, s3), k10));
+		const __m128i o_lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(s1, s2), k01),
+		                                   _mm_madd_epi16(_mm_unpacklo_epi16(s3, s4), k23));
+		const __m128i o_hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(s1, s2), k01),
+		                                   _mm_madd_epi16(_mm_unpackhi_epi16(s3, s4), k23));
+
+		_mm_storeu_si128((__m128i *)(even + x),
+		                 _mm_packs_epi32(US_SHIFT_TRUNCATE_S16(e_lo, _mm_slli_epi32, _mm_srai_epi32, round, mm),
+		                                 US_SHIFT_TRUNCATE_S16(e_hi, _mm_slli_epi32, _mm_srai_epi32, round, mm)));
+		_mm_storeu_si128((__m128i *)(odd + x),
+		                 _mm_packs_epi32(US_SHIFT_TRUNCATE_S16(o_lo, _mm_slli_epi32, _mm_srai_epi32, round, mm),
+		                                 US_SHIFT_TRUNCATE_S16(o_hi, _mm_slli_epi32, _mm_srai_epi32, round, mm)));
+	}
+	return x;
+}
+
+// As SSE4.1 version - the 256 bit unpack and pack both work within 128 bit lanes, so output order is preserved
+LCEVC_TARGET_AVX2 static unsigned vertical_rows_avx2(int16_t *__restrict even, int16_t *__restrict odd,
+                                                     const int16_t *const rows[5], unsigned width,
+                                                     const UpsampleKernel &kernel) {
+	const __m256i k32 = _mm256_set1_epi32(coefficient_pair(kernel[3], kernel[2]));
+	const __m256i k10 = _mm256_set1_epi32(coefficient_pair(kernel[1], kernel[0]));
+	const __m256i k01 = _mm256_set1_epi32(coefficient_pair(kernel[0], kernel[1]));
+	const __m256i k23 = _mm256_set1_epi32(coefficient_pair(kernel[2], kernel[3]));
+	const __m256i round = _mm256_set1_epi32(0x2000);
+
+	unsigned x = 0;
+	for (; x + 16 <= width; x += 16) {
+		const __m256i s0 = _mm256_loadu_si256((const __m256i *)(rows[0] + x));
+		const __m256i s1 = _mm256_loadu_si256((const __m256i *)(rows[1] + x));
+		const __m256i s2 = _mm256_loadu_si256((const __m256i *)(rows[2] + x));
+		const __m256i s3 = _mm256_loadu_si256((const __m256i *)(rows[3] + x));
+		const __m256i s4 = _mm256_loadu_si256((const __m256i *)(rows[4] + x));
+
+		const __m256i e_lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(s0, s1), k32),
+		                                      _mm256_madd_epi16(_mm256_unpacklo_epi16(s2, s3), k10));
+		const __m256i e_hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(s0, s1), k32),
+		                                      _mm256_madd_epi16(_mm256_unpackhi_epi16(s2, s3), k10));
+		const __m256i o_lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(s1, s2), k01),
+		                                      _mm256_madd_epi16(_mm256_unpacklo_epi16(s3, s4), k23));
+		const __m256i o_hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(s1, s2), k01),
+		                                      _mm256_madd_epi16(_mm256_unpackhi_epi16(s3, s4), k23));
+
+		_mm256_storeu_si256((__m256i *)(even + x),
+		                    _mm256_packs_epi32(US_SHIFT_TRUNCATE_S16(e_lo, _mm256_slli_epi32, _mm256_srai_epi32, round, mm256),
+		                                       US_SHIFT_TRUNCATE_S16(e_hi, _mm256_slli_epi32, _mm256_srai_epi32, round, mm256)));
+		_mm256_storeu_si256((__m256i *)(odd + x),
+		                    _mm256_packs_epi32(US_SHIFT_TRUNCATE_S16(o_lo, _mm256_slli_epi32, _mm256_srai_epi32, round, mm256),
+		                                       US_SHIFT_TRUNCATE_S16(o_hi, _mm256_slli_epi32, _mm256_srai_epi32, round, mm256)));
+	}
+	return x;
+}
+
+#undef US_SHIFT_TRUNCATE_S16
+#endif
+
+// Kernel taps must fit in 16 bits for the SIMD multiply-add
+static bool kernel_fits_s16(const UpsampleKernel &kernel) {
+	for (unsigned i = 0; i < ARRAY_SIZE(kernel); ++i)
+		if (kernel[i] < -32768 || kernel[i] > 32767)
+			return false;
+	return true;
+}
+
+// SIMD features that may be used with this kernel
+static unsigned kernel_features(const UpsampleKernel &kernel) { return kernel_fits_s16(kernel) ? cpu_features() : 0; }
+
+// Vertically filter source row 'y' of a plane into the two output rows it centres - 'src' points at row 'src_y'
+//
+static void vertical_rows(int16_t *even, int16_t *odd, const int16_t *src, unsigned src_stride, unsigned src_y, unsigned y,
+                          unsigned width, unsigned height, const UpsampleKernel &kernel, unsigned features) {
+	const int16_t *rows[5];
+	for (int k = 0; k < 5; ++k)
+		rows[k] = src + src_stride * (clamp((int)y + k - 2, 0, (int)height - 1) - (int)src_y);
+
+	unsigned x = 0;
+#if LCEVC_SIMD_X86
+	if (features & CpuFeature_AVX2)
+		x = vertical_rows_avx2(even, odd, rows, width, kernel);
+	else if (features & CpuFeature_SSE41)
+		x = vertical_rows_sse41(even, odd, rows, width, kernel);
+#endif
+	vertical_rows_c(even, odd, rows, x, width, kernel);
+}
+
+static void upsample_vertical(int16_t *dest, unsigned dest_stride, const int16_t *src, unsigned src_stride, unsigned width,
+                              unsigned height, const UpsampleKernel &kernel) {
+	const unsigned features = kernel_features(kernel);
+
+	for (unsigned y = 0; y < height; ++y) {
+		int16_t *even = dest + dest_stride * (2 * y);
+		vertical_rows(even, even + dest_stride, src, src_stride, 0, y, width, height, kernel, features);
+	}
+}
+
 Surface Upsampling::process(const Surface &src_plane, Upsample upsample, const unsigned *coefficients) {
 	const unsigned width = src_plane.width();
 	const unsigned height = src_plane.height();
@@ -163,8 +309,7 @@ Surface Upsampling::process(const Surface &src_plane, Upsample upsample, const u
 
 	// Vertical scale
 	//
-	for (unsigned x = 0; x < width; ++x)
-		apply_kernel(v_dest.data(x, 0), width, v_src.data(x, 0), width, height, kernel);
+	upsample_vertical(v_dest.data(0, 0), width, v_src.data(0, 0), width, width, height, kernel);
 
 	Surface intermediate = v_dest.finish();
 
@@ -201,6 +346,120 @@ Surface Upsampling_1D::process(const Surface &src_plane, Upsample upsample, cons
 	return h_dest.finish();
 }
 
+// Add a row of residuals to a row of output pels - wrapping as the in-place 16 bit add
+//
+static inline void add_residual_row(int16_t *__restrict dest, const int16_t *__restrict residuals, unsigned width) {
+	for (unsigned x = 0; x < width; ++x)
+		dest[x] += residuals[x];
+}
+
+Surface UpsamplingReconstruct::process(const Surface &src_plane, const Surface &residuals, Upsample upsample,
+                                       const unsigned *coefficients, bool predicted_average) {
+	const unsigned width = src_plane.width();
+	const unsigned height = src_plane.height();
+
+	const bool add_residuals = !residuals.empty();
+	if (add_residuals)
+		CHECK(residuals.width() == width * 2 && residuals.height() == height * 2);
+
+	const auto src = src_plane.view_as<int16_t>();
+	const auto res = (add_residuals ? residuals : src_plane).view_as<int16_t>();
+
+	auto dest = Surface::build_from<int16_t>();
+	dest.reserve(width * 2, height * 2);
+
+	process_rows(dest.data(0, 0), width * 2, src.data(0, 0), width, 0, width, height, 0, height,
+	             add_residuals ? res.data(0, 0) : nullptr, width * 2, upsample, coefficients, predicted_average);
+
+	return dest.finish();
+}
+
+void UpsamplingReconstruct::process_rows(int16_t *dest, unsigned dest_stride, const int16_t *src, unsigned src_stride,
+                                         unsigned src_y, unsigned width, unsigned height, unsigned y_begin, unsigned y_end,
+                                         const int16_t *residuals, unsigned residuals_stride, Upsample upsample,
+                                         const unsigned *coefficients, bool predicted_average) {
+	UpsampleKernel kernel;
+	make_kernel(kernel, upsample, coefficients);
+	const unsigned features = kernel_features(kernel);
+
+	// Vertically filtered rows for current pair of output rows
+	std::vector<int16_t> even(width), odd(width);
+
+	for (unsigned y = y_begin; y < y_end; ++y) {
+		vertical_rows(even.data(), odd.data(), src, src_stride, src_y, y, width, height, kernel, features);
+
+		int16_t *__restrict pdst0 = dest + dest_stride * (2 * (y - y_begin) + 0);
+		int16_t *__restrict pdst1 = dest + dest_stride * (2 * (y - y_begin) + 1);
+		apply_kernel(pdst0, 1, even.data(), 1, width, kernel);
+		apply_kernel(pdst1, 1, odd.data(), 1, width, kernel);
+
+		if (predicted_average) {
+			// As PredictedResidualSum + PredictedResidualAdjust, on each 2x2 block
+			const int16_t *__restrict pbas = src + src_stride * (y - src_y);
+			for (unsigned x = 0; x < width; ++x) {
+				const int32_t sum = pdst0[2 * x + 0] + pdst0[2 * x + 1] + pdst1[2 * x + 0] + pdst1[2 * x + 1];
+				const int32_t adjust = pbas[x] - ((sum + 2) >> 2);
+				pdst0[2 * x + 0] = clamp(pdst0[2 * x + 0] + adjust, -32767, 32767);
+				pdst0[2 * x + 1] = clamp(pdst0[2 * x + 1] + adjust, -32767, 32767);
+				pdst1[2 * x + 0] = clamp(pdst1[2 * x + 0] + adjust, -32767, 32767);
+				pdst1[2 * x + 1] = clamp(pdst1[2 * x + 1] + adjust, -32767, 32767);
+			}
+		}
+
+		if (residuals) {
+			add_residual_row(pdst0, residuals + residuals_stride * (2 * (y - y_begin) + 0), width * 2);
+			add_residual_row(pdst1, residuals + residuals_stride * (2 * (y - y_begin) + 1), width * 2);
+		}
+	}
+}
+
+Surface UpsamplingReconstruct_1D::process(const Surface &src_plane, const Surface &residuals, Upsample upsample,
+                                          const unsigned *coefficients, bool predicted_average) {
+	const unsigned width = src_plane.width();
+	const unsigned height = src_plane.height();
+
+	const bool add_residuals = !residuals.empty();
+	if (add_residuals)
+		CHECK(residuals.width() == width * 2 && residuals.height() == height);
+
+	const auto src = src_plane.view_as<int16_t>();
+	const auto res = (add_residuals ? residuals : src_plane).view_as<int16_t>();
+
+	auto dest = Surface::build_from<int16_t>();
+	dest.reserve(width * 2, height);
+
+	process_rows(dest.data(0, 0), width * 2, src.data(0, 0), width, width, 0, height, add_residuals ? res.data(0, 0) : nullptr,
+	             width * 2, upsample, coefficients, predicted_average);
+
+	return dest.finish();
+}
+
+void UpsamplingReconstruct_1D::process_rows(int16_t *dest, unsigned dest_stride, const int16_t *src, unsigned src_stride,
+                                            unsigned width, unsigned y_begin, unsigned y_end, const int16_t *residuals,
+                                            unsigned residuals_stride, Upsample upsample, const unsigned *coefficients,
+                                            bool predicted_average) {
+	UpsampleKernel kernel;
+	make_kernel(kernel, upsample, coefficients);
+
+	for (unsigned y = 0; y < y_end - y_begin; ++y) {
+		int16_t *__restrict pdst = dest + dest_stride * y;
+		const int16_t *__restrict pbas = src + src_stride * y;
+		apply_kernel(pdst, 1, pbas, 1, width, kernel);
+
+		if (predicted_average) {
+			// As PredictedResidualSum_1D + PredictedResidualAdjust_1D, on each 2x1 block
+			for (unsigned x = 0; x < width; ++x) {
+				const int32_t adjust = pbas[x] - ((pdst[2 * x + 0] + pdst[2 * x + 1] + 1) >> 1);
+				pdst[2 * x + 0] = clamp(pdst[2 * x + 0] + adjust, -32767, 32767);
+				pdst[2 * x + 1] = clamp(pdst[2 * x + 1] + adjust, -32767, 32767);
+			}
+		}
+
+		if (residuals)
+			add_residual_row(pdst, residuals + residuals_stride * y, width * 2);
+	}
+}
+
 Image UpsampleImage(const Image &src, Upsample upsample, const unsigned upsampling_coefficients[4], ScalingMode scaling_mode) {
 	if (scaling_mode == ScalingMode_None)
 		return src;
@@ -0,0 +1,112 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+// UpsamplingDPI.cpp
+//
+// Three plane upsampling with predicted average and residuals - a band of rows of every plane at a time, through the
+// row kernels of the single plane reconstruction.
+//
+
+#include "UpsamplingDPI.hpp"
+#include "Upsampling.hpp"
+
+#include "Diagnostics.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+
+namespace lctm {
+
+// Source rows of the tallest plane in each band
+static const unsigned BAND_ROWS = 16;
+
+static void upsample_planes(Surface dst_planes[3], const Surface src_planes[3], const Surface residuals[3], bool is_1d,
+                            Upsample upsample, bool apply_predicted_average, const unsigned *coefficients,
+                            unsigned num_threads) {
+	const unsigned vertical_scale = is_1d ? 1 : 2;
+
+	SurfaceBuilder<int16_t> dest[3];
+	unsigned num_bands = 0;
+	for (unsigned plane = 0; plane < 3; ++plane) {
+		const Surface &src = src_planes[plane];
+		if (src.empty())
+			continue;
+		if (!residuals[plane].empty())
+			CHECK(residuals[plane].width() == src.width() * 2 && residuals[plane].height() == src.height() * vertical_scale);
+
+		dest[plane].reserve(src.width() * 2, src.height() * vertical_scale);
+		num_bands = std::max(num_bands, (src.height() + BAND_ROWS - 1) / BAND_ROWS);
+	}
+
+	// Each band covers the same fraction of every plane
+	parallel_for(num_bands, num_threads, [&](unsigned band) {
+		for (unsigned plane = 0; plane < 3; ++plane) {
+			const Surface &src = src_planes[plane];
+			if (src.empty())
+				continue;
+
+			const unsigned width = src.width(), height = src.height();
+			const unsigned y_begin = band * height / num_bands, y_end = (band + 1) * height / num_bands;
+			if (y_begin == y_end)
+				continue;
+
+			const auto src_view = src.view_as<int16_t>();
+			const int16_t *res = nullptr;
+			if (!residuals[plane].empty())
+				res = residuals[plane].view_as<int16_t>().data(0, y_begin * vertical_scale);
+			int16_t *dst = dest[plane].data(0, y_begin * vertical_scale);
+
+			if (is_1d)
+				UpsamplingReconstruct_1D().process_rows(dst, width * 2, src_view.data(0, y_begin), width, width, y_begin, y_end,
+				                                        res, width * 2, upsample, coefficients, apply_predicted_average);
+			else
+				UpsamplingReconstruct().process_rows(dst, width * 2, src_view.data(0, 0), width, 0, width, height, y_begin,
+				                                     y_end, res, width * 2, upsample, coefficients, apply_predicted_average);
+		}
+	});
+
+	for (unsigned plane = 0; plane < 3; ++plane)
+		dst_planes[plane] = src_planes[plane].empty() ? Surface() : dest[plane].finish();
+}
+
+void UpsamplingDPI::process(Surface dst_planes[3], const Surface src_planes[3], const Surface residuals[3], Upsample upsample,
+                            bool apply_predicted_average, const unsigned *coefficients, unsigned num_threads) {
+	upsample_planes(dst_planes, src_planes, residuals, false, upsample, apply_predicted_average, coefficients, num_threads);
+}
+
+void UpsamplingDPI_1D::process(Surface dst_planes[3], const Surface src_planes[3], const Surface residuals[3],
+                               Upsample upsample, bool apply_predicted_average, const unsigned *coefficients,
+                               unsigned num_threads) {
+	upsample_planes(dst_planes, src_planes, residuals, true, upsample, apply_predicted_average, coefficients, num_threads);
+}
+
+} // namespace lctm
@@ -0,0 +1,684 @@
+//
+// Loadable HEVC base encoder using x265
+//
+// libx265 is loaded when the first context is created, so nothing of it is needed to build this. The library named by
+// the "library" option is used, otherwise libx265 from the program's external_codecs/libs directory, otherwise the
+// system's.
+//
+// Context options (JSON):
+//   width, height, bit_depth  - base picture size and sample depth
+//   chroma_format             - 400, 420, 422 or 444 (default: 420)
+//   fps, qp                   - frame rate, and constant QP
+//   intra_period              - maximum distance between key frames (default: x265's)
+//   preset                    - x265 preset (default: medium)
+//   x265_params               - further x265 options, as "name=value:name=value"
+//   library                   - path of libx265
+//
+// Pictures are pushed with push_image(), tagged with PropertyID_Timestamp metadata. pull_packet() returns access units in
+// decode order, with timestamp, POC, frame type and IDR metadata, and pull_image() the reconstruction of the last one.
+//
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CodecApi.h"
+#include "CodecUtils.h"
+#include "Misc.hpp"
+#include "SharedLibrary.hpp"
+
+#include "nlohmann/json.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+//// x265 interface
+//
+// Just the parts that are used. Parameters, pictures and the encoder are only handled through pointers, and only the
+// leading fields of x265_picture are declared. That layout, and the signature of x265_encoder_encode(), are only relied
+// on for the builds in X265_BUILDS.
+//
+struct x265_nal {
+	uint32_t type;
+	uint32_t sizeBytes;
+	uint8_t *payload;
+};
+
+struct x265_picture {
+	int64_t pts;
+	int64_t dts;
+	void *userData;
+	void *planes[3];
+	int stride[3];
+	int bitDepth;
+	int sliceType;
+	int poc;
+	int colorSpace;
+	// ... more that is not used
+};
+
+enum { X265_TYPE_IDR = 1, X265_TYPE_I = 2, X265_TYPE_P = 3, X265_TYPE_BREF = 4, X265_TYPE_B = 5 };
+
+// The x265 build numbers whose x265.h has been checked against the declarations above - these are looked for in versioned
+// library and symbol names, newest first. Add a build here only after checking its header.
+//
+//   199 - x265 3.5
+//   204 - x265 3.5+36 (test_bench/libx265.so.204): x265_picture and x265_encoder_encode() as in 199
+//
+const int X265_BUILDS[] = {204, 199};
+
+class X265Library {
+public:
+	// Load the library once per process - returns an error message, or empty for success
+	static string load(const string &path, X265Library *&library) {
+		static mutex load_mutex;
+		static X265Library *loaded = nullptr;
+		lock_guard<mutex> lock(load_mutex);
+
+		if (!loaded) {
+			unique_ptr<X265Library> l(new X265Library);
+			const string message = l->open(path);
+			if (!message.empty())
+				return message;
+			loaded = l.release();
+		}
+		library = loaded;
+		return "";
+	}
+
+	void *(*param_alloc)() = nullptr;
+	void (*param_free)(void *param) = nullptr;
+	int (*param_default_preset)(void *param, const char *preset, const char *tune) = nullptr;
+	int (*param_parse)(void *param, const char *name, const char *value) = nullptr;
+	x265_picture *(*picture_alloc)() = nullptr;
+	void (*picture_free)(x265_picture *picture) = nullptr;
+	void (*picture_init)(void *param, x265_picture *picture) = nullptr;
+	void *(*encoder_open)(void *param) = nullptr;
+	int (*encoder_headers)(void *encoder, x265_nal **nals, uint32_t *num_nals) = nullptr;
+	int (*encoder_encode)(void *encoder, x265_nal **nals, uint32_t *num_nals, x265_picture *in, x265_picture *out) = nullptr;
+	void (*encoder_close)(void *encoder) = nullptr;
+
+	int bit_depth = 0;
+	string version;
+
+private:
+	string open(const string &path) {
+		vector<string> names;
+		if (!path.empty()) {
+			names.push_back(path);
+		} else {
+			names.push_back(lctm::get_program_directory(format("external_codecs/libs/%sx265.%s", SHARED_PREFIX, SHARED_SUFFIX)));
+			names.push_back(format("%sx265.%s", SHARED_PREFIX, SHARED_SUFFIX));
+#if !defined(_WIN32)
+			for (int b : X265_BUILDS)
+				names.push_back(format("libx265.so.%d", b));
+#endif
+		}
+
+		for (const auto &n : names)
+			if ((handle_ = SHARED_LOAD(n.c_str())) != nullptr)
+				break;
+		if (!handle_)
+			return path.empty() ? "Cannot find x265 library" : format("Cannot load x265 library: \"%s\"", path.c_str());
+
+		if (!symbol(param_alloc, "x265_param_alloc") || !symbol(param_free, "x265_param_free") ||
+		    !symbol(param_default_preset, "x265_param_default_preset") || !symbol(param_parse, "x265_param_parse") ||
+		    !symbol(picture_alloc, "x265_picture_alloc") || !symbol(picture_free, "x265_picture_free") ||
+		    !symbol(picture_init, "x265_picture_init") || !symbol(encoder_headers, "x265_encoder_headers") ||
+		    !symbol(encoder_encode, "x265_encoder_encode") || !symbol(encoder_close, "x265_encoder_close"))
+			return "x265 library is missing functions";
+
+		// Opening the encoder is named for the build, so a library of any other build is refused here
+		for (int b : X265_BUILDS)
+			if (symbol(encoder_open, format("x265_encoder_open_%d", b).c_str()))
+				break;
+		if (!encoder_open)
+			return "x265 library is not a supported build";
+
+		const int *max_bit_depth = nullptr;
+		const char **version_str = nullptr;
+		if (!symbol(max_bit_depth, "x265_max_bit_depth"))
+			return "x265 library does not give its bit depth";
+		bit_depth = *max_bit_depth;
+		if (symbol(version_str, "x265_version_str"))
+			version = *version_str;
+
+		return "";
+	}
+
+	template <typename T> bool symbol(T &fn, const char *name) {
+		fn = (T)SHARED_SYMBOL(handle_, name);
+		return fn != nullptr;
+	}
+
+	template <typename... Args> static string format(const char *fmt, Args... args) {
+		char buffer[256];
+		snprintf(buffer, sizeof(buffer), fmt, args...);
+		return buffer;
+	}
+
+	shared_handle_t handle_ = nullptr;
+};
+
+//// Metadata & errors
+//
+struct Metadata {
+	uint64_t timestamp = 0;
+	uint64_t poc = 0;
+	uint32_t qp = 0;
+	uint32_t frame_type = 0;
+	bool idr = false;
+};
+
+struct Error {
+	int32_t code = 0;
+	string message;
+	string file;
+	uint32_t line = 0;
+};
+
+void set_error(CodecError *error, const string &message, const char *file, uint32_t line) {
+	if (!error)
+		return;
+
+	Error *e = new Error;
+	e->code = 1;
+	e->message = message;
+	e->file = file;
+	e->line = line;
+	*error = (CodecError)e;
+}
+
+#define SET_ERROR(error, message) set_error(error, message, __FILE__, __LINE__)
+
+//// Context
+//
+// One encoding session
+//
+struct Output {
+	vector<uint8_t> packet;
+	Metadata metadata;
+	vector<uint8_t> recon;
+	CodecImage recon_image;
+};
+
+class Context {
+public:
+	~Context();
+
+	void open(const char *json_configuration);
+	void encode(const CodecImage *image, uint64_t timestamp);
+	void flush();
+
+	deque<Output> outputs_;
+	Output pulled_;
+	bool recon_pending_ = false;
+	bool flushed_ = false;
+	uint64_t pushed_ = 0;
+
+private:
+	void add_output(const x265_nal *nals, uint32_t num_nals, const x265_picture &picture);
+
+	X265Library *x265_ = nullptr;
+	void *param_ = nullptr;
+	void *encoder_ = nullptr;
+	x265_picture *picture_in_ = nullptr;
+	x265_picture *picture_out_ = nullptr;
+
+	unsigned width_ = 0;
+	unsigned height_ = 0;
+	unsigned bit_depth_ = 8;
+	unsigned chroma_format_ = 420;
+
+	// Parameter sets, which go in front of the first access unit
+	vector<uint8_t> headers_;
+};
+
+Context::~Context() {
+	if (!x265_)
+		return;
+	if (encoder_)
+		x265_->encoder_close(encoder_);
+	if (picture_in_)
+		x265_->picture_free(picture_in_);
+	if (picture_out_)
+		x265_->picture_free(picture_out_);
+	if (param_)
+		x265_->param_free(param_);
+}
+
+void Context::open(const char *json_configuration) {
+	const json config = json::parse(json_configuration && *json_configuration ? json_configuration : "{}");
+
+	const string message = X265Library::load(config.value("library", string()), x265_);
+	if (!message.empty())
+		throw runtime_error(message);
+
+	width_ = config.value("width", 0u);
+	height_ = config.value("height", 0u);
+	bit_depth_ = config.value("bit_depth", 8u);
+	chroma_format_ = config.value("chroma_format", 420u);
+	if (width_ == 0 || height_ == 0)
+		throw runtime_error("No picture size for x265");
+	if ((int)bit_depth_ != x265_->bit_depth)
+		throw runtime_error("x265 library is built for " + to_string(x265_->bit_depth) + " bit, not " + to_string(bit_depth_));
+
+	param_ = x265_->param_alloc();
+	if (x265_->param_default_preset(param_, config.value("preset", string("medium")).c_str(), nullptr) != 0)
+		throw runtime_error("Unknown x265 preset");
+
+	vector<pair<string, string>> options = {
+	    {"input-res", to_string(width_) + "x" + to_string(height_)},
+	    {"input-csp", "i" + to_string(chroma_format_)},
+	    {"fps", to_string(config.value("fps", 50u))},
+	    {"qp", to_string(config.value("qp", 28u))},
+	    {"log-level", "error"},
+	};
+	if (config.value("intra_period", 0u))
+		options.push_back({"keyint", to_string(config.value("intra_period", 0u))});
+
+	// Extra options: "name=value:name=value"
+	stringstream extra(config.value("x265_params", string()));
+	string option;
+	while (getline(extra, option, ':')) {
+		const size_t eq = option.find('=');
+		if (!option.empty())
+			options.push_back({option.substr(0, eq), eq == string::npos ? "1" : option.substr(eq + 1)});
+	}
+
+	for (const auto &o : options)
+		if (x265_->param_parse(param_, o.first.c_str(), o.second.c_str()) != 0)
+			throw runtime_error("Bad x265 option: " + o.first + "=" + o.second);
+
+	encoder_ = x265_->encoder_open(param_);
+	if (!encoder_)
+		throw runtime_error("Cannot open x265 encoder");
+
+	picture_in_ = x265_->picture_alloc();
+	picture_out_ = x265_->picture_alloc();
+	x265_->picture_init(param_, picture_in_);
+	x265_->picture_init(param_, picture_out_);
+
+	x265_nal *nals = nullptr;
+	uint32_t num_nals = 0;
+	if (x265_->encoder_headers(encoder_, &nals, &num_nals) < 0)
+		throw runtime_error("Cannot get x265 parameter sets");
+	for (uint32_t n = 0; n < num_nals; ++n)
+		headers_.insert(headers_.end(), nals[n].payload, nals[n].payload + nals[n].sizeBytes);
+}
+
+// Encode a picture - any access unit that comes out is queued
+//
+void Context::encode(const CodecImage *image, uint64_t timestamp) {
+	if (image->bpp != (bit_depth_ > 8 ? 2u : 1u))
+		throw runtime_error("Picture has wrong sample size for x265");
+	if (image->width_y != width_ || image->height_y != height_)
+		throw runtime_error("Picture has wrong size for x265");
+
+	picture_in_->planes[0] = (void *)image->data_y;
+	picture_in_->planes[1] = (void *)image->data_u;
+	picture_in_->planes[2] = (void *)image->data_v;
+	picture_in_->stride[0] = (int)image->stride_y;
+	picture_in_->stride[1] = (int)image->stride_uv;
+	picture_in_->stride[2] = (int)image->stride_uv;
+	picture_in_->bitDepth = (int)bit_depth_;
+	picture_in_->pts = (int64_t)timestamp;
+
+	x265_nal *nals = nullptr;
+	uint32_t num_nals = 0;
+	const int n = x265_->encoder_encode(encoder_, &nals, &num_nals, picture_in_, picture_out_);
+	if (n < 0)
+		throw runtime_error("x265 encoding failed");
+	if (n > 0)
+		add_output(nals, num_nals, *picture_out_);
+}
+
+// Drain the pictures still held by the encoder
+//
+void Context::flush() {
+	for (;;) {
+		x265_nal *nals = nullptr;
+		uint32_t num_nals = 0;
+		const int n = x265_->encoder_encode(encoder_, &nals, &num_nals, nullptr, picture_out_);
+		if (n < 0)
+			throw runtime_error("x265 encoding failed");
+		if (n == 0)
+			break;
+		add_output(nals, num_nals, *picture_out_);
+	}
+	flushed_ = true;
+}
+
+void Context::add_output(const x265_nal *nals, uint32_t num_nals, const x265_picture &picture) {
+	Output output;
+
+	output.packet.swap(headers_);
+	for (uint32_t n = 0; n < num_nals; ++n)
+		output.packet.insert(output.packet.end(), nals[n].payload, nals[n].payload + nals[n].sizeBytes);
+
+	output.metadata.timestamp = (uint64_t)picture.pts;
+	output.metadata.poc = (uint64_t)picture.poc;
+	switch (picture.sliceType) {
+	case X265_TYPE_IDR:
+	case X265_TYPE_I:
+		output.metadata.frame_type = 0;
+		break;
+	case X265_TYPE_P:
+		output.metadata.frame_type = 1;
+		break;
+	default:
+		output.metadata.frame_type = 2;
+		break;
+	}
+	output.metadata.idr = picture.sliceType == X265_TYPE_IDR;
+
+	// Copy reconstruction - it belongs to the encoder, and changes with the next picture
+	const unsigned bpp = bit_depth_ > 8 ? 2 : 1;
+	const unsigned width_uv = (chroma_format_ == 444) ? width_ : (width_ + 1) / 2;
+	const unsigned height_uv = (chroma_format_ == 420) ? (height_ + 1) / 2 : height_;
+	const unsigned num_planes = (chroma_format_ == 400) ? 1 : 3;
+
+	const size_t size_y = (size_t)width_ * height_ * bpp;
+	const size_t size_uv = (size_t)width_uv * height_uv * bpp;
+	output.recon.resize(size_y + (num_planes - 1) * size_uv);
+
+	uint8_t *dst = output.recon.data();
+	for (unsigned p = 0; p < num_planes; ++p) {
+		const unsigned w = p ? width_uv : width_;
+		const unsigned h = p ? height_uv : height_;
+		const uint8_t *src = (const uint8_t *)picture.planes[p];
+		for (unsigned y = 0; y < h; ++y, dst += w * bpp)
+			memcpy(dst, src + (size_t)y * picture.stride[p], w * bpp);
+	}
+
+	CodecImage &image = output.recon_image;
+	memset(&image, 0, sizeof(image));
+	image.bpp = bpp;
+	image.width_y = width_;
+	image.height_y = height_;
+	image.stride_y = width_ * bpp;
+	image.data_y = output.recon.data();
+	if (num_planes > 1) {
+		image.width_uv = width_uv;
+		image.height_uv = height_uv;
+		image.stride_uv = width_uv * bpp;
+		image.data_u = image.data_y + size_y;
+		image.data_v = image.data_u + size_uv;
+	}
+
+	outputs_.push_back(std::move(output));
+}
+
+//// Codec API
+//
+int32_t create_context(CodecContext *cp, const char *json_configuration, CodecError *error) {
+	if (error)
+		*error = 0;
+
+	Context *context = new Context;
+	try {
+		context->open(json_configuration);
+	} catch (const std::exception &e) {
+		delete context;
+		SET_ERROR(error, e.what());
+		return 0;
+	}
+
+	*cp = (CodecContext)context;
+	return 1;
+}
+
+int32_t push_image(CodecContext c, const CodecImage *image, CodecMetadata metadata, int8_t eos, CodecError *error) {
+	Context *context = (Context *)c;
+	if (error)
+		*error = 0;
+
+	try {
+		const uint64_t timestamp = metadata ? ((const Metadata *)metadata)->timestamp : context->pushed_;
+		if (image && image->data_y) {
+			context->encode(image, timestamp);
+			context->pushed_++;
+		}
+		if (eos && !context->flushed_)
+			context->flush();
+		return 1;
+	} catch (const std::exception &e) {
+		SET_ERROR(error, e.what());
+		return 0;
+	}
+}
+
+int32_t pull_packet(CodecContext c, const uint8_t *data, size_t length, CodecMetadata *metadata, int8_t *eos,
+                    CodecError *error) {
+	Context *context = (Context *)c;
+	if (error)
+		*error = 0;
+	if (metadata)
+		*metadata = 0;
+
+	if (context->outputs_.empty()) {
+		if (eos)
+			*eos = context->flushed_ ? 1 : 0;
+		return 0;
+	}
+	if (eos)
+		*eos = 0;
+
+	Output &output = context->outputs_.front();
+	const int32_t size = (int32_t)output.packet.size();
+	if (!data || length < output.packet.size())
+		return size;
+
+	memcpy((uint8_t *)data, output.packet.data(), output.packet.size());
+	if (metadata)
+		*metadata = (CodecMetadata) new Metadata(output.metadata);
+
+	context->pulled_ = std::move(output);
+	context->outputs_.pop_front();
+	context->recon_pending_ = true;
+	return size;
+}
+
+int32_t pull_image(CodecContext c, CodecImage *image, CodecMetadata *metadata, int8_t *eos, CodecError *error) {
+	Context *context = (Context *)c;
+	if (error)
+		*error = 0;
+	if (metadata)
+		*metadata = 0;
+	if (eos)
+		*eos = (context->flushed_ && context->outputs_.empty() && !context->recon_pending_) ? 1 : 0;
+
+	if (!context->recon_pending_)
+		return 0;
+
+	*image = context->pulled_.recon_image;
+	if (metadata)
+		*metadata = (CodecMetadata) new Metadata(context->pulled_.metadata);
+	context->recon_pending_ = false;
+	return 1;
+}
+
+int32_t create_metadata(CodecMetadata *metadata, CodecError *error) {
+	if (error)
+		*error = 0;
+	*metadata = (CodecMetadata) new Metadata;
+	return 1;
+}
+
+void release_context(CodecContext c) { delete (Context *)c; }
+
+void release_error(CodecError e) { delete (Error *)e; }
+
+void release_metadata(CodecMetadata m) { delete (Metadata *)m; }
+
+const char *get_metadata_property_name(CodecMetadata, uint32_t id) {
+	switch (id) {
+	case PropertyID_Timestamp:
+		return "timestamp";
+	case PropertyID_PictureOrderCount:
+		return "picture_order_count";
+	case PropertyID_QP:
+		return "qp";
+	case PropertyID_FrameType:
+		return "frame_type";
+	case PropertyID_IDR:
+		return "idr";
+	default:
+		return 0;
+	}
+}
+
+uint64_t get_metadata_property_u64(CodecMetadata metadata, uint32_t id) {
+	const Metadata *m = (const Metadata *)metadata;
+	if (!m)
+		return 0;
+
+	switch (id) {
+	case PropertyID_Timestamp:
+		return m->timestamp;
+	case PropertyID_PictureOrderCount:
+		return m->poc;
+	case PropertyID_QP:
+		return m->qp;
+	case PropertyID_FrameType:
+		return m->frame_type;
+	case PropertyID_IDR:
+		return m->idr;
+	default:
+		return 0;
+	}
+}
+
+void set_metadata_property_u64(CodecMetadata metadata, uint32_t id, uint64_t v) {
+	Metadata *m = (Metadata *)metadata;
+	if (!m)
+		return;
+
+	switch (id) {
+	case PropertyID_Timestamp:
+		m->timestamp = v;
+		break;
+	case PropertyID_PictureOrderCount:
+		m->poc = v;
+		break;
+	case PropertyID_QP:
+		m->qp = (uint32_t)v;
+		break;
+	case PropertyID_FrameType:
+		m->frame_type = (uint32_t)v;
+		break;
+	case PropertyID_IDR:
+		m->idr = v != 0;
+		break;
+	default:
+		break;
+	}
+}
+
+uint32_t get_metadata_property_u32(CodecMetadata metadata, uint32_t id) {
+	return (uint32_t)get_metadata_property_u64(metadata, id);
+}
+
+int32_t get_metadata_property_i32(CodecMetadata metadata, uint32_t id) {
+	return (int32_t)get_metadata_property_u64(metadata, id);
+}
+
+int64_t get_metadata_property_i64(CodecMetadata metadata, uint32_t id) {
+	return (int64_t)get_metadata_property_u64(metadata, id);
+}
+
+int8_t get_metadata_property_bool(CodecMetadata metadata, uint32_t id) {
+	return get_metadata_property_u64(metadata, id) != 0;
+}
+
+void set_metadata_property_u32(CodecMetadata metadata, uint32_t id, uint32_t v) { set_metadata_property_u64(metadata, id, v); }
+
+void set_metadata_property_i32(CodecMetadata metadata, uint32_t id, int32_t v) {
+	set_metadata_property_u64(metadata, id, (uint64_t)v);
+}
+
+void set_metadata_property_i64(CodecMetadata metadata, uint32_t id, uint64_t v) { set_metadata_property_u64(metadata, id, v); }
+
+void set_metadata_property_bool(CodecMetadata metadata, uint32_t id, uint8_t v) { set_metadata_property_u64(metadata, id, v); }
+
+int32_t get_error_code(CodecError error) { return error ? ((const Error *)error)->code : 0; }
+
+size_t copy_string(const string &str, char *data, size_t length) {
+	if (data && length) {
+		const size_t n = min(str.size(), length - 1);
+		memcpy(data, str.data(), n);
+		data[n] = '\0';
+	}
+	return str.size();
+}
+
+size_t get_error_message(CodecError error, char *data, size_t length) {
+	return error ? copy_string(((const Error *)error)->message, data, length) : 0;
+}
+
+size_t get_error_file(CodecError error, char *filename, size_t length) {
+	return error ? copy_string(((const Error *)error)->file, filename, length) : 0;
+}
+
+uint32_t get_error_line(CodecError error) { return error ? ((const Error *)error)->line : 0; }
+
+const char codec_name[] = "x265";
+const char codec_version_string[] = "LTM x265";
+
+} // namespace
+
+CODEC_API_EXPORT uint32_t CodecAPI_Version() { return LOADABLE_CODEC_API_VERSION; }
+
+CODEC_API_EXPORT uint32_t CodecAPI_Query(int, const char *, uint32_t) { return 0; }
+
+CODEC_API_EXPORT Codec *CodecAPI_Create(const char *, CodecOperation operation, const char *) {
+	if (operation != CodecOperation_Encode)
+		return 0;
+
+	Codec *codec = LTMCodecAllocate(codec_name, codec_version_string, operation);
+
+	codec->create_context = create_context;
+	codec->push_image = push_image;
+	codec->pull_packet = pull_packet;
+	codec->pull_image = pull_image;
+	codec->create_metadata = create_metadata;
+
+	codec->release_context = release_context;
+	codec->release_error = release_error;
+	codec->release_metadata = release_metadata;
+
+	codec->get_metadata_property_name = get_metadata_property_name;
+	codec->get_metadata_property_u32 = get_metadata_property_u32;
+	codec->get_metadata_property_i32 = get_metadata_property_i32;
+	codec->get_metadata_property_u64 = get_metadata_property_u64;
+	codec->get_metadata_property_i64 = get_metadata_property_i64;
+	codec->get_metadata_property_bool = get_metadata_property_bool;
+
+	codec->set_metadata_property_u32 = set_metadata_property_u32;
+	codec->set_metadata_property_i32 = set_metadata_property_i32;
+	codec->set_metadata_property_u64 = set_metadata_property_u64;
+	codec->set_metadata_property_i64 = set_metadata_property_i64;
+	codec->set_metadata_property_bool = set_metadata_property_bool;
+
+	codec->get_error_code = get_error_code;
+	codec->get_error_message = get_error_message;
+	codec->get_error_file = get_error_file;
+	codec->get_error_line = get_error_line;
+
+	return codec;
+}
+
+CODEC_API_EXPORT void CodecAPI_Release(Codec *codec) {
+	if (!codec)
+		return;
+
+	LTMCodecFree(codec);
+}
@@ -134,6 +134,9 @@ private:
 	int32_t last_idr_frame_num;
 
 	Dithering dithering_;
+
+	// Generates random user data - advanced by const encoding steps
+	mutable Random user_data_random_;
 };
 
 } // namespace lctm
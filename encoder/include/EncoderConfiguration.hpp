@@ -70,6 +70,8 @@ struct EncoderConfiguration {
 	UserDataMethod user_data_method;
 
 	unsigned base_qp;
+
+	bool upsampling_dpi;
 };
 
 } // namespace lctm
@@ -86,7 +86,8 @@ public:
 class UserDataInsert : public Component {
 public:
 	UserDataInsert() : Component("UserDataInsert") {}
-	Surface process(const Surface &symbols, const UserDataMethod method, UserDataMode user_data, FILE *file=NULL);
+	Surface process(const Surface &symbols, const UserDataMethod method, UserDataMode user_data, Random &random,
+	                FILE *file = NULL);
 };
 
 } // namespace lctm
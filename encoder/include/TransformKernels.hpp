@@ -0,0 +1,53 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// TransformKernels.hpp
+//
+// Row kernels shared by the forward transforms - one output layer at a time from a basis vector
+//
+#pragma once
+
+#include "Surface.hpp"
+
+#include <cstdint>
+
+namespace lctm {
+
+// Generate one coefficient layer of an NxN (N = 2 or 4) block transform: each output is the dot product of the
+// block with 'basis' (raster order), divided by 'divisor' with the truncating semantics of C++ integer division.
+//
+// Uses SSE4.1/AVX2 kernels when the CPU has them, with the scalar code handling any remaining blocks.
+//
+Surface transform_layer(const Surface &residuals, unsigned block_size, const int32_t *basis, int32_t divisor);
+
+} // namespace lctm
@@ -70,6 +70,7 @@
 #include "TransformDDS_1D.hpp"
 #include "TransformDD_1D.hpp"
 #include "Upsampling.hpp"
+#include "UpsamplingDPI.hpp"
 
 #include "HuffmanDecoder.hpp"
 
@@ -90,10 +91,10 @@ using namespace std;
 
 // bitstream statistics
 #include "BitstreamStatistic.hpp"
-extern PsnrStatistic goPsnr;
-extern uint8_t gaucMd5Digest[][16];
-extern ReportStructure goReportStructure;
-extern priority_queue<ReportStructure, vector<ReportStructure, allocator<ReportStructure>>, ReportStructureComp> goReportQueue;
+extern thread_local PsnrStatistic goPsnr;
+extern thread_local uint8_t gaucMd5Digest[][16];
+extern thread_local ReportStructure goReportStructure;
+extern thread_local priority_queue<ReportStructure, vector<ReportStructure, allocator<ReportStructure>>, ReportStructureComp> goReportQueue;
 
 #define DELTA_SW
 
@@ -232,6 +233,7 @@ void Encoder::update_encoder_configuration(const Parameters &p, const Parameters
 	encoder_configuration_.sad_threshold = p["sad_threshold"].get<unsigned>(d);
 	encoder_configuration_.sad_coeff_threshold = p["sad_coeff_threshold"].get<unsigned>(d);
 	encoder_configuration_.quant_reduced_deadzone = p["quant_reduced_deadzone"].get<unsigned>(d);
+	encoder_configuration_.upsampling_dpi = p["upsampling_dpi"].get<bool>(false);
 	// clang-format on
 }
 
@@ -761,11 +763,11 @@ void Encoder::encode_residuals(unsigned plane, unsigned loq, const Surface &resi
 #if USER_DATA_EXTRACTION
 			FILE *file = fopen("userdata_enc.bin", "ab");
 			symbols[layer] = UserDataInsert().process(syms, encoder_configuration_.user_data_method,
-			                                          configuration_.global_configuration.user_data_enabled, file);
+			                                          configuration_.global_configuration.user_data_enabled, user_data_random_, file);
 			fclose(file);
 #else
 			symbols[layer] = UserDataInsert().process(syms, encoder_configuration_.user_data_method,
-			                                          configuration_.global_configuration.user_data_enabled);
+			                                          configuration_.global_configuration.user_data_enabled, user_data_random_);
 #endif
 		} else
 			symbols[layer] = syms;
@@ -1032,18 +1034,18 @@ Packet Encoder::encode(std::vector<std::unique_ptr<Image>> &src_image, const Ima
 	// Needed to randomly generate user data (part of CE)
 	if (configuration_.global_configuration.user_data_enabled) {
 		if (encoder_configuration_.user_data_method == UserDataMethod_Random)
-			Random().srand((unsigned)std::time(nullptr));
+			user_data_random_.srand((unsigned)std::time(nullptr));
 		else if (encoder_configuration_.user_data_method == UserDataMethod_FixedRandom)
-			Random().srand(45721);
+			user_data_random_.srand(45721);
 	}
 
 	configuration_.picture_configuration.temporal_refresh = false;
 
-	for (unsigned plane = 0; plane < src_image[0]->description().num_planes(); ++plane) {
-		const bool enhancement_enabled = configuration_.picture_configuration.enhancement_enabled &&
-		                                 plane < configuration_.global_configuration.num_processed_planes;
+	const unsigned num_planes = src_image[0]->description().num_planes();
 
-		//// Convert between base and enhancement bit depth
+	//// Convert between base and enhancement bit depth
+	Surface base_decoded_planes[MAX_NUM_PLANES];
+	for (unsigned plane = 0; plane < num_planes; ++plane) {
 		Surface base_image;
 		unsigned base_bit_depth = configuration_.global_configuration.base_depth;
 		if (configuration_.global_configuration.enhancement_depth > configuration_.global_configuration.base_depth &&
@@ -1055,11 +1057,43 @@ Packet Encoder::encode(std::vector<std::unique_ptr<Image>> &src_image, const Ima
 		} else {
 			base_image = base_prediction_image.plane(plane);
 		}
+		base_decoded_planes[plane] = ConvertToInternal().process(base_image, base_bit_depth);
+	}
+
+	//// Upsample all decoded base planes to preliminary intermediate picture in one go
+	//
+	// NB: Only here - the sub-layer 1 residuals are encoded from this prediction, so none are added, and the
+	// reconstructed intermediate picture is made a plane at a time, as encoding each plane updates the picture
+	// configuration used by the next.
+	Surface base_prediction_planes[MAX_NUM_PLANES];
+	if (encoder_configuration_.upsampling_dpi) {
+		const Surface no_residuals[MAX_NUM_PLANES];
+		switch (configuration_.global_configuration.scaling_mode[LOQ_LEVEL_1]) {
+		case ScalingMode_1D:
+			UpsamplingDPI_1D().process(base_prediction_planes, base_decoded_planes, no_residuals,
+			                           configuration_.global_configuration.upsample,
+			                           configuration_.global_configuration.predicted_residual_enabled,
+			                           configuration_.global_configuration.upsampling_coefficients);
+			break;
+		case ScalingMode_2D:
+			UpsamplingDPI().process(base_prediction_planes, base_decoded_planes, no_residuals,
+			                        configuration_.global_configuration.upsample,
+			                        configuration_.global_configuration.predicted_residual_enabled,
+			                        configuration_.global_configuration.upsampling_coefficients);
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (unsigned plane = 0; plane < num_planes; ++plane) {
+		const bool enhancement_enabled = configuration_.picture_configuration.enhancement_enabled &&
+		                                 plane < configuration_.global_configuration.num_processed_planes;
 
 		const Surface src = ConvertToInternal().process(src_image[0]->plane(plane), src_image[0]->description().bit_depth());
 		const Surface intermediate_src =
 		    ConvertToInternal().process(intermediate_src_image.plane(plane), intermediate_src_image.description().bit_depth());
-		const Surface base_decoded = ConvertToInternal().process(base_image, base_bit_depth);
+		const Surface &base_decoded = base_decoded_planes[plane];
 		Surface temporal_mask;
 
 		// Work out quantization matrix for each LoQ
@@ -1079,30 +1113,36 @@ Packet Encoder::encode(std::vector<std::unique_ptr<Image>> &src_image, const Ima
 		//// Upsample from decoded base picture to preliminary intermediate picture
 		//
 		Surface base_prediction;
-		switch (configuration_.global_configuration.scaling_mode[LOQ_LEVEL_1]) {
-		case ScalingMode_1D:
-			base_prediction = Upsampling_1D().process(base_decoded, configuration_.global_configuration.upsample,
-			                                          configuration_.global_configuration.upsampling_coefficients);
-			if (configuration_.global_configuration.predicted_residual_enabled) {
-				base_prediction = PredictedResidualAdjust_1D().process(base_decoded, base_prediction,
-				                                                       PredictedResidualSum_1D().process(base_prediction));
-			}
+		if (!base_prediction_planes[plane].empty()) {
+			// Upsampled above, along with the other planes
+			base_prediction = base_prediction_planes[plane];
 			base_decoded.dump(format("enc_base_deco_P%1d", plane));
-			break;
-		case ScalingMode_2D:
-			base_prediction = Upsampling().process(base_decoded, configuration_.global_configuration.upsample,
-			                                       configuration_.global_configuration.upsampling_coefficients);
-			if (configuration_.global_configuration.predicted_residual_enabled) {
-				base_prediction = PredictedResidualAdjust().process(base_decoded, base_prediction,
-				                                                    PredictedResidualSum().process(base_prediction));
+		} else {
+			switch (configuration_.global_configuration.scaling_mode[LOQ_LEVEL_1]) {
+			case ScalingMode_1D:
+				base_prediction = Upsampling_1D().process(base_decoded, configuration_.global_configuration.upsample,
+				                                          configuration_.global_configuration.upsampling_coefficients);
+				if (configuration_.global_configuration.predicted_residual_enabled) {
+					base_prediction = PredictedResidualAdjust_1D().process(base_decoded, base_prediction,
+					                                                       PredictedResidualSum_1D().process(base_prediction));
+				}
+				base_decoded.dump(format("enc_base_deco_P%1d", plane));
+				break;
+			case ScalingMode_2D:
+				base_prediction = Upsampling().process(base_decoded, configuration_.global_configuration.upsample,
+				                                       configuration_.global_configuration.upsampling_coefficients);
+				if (configuration_.global_configuration.predicted_residual_enabled) {
+					base_prediction = PredictedResidualAdjust().process(base_decoded, base_prediction,
+					                                                    PredictedResidualSum().process(base_prediction));
+				}
+				base_decoded.dump(format("enc_base_deco_P%1d", plane));
+				break;
+			case ScalingMode_None:
+				base_prediction = base_decoded;
+				break;
+			default:
+				CHECK(0);
 			}
-			base_decoded.dump(format("enc_base_deco_P%1d", plane));
-			break;
-		case ScalingMode_None:
-			base_prediction = base_decoded;
-			break;
-		default:
-			CHECK(0);
 		}
 
 		base_prediction.dump(format("enc_base_pred_P%1d", plane));
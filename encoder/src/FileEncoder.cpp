@@ -47,6 +47,7 @@
 
 #include <atomic>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <list>
 #include <map>
@@ -66,11 +67,14 @@
 #include "Upsampling.hpp"
 
 #include "BitstreamPacker.hpp"
+#include "Codec.hpp"
 #include "Diagnostics.hpp"
 #include "Image.hpp"
 #include "Misc.hpp"
 #include "Packet.hpp"
+#include "Parallel.hpp"
 #include "Probe.hpp"
+#include "Surface.hpp"
 #include "TemporalDecode.hpp"
 #include "YUVReader.hpp"
 #include "YUVWriter.hpp"
@@ -81,10 +85,10 @@ using namespace std;
 
 // bitstream statistics
 #include "BitstreamStatistic.hpp"
-extern PsnrStatistic goPsnr;
-extern uint8_t gaucMd5Digest[][16];
-extern ReportStructure goReportStructure;
-extern priority_queue<ReportStructure, vector<ReportStructure, allocator<ReportStructure>>, ReportStructureComp> goReportQueue;
+extern thread_local PsnrStatistic goPsnr;
+extern thread_local uint8_t gaucMd5Digest[][16];
+extern thread_local ReportStructure goReportStructure;
+extern thread_local priority_queue<ReportStructure, vector<ReportStructure, allocator<ReportStructure>>, ReportStructureComp> goReportQueue;
 
 using namespace vnova::utility;
 
@@ -93,6 +97,260 @@ using json = nlohmann::json;
 
 namespace lctm {
 
+//// BaseSource
+//
+// Where the enhancement encoder gets base access units, in decode order, and the base reconstruction of each picture
+//
+class BaseSource {
+public:
+	virtual ~BaseSource() {}
+
+	// Fetch next AU - return true if not end of stream
+	virtual bool next_au(ESFile::AccessUnit &au) = 0;
+
+	// Reconstruction of picture at display position 'frame' - only asked for once its AU has been fetched
+	virtual Image recon(unsigned frame) = 0;
+};
+
+//// BaseSourceFile
+//
+// Base from an elementary stream and a YUV file of reconstructions
+//
+class BaseSourceFile : public BaseSource {
+public:
+	BaseSourceFile(ESFile &es_file, const YUVReader &recon_file) : es_file_(es_file), recon_file_(recon_file) {}
+
+	bool next_au(ESFile::AccessUnit &au) override {
+		ESFile::Result rc = ESFile::EndOfFile;
+
+		try {
+			rc = es_file_.NextAccessUnit(au);
+		} catch (const DiagnosticsError &) {
+			throw;
+		} catch (const runtime_error &) {
+			rc = ESFile::NalParsingError;
+		}
+
+		return rc == ESFile::Success;
+	}
+
+	Image recon(unsigned frame) override { return recon_file_.read(frame, frame); }
+
+private:
+	ESFile &es_file_;
+	const YUVReader &recon_file_;
+};
+
+//// BaseSourceCodec
+//
+// Base from an encoder loaded through the codec API - pictures are pushed as the encoder needs them, and AUs and
+// reconstructions are taken straight from it. Pictures are tagged with their display position, which comes back as the POC.
+//
+class BaseSourceCodec : public BaseSource {
+public:
+	BaseSourceCodec(Codec *codec, CodecContext context, unsigned frame_count, const ImageDescription &description,
+	                std::function<Image(unsigned)> base_picture)
+	    : codec_(codec), context_(context), frame_count_(frame_count), description_(description),
+	      base_picture_(base_picture) {}
+
+	~BaseSourceCodec() override {
+		codec_->release_context(context_);
+		CodecRelease(codec_);
+	}
+
+	bool next_au(ESFile::AccessUnit &au) override;
+
+	Image recon(unsigned frame) override {
+		auto r = recons_.find(frame);
+		if (r == recons_.end())
+			ERR("No base reconstruction for picture %u", frame);
+		const Image image = r->second;
+		recons_.erase(r);
+		return image;
+	}
+
+private:
+	void push_picture();
+	void check(int32_t ok, CodecError error) const {
+		if (!ok)
+			ERR("Base encoder: %s", CodecErrorToString(codec_, error).c_str());
+	}
+
+	Codec *codec_;
+	CodecContext context_;
+	const unsigned frame_count_;
+	const ImageDescription description_;
+	std::function<Image(unsigned)> base_picture_;
+
+	unsigned pushed_ = 0;
+	std::map<uint64_t, Image> recons_;
+};
+
+// Give the encoder the next picture, or the end of stream
+//
+void BaseSourceCodec::push_picture() {
+	CodecError error = 0;
+	CodecMetadata metadata = 0;
+	check(codec_->create_metadata(&metadata, &error), error);
+
+	if (pushed_ < frame_count_) {
+		const Image image = base_picture_(pushed_);
+
+		// Views are kept until the push returns
+		const auto view_y = image.plane(0).view_as<uint8_t>();
+		const auto view_u = image.plane(description_.num_planes() > 1 ? 1 : 0).view_as<uint8_t>();
+		const auto view_v = image.plane(description_.num_planes() > 1 ? 2 : 0).view_as<uint8_t>();
+
+		CodecImage codec_image = {};
+		codec_image.bpp = image.plane(0).bpp();
+		codec_image.width_y = view_y.width();
+		codec_image.height_y = view_y.height();
+		codec_image.stride_y = view_y.stride();
+		codec_image.data_y = view_y.data();
+		if (description_.num_planes() > 1) {
+			codec_image.width_uv = view_u.width();
+			codec_image.height_uv = view_u.height();
+			codec_image.stride_uv = view_u.stride();
+			codec_image.data_u = view_u.data();
+			codec_image.data_v = view_v.data();
+		}
+
+		codec_->set_metadata_property_u64(metadata, PropertyID_Timestamp, pushed_);
+		pushed_++;
+		check(codec_->push_image(context_, &codec_image, metadata, pushed_ == frame_count_, &error), error);
+	} else {
+		pushed_++;
+		check(codec_->push_image(context_, 0, metadata, 1, &error), error);
+	}
+
+	codec_->release_metadata(metadata);
+}
+
+bool BaseSourceCodec::next_au(ESFile::AccessUnit &au) {
+	// Push pictures until a packet comes out
+	int32_t size = 0;
+	int8_t eos = 0;
+	CodecError error = 0;
+	for (;;) {
+		size = codec_->pull_packet(context_, 0, 0, 0, &eos, &error);
+		check(size >= 0, error);
+		if (size > 0)
+			break;
+		if (eos || pushed_ > frame_count_)
+			return false;
+		push_picture();
+	}
+
+	DataBuffer packet(size);
+	CodecMetadata metadata = 0;
+	check(codec_->pull_packet(context_, packet.data(), packet.size(), &metadata, &eos, &error) == size, error);
+
+	au = ESFile::AccessUnit();
+	au.m_poc = (int64_t)codec_->get_metadata_property_u64(metadata, PropertyID_Timestamp);
+	au.m_qp = (int32_t)codec_->get_metadata_property_u32(metadata, PropertyID_QP);
+	au.m_size = size;
+	switch (codec_->get_metadata_property_u32(metadata, PropertyID_FrameType)) {
+	case 0:
+		au.m_pictureType = codec_->get_metadata_property_bool(metadata, PropertyID_IDR) ? BaseDecPictType::IDR : BaseDecPictType::I;
+		break;
+	case 1:
+		au.m_pictureType = BaseDecPictType::P;
+		break;
+	default:
+		au.m_pictureType = BaseDecPictType::B;
+		break;
+	}
+	codec_->release_metadata(metadata);
+
+	// Split into NAL units at start codes - each unit keeps its own start code
+	std::vector<size_t> starts;
+	for (size_t i = 0; i + 3 <= packet.size(); ++i) {
+		if (packet[i] == 0 && packet[i + 1] == 0 && packet[i + 2] == 1) {
+			starts.push_back((i > 0 && packet[i - 1] == 0) ? i - 1 : i);
+			i += 2;
+		}
+	}
+	for (size_t n = 0; n < starts.size(); ++n) {
+		const size_t end = (n + 1 < starts.size()) ? starts[n + 1] : packet.size();
+		ESFile::NalUnit nal_unit;
+		const size_t header = starts[n] + (packet[starts[n] + 2] == 1 ? 3 : 4);
+		nal_unit.m_type = header < end ? (packet[header] >> 1) & 0x3f : 0;
+		nal_unit.m_data.assign(packet.begin() + starts[n], packet.begin() + end);
+		au.m_nalUnits.push_back(std::move(nal_unit));
+	}
+
+	// Reconstruction of this AU
+	CodecImage codec_image = {};
+	if (codec_->pull_image(context_, &codec_image, 0, &eos, &error)) {
+		std::vector<Surface> surfaces;
+		const uint8_t *data[3] = {codec_image.data_y, codec_image.data_u, codec_image.data_v};
+		for (unsigned p = 0; p < description_.num_planes(); ++p) {
+			const unsigned stride = p ? codec_image.stride_uv : codec_image.stride_y;
+			auto b = Surface::build_from<int8_t>();
+			b.reserve_bpp(description_.width(p), description_.height(p), description_.byte_depth(), description_.row_stride(p));
+			for (unsigned y = 0; y < description_.height(p); ++y)
+				memcpy(b.data(0, y), data[p] + (size_t)y * stride, description_.row_size(p));
+			surfaces.push_back(b.finish());
+		}
+		recons_.erase(au.m_poc);
+		recons_.emplace(au.m_poc, Image(format("base_recon:%u", (unsigned)au.m_poc), description_, au.m_poc, surfaces));
+	} else {
+		check(error == 0, error);
+		ERR("No base reconstruction for picture %u", (unsigned)au.m_poc);
+	}
+
+	return true;
+}
+
+// The reading end of a pipe from a streaming base encoder, along with the writing end held open for it by
+// open_fifo_spooled(). Whatever has not been handed on is let go in order: the held end first, so that closing the
+// stream sees the end of the pipe.
+//
+struct BasePipe {
+	FILE *stream = nullptr;
+	int hold = -1;
+
+	BasePipe() = default;
+	BasePipe(const BasePipe &) = delete;
+	BasePipe &operator=(const BasePipe &) = delete;
+	~BasePipe() {
+		release_fifo_reader(hold);
+		if (stream)
+			fclose(stream);
+	}
+
+	FILE *take_stream() {
+		FILE *s = stream;
+		stream = nullptr;
+		return s;
+	}
+	int take_hold() {
+		const int h = hold;
+		hold = -1;
+		return h;
+	}
+};
+
+// A thread that is waited for when it goes out of scope, including on the way out of an exception
+//
+class JoiningThread {
+public:
+	JoiningThread() = default;
+	JoiningThread(const JoiningThread &) = delete;
+	JoiningThread &operator=(const JoiningThread &) = delete;
+	~JoiningThread() { join(); }
+
+	template <typename F> void start(F fn) { thread_ = std::thread(fn); }
+	void join() {
+		if (thread_.joinable())
+			thread_.join();
+	}
+
+private:
+	std::thread thread_;
+};
+
+
 // Implementation is specialised for base codec
 //
 class FileEncoderImpl : public FileEncoder {
@@ -125,13 +383,44 @@ public:
 
 protected:
 	// Body of encode loop
-	void encode(const YUVReader &src_file, const YUVReader &recon_file, FILE *output_file, ESFile &es_file,
-	            const string &dst_filename_yuv, unsigned limit);
+	void encode(const YUVReader &src_file, BaseSource &base, FILE *output_file, const string &dst_filename_yuv, unsigned limit);
+
+	// Encode from 'src' YUV file, running the base encoder in process through the codec API
+	void encode_file_with_codec(Codec *codec, const string &src_filename, const string &dst_filename,
+	                            const string &dst_filename_yuv, unsigned limit);
+
+	// Part of a sequence that is encoded by an encoder of its own
+	struct Segment {
+		unsigned first = 0;
+		unsigned count = 0;
+		string stream_filename;
+		string recon_filename;
+		PsnrStatistic psnr = {};
+	};
+
+	// Encode from 'src' YUV file, as segments of whole intra periods on 'num_threads' threads - false if the source
+	// cannot be split
+	bool encode_file_segmented(const string &src_filename, const string &dst_filename, const string &dst_filename_yuv,
+	                           unsigned limit, unsigned num_threads);
+
+	// Encode one segment with a new encoder
+	void encode_segment(const string &src_filename, bool recon, Segment &segment) const;
+
+	// Source picture to base resolution and depth
+	Image downsample_base(const Image &src) const;
 
-	bool read_au(ESFile &es_file, ESFile::AccessUnit &au);
 	Packet rbsp_encapsulate(const Packet &src) const;
 
 	void initialize_encoder(const YUVReader &src_file, unsigned limit);
+
+	// Print PSNR and bit rates accumulated in goPsnr
+	void report_summary(unsigned frames) const;
+
+	unique_ptr<YUVReader> open_yuv(const string &filename, const ImageDescription &description) const;
+
+	// Open the source YUV file - just the pictures of the segment, if encoding one
+	unique_ptr<YUVReader> open_source(const string &filename) const;
+
 	struct RegisteredSEI {
 		static Packet sei_payload(const Packet &enhancement_data);
 	};
@@ -148,6 +437,10 @@ protected:
 
 	virtual bool run_base_encoder(const string &input, const string &stream_output, const string &recon_output,
 	                              unsigned frame_count) const = 0;
+	// True if the base encoder writes its outputs front to back, so they can be pipes
+	virtual bool base_encoder_can_stream() const { return false; }
+	// Name of the base encoder library for the codec API, or empty if there is none
+	virtual string codec_api_name() const { return ""; }
 	virtual bool run_base_decoder(const string &input, const string &output) = 0;
 
 	// Size, format & depth - base, intermediate & full resolution
@@ -163,6 +456,10 @@ protected:
 
 	const Encapsulation encapsulation_;
 
+	// If encoding a segment - the first source picture, and number of pictures (0 if not a segment)
+	unsigned segment_first_ = 0;
+	unsigned segment_count_ = 0;
+
 	Encoder encoder_;
 };
 
@@ -180,10 +477,39 @@ FileEncoderImpl::FileEncoderImpl(const ImageDescription &image_description, unsi
 
 FileEncoderImpl::~FileEncoderImpl() {}
 
+// Open a YUV file for reading - frames can be mapped rather than copied in, if configured
+//
+unique_ptr<YUVReader> FileEncoderImpl::open_yuv(const string &filename, const ImageDescription &description) const {
+	unique_ptr<YUVReader> reader(CHECK(CreateYUVReader(filename, description, fps_)));
+	reader->set_memory_mapped(parameters_["mapped_input"].get<bool>(false));
+	return reader;
+}
+
+unique_ptr<YUVReader> FileEncoderImpl::open_source(const string &filename) const {
+	unique_ptr<YUVReader> reader(open_yuv(filename, encoder_.src_image_description()));
+	if (segment_count_)
+		reader->set_window(segment_first_, segment_count_);
+	return reader;
+}
+
 //
 //
 void FileEncoderImpl::encode_file(const string &src_filename, const string &dst_filename, const string &dst_filename_yuv,
                                   unsigned limit) {
+	const unsigned segment_parallel = parameters_["segment_parallel"].get<unsigned>(0);
+	if (segment_parallel && !segment_count_ &&
+	    encode_file_segmented(src_filename, dst_filename, dst_filename_yuv, limit, segment_parallel))
+		return;
+
+	if (parameters_["base_codec_api"].get<bool>(false)) {
+		if (!codec_api_name().empty()) {
+			encode_file_with_codec(CHECK(CodecCreate(codec_api_name(), CodecOperation_Encode, "")), src_filename, dst_filename,
+			                       dst_filename_yuv, limit);
+			return;
+		}
+		WARN("No codec API base encoder for this base - running it as a program.");
+	}
+
 	// Temp. input file to encode
 	//
 	string base_yuv_filename = make_temporary_filename("_base.yuv");
@@ -207,46 +533,107 @@ void FileEncoderImpl::encode_file(const string &src_filename, const string &dst_
 
 	// Read source and downsample into base
 	//
-	unique_ptr<YUVReader> src_file(CHECK(CreateYUVReader(src_filename, encoder_.src_image_description(), fps_)));
+	unique_ptr<YUVReader> src_file(open_source(src_filename));
 	initialize_encoder(*src_file, limit);
 	auto base_yuv = CHECK(CreateYUVWriter(base_yuv_filename, encoder_.base_image_description(), true));
 
 	int64_t pts = 0;
 	int64_t duration = 90000L / fps_;
 
-	const unsigned frame_count = min(src_file->length(), limit);
-	INFO("input limit %8d - local count %8d", limit, frame_count);
-	const bool level1_depth_flag = encoder_.level1_depth_flag();
+	// The source is read again to encode the enhancement - a stream is kept in a temporary file on the way through
+	string src_spool_filename;
+	unique_ptr<YUVWriter> src_spool;
+	if (src_file->is_stream()) {
+		src_spool_filename = make_temporary_filename("_source.yuv");
+		INFO("Using temporary file for streamed source: %s", src_spool_filename.c_str());
+		src_spool = CHECK(CreateYUVWriter(src_spool_filename, src_file->description(), false));
+	}
 
-	for (unsigned f = 0; f < frame_count; ++f, pts += duration) {
+	unsigned frame_count = 0;
+	for (; frame_count < limit && src_file->has_frame(frame_count); ++frame_count, pts += duration) {
+		const unsigned f = frame_count;
 		INFO("Writing base %d", f);
-		const Image src = ExpandImage(src_file->read(f, pts), encoder_.enhancement_image_description());
-		// Downsample and bit shifting depending base and enhancement bit depths
-		const Image img = DownsampleImage(DownsampleImage(src, downsample_luma_, downsample_chroma_, scaling_mode_[LOQ_LEVEL_2],
-		                                                  level1_depth_flag ? 0 : encoder_.base_image_description().bit_depth()),
-		                                  downsample_luma_, downsample_chroma_, scaling_mode_[LOQ_LEVEL_1],
-		                                  level1_depth_flag ? encoder_.base_image_description().bit_depth()	: 0);
-		base_yuv->write(img);
+		if (src_spool)
+			src_spool->write(src_file->read(f, pts));
+		base_yuv->write(downsample_base(src_file->read(f, pts)));
 	}
+	INFO("input limit %8d - local count %8d", limit, frame_count);
 
-	// Run the base encoder yuv-file-> es-file and recon
-	run_base_encoder(base_yuv->filename(), base_bin_filename, base_recon_filename, frame_count);
-
-	// Open file
-	unique_ptr<YUVReader> recon_file(CHECK(CreateYUVReader(base_recon_filename, encoder_.base_image_description(), fps_)));
+	if (src_spool) {
+		src_spool->close();
+		src_file = open_yuv(src_spool_filename, encoder_.src_image_description());
+	}
 
-	UniquePtrFile output_file(CHECK(fopen(format("%s", dst_filename.c_str()).c_str(), "wb")));
+	// Streaming runs the base encoder alongside the enhancement encoder, with its outputs going through pipes
+	bool streaming = parameters_["base_streaming"].get<bool>(false);
+	if (streaming && (parameters_["keep_base"].get<bool>(false) || !base_encoder_can_stream())) {
+		WARN("Base encoder output cannot be streamed - running it to completion first.");
+		streaming = false;
+	}
+	if (streaming && !(make_fifo(base_bin_filename) && make_fifo(base_recon_filename))) {
+		WARN("Cannot make pipes for base encoder output - running it to completion first.");
+		::remove(base_bin_filename.c_str());
+		::remove(base_recon_filename.c_str());
+		streaming = false;
+	}
 
+	unique_ptr<YUVReader> recon_file;
 	ESFile es_file;
-	CHECK(es_file.Open(base_bin_filename, es_file_type()));
+	bool base_ok = true;
+
+	// Declared after the readers, so that if anything throws, the base encoder is waited for before they are closed
+	JoiningThread base_thread;
+
+	if (streaming) {
+		INFO("Streaming base encoder output");
+		// Both pipes are open for reading before the base encoder starts, and are released once it has gone - so readers
+		// see end of file even if it never opened them
+		BasePipe es_pipe, recon_pipe;
+		es_pipe.stream = CHECK(open_fifo_spooled(base_bin_filename, es_pipe.hold));
+		recon_pipe.stream = CHECK(open_fifo_spooled(base_recon_filename, recon_pipe.hold));
+
+		const int es_hold = es_pipe.take_hold(), recon_hold = recon_pipe.take_hold();
+		base_thread.start([&, es_hold, recon_hold]() {
+			try {
+				base_ok = run_base_encoder(base_yuv->filename(), base_bin_filename, base_recon_filename, frame_count);
+			} catch (const std::exception &e) {
+				WARN("Base encoder: %s", e.what());
+				base_ok = false;
+			}
+			release_fifo_reader(es_hold);
+			release_fifo_reader(recon_hold);
+		});
+
+		recon_file = CreateYUVReader(recon_pipe.take_stream(), base_recon_filename, encoder_.base_image_description(), fps_);
+		CHECK(es_file.Open(es_pipe.take_stream(), es_file_type()));
+	} else {
+		// Run the base encoder yuv-file-> es-file and recon
+		run_base_encoder(base_yuv->filename(), base_bin_filename, base_recon_filename, frame_count);
+
+		// Open file
+		recon_file = open_yuv(base_recon_filename, encoder_.base_image_description());
+		CHECK(es_file.Open(base_bin_filename, es_file_type()));
+	}
+
+	UniquePtrFile output_file(CHECK(fopen(format("%s", dst_filename.c_str()).c_str(), "wb")));
 
 	// Encode enhancement given src, base and base_recon
 	clock_t EnhaClock1 = clock();
 
-	encode(*src_file, *recon_file, output_file.get(), es_file, dst_filename_yuv, limit);
+	BaseSourceFile base(es_file, *recon_file);
+	encode(*src_file, base, output_file.get(), dst_filename_yuv, limit);
 
 	clock_t EnhaClock2 = clock();
 
+	// Closing the pipes waits for the base encoder to finish writing
+	if (streaming) {
+		es_file.Close();
+		recon_file.reset();
+		base_thread.join();
+		if (!base_ok)
+			ERR("Base encoder failed");
+	}
+
 	INFO("**** Encode enhancement. delta. %16d secs", (EnhaClock2 - EnhaClock1) / CLOCKS_PER_SEC);
 	// Clear up
 	if (!parameters_["keep_base"].get<bool>(false)) {
@@ -254,13 +641,215 @@ void FileEncoderImpl::encode_file(const string &src_filename, const string &dst_
 		::remove(base_bin_filename.c_str());
 		::remove(base_recon_filename.c_str());
 	}
+	if (!src_spool_filename.empty())
+		::remove(src_spool_filename.c_str());
+}
+
+// Encode with the base encoder driven a picture at a time - there are no intermediate files, and base AUs are enhanced
+// as they come out of the encoder
+//
+void FileEncoderImpl::encode_file_with_codec(Codec *codec, const string &src_filename, const string &dst_filename,
+                                             const string &dst_filename_yuv, unsigned limit) {
+	unique_ptr<YUVReader> src_file(open_source(src_filename));
+	initialize_encoder(*src_file, limit);
+
+	// The source is read again by the enhancement encoder, behind the base encoder's lookahead - a stream is kept in a
+	// temporary file
+	string src_spool_filename;
+	if (src_file->is_stream()) {
+		src_spool_filename = make_temporary_filename("_source.yuv");
+		INFO("Using temporary file for streamed source: %s", src_spool_filename.c_str());
+		auto src_spool = CHECK(CreateYUVWriter(src_spool_filename, src_file->description(), false));
+		for (unsigned f = 0; f < limit && src_file->has_frame(f); ++f)
+			src_spool->write(src_file->read(f, f));
+		src_spool->close();
+		src_file = open_yuv(src_spool_filename, encoder_.src_image_description());
+	}
+
+	unsigned frame_count = 0;
+	while (frame_count < limit && src_file->has_frame(frame_count))
+		++frame_count;
+
+	const ImageDescription &description = encoder_.base_image_description();
+	unsigned chroma_format = 420;
+	switch (description.colourspace()) {
+	case Colourspace_Y:
+		chroma_format = 400;
+		break;
+	case Colourspace_YUV420:
+		chroma_format = 420;
+		break;
+	case Colourspace_YUV422:
+		chroma_format = 422;
+		break;
+	case Colourspace_YUV444:
+		chroma_format = 444;
+		break;
+	default:
+		ERR("Not a colour space");
+	}
+
+	json options = parameters_["base_codec_options"].empty() ? json::object()
+	                                                         : json::parse(parameters_["base_codec_options"].get<string>());
+	options["width"] = description.width();
+	options["height"] = description.height();
+	options["bit_depth"] = description.bit_depth();
+	options["chroma_format"] = chroma_format;
+	options["fps"] = fps_;
+	options["qp"] = encoder_.base_qp();
+	options["intra_period"] = intra_period();
+
+	CodecContext context = 0;
+	CodecError error = 0;
+	if (!codec->create_context(&context, options.dump().c_str(), &error))
+		ERR("Base encoder: %s", CodecErrorToString(codec, error).c_str());
+
+	INFO("Using codec API base encoder: %s", codec_api_name().c_str());
+
+	const int64_t duration = 90000L / fps_;
+	BaseSourceCodec base(codec, context, frame_count, description,
+	                     [&](unsigned f) { return downsample_base(src_file->read(f, f * duration)); });
+
+	UniquePtrFile output_file(CHECK(fopen(format("%s", dst_filename.c_str()).c_str(), "wb")));
+	encode(*src_file, base, output_file.get(), dst_filename_yuv, limit);
+
+	if (!src_spool_filename.empty())
+		::remove(src_spool_filename.c_str());
+}
+
+// Split the sequence into runs of whole intra periods, each starting with an IDR, and encode them at the same time with
+// encoders of their own - base and enhancement. The elementary streams of the runs are joined in order.
+//
+bool FileEncoderImpl::encode_file_segmented(const string &src_filename, const string &dst_filename,
+                                            const string &dst_filename_yuv, unsigned limit, unsigned num_threads) {
+	if (parameters_["keep_base"].get<bool>(false)) {
+		WARN("Cannot keep the base of a segmented encode - encoding in one piece.");
+		return false;
+	}
+
+	unsigned frame_count = 0;
+	{
+		unique_ptr<YUVReader> src_file(open_yuv(src_filename, encoder_.src_image_description()));
+		if (src_file->is_stream()) {
+			WARN("Cannot split a streamed source - encoding in one piece.");
+			return false;
+		}
+		while (frame_count < limit && src_file->has_frame(frame_count))
+			++frame_count;
+	}
+	if (frame_count == 0)
+		ERR("Frames cannot be read from source.");
+
+	// Back to back AVC IDRs need different idr_pic_ids, so a segment is never a single picture
+	const unsigned segment_length = std::max(intra_period(), 2u);
+	vector<Segment> segments;
+	for (unsigned first = 0; first < frame_count; first += segment_length) {
+		Segment segment;
+		segment.first = first;
+		segment.count = std::min(segment_length, frame_count - first);
+		segments.push_back(segment);
+	}
+	if (segments.size() > 1 && segments.back().count == 1) {
+		segments.pop_back();
+		segments.back().count++;
+	}
+
+	INFO("Encoding %u pictures as %u segments on %u threads", frame_count, (unsigned)segments.size(), num_threads);
+
+	UniquePtrFile output_file(CHECK(fopen(format("%s", dst_filename.c_str()).c_str(), "wb")));
+	unique_ptr<YUVWriter> recon_writer;
+	if (!dst_filename_yuv.empty()) {
+		recon_writer = CreateYUVWriter(dst_filename_yuv, encoder_.src_image_description(), false);
+		recon_writer->set_rate((float)fps_);
+	}
+
+	// Segments are encoded on worker threads, and joined to the output here in order
+	PsnrStatistic psnr = {};
+	try {
+		parallel_ordered(
+		    (unsigned)segments.size(), num_threads,
+		    [&](unsigned s) { encode_segment(src_filename, !dst_filename_yuv.empty(), segments[s]); },
+		    [&](unsigned s) {
+			    const Segment &segment = segments[s];
+
+			    // Each segment's stream starts again from POC 0 at an IDR - readers offset POCs across IDRs (see
+			    // ESFile::GenerateIncreasingPOC()), so the joined stream has increasing POCs and timestamps
+			    {
+				    UniquePtrFile stream(CHECK(fopen(segment.stream_filename.c_str(), "rb")));
+				    uint8_t buffer[65536];
+				    size_t n;
+				    while ((n = fread(buffer, 1, sizeof(buffer), stream.get())) > 0)
+					    CHECK(fwrite(buffer, 1, n, output_file.get()) == n);
+			    }
+			    ::remove(segment.stream_filename.c_str());
+
+			    if (recon_writer) {
+				    unique_ptr<YUVReader> recon(
+				        CHECK(CreateYUVReader(segment.recon_filename, encoder_.src_image_description(), fps_)));
+				    for (unsigned f = 0; f < segment.count; ++f)
+					    recon_writer->write(recon->read(f));
+				    ::remove(segment.recon_filename.c_str());
+			    }
+
+			    psnr.miBaseBytes += segment.psnr.miBaseBytes;
+			    psnr.miEnhancementBytes += segment.psnr.miEnhancementBytes;
+			    for (unsigned plane = 0; plane < 3; ++plane)
+				    psnr.mfAccMse[plane] += segment.psnr.mfAccMse[plane];
+		    });
+	} catch (...) {
+		// Segments encoded, or part encoded, but not joined to the output
+		for (const auto &segment : segments) {
+			if (!segment.stream_filename.empty())
+				::remove(segment.stream_filename.c_str());
+			if (!segment.recon_filename.empty())
+				::remove(segment.recon_filename.c_str());
+		}
+		throw;
+	}
+
+	goPsnr = psnr;
+	report_summary(frame_count);
+	return true;
+}
+
+void FileEncoderImpl::encode_segment(const string &src_filename, bool recon, Segment &segment) const {
+	// Debugging dumps and reconstruction go to files of this segment's own
+	const string prefix = make_temporary_filename(format("segment%u_", segment.first));
+	SurfaceDumps dumps(prefix);
+	dumps.set_enabled(Surface::get_dump_surfaces());
+	SurfaceDumps::Scope dumps_scope(&dumps);
+
+	segment.stream_filename = make_temporary_filename("_segment.lvc");
+	if (recon)
+		segment.recon_filename = prefix + "recon.yuv";
+
+	unique_ptr<FileEncoder> file_encoder(CHECK(CreateFileEncoder(base_coding(), encoder_.src_image_description(), fps_, parameters_)));
+	FileEncoderImpl &impl = static_cast<FileEncoderImpl &>(*file_encoder);
+	impl.segment_first_ = segment.first;
+	impl.segment_count_ = segment.count;
+
+	// Statistics are per thread
+	goPsnr = PsnrStatistic();
+	impl.encode_file(src_filename, segment.stream_filename, recon ? "recon.yuv" : "", segment.count);
+	segment.psnr = goPsnr;
+}
+
+// Downsample and bit shifting depending base and enhancement bit depths
+//
+Image FileEncoderImpl::downsample_base(const Image &src) const {
+	const bool level1_depth_flag = encoder_.level1_depth_flag();
+	const Image expanded = ExpandImage(src, encoder_.enhancement_image_description());
+	return DownsampleImage(DownsampleImage(expanded, downsample_luma_, downsample_chroma_, scaling_mode_[LOQ_LEVEL_2],
+	                                       level1_depth_flag ? 0 : encoder_.base_image_description().bit_depth()),
+	                       downsample_luma_, downsample_chroma_, scaling_mode_[LOQ_LEVEL_1],
+	                       level1_depth_flag ? encoder_.base_image_description().bit_depth() : 0);
 }
 
 void FileEncoderImpl::encode_file_with_decoder(const string &src_filename, const string base_filename, const string &dst_filename,
                                                const string &dst_filename_yuv, unsigned limit) {
 
 	// Initialize encoder to derive final dimensions
-	unique_ptr<YUVReader> src_file(CHECK(CreateYUVReader(src_filename, encoder_.src_image_description(), fps_)));
+	unique_ptr<YUVReader> src_file(open_yuv(src_filename, encoder_.src_image_description()));
 	initialize_encoder(*src_file, limit);
 
 	// Verify dimensions of base input
@@ -283,14 +872,15 @@ void FileEncoderImpl::encode_file_with_decoder(const string &src_filename, const
 	run_base_decoder(base_filename, base_recon_filename);
 
 	// Open file
-	unique_ptr<YUVReader> recon_file(CHECK(CreateYUVReader(base_recon_filename, encoder_.base_image_description(), fps_)));
+	unique_ptr<YUVReader> recon_file(open_yuv(base_recon_filename, encoder_.base_image_description()));
 
 	UniquePtrFile output_file(CHECK(fopen(format("%s", dst_filename.c_str()).c_str(), "wb")));
 
 	ESFile es_file;
 	CHECK(es_file.Open(base_filename, es_file_type()));
 
-	encode(*src_file, *recon_file, output_file.get(), es_file, dst_filename_yuv, limit);
+	BaseSourceFile base(es_file, *recon_file);
+	encode(*src_file, base, output_file.get(), dst_filename_yuv, limit);
 
 	// Clear up
 	if (!parameters_["keep_base"].get<bool>(false)) {
@@ -298,20 +888,6 @@ void FileEncoderImpl::encode_file_with_decoder(const string &src_filename, const
 	}
 }
 
-// Fetch next AU from an ES file - return true if not EOF
-//
-bool FileEncoderImpl::read_au(ESFile &es_file, ESFile::AccessUnit &au) {
-	ESFile::Result rc = ESFile::EndOfFile;
-
-	try {
-		rc = es_file.NextAccessUnit(au);
-	} catch (const runtime_error &) {
-		rc = ESFile::NalParsingError;
-	}
-
-	return rc == ESFile::Success;
-}
-
 static BaseFrameType frame_type(BaseDecPictType::Enum pt) {
 	switch (pt) {
 	case BaseDecPictType::IDR:
@@ -340,8 +916,8 @@ void FileEncoderImpl::encode_file_with_base(const string &src_filename, const st
                                             const string &dst_filename_yuv, unsigned limit) {
 	// Open files
 	//
-	unique_ptr<YUVReader> src_file(CHECK(CreateYUVReader(src_filename, encoder_.src_image_description(), fps_)));
-	unique_ptr<YUVReader> recon_file(CHECK(CreateYUVReader(base_recon_filename, encoder_.base_image_description(), fps_)));
+	unique_ptr<YUVReader> src_file(open_yuv(src_filename, encoder_.src_image_description()));
+	unique_ptr<YUVReader> recon_file(open_yuv(base_recon_filename, encoder_.base_image_description()));
 
 	initialize_encoder(*src_file, limit);
 
@@ -361,15 +937,16 @@ void FileEncoderImpl::encode_file_with_base(const string &src_filename, const st
 	ESFile es_file;
 	CHECK(es_file.Open(base_filename, es_file_type()));
 
-	encode(*src_file, *recon_file, output_file.get(), es_file, dst_filename_yuv, limit);
+	BaseSourceFile base(es_file, *recon_file);
+	encode(*src_file, base, output_file.get(), dst_filename_yuv, limit);
 }
 
 template <typename T, typename... Args> std::unique_ptr<T> make_unique(Args &&...args) {
 	return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
 }
 
-void FileEncoderImpl::encode(const YUVReader &src_file, const YUVReader &recon_file, FILE *output_file, ESFile &es_file,
-                             const string &dst_filename_yuv, unsigned limit) {
+void FileEncoderImpl::encode(const YUVReader &src_file, BaseSource &base, FILE *output_file, const string &dst_filename_yuv,
+                             unsigned limit) {
 
 	// Queue of pending AUs, so that enhancment can be encoded in display order
 	deque<ESFile::AccessUnit> pending;
@@ -380,8 +957,7 @@ void FileEncoderImpl::encode(const YUVReader &src_file, const YUVReader &recon_f
 	encoder_.set_last_idr_frame_num(0);
 	std::vector<std::unique_ptr<Image>> src;
 
-	const unsigned num_frames = std::min(src_file.length(), limit);
-	if (num_frames == 0)
+	if (limit == 0 || !src_file.has_frame(0))
 		ERR("Frames cannot be read from source.");
 
 	// Fill with initial frame
@@ -391,7 +967,7 @@ void FileEncoderImpl::encode(const YUVReader &src_file, const YUVReader &recon_f
 
 		// Get next AU from base stream
 		ESFile::AccessUnit au;
-		if (read_au(es_file, au))
+		if (base.next_au(au))
 			pending.push_front(au);
 		else
 			end_of_es = true;
@@ -408,23 +984,25 @@ void FileEncoderImpl::encode(const YUVReader &src_file, const YUVReader &recon_f
 				if (a.m_poc == enhance_poc) {
 					if (display_frame != 0)
 						src.erase(src.begin());
-					if (src.size() < 2 && (display_frame + 1) < src_file.length()) {
+					if (src.size() < 2 && src_file.has_frame(display_frame + 1)) {
 						src.push_back(make_unique<Image>(ExpandImage(src_file.read(display_frame + 1, display_frame + 1),
 						                                             encoder_.enhancement_image_description())));
 					}
 
-					const Image recon = recon_file.read(display_frame, display_frame);
+					const Image recon = base.recon(display_frame);
 
 					const Image src_intermediate =
 					    DownsampleImage(*src[0], downsample_luma_, downsample_chroma_, scaling_mode_[LOQ_LEVEL_2],
 					                    encoder_.intermediate_image_description().bit_depth());
 
-					// Enhancement encoding
-					const bool is_idr = a.m_pictureType == BaseDecPictType::IDR;
+					// Enhancement encoding - a segment always starts with an IDR, whatever the base calls its first picture
+					const bool is_idr = a.m_pictureType == BaseDecPictType::IDR || (segment_count_ && display_frame == 0);
 					Packet pss = encoder_.encode(src, src_intermediate, recon, frame_type(a.m_pictureType), is_idr, display_frame,
 					                             dst_filename_yuv);
 
-					goReportStructure.miTimeStamp = (int)a.m_poc;
+					// Timestamps are of the whole sequence
+					const int64_t segment_poc = (es_file_type() == BaseDecoder::AVC) ? 2 * segment_first_ : segment_first_;
+					goReportStructure.miTimeStamp = (int)(a.m_poc + segment_poc);
 					goReportStructure.miPictureType = (int)a.m_pictureType;
 					goReportStructure.miBaseSize = (int)a.m_size;
 					if (!pss.empty())
@@ -433,6 +1011,10 @@ void FileEncoderImpl::encode(const YUVReader &src_file, const YUVReader &recon_f
 					goPsnr.miBaseBytes += goReportStructure.miBaseSize;
 					goPsnr.miEnhancementBytes += goReportStructure.miEnhancementSize;
 
+					// Keep lines from segments encoded at the same time apart
+					static std::mutex report_mutex;
+					std::lock_guard<std::mutex> report_lock(report_mutex);
+
 					// clang-format off
 					fprintf(stdout, "ENC. [pts. %4d] [type %4d] [base %8d] [enha %8d] ",
 						goReportStructure.miTimeStamp, goReportStructure.miPictureType, goReportStructure.miBaseSize, goReportStructure.miEnhancementSize);
@@ -490,28 +1072,33 @@ void FileEncoderImpl::encode(const YUVReader &src_file, const YUVReader &recon_f
 		}
 	}
 
-	if (written_count > 0) {
-		int iFrames = written_count;
-
-		float fAccMse[MAX_NUM_PLANES];
-		float fPsnr[MAX_NUM_PLANES];
-		for (unsigned plane = 0; plane < encoder_.src_image_description().num_planes(); plane++) {
-			fAccMse[plane] = goPsnr.mfAccMse[plane] / iFrames;
-			fPsnr[plane] = (float)(10.0f * log10((32767.0f * 32767.0f) / fAccMse[plane]));
-		}
+	// Segments are summarised together, once they are all done
+	if (written_count > 0 && !segment_count_)
+		report_summary(written_count);
+}
 
-		REPORT("========= ========= ========= ========= ========= ========= ========= ========= ");
-		if (encoder_.src_image_description().num_planes() > 1)
-			REPORT("PSNR -- YUV %8.4f -- Y %8.4f U %8.4f V %8.4f", (6 * fPsnr[0] + fPsnr[1] + fPsnr[2]) / 8, fPsnr[0], fPsnr[1],
-			       fPsnr[2]);
-		else
-			REPORT("PSNR -- Y %8.4f", fPsnr[0]);
-		REPORT("========= ========= ========= ========= ========= ========= ========= ========= ");
-		REPORT("BITS -- base %8d bps -- enha %8d bps ", (goPsnr.miBaseBytes * 8 * this->fps_) / iFrames,
-		       (goPsnr.miEnhancementBytes * 8 * this->fps_) / iFrames);
-		REPORT("========= ========= ========= ========= ========= ========= ========= ========= ");
+// Summary of PSNR and bit rates over 'frames' pictures
+//
+void FileEncoderImpl::report_summary(unsigned frames) const {
+	int iFrames = frames;
+
+	float fAccMse[MAX_NUM_PLANES];
+	float fPsnr[MAX_NUM_PLANES];
+	for (unsigned plane = 0; plane < encoder_.src_image_description().num_planes(); plane++) {
+		fAccMse[plane] = goPsnr.mfAccMse[plane] / iFrames;
+		fPsnr[plane] = (float)(10.0f * log10((32767.0f * 32767.0f) / fAccMse[plane]));
 	}
-	
+
+	REPORT("========= ========= ========= ========= ========= ========= ========= ========= ");
+	if (encoder_.src_image_description().num_planes() > 1)
+		REPORT("PSNR -- YUV %8.4f -- Y %8.4f U %8.4f V %8.4f", (6 * fPsnr[0] + fPsnr[1] + fPsnr[2]) / 8, fPsnr[0], fPsnr[1],
+		       fPsnr[2]);
+	else
+		REPORT("PSNR -- Y %8.4f", fPsnr[0]);
+	REPORT("========= ========= ========= ========= ========= ========= ========= ========= ");
+	REPORT("BITS -- base %8d bps -- enha %8d bps ", (goPsnr.miBaseBytes * 8 * this->fps_) / iFrames,
+	       (goPsnr.miEnhancementBytes * 8 * this->fps_) / iFrames);
+	REPORT("========= ========= ========= ========= ========= ========= ========= ========= ");
 }
 
 // RBSP encapsualtion (0b00000000 0b00000000 0b000000xx -> 0b00000000 0b00000000 0b00000011 0b000000xx)
@@ -646,12 +1233,11 @@ unsigned FileEncoderImpl::intra_period() const {
 //
 void FileEncoderImpl::initialize_encoder(const YUVReader &src_file, unsigned limit) {
 	std::vector<std::unique_ptr<Image>> src;
-	const unsigned num_frames = std::min(src_file.length(), limit);
-	if (num_frames == 0)
+	if (limit == 0 || !src_file.has_frame(0))
 		ERR("Frames cannot be read from source.");
 
 	// Fill vector with first 5 frames
-	for (unsigned n = 0; n < std::min(5u, num_frames); n++)
+	for (unsigned n = 0; n < std::min(5u, limit) && src_file.has_frame(n); n++)
 		src.push_back(make_unique<Image>(ExpandImage(src_file.read(n, n), encoder_.enhancement_image_description())));
 	encoder_.initialise_config(parameters_, src);
 }
@@ -764,6 +1350,7 @@ public:
 
 	BaseDecoder::Codec es_file_type() const override { return BaseDecoder::HEVC; };
 	BaseCoding base_coding() const override { return BaseCoding_HEVC; }
+	bool base_encoder_can_stream() const override { return true; }
 
 	bool run_base_encoder(const string &yuv_file, const string &es_file, const string &recon_file,
 	                      unsigned frame_count) const override {
@@ -877,6 +1464,7 @@ public:
 
 	BaseDecoder::Codec es_file_type() const override { return BaseDecoder::HEVC; };
 	BaseCoding base_coding() const override { return BaseCoding_X265; }
+	string codec_api_name() const override { return "x265"; }
 
 	bool run_base_encoder(const string &yuv_file, const string &es_file, const string &recon_file,
 	                      unsigned frame_count) const override {
@@ -912,6 +1500,12 @@ public:
 			recon_file.c_str(), encoder_.base_image_description().bit_depth()
 			);
 
+		// x265 keeps its own key frame interval, unless an intra period is given
+		if (!parameters_["intra_period"].empty()) {
+			INFO("Base key frame interval from intra_period: %u", intra_period());
+			cmd_line.append(format(" --keyint %u", intra_period()));
+		}
+
 		// if (encoder_.base_image_description().bit_depth() > Bitdepth_12) {
 		// 	cmd_line.append(" --Profile=main_444_16");
 		// } else if (encoder_.base_image_description().colourspace() != Colourspace_YUV420 ||
@@ -990,6 +1584,7 @@ public:
 
 	BaseDecoder::Codec es_file_type() const override { return BaseDecoder::VVC; };
 	BaseCoding base_coding() const override { return BaseCoding_VVC; }
+	bool base_encoder_can_stream() const override { return true; }
 
 	bool run_base_encoder(const string &yuv_file, const string &es_file, const string &recon_file,
 	                      unsigned frame_count) const override {
@@ -1209,13 +1804,13 @@ public:
 // Downsample input according to current settings and write to output file
 //
 void FileEncoderImpl::downsample_file(const string &input_file, const string &output_file, unsigned limit) {
-	auto input = CHECK(CreateYUVReader(input_file, encoder_.src_image_description(), fps_));
+	auto input = open_yuv(input_file, encoder_.src_image_description());
 	auto output = CHECK(CreateYUVWriter(output_file, encoder_.base_image_description(), true));
+	output->set_rate((float)fps_);
 
-	const unsigned frame_count = min(input->length(), limit);
-	INFO("Downsampling %d frames", frame_count);
+	INFO("Downsampling up to %d frames", limit);
 
-	for (unsigned f = 0; f < frame_count; ++f) {
+	for (unsigned f = 0; f < limit && input->has_frame(f); ++f) {
 		INFO("  Writing downsampled %d", f);
 		const Image src = input->read(f, f);
 		const Image img = DownsampleImage(DownsampleImage(src, downsample_luma_, downsample_chroma_, scaling_mode_[LOQ_LEVEL_2]),
@@ -1227,13 +1822,13 @@ void FileEncoderImpl::downsample_file(const string &input_file, const string &ou
 // Upsample input according to current settings and write to output file
 //
 void FileEncoderImpl::upsample_file(const string &input_file, const string &output_file, unsigned limit) {
-	auto input = CHECK(CreateYUVReader(input_file, encoder_.base_image_description(), fps_));
+	auto input = open_yuv(input_file, encoder_.base_image_description());
 	auto output = CHECK(CreateYUVWriter(output_file, encoder_.src_image_description(), true));
+	output->set_rate((float)fps_);
 
-	const unsigned frame_count = min(input->length(), limit);
-	INFO("Upsampling %d frames", frame_count);
+	INFO("Upsampling up to %d frames", limit);
 
-	for (unsigned f = 0; f < frame_count; ++f) {
+	for (unsigned f = 0; f < limit && input->has_frame(f); ++f) {
 		INFO("  Writing upsampled %d", f);
 		const Image src = input->read(f, f);
 		const Image img = UpsampleImage(UpsampleImage(src, upsample_, upsampling_coefficients_, scaling_mode_[LOQ_LEVEL_2]),
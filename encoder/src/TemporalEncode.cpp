@@ -267,7 +267,8 @@ Surface TemporalInsertMask::process(const Surface &symbols, const Surface &mask,
 
 // Insert the user_data
 //
-Surface UserDataInsert::process(const Surface &symbols, UserDataMethod method, UserDataMode user_data, FILE* file) {
+Surface UserDataInsert::process(const Surface &symbols, UserDataMethod method, UserDataMode user_data, Random &random,
+                                FILE *file) {
 	unsigned size;
 	switch (user_data) {
 	case UserData_2bits:
@@ -297,7 +298,7 @@ Surface UserDataInsert::process(const Surface &symbols, UserDataMethod method, U
 			              break;
 		              case UserDataMethod_FixedRandom:
 		              case UserDataMethod_Random:
-			              data = Random().rand();
+			              data = random.rand();
 			              break;
 		              default:
 			              CHECK(0);
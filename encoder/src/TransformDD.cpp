@@ -37,6 +37,8 @@
 
 #include "TransformDD.hpp"
 #include "Config.hpp"
+#include "CpuFeatures.hpp"
+#include "TransformKernels.hpp"
 
 namespace lctm {
 
@@ -67,6 +69,18 @@ void TransformDD::process(const Surface &residuals, EncodingMode mode, Surface l
 	    {+1, -1, -1, +1}, // 1,1
 	};
 
+#if LCEVC_SIMD_X86
+	if (cpu_features()) {
+		for (unsigned l = 0; l < 4; ++l) {
+			if (encode_flags.encode_residual(l))
+				layers[l] = transform_layer(residuals, 2, basis[l], 4);
+			else
+				layers[l] = Surface::build_from<int16_t>().fill(0, width, height).finish();
+		}
+		return;
+	}
+#endif
+
 	for (unsigned l = 0; l < 4; ++l) {
 		if (encode_flags.encode_residual(l)) {
 			layers[l] = Surface::build_from<int16_t>()
@@ -38,6 +38,8 @@
 
 #include "TransformDDS.hpp"
 #include "Config.hpp"
+#include "CpuFeatures.hpp"
+#include "TransformKernels.hpp"
 
 namespace lctm {
 
@@ -83,6 +85,18 @@ void TransformDDS::process(const Surface &residuals, EncodingMode mode, Surface
 	    {+1, -1, -1, +1, -1, +1, +1, -1, -1, +1, +1, -1, +1, -1, -1, +1}, // 3,3
 	};
 
+#if LCEVC_SIMD_X86
+	if (cpu_features()) {
+		for (unsigned l = 0; l < 16; ++l) {
+			if (encode_flags.encode_residual(l))
+				layers[l] = transform_layer(residuals, 4, basis[l], 16);
+			else
+				layers[l] = Surface::build_from<int16_t>().fill(0, width, height).finish();
+		}
+		return;
+	}
+#endif
+
 #if defined __OPT_MATRIX__
 
 	if (encode_flags.encode_residual(0)) {
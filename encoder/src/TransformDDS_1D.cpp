@@ -37,6 +37,8 @@
 
 #include "TransformDDS_1D.hpp"
 #include "Config.hpp"
+#include "CpuFeatures.hpp"
+#include "TransformKernels.hpp"
 
 namespace lctm {
 
@@ -84,6 +86,18 @@ void TransformDDS_1D::process(const Surface &residuals, EncodingMode mode, Surfa
   };
 	// clang-format on
 
+#if LCEVC_SIMD_X86
+	if (cpu_features()) {
+		for (unsigned l = 0; l < 16; ++l) {
+			if (encode_flags.encode_residual(l))
+				layers[l] = transform_layer(residuals, 4, basis[l], 16);
+			else
+				layers[l] = Surface::build_from<int16_t>().fill(0, width, height).finish();
+		}
+		return;
+	}
+#endif
+
 	for (unsigned l = 0; l < 16; ++l) {
 
 		if (encode_flags.encode_residual(l)) {
@@ -37,6 +37,8 @@
 
 #include "TransformDD_1D.hpp"
 #include "Config.hpp"
+#include "CpuFeatures.hpp"
+#include "TransformKernels.hpp"
 
 namespace lctm {
 
@@ -68,6 +70,18 @@ void TransformDD_1D::process(const Surface &residuals, EncodingMode mode, Surfac
   };
 	// clang-format on
 
+#if LCEVC_SIMD_X86
+	if (cpu_features()) {
+		for (unsigned l = 0; l < 4; ++l) {
+			if (encode_flags.encode_residual(l))
+				layers[l] = transform_layer(residuals, 2, basis[l], 4);
+			else
+				layers[l] = Surface::build_from<int16_t>().fill(0, width, height).finish();
+		}
+		return;
+	}
+#endif
+
 	for (unsigned l = 0; l < 4; ++l) {
 		if (encode_flags.encode_residual(l)) {
 			layers[l] = Surface::build_from<int16_t>()
@@ -0,0 +1,202 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// TransformKernels.cpp
+//
+// The forward transforms need 32 bit intermediates to get the exact truncating division, so the kernels
+// accumulate in 32 bit lanes and pack the results back down to 16 bits.
+//
+#include "TransformKernels.hpp"
+
+#include "CpuFeatures.hpp"
+#include "Diagnostics.hpp"
+
+#if LCEVC_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace lctm {
+
+#if LCEVC_SIMD_X86
+// Divide by 2^shift, rounding towards zero
+//
+LCEVC_TARGET_SSE41 static inline __m128i div_trunc_sse41(__m128i v, int shift) {
+	const __m128i bias = _mm_srli_epi32(_mm_srai_epi32(v, 31), 32 - shift);
+	return _mm_srai_epi32(_mm_add_epi32(v, bias), shift);
+}
+
+LCEVC_TARGET_AVX2 static inline __m256i div_trunc_avx2(__m256i v, int shift) {
+	const __m256i bias = _mm256_srli_epi32(_mm256_srai_epi32(v, 31), 32 - shift);
+	return _mm256_srai_epi32(_mm256_add_epi32(v, bias), shift);
+}
+
+// 2x2 blocks - a pair of pixels per row fits a 32 bit lane, so madd gives each row's contribution in block order
+//
+LCEVC_TARGET_SSE41 static unsigned transform_2x2_sse41(int16_t *dst, const int16_t *const src[2], unsigned blocks,
+                                                       const int32_t *basis, int shift) {
+	const __m128i b0 = _mm_set1_epi32((int32_t)(uint16_t)basis[0] | ((int32_t)basis[1] << 16));
+	const __m128i b1 = _mm_set1_epi32((int32_t)(uint16_t)basis[2] | ((int32_t)basis[3] << 16));
+
+	unsigned x = 0;
+	for (; x + 8 <= blocks; x += 8) {
+		__m128i r[2];
+		for (unsigned h = 0; h < 2; ++h) {
+			const __m128i s0 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(src[0] + 2 * x + 8 * h)), b0);
+			const __m128i s1 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(src[1] + 2 * x + 8 * h)), b1);
+			r[h] = div_trunc_sse41(_mm_add_epi32(s0, s1), shift);
+		}
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_packs_epi32(r[0], r[1]));
+	}
+	return x;
+}
+
+LCEVC_TARGET_AVX2 static unsigned transform_2x2_avx2(int16_t *dst, const int16_t *const src[2], unsigned blocks,
+                                                     const int32_t *basis, int shift) {
+	const __m256i b0 = _mm256_set1_epi32((int32_t)(uint16_t)basis[0] | ((int32_t)basis[1] << 16));
+	const __m256i b1 = _mm256_set1_epi32((int32_t)(uint16_t)basis[2] | ((int32_t)basis[3] << 16));
+
+	unsigned x = 0;
+	for (; x + 8 <= blocks; x += 8) {
+		const __m256i s0 = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(src[0] + 2 * x)), b0);
+		const __m256i s1 = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(src[1] + 2 * x)), b1);
+		const __m256i r = div_trunc_avx2(_mm256_add_epi32(s0, s1), shift);
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_packs_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+	}
+	return x;
+}
+
+// 4x4 blocks - madd leaves two partial sums per block per row, hadd folds them back into block order
+//
+LCEVC_TARGET_SSE41 static unsigned transform_4x4_sse41(int16_t *dst, const int16_t *const src[4], unsigned blocks,
+                                                       const int32_t *basis, int shift) {
+	__m128i b[4];
+	for (unsigned r = 0; r < 4; ++r)
+		b[r] = _mm_setr_epi16((int16_t)basis[4 * r + 0], (int16_t)basis[4 * r + 1], (int16_t)basis[4 * r + 2],
+		                      (int16_t)basis[4 * r + 3], (int16_t)basis[4 * r + 0], (int16_t)basis[4 * r + 1],
+		                      (int16_t)basis[4 * r + 2], (int16_t)basis[4 * r + 3]);
+
+	unsigned x = 0;
+	for (; x + 8 <= blocks; x += 8) {
+		__m128i q[2];
+		for (unsigned h = 0; h < 2; ++h) {
+			__m128i sum = _mm_setzero_si128();
+			for (unsigned r = 0; r < 4; ++r) {
+				const int16_t *s = src[r] + 4 * x + 16 * h;
+				const __m128i m0 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(s + 0)), b[r]);
+				const __m128i m1 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(s + 8)), b[r]);
+				sum = _mm_add_epi32(sum, _mm_hadd_epi32(m0, m1));
+			}
+			q[h] = div_trunc_sse41(sum, shift);
+		}
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_packs_epi32(q[0], q[1]));
+	}
+	return x;
+}
+
+LCEVC_TARGET_AVX2 static unsigned transform_4x4_avx2(int16_t *dst, const int16_t *const src[4], unsigned blocks,
+                                                     const int32_t *basis, int shift) {
+	__m256i b[4];
+	for (unsigned r = 0; r < 4; ++r)
+		b[r] = _mm256_broadcastsi128_si256(_mm_setr_epi16((int16_t)basis[4 * r + 0], (int16_t)basis[4 * r + 1],
+		                                                  (int16_t)basis[4 * r + 2], (int16_t)basis[4 * r + 3],
+		                                                  (int16_t)basis[4 * r + 0], (int16_t)basis[4 * r + 1],
+		                                                  (int16_t)basis[4 * r + 2], (int16_t)basis[4 * r + 3]));
+
+	unsigned x = 0;
+	for (; x + 8 <= blocks; x += 8) {
+		__m256i sum = _mm256_setzero_si256();
+		for (unsigned r = 0; r < 4; ++r) {
+			const int16_t *s = src[r] + 4 * x;
+			const __m256i m0 = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(s + 0)), b[r]);
+			const __m256i m1 = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(s + 16)), b[r]);
+			sum = _mm256_add_epi32(sum, _mm256_hadd_epi32(m0, m1));
+		}
+		// hadd works within 128 bit lanes: blocks are in order 0,1,4,5,2,3,6,7
+		const __m256i r = _mm256_permute4x64_epi64(div_trunc_avx2(sum, shift), 0xd8);
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_packs_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+	}
+	return x;
+}
+#endif
+
+Surface transform_layer(const Surface &residuals, unsigned block_size, const int32_t *basis, int32_t divisor) {
+	CHECK(block_size == 2 || block_size == 4);
+	CHECK(divisor == 4 || divisor == 16);
+
+	const unsigned width = residuals.width() / block_size;
+	const unsigned height = residuals.height() / block_size;
+	const auto src = residuals.view_as<int16_t>();
+
+	auto dst = Surface::build_from<int16_t>();
+	dst.reserve(width, height);
+
+#if LCEVC_SIMD_X86
+	const unsigned features = cpu_features();
+	const int shift = (divisor == 4) ? 2 : 4;
+#endif
+
+	for (unsigned y = 0; y < height; ++y) {
+		const int16_t *rows[4];
+		for (unsigned r = 0; r < block_size; ++r)
+			rows[r] = src.data(0, y * block_size + r);
+		int16_t *out = dst.data(0, y);
+
+		unsigned x = 0;
+#if LCEVC_SIMD_X86
+		if (block_size == 2) {
+			if (features & CpuFeature_AVX2)
+				x = transform_2x2_avx2(out, rows, width, basis, shift);
+			else if (features & CpuFeature_SSE41)
+				x = transform_2x2_sse41(out, rows, width, basis, shift);
+		} else {
+			if (features & CpuFeature_AVX2)
+				x = transform_4x4_avx2(out, rows, width, basis, shift);
+			else if (features & CpuFeature_SSE41)
+				x = transform_4x4_sse41(out, rows, width, basis, shift);
+		}
+#endif
+
+		// Remaining blocks
+		for (; x < width; ++x) {
+			int32_t sum = 0;
+			for (unsigned r = 0; r < block_size; ++r)
+				for (unsigned c = 0; c < block_size; ++c)
+					sum += rows[r][x * block_size + c] * basis[r * block_size + c];
+			out[x] = (int16_t)(sum / divisor);
+		}
+	}
+
+	return dst.finish();
+}
+
+} // namespace lctm
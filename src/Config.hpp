@@ -57,6 +57,12 @@
 #define __OPT_MATRIX__
 #define __OPT_INPLACE__
 
+// SSE4.1/AVX2 kernels, selected at runtime from CPUID
+#define __OPT_SIMD__
+
+// Surface buffers are recycled through a pool rather than allocated for each new surface
+#define __OPT_BUFFER_POOL__
+
 // Pretty convinced these have no effect - same code generated each way on GCC and MSVC
 #define __OPT_DIVISION__
 #define __OPT_MODULO__
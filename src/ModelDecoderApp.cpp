@@ -45,6 +45,9 @@
 #include "Decoder.hpp"
 #include "Diagnostics.hpp"
 #include "Expand.hpp"
+#include "Parallel.hpp"
+#include "RingBuffer.hpp"
+#include "ScanEnhancement.hpp"
 #include "Surface.hpp"
 #include "YUVReader.hpp"
 #include "YUVWriter.hpp"
@@ -63,27 +66,23 @@
 
 #include "SignaledConfiguration.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include <vector>
 
 using namespace std;
 
-// bitstream statistics
-#include "BitstreamStatistic.hpp"
-BitstreamStatistic goStat;
-FILE *goBits = NULL;
-PsnrStatistic goPsnr;
-uint8_t gaucMd5Digest[lctm::MAX_NUM_PLANES][16];
-ReportStructure goReportStructure;
-std::priority_queue<ReportStructure, std::vector<ReportStructure, std::allocator<ReportStructure>>, ReportStructureComp>
-    goReportQueue;
-
 using namespace lctm;
 using namespace vnova::utility;
 
 class DecoderApp : public BaseVideoDecoder::Output {
 public:
 	DecoderApp(YUVWriter &writer, YUVReader &reader);
+	~DecoderApp() override;
 
 	// implement BaseVideoDecoder::Output
 	void push_base_enhancement(const BaseVideoDecoder::BasePicture *base_picture, const uint8_t *enhancement_data,
@@ -100,31 +99,134 @@ public:
 	Colourspace get_colourspace() override;
 	unsigned get_base_bitdepth() override;
 
+	void flush() override;
+
+	DecoderStatistics &statistics() override { return decoder_.statistics(); }
+
 	YUVWriter &writer_;
 	YUVReader &reader_;
 
 	Decoder decoder_;
 
+	// Parses enhancement data when pipelined, so that decoder_ only reconstructs
+	Decoder parser_;
+
 	int count_ = 0;
 
 	bool report_ = false;
 	bool dithering_switch_ = false;
 	bool dithering_fixed_ = false;
 	bool apply_enhancement_ = true;
+
+	// If non-zero, parsing and reconstruction run on their own threads, with up to this many pictures queued for each
+	unsigned pipeline_depth_ = 0;
+
+private:
+	// A picture on its way through the pipeline - holds copies of data that is only valid during a push
+	struct Picture {
+		std::vector<uint8_t> base_data;
+		BaseVideoDecoder::BasePicture base_picture = {};
+		bool has_base_picture = false;
+
+		Packet enhancement;
+		bool parsed = false;
+
+		Surface symbols[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS];
+		SignaledConfiguration configuration;
+		Dimensions dimensions;
+
+		uint64_t pts = 0;
+		bool is_lcevc_idr = false;
+
+		// Sizes from the base decoder, taken as the picture is pushed
+		ReportStructure report = {};
+		bool has_report = false;
+	};
+
+	// Reconstruct and write a picture, given a base and the symbols parsed into decoder_'s configuration
+	void decode_base_picture(const BaseVideoDecoder::BasePicture *base_picture,
+	                         Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS], uint64_t pts, bool is_lcevc_idr,
+	                         const ReportStructure *report);
+	void decode_base_data(const uint8_t *base_data, Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS],
+	                      uint64_t pts, bool is_lcevc_idr, const ReportStructure *report);
+
+	// Pipeline stages
+	void pipeline_push(const std::shared_ptr<Picture> &picture);
+	void parse(Picture &picture);
+	void parse_stage();
+	void reconstruct_stage();
+
+	std::unique_ptr<RingBuffer<std::shared_ptr<Picture>>> parse_queue_;
+	std::unique_ptr<RingBuffer<std::shared_ptr<Picture>>> reconstruct_queue_;
+	std::thread parse_thread_;
+	std::thread reconstruct_thread_;
+
+	// Picture given to deserialize_enhancement(), waiting for its base
+	std::shared_ptr<Picture> pending_;
+};
+
+//// GopDecoder
+//
+// Decodes each stretch of stream from one IDR to the next on its own thread, with its own base decoder and DecoderApp -
+// nothing is carried between them, as temporal state is reset at IDRs. Each stretch is decoded to a temporary file, which
+// is copied to the output once the stretches before it have been.
+//
+class GopDecoder {
+public:
+	GopDecoder(const string &input_es, BaseDecoder::Codec file_base, BaseCoding base_video_type, Encapsulation encapsulation,
+	           YUVReader &reader, std::function<void(DecoderApp &)> configure)
+	    : input_es_(input_es), file_base_(file_base), base_video_type_(base_video_type), encapsulation_(encapsulation),
+	      reader_(reader), configure_(configure) {}
+
+	// Decode up to 'limit' access units with 'num_threads' stretches in flight - returns number of pictures written
+	unsigned decode(const std::vector<ESFile::IndexEntry> &index, uint32_t num_access_units, unsigned limit,
+	                unsigned num_threads, YUVWriter &writer);
+
+private:
+	struct Gop {
+		ESFile::IndexEntry entry;
+		unsigned num_access_units = 0;
+
+		string filename;
+		ImageDescription description;
+		unsigned num_pictures = 0;
+	};
+
+	// The index entries where the enhancement starts again as well - the first LCEVC data of the access unit is an IDR
+	std::vector<ESFile::IndexEntry> restart_points(const std::vector<ESFile::IndexEntry> &index) const;
+
+	void decode_gop(Gop &gop);
+
+	const string input_es_;
+	const BaseDecoder::Codec file_base_;
+	const BaseCoding base_video_type_;
+	const Encapsulation encapsulation_;
+	YUVReader &reader_;
+	std::function<void(DecoderApp &)> configure_;
 };
 
 int main(int argc, char *argv[]) {
 	BaseCoding base_video_type;
 	bool base_external;
+	bool base_streaming;
 	bool keep_base;
 	bool apply_enhancement;
 	Encapsulation encapsulation;
 	std::string input_es, output_yuv, base_yuv, input_yuv;
-	BaseDecoder::Codec file_base;
+	BaseDecoder::Codec file_base = BaseDecoder::None;
 	bool report;
 	bool dithering_switch;
 	bool dithering_fixed;
 	unsigned limit = 1000000;
+	unsigned threads = 1;
+	bool upsampling_dpi = false;
+	bool interleaved_coefficients = false;
+	bool parallel_planes = false;
+	unsigned pipeline_depth = 0;
+	unsigned stripe_rows = 0;
+	unsigned output_queue = 0;
+	bool output_y4m = false;
+	unsigned gop_parallel = 0;
 
 	try {
 		cxxopts::Options options_description(argv[0], "LCEVC Decoder " GIT_VERSION);
@@ -132,10 +234,11 @@ int main(int argc, char *argv[]) {
 		// clang-format off
 		options_description.add_options()
 			("i,input_file", "Input elementary stream filename", cxxopts::value<string>()->default_value("input.lvc"))
-			("o,output_file", "Output filename for decoded YUV data", cxxopts::value<string>()->default_value("output.yuv"))
+			("o,output_file", "Output filename for decoded YUV data ('-' for standard output)", cxxopts::value<string>()->default_value("output.yuv"))
 			("b,base", "Base codec (avc, hevc, evc, vvc, or yuv)", cxxopts::value<string>()->default_value("avc"))
 			("base_encoder", "Base codec (same as --base)", cxxopts::value<string>()->default_value("avc"))
 			("base_external", "Use an external base codec executable (select for decoding of monochrome output)", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+			("base_streaming", "Run the external base codec alongside enhancement, passing pictures through a FIFO as they are decoded (implies --base_external)", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
 			("y,base_yuv", "Prepared YUV data for base decode", cxxopts::value<string>()->default_value(""))
 			("input_yuv", "Original YUV data for PSNR computation", cxxopts::value<string>()->default_value(""))
 			("l,limit", "Number of frames to decode", cxxopts::value<unsigned>()->default_value("1000000"))
@@ -146,6 +249,15 @@ int main(int argc, char *argv[]) {
 			("report", "Calculate PSNR and checksums", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
 			("keep_base", "Keep the base + enhancement bitstreams and base decoded yuv file", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
 			("apply_enhancement", "Apply LCEVC enhancement data (residuals) on output YUV", cxxopts::value<bool>()->default_value("true"))
+			("threads", "Number of worker threads for enhancement decoding (1 = serial)", cxxopts::value<unsigned>()->default_value("1"))
+			("upsampling_dpi", "Upsample all planes of a picture and add their residuals in one pass, in bands on the worker threads", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+			("interleaved_coefficients", "Entropy decode coefficients with all layers of a block contiguous", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+			("parallel_planes", "Decode planes and sub-layers as parallel tasks on the worker threads", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+			("pipeline_depth", "Parse and reconstruct pictures on their own threads, with this many queued per stage (0 = not pipelined)", cxxopts::value<unsigned>()->default_value("0"))
+			("stripe_rows", "Reconstruct output planes in bands of this many rows, as parallel tasks on the worker threads (0 = whole planes)", cxxopts::value<unsigned>()->default_value("0"))
+			("output_y4m", "Write Y4M rather than raw YUV (the default for .y4m output filenames)", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+			("output_queue", "Write output on its own thread, with this many pictures queued (0 = write synchronously)", cxxopts::value<unsigned>()->default_value("0"))
+			("gop_parallel", "Decode the stretches of stream between IDRs on this many threads at once, each with an external base decoder (0 = serial)", cxxopts::value<unsigned>()->default_value("0"))
 
 			// Retain additional arguments for backwards compatibility (to be removed in future release)
 			("w,width", "Placeholder (to be removed in future release)", cxxopts::value<unsigned>()->default_value("1920"))
@@ -204,6 +316,7 @@ int main(int argc, char *argv[]) {
 		}
 
 		base_external = options["base_external"].as<bool>();
+		base_streaming = options["base_streaming"].as<bool>();
 		keep_base = options["keep_base"].as<bool>();
 		apply_enhancement = options["apply_enhancement"].as<bool>();
 
@@ -219,10 +332,26 @@ int main(int argc, char *argv[]) {
 		dithering_switch = options["dithering_switch"].as<bool>();
 		dithering_fixed = options["dithering_fixed"].as<bool>();
 		limit = options["limit"].as<unsigned>();
+		threads = options["threads"].as<unsigned>();
+		upsampling_dpi = options["upsampling_dpi"].as<bool>();
+		interleaved_coefficients = options["interleaved_coefficients"].as<bool>();
+		parallel_planes = options["parallel_planes"].as<bool>();
+		pipeline_depth = options["pipeline_depth"].as<unsigned>();
+		stripe_rows = options["stripe_rows"].as<unsigned>();
+		output_queue = options["output_queue"].as<unsigned>();
+		output_y4m = options["output_y4m"].as<bool>();
+		gop_parallel = options["gop_parallel"].as<unsigned>();
 
 		if (base_video_type == BaseCoding_YUV && base_yuv.empty())
 			ERR("No base codec selected and no base yuv file provided.");
 
+		if (gop_parallel && (base_video_type == BaseCoding_YUV || base_streaming || keep_base || report || pipeline_depth ||
+		                     !base_yuv.empty() || !input_yuv.empty())) {
+			WARN("GOP parallel decoding cannot be used with a prepared base, streaming, keeping the base, reports or "
+			     "pipelining - decoding serially.");
+			gop_parallel = 0;
+		}
+
 	} catch (const cxxopts::OptionException &e) {
 		std::cout << "error parsing options: " << e.what() << std::endl;
 		exit(1);
@@ -238,18 +367,60 @@ int main(int argc, char *argv[]) {
 	// Dummy Output
 	//
 	unique_ptr<YUVWriter> yuv_writer(CreateYUVWriter(output_yuv));
+	yuv_writer->set_asynchronous(output_queue);
+	if (output_y4m)
+		yuv_writer->set_y4m(true);
 	// additional Input for PSNR
 	unique_ptr<YUVReader> yuv_reader(CreateYUVReader(input_yuv, 60));
 
+	auto configure = [&](DecoderApp &app) {
+		app.report_ = report;
+		app.dithering_switch_ = dithering_switch;
+		app.dithering_fixed_ = dithering_fixed;
+		app.apply_enhancement_ = apply_enhancement;
+		app.decoder_.set_num_threads(threads);
+		app.decoder_.set_upsampling_dpi(upsampling_dpi);
+		app.decoder_.set_interleaved_coefficients(interleaved_coefficients);
+		app.decoder_.set_parallel_planes(parallel_planes);
+		app.decoder_.set_stripe_rows(stripe_rows);
+		app.parser_.set_num_threads(threads);
+		app.parser_.set_interleaved_coefficients(interleaved_coefficients);
+		app.pipeline_depth_ = pipeline_depth;
+	};
+
+	if (gop_parallel) {
+		const float start = (float)(system_timestamp() / 1000000.0);
+		INFO("-- Indexing: %.3f", start);
+
+		std::vector<ESFile::IndexEntry> index;
+		uint32_t num_access_units = 0;
+		const ESFile::Result rc = es_file.IndexIDR(index, num_access_units);
+		if (rc != ESFile::Success)
+			ERR("Cannot index %s: %s", input_es.c_str(), ESFile::ToString(rc));
+		es_file.Close();
+		INFO("-- %u IDR pictures in %u access units", (unsigned)index.size(), num_access_units);
+
+		GopDecoder gop_decoder(input_es, file_base, base_video_type, encapsulation, *yuv_reader, configure);
+		unsigned count = 0;
+		try {
+			count = gop_decoder.decode(index, num_access_units, limit, gop_parallel, *yuv_writer);
+		} catch (const std::exception &e) {
+			ERR("Cannot decode %s: %s", input_es.c_str(), e.what());
+		}
+		yuv_writer->flush();
+
+		const float finish = (float)(system_timestamp() / 1000000.0);
+		INFO("-- Finished: %.3f", finish);
+		INFO("-- FPS: %.3f", (float)count / (finish - start));
+		return 0;
+	}
+
 	// Create Base Video Decpder
 	DecoderApp app(*yuv_writer, *yuv_reader);
 	std::unique_ptr<BaseVideoDecoder> base_video_decoder(
-	    CreateBaseVideoDecoder(app, base_video_type, encapsulation, base_external, base_yuv, keep_base));
+	    CreateBaseVideoDecoder(app, base_video_type, encapsulation, base_external, base_yuv, keep_base, base_streaming));
 
-	app.report_ = report;
-	app.dithering_switch_ = dithering_switch;
-	app.dithering_fixed_ = dithering_fixed;
-	app.apply_enhancement_ = apply_enhancement;
+	configure(app);
 
 	const float start = (float)(system_timestamp() / 1000000.0);
 	INFO("-- Starting: %.3f", start);
@@ -300,6 +471,8 @@ int main(int argc, char *argv[]) {
 	INFO("-- Flushing: %.3f", system_timestamp() / 1000000.0);
 
 	base_video_decoder->push_au(0, 0, 0, false, 0);
+	app.flush();
+	yuv_writer->flush();
 
 	clock_t EnhaClock1;
 	EnhaClock1 = clock();
@@ -323,14 +496,49 @@ int main(int argc, char *argv[]) {
 
 DecoderApp::DecoderApp(YUVWriter &writer, YUVReader &reader) : writer_(writer), reader_(reader) {}
 
+DecoderApp::~DecoderApp() { flush(); }
+
 void DecoderApp::push_base_enhancement(const BaseVideoDecoder::BasePicture *base_picture, const uint8_t *enhancement_data,
                                        size_t enhancement_data_size, uint64_t pts, bool is_lcevc_idr) {
+	ReportStructure report = {};
+	const bool has_report = statistics().take_report((int)pts, report);
+
+	if (pipeline_depth_) {
+		// Copy base planes and enhancement data, and queue for parsing
+		auto picture = std::make_shared<Picture>();
+		const size_t size_y = (size_t)base_picture->width_y * base_picture->height_y * base_picture->bpp;
+		const size_t size_uv = (size_t)base_picture->width_uv * base_picture->height_uv * base_picture->bpp;
+		picture->base_data.resize(size_y + 2 * size_uv);
+		memcpy(picture->base_data.data(), base_picture->data_y, size_y);
+		memcpy(picture->base_data.data() + size_y, base_picture->data_u, size_uv);
+		memcpy(picture->base_data.data() + size_y + size_uv, base_picture->data_v, size_uv);
+		picture->base_picture = *base_picture;
+		picture->base_picture.data_y = picture->base_data.data();
+		picture->base_picture.data_u = picture->base_data.data() + size_y;
+		picture->base_picture.data_v = picture->base_data.data() + size_y + size_uv;
+		picture->has_base_picture = true;
+		picture->enhancement = Packet::build().contents(enhancement_data, (unsigned)enhancement_data_size).finish();
+		picture->pts = pts;
+		picture->is_lcevc_idr = is_lcevc_idr;
+		picture->report = report;
+		picture->has_report = has_report;
+		pipeline_push(picture);
+		return;
+	}
+
 	if (count_ == 0)
 		INFO("-- Decoding: %.3f", system_timestamp() / 1000000.0);
 
 	// Deserilize LCEVC data
 	Surface symbols[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS];
 	decoder_.initialize_decode(Packet::build().contents(enhancement_data, (unsigned)enhancement_data_size).finish(), symbols);
+
+	decode_base_picture(base_picture, symbols, pts, is_lcevc_idr, has_report ? &report : nullptr);
+}
+
+void DecoderApp::decode_base_picture(const BaseVideoDecoder::BasePicture *base_picture,
+                                     Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS], uint64_t pts,
+                                     bool is_lcevc_idr, const ReportStructure *report) {
 	const SignaledConfiguration configuration = decoder_.get_configuration();
 	decoder_.set_idr(is_lcevc_idr);
 
@@ -390,12 +598,12 @@ void DecoderApp::push_base_enhancement(const BaseVideoDecoder::BasePicture *base
 	if (&reader_) {
 		auto reference_image = ExpandImage(reader_.read(count_), reader_.description());
 		auto full_image = decoder_.decode(Image("base", base_desc, pts, base_planes), symbols, reference_image,
-		                                  report_, dithering_switch_, dithering_fixed_, apply_enhancement_);
+		                                  report_, dithering_switch_, dithering_fixed_, apply_enhancement_, report);
 		writer_.write(full_image);
 	} else {
 		Image reference_image;
 		auto full_image = decoder_.decode(Image("base", base_desc, pts, base_planes), symbols, reference_image,
-		                                  report_, dithering_switch_, dithering_fixed_, apply_enhancement_);
+		                                  report_, dithering_switch_, dithering_fixed_, apply_enhancement_, report);
 		writer_.write(full_image);
 	}
 
@@ -405,7 +613,28 @@ void DecoderApp::push_base_enhancement(const BaseVideoDecoder::BasePicture *base
 void DecoderApp::push_base_enhancement(const uint8_t *base_data, size_t base_data_size,
                                        Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS], uint64_t pts,
                                        bool is_lcevc_idr) {
+	ReportStructure report = {};
+	const bool has_report = statistics().take_report((int)pts, report);
+
+	if (pipeline_depth_) {
+		// Enhancement data came through deserialize_enhancement() - add a copy of the base, and queue for parsing
+		CHECK(pending_);
+		std::shared_ptr<Picture> picture;
+		picture.swap(pending_);
+		picture->base_data.assign(base_data, base_data + base_data_size);
+		picture->pts = pts;
+		picture->is_lcevc_idr = is_lcevc_idr;
+		picture->report = report;
+		picture->has_report = has_report;
+		pipeline_push(picture);
+		return;
+	}
 
+	decode_base_data(base_data, symbols, pts, is_lcevc_idr, has_report ? &report : nullptr);
+}
+
+void DecoderApp::decode_base_data(const uint8_t *base_data, Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS],
+                                  uint64_t pts, bool is_lcevc_idr, const ReportStructure *report) {
 	Dimensions dimensions = decoder_.get_dimensions();
 	const SignaledConfiguration configuration = decoder_.get_configuration();
 	decoder_.set_idr(is_lcevc_idr);
@@ -464,12 +693,12 @@ void DecoderApp::push_base_enhancement(const uint8_t *base_data, size_t base_dat
 	if (&reader_) {
 		auto reference_image = ExpandImage(reader_.read(count_), reader_.description());
 		auto full_image = decoder_.decode(base, symbols, reference_image, report_, dithering_switch_, dithering_fixed_,
-		                                  apply_enhancement_);
+		                                  apply_enhancement_, report);
 		writer_.write(full_image);
 	} else {
 		Image reference_image;
 		auto full_image = decoder_.decode(base, symbols, reference_image, report_, dithering_switch_, dithering_fixed_,
-		                                  apply_enhancement_);
+		                                  apply_enhancement_, report);
 		writer_.write(full_image);
 	}
 
@@ -479,11 +708,207 @@ void DecoderApp::push_base_enhancement(const uint8_t *base_data, size_t base_dat
 // Deserilize LCEVC data
 void DecoderApp::deserialize_enhancement(const uint8_t *enhancement_data, size_t enhancement_data_size,
                                          Surface (&symbols)[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS]) {
+	if (pipeline_depth_) {
+		// Keep a copy for the pipeline. Until the pipeline is running, parse here, so that the base decoder can query the
+		// configuration.
+		pending_ = std::make_shared<Picture>();
+		pending_->enhancement = Packet::build().contents(enhancement_data, (unsigned)enhancement_data_size).finish();
+		if (!parse_thread_.joinable())
+			parse(*pending_);
+		return;
+	}
+
 	decoder_.initialize_decode(Packet::build().contents(enhancement_data, (unsigned)enhancement_data_size).finish(), symbols);
 }
 
-Dimensions DecoderApp::get_dimensions() { return decoder_.get_dimensions(); }
+Dimensions DecoderApp::get_dimensions() { return (pipeline_depth_ ? parser_ : decoder_).get_dimensions(); }
+
+unsigned DecoderApp::get_base_bitdepth() {
+	return (pipeline_depth_ ? parser_ : decoder_).get_configuration().global_configuration.base_depth;
+}
+
+Colourspace DecoderApp::get_colourspace() {
+	return (pipeline_depth_ ? parser_ : decoder_).get_configuration().global_configuration.colourspace;
+}
+
+//// Pipeline
+//
+// Base decoding runs on the calling thread, which pushes pictures to a parsing thread, which in turn pushes to a
+// reconstruction thread. Each stage handles pictures in order, so output is the same as when not pipelined. A null
+// picture tells each stage to finish.
+//
+void DecoderApp::pipeline_push(const std::shared_ptr<Picture> &picture) {
+	if (!parse_thread_.joinable()) {
+		parse_queue_.reset(new RingBuffer<std::shared_ptr<Picture>>(pipeline_depth_));
+		reconstruct_queue_.reset(new RingBuffer<std::shared_ptr<Picture>>(pipeline_depth_));
+		parse_thread_ = std::thread(&DecoderApp::parse_stage, this);
+		reconstruct_thread_ = std::thread(&DecoderApp::reconstruct_stage, this);
+	}
+
+	parse_queue_->push(picture);
+}
+
+void DecoderApp::parse(Picture &picture) {
+	parser_.initialize_decode(picture.enhancement, picture.symbols);
+	picture.configuration = parser_.get_configuration();
+	picture.dimensions = parser_.get_dimensions();
+	picture.parsed = true;
+}
+
+void DecoderApp::parse_stage() {
+	for (;;) {
+		std::shared_ptr<Picture> picture;
+		parse_queue_->pop(picture);
+		if (picture && !picture->parsed)
+			parse(*picture);
+		reconstruct_queue_->push(picture);
+		if (!picture)
+			return;
+	}
+}
+
+void DecoderApp::reconstruct_stage() {
+	for (;;) {
+		std::shared_ptr<Picture> picture;
+		reconstruct_queue_->pop(picture);
+		if (!picture)
+			return;
+
+		decoder_.set_configuration(picture->configuration, picture->dimensions);
+		const ReportStructure *report = picture->has_report ? &picture->report : nullptr;
+		if (picture->has_base_picture) {
+			if (count_ == 0)
+				INFO("-- Decoding: %.3f", system_timestamp() / 1000000.0);
+			decode_base_picture(&picture->base_picture, picture->symbols, picture->pts, picture->is_lcevc_idr, report);
+		} else {
+			decode_base_data(picture->base_data.data(), picture->symbols, picture->pts, picture->is_lcevc_idr, report);
+		}
+	}
+}
+
+void DecoderApp::flush() {
+	if (!parse_thread_.joinable())
+		return;
+
+	parse_queue_->push(nullptr);
+	parse_thread_.join();
+	reconstruct_thread_.join();
+}
+
+//// GopDecoder
+//
+unsigned GopDecoder::decode(const std::vector<ESFile::IndexEntry> &index, uint32_t num_access_units, unsigned limit,
+                            unsigned num_threads, YUVWriter &writer) {
+	// A base IDR with enhancement that carries on from earlier pictures stays in the stretch before it
+	const std::vector<ESFile::IndexEntry> restarts = restart_points(index);
+	INFO("-- %u IDR pictures start both base and enhancement", (unsigned)restarts.size());
+
+	// Stretches of stream - anything before the first IDR is decoded as if it were one
+	std::vector<Gop> gops;
+	for (size_t i = 0; i <= restarts.size(); ++i) {
+		const uint32_t begin = (i == 0) ? 0 : restarts[i - 1].m_accessUnit;
+		const uint32_t end = std::min<uint32_t>((i < restarts.size()) ? restarts[i].m_accessUnit : num_access_units, limit);
+		if (begin >= end)
+			continue;
+
+		Gop gop;
+		if (i > 0)
+			gop.entry = restarts[i - 1];
+		gop.num_access_units = end - begin;
+		gops.push_back(std::move(gop));
+	}
 
-unsigned DecoderApp::get_base_bitdepth() { return decoder_.get_configuration().global_configuration.base_depth; }
+	// Stretches are decoded on worker threads, and copied to the output here in order
+	unsigned count = 0;
+	try {
+		parallel_ordered(
+		    (unsigned)gops.size(), num_threads, [&](unsigned g) { decode_gop(gops[g]); },
+		    [&](unsigned g) {
+			    const Gop &gop = gops[g];
+			    if (gop.num_pictures) {
+				    if (count == 0)
+					    writer.update_data(gop.description);
+				    unique_ptr<YUVReader> reader(CHECK(CreateYUVReader(gop.filename, gop.description, 0)));
+				    for (unsigned p = 0; p < gop.num_pictures; ++p)
+					    writer.write(reader->read(p));
+				    count += gop.num_pictures;
+			    }
+			    ::remove(gop.filename.c_str());
+		    });
+	} catch (...) {
+		// Stretches decoded, or part decoded, but not copied to the output
+		for (const auto &gop : gops)
+			if (!gop.filename.empty())
+				::remove(gop.filename.c_str());
+		throw;
+	}
 
-Colourspace DecoderApp::get_colourspace() { return decoder_.get_configuration().global_configuration.colourspace; }
+	return count;
+}
+
+std::vector<ESFile::IndexEntry> GopDecoder::restart_points(const std::vector<ESFile::IndexEntry> &index) const {
+	ESFile es_file;
+	if (!es_file.Open(input_es_, file_base_))
+		ERR("Cannot open file: %s", input_es_.c_str());
+
+	std::vector<ESFile::IndexEntry> restarts;
+	for (const auto &entry : index) {
+		ESFile::AccessUnit au;
+		if (!es_file.Seek(entry) || es_file.NextAccessUnit(au) != ESFile::Success)
+			ERR("Cannot read access unit %u of %s", entry.m_accessUnit, input_es_.c_str());
+
+		vector<uint8_t> bytes;
+		for (const auto &u : au.m_nalUnits)
+			bytes.insert(bytes.end(), u.m_data.begin(), u.m_data.end());
+
+		// SEI encapsulation has no LCEVC picture type, and follows the base
+		bool found = false, lcevc_idr = false;
+		scan_enhancement(bytes.data(), bytes.size(), encapsulation_, base_video_type_, 0, true,
+		                 [&](const Packet &, const bool is_lcevc_idr) {
+			                 if (!found)
+				                 lcevc_idr = is_lcevc_idr;
+			                 found = true;
+		                 });
+		if (lcevc_idr)
+			restarts.push_back(entry);
+	}
+
+	return restarts;
+}
+
+void GopDecoder::decode_gop(Gop &gop) {
+	ESFile es_file;
+	if (!es_file.Open(input_es_, file_base_) || !es_file.Seek(gop.entry))
+		ERR("Cannot open file: %s", input_es_.c_str());
+
+	gop.filename = make_temporary_filename("_gop.yuv");
+	unique_ptr<YUVWriter> writer(CreateYUVWriter(gop.filename));
+
+	DecoderApp app(*writer, reader_);
+	configure_(app);
+
+	// External base decoders are separate processes, so nothing is shared with other stretches
+	std::unique_ptr<BaseVideoDecoder> base_video_decoder(
+	    CreateBaseVideoDecoder(app, base_video_type_, encapsulation_, true, "", false, false));
+	base_video_decoder->start();
+
+	ESFile::AccessUnit au;
+	for (unsigned n = 0; n < gop.num_access_units; ++n) {
+		if (es_file.NextAccessUnit(au) != ESFile::Success)
+			ERR("Cannot read access unit %u of %s", gop.entry.m_accessUnit + n, input_es_.c_str());
+
+		vector<uint8_t> bytes;
+		for (const auto &u : au.m_nalUnits)
+			bytes.insert(bytes.end(), u.m_data.begin(), u.m_data.end());
+
+		const uint64_t pts = au.m_poc + 1000;
+		base_video_decoder->push_au(bytes.data(), bytes.size(), pts, au.m_pictureType == BaseDecPictType::IDR,
+		                            au.m_pictureType);
+	}
+
+	base_video_decoder->push_au(0, 0, 0, false, 0);
+	app.flush();
+
+	gop.description = writer->image_description();
+	gop.num_pictures = app.count_;
+}
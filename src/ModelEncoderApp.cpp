@@ -40,6 +40,7 @@
 #include <algorithm>
 #include <cinttypes>
 #include <cstdio>
+#include <exception>
 #include <string>
 
 #include <cxxopts.hpp>
@@ -70,19 +71,28 @@ using json = nlohmann::json;
 
 using namespace std;
 
-// bitstream statistics
+// bitstream statistics - per thread, so that segments of a sequence can be encoded at the same time
 #include "BitstreamStatistic.hpp"
-BitstreamStatistic goStat;
-FILE *goBits = NULL;
-PsnrStatistic goPsnr;
-uint8_t gaucMd5Digest[lctm::MAX_NUM_PLANES][16];
-ReportStructure goReportStructure;
-std::priority_queue<ReportStructure, std::vector<ReportStructure, std::allocator<ReportStructure>>, ReportStructureComp>
+thread_local PsnrStatistic goPsnr;
+thread_local uint8_t gaucMd5Digest[lctm::MAX_NUM_PLANES][16];
+thread_local ReportStructure goReportStructure;
+thread_local std::priority_queue<ReportStructure, std::vector<ReportStructure, std::allocator<ReportStructure>>, ReportStructureComp>
     goReportQueue;
 
 using namespace lctm;
 
-int main(int argc, char *argv[]) {
+// Name of an image format, as taken by --format
+//
+static string format_name(const ImageDescription &description) {
+	static const char *const colourspaces[] = {"y", "yuv420p", "yuv422p", "yuv444p"};
+
+	string name = colourspaces[description.colourspace()];
+	if (description.bit_depth() != 8)
+		name += std::to_string(description.bit_depth());
+	return name;
+}
+
+static int encode(int argc, char *argv[]) {
 
 	auto pb = Parameters::build();
 
@@ -93,7 +103,7 @@ int main(int argc, char *argv[]) {
 
 		// clang-format off
 		options_description.add_options()
-			("i,input_file", "Input filename for raw YUV video frames", cxxopts::value<string>()->default_value("source.yuv"))
+			("i,input_file", "Input filename for raw YUV or Y4M video frames ('-' for standard input)", cxxopts::value<string>()->default_value("source.yuv"))
 			("o,output_file", "Output filename for elementary stream", cxxopts::value<string>()->default_value("output.lvc"))
 			("w,width", "Image width", cxxopts::value<unsigned>()->default_value("1920"))
 			("h,height", "Image height", cxxopts::value<unsigned>()->default_value("1080"))
@@ -107,6 +117,7 @@ int main(int argc, char *argv[]) {
 			("upsample_only", "Upsample input and write to output.", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
 			("output_recon", "Output filename for encoder yuv reconstruction (must be specified for output)", cxxopts::value<string>())
 			("encapsulation", "Code enhancement as SEI or NAL", cxxopts::value<string>()->default_value("nal"))
+			("mapped_input", "Map input YUV files into memory rather than copying each frame", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
 
 			("additional_info_present", "Additional Info present.", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
 			("additional_info_type", "Additional Info type.", cxxopts::value<unsigned>()->default_value("0")->implicit_value("0"))
@@ -122,6 +133,10 @@ int main(int argc, char *argv[]) {
 			("base", "Encoded base bitstream if base encoder shall be skipped", cxxopts::value<string>())
 			("base_recon", "Decoded YUV for base bitstream", cxxopts::value<string>())
 			("keep_base", "Keep the encoded base bitstream and reconstruction", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+			("base_streaming", "Run the base encoder alongside the enhancement encoder, reading its output through pipes", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+			("base_codec_api", "Run the base encoder in process, from its codec API library (x265)", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+			("base_codec_options", "JSON options for the codec API base encoder", cxxopts::value<string>())
+			("segment_parallel", "Encode segments of whole intra periods, each starting with an IDR, on this many threads at once (0 = in one piece)", cxxopts::value<unsigned>()->default_value("0"))
 			("intra_period", "Intra Period for base encoding (default: derived from framerate)", cxxopts::value<unsigned>())
 			("base_depth", "Bit depth of base encoder", cxxopts::value<unsigned>());
 
@@ -189,6 +204,7 @@ int main(int argc, char *argv[]) {
 			("sad_coeff_threshold", "Threshold of coefficients for removing non-static residuals (off: 0)", cxxopts::value<unsigned>()->default_value("0"))
 			("quant_reduced_deadzone", "Multiplier to reduce the quantization deadzone (range: [1, 5]) (off: 5)", cxxopts::value<unsigned>()->default_value("5"))
 			("user_data_method", "Type of user data to be inserted (zeros, ones, random or fixed_random)", cxxopts::value<string>()->default_value("zeros"))
+			("upsampling_dpi", "Upsample all planes of the decoded base picture in one pass", cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
 			("dump_configuration", "Output JSON encoded contents of config blocks that are written enhancement stream.", cxxopts::value<bool>()->default_value("false")->implicit_value("true"));
 
 		// clang-format on
@@ -257,6 +273,8 @@ int main(int argc, char *argv[]) {
 			pb.set("downsample_only", options["downsample_only"].as<bool>());
 		if (options.count("upsample_only"))
 			pb.set("upsample_only", options["upsample_only"].as<bool>());
+		if (options.count("mapped_input"))
+			pb.set("mapped_input", options["mapped_input"].as<bool>());
 
 		// Base Encoder Configuration
 		if (options.count("base_encoder"))
@@ -269,6 +287,14 @@ int main(int argc, char *argv[]) {
 			pb.set("base_recon", options["base_recon"].as<std::string>());
 		if (options.count("keep_base"))
 			pb.set("keep_base", options["keep_base"].as<bool>());
+		if (options.count("base_streaming"))
+			pb.set("base_streaming", options["base_streaming"].as<bool>());
+		if (options.count("base_codec_api"))
+			pb.set("base_codec_api", options["base_codec_api"].as<bool>());
+		if (options.count("base_codec_options"))
+			pb.set("base_codec_options", options["base_codec_options"].as<std::string>());
+		if (options.count("segment_parallel"))
+			pb.set("segment_parallel", options["segment_parallel"].as<unsigned>());
 		if (options.count("intra_period"))
 			pb.set("intra_period", options["intra_period"].as<unsigned>());
 		if (options.count("base_depth"))
@@ -395,11 +421,24 @@ int main(int argc, char *argv[]) {
 			pb.set("sad_coeff_threshold", options["sad_coeff_threshold"].as<unsigned>());
 		if (options.count("quant_reduced_deadzone"))
 			pb.set("quant_reduced_deadzone", options["quant_reduced_deadzone"].as<unsigned>());
+		if (options.count("upsampling_dpi"))
+			pb.set("upsampling_dpi", options["upsampling_dpi"].as<bool>());
 
 	} catch (const cxxopts::OptionException &e) {
 		std::cout << "error parsing options: " << e.what() << std::endl;
 		exit(1);
 	}
+	// Y4M input carries its own picture size, format and rate
+	ImageDescription y4m_description;
+	float y4m_rate = 0.0f;
+	if (ProbeY4M(pb.finish()["input_file"].get<string>("source.yuv"), y4m_description, y4m_rate)) {
+		pb.set("width", y4m_description.width());
+		pb.set("height", y4m_description.height());
+		pb.set("format", format_name(y4m_description));
+		if (y4m_rate > 0.0f)
+			pb.set("fps", static_cast<unsigned>(y4m_rate + 0.5f));
+	}
+
 	auto parameters = pb.finish();
 
 	// After parsing JSON
@@ -466,4 +505,20 @@ int main(int argc, char *argv[]) {
 	fflush(goBits);
 	fclose(goBits);
 #endif
+	return 0;
+}
+
+// The encoder is built with DIAGNOSTICS_ERR_THROWS, so that errors on the worker threads of a segmented encode come
+// back here, after the workers have stopped and removed their temporary files.
+//
+int main(int argc, char *argv[]) {
+	try {
+		return encode(argc, argv);
+	} catch (const DiagnosticsError &e) {
+		// Already logged
+		return e.exit_code();
+	} catch (const std::exception &e) {
+		fprintf(stderr, "Error: %s\n", e.what());
+		return 20;
+	}
 }
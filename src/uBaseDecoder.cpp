@@ -99,6 +99,8 @@ BaseDecoder::BaseDecoder() : m_currentBits(0), m_remainingBits(8), m_byteOffset(
 
 BaseDecoder::~BaseDecoder() {}
 
+bool BaseDecoder::IsIDR() const { return GetBasePictureType() == BaseDecPictType::IDR; }
+
 void BaseDecoder::Unencapsulate(const uint8_t *nalIn, uint32_t nalLength, DataBuffer &out) {
 	out.resize(nalLength);
 
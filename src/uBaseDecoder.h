@@ -131,6 +131,9 @@ public:
 	virtual NALDelimitier Delimiter() const = 0;
 	virtual int64_t GetPictureOrderCountIncrement() const = 0;
 
+	/// True if the last slice parsed starts a picture that can be decoded without any earlier ones
+	virtual bool IsIDR() const;
+
 protected:
 	uint32_t ReadBits(uint8_t numBits);
 	uint32_t ReadUE();
@@ -172,6 +172,8 @@ int32_t BaseDecoderEVC::GetQP() const {
 
 uint32_t BaseDecoderEVC::GetNalType() const { return m_nal_type; }
 
+bool BaseDecoderEVC::IsIDR() const { return m_nal_type == EVCNalType::IDR_NUT; }
+
 uint32_t BaseDecoderEVC::GetPictureWidth() const {
 	if (!m_sps)
 		return 0;
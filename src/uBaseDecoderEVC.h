@@ -71,6 +71,7 @@ public:
 	BaseDecNalUnitType::Enum GetBaseNalUnitType() const;
 	int32_t GetQP() const;
 	uint32_t GetNalType() const;
+	bool IsIDR() const;
 	int64_t GetPictureOrderCount() const;
 	uint32_t GetPictureWidth() const;
 	uint32_t GetPictureHeight() const;
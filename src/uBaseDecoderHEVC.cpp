@@ -227,6 +227,10 @@ int32_t BaseDecoderHEVC::GetQP() const { return (m_activeSlice.m_pps->m_initQP +
 
 uint32_t BaseDecoderHEVC::GetNalType() const { return m_currentNalType; }
 
+bool BaseDecoderHEVC::IsIDR() const {
+	return m_currentNalType == HEVCNalType::CodedSlice_IDR_W_RADL || m_currentNalType == HEVCNalType::CodedSlice_IDR_N_LP;
+}
+
 uint32_t BaseDecoderHEVC::GetPictureWidth() const {
 	if (!m_activeSPS) {
 		return 0;
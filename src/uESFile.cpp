@@ -34,6 +34,8 @@
 #include "uESFile.h"
 #include "Diagnostics.hpp"
 
+#include <stdexcept>
+
 namespace vnova {
 namespace utility {
 
@@ -51,12 +53,18 @@ ESFile::~ESFile() {
 }
 
 bool ESFile::Open(const std::string &path, BaseDecoder::Codec type) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+
+	return Open(file, type);
+}
+
+bool ESFile::Open(FILE *file, BaseDecoder::Codec type) {
 	if (IsOpen())
 		Close();
 
-	if ((m_file = fopen(path.c_str(), "rb")) == nullptr)
-		return false;
-
+	m_file = file;
 	m_type = type;
 
 	return Reset();
@@ -66,6 +74,10 @@ bool ESFile::Reset() {
 	m_decoder = CreateBaseDecoder(m_type);
 	CHECK(!!m_decoder);
 
+	m_poc_highest = 0;
+	m_poc_offset = 0;
+	m_pendingParameterSets.clear();
+
 	return fseek(m_file, 0, SEEK_SET) == 0;
 }
 
@@ -118,9 +130,94 @@ ESFile::Result ESFile::NextAccessUnit(AccessUnit &out) {
 	if (result != Success)
 		return result;
 
+	if (!m_pendingParameterSets.empty()) {
+		const bool has_parameter_sets =
+		    std::any_of(out.m_nalUnits.begin(), out.m_nalUnits.end(), [](const NalUnit &n) { return IsParameterSet(n); });
+		if (!has_parameter_sets) {
+			for (const auto &n : m_pendingParameterSets)
+				out.m_size += (int32_t)n.m_data.size();
+			out.m_nalUnits.insert(out.m_nalUnits.begin(), m_pendingParameterSets.begin(), m_pendingParameterSets.end());
+		}
+		m_pendingParameterSets.clear();
+	}
+
 	return Success;
 }
 
+ESFile::Result ESFile::IndexIDR(std::vector<IndexEntry> &index, uint32_t &numAccessUnits) {
+	index.clear();
+	numAccessUnits = 0;
+
+	if (m_file == nullptr || !Reset())
+		return NoFile;
+
+	// Latest of each distinct parameter set, in the order seen
+	std::vector<NalUnit> parameterSets;
+
+	for (;;) {
+		const long offset = ftell(m_file);
+		if (offset < 0)
+			return NoFile;
+
+		AccessUnit au;
+		Result result = EndOfFile;
+		try {
+			result = NextAccessUnit(au);
+		} catch (const std::runtime_error &) {
+			result = NalParsingError;
+		}
+
+		if (result == EndOfFile)
+			break;
+		if (result != Success) {
+			Reset();
+			return result;
+		}
+
+		if (au.m_idr) {
+			IndexEntry entry;
+			entry.m_offset = (uint64_t)offset;
+			entry.m_accessUnit = numAccessUnits;
+			entry.m_parameterSets = parameterSets;
+			index.push_back(std::move(entry));
+		}
+
+		for (const auto &n : au.m_nalUnits) {
+			if (!IsParameterSet(n))
+				continue;
+			parameterSets.erase(std::remove_if(parameterSets.begin(), parameterSets.end(),
+			                                   [&n](const NalUnit &p) { return p.m_data == n.m_data; }),
+			                    parameterSets.end());
+			parameterSets.push_back(n);
+		}
+
+		++numAccessUnits;
+	}
+
+	return Reset() ? Success : NoFile;
+}
+
+bool ESFile::Seek(const IndexEntry &entry) {
+	if (m_file == nullptr || !Reset())
+		return false;
+
+	if (fseek(m_file, (long)entry.m_offset, SEEK_SET) != 0)
+		return false;
+
+	// Length prefixed units are parsed without their prefix
+	const size_t prefix = (m_decoder->Delimiter() == NALDelimiterU32Length) ? sizeof(uint32_t) : 0;
+	for (const auto &n : entry.m_parameterSets)
+		m_decoder->ParseNalUnit(n.m_data.data() + prefix, static_cast<uint32_t>(n.m_data.size() - prefix));
+
+	m_pendingParameterSets = entry.m_parameterSets;
+	return true;
+}
+
+bool ESFile::IsParameterSet(const NalUnit &unit) {
+	return unit.m_baseType == BaseDecNalUnitType::VPS || unit.m_baseType == BaseDecNalUnitType::SPS ||
+	       unit.m_baseType == BaseDecNalUnitType::PPS;
+}
+
 ESFile::Result ESFile::ReadAccessUnit(AccessUnit &out) {
 	switch (m_decoder->Delimiter()) {
 	case NALDelimiterMarker:
@@ -175,6 +272,7 @@ ESFile::Result ESFile::ReadAccessUnitMarker(AccessUnit &out) {
 
 					auto nalEnd = buffer.end() - markerSize;
 					unit.m_type = m_decoder->GetNalType();
+					unit.m_baseType = m_decoder->GetBaseNalUnitType();
 					temporalId = std::max(temporalId, m_decoder->GetTemporalId());
 
 					// Move the next nal unit's marker into unit's buffer so we can just swap the two
@@ -188,6 +286,7 @@ ESFile::Result ESFile::ReadAccessUnitMarker(AccessUnit &out) {
 					if (m_decoder->GetBaseNalUnitType() == BaseDecNalUnitType::Slice) {
 
 						out.m_pictureType = m_decoder->GetBasePictureType();
+						out.m_idr = m_decoder->IsIDR();
 						out.m_poc = GenerateIncreasingPOC();
 						out.m_qp = m_decoder->GetQP();
 						out.m_temporalId = temporalId;
@@ -202,7 +301,9 @@ ESFile::Result ESFile::ReadAccessUnitMarker(AccessUnit &out) {
 				} else if (result == 2) {
 					NalUnit unit;
 
+					// Not parsed - the decoder's state is from the previous unit
 					auto nalEnd = buffer.end() - markerSize;
+					unit.m_baseType = BaseDecNalUnitType::Unknown;
 
 					// Move the next nal unit's marker into unit's buffer so we can just swap the two
 					unit.m_data.insert(unit.m_data.end(), nalEnd, buffer.end());
@@ -249,6 +350,7 @@ ESFile::Result ESFile::ReadAccessUnitU32Length(AccessUnit &out) {
 		if (m_decoder->ParseNalUnit(buffer.data(), nal_length)) {
 			NalUnit unit;
 			unit.m_type = m_decoder->GetNalType();
+			unit.m_baseType = m_decoder->GetBaseNalUnitType();
 			unit.m_data.insert(unit.m_data.end(), (uint8_t *)&nal_length, (uint8_t *)&nal_length + sizeof(nal_length));
 			unit.m_data.insert(unit.m_data.end(), buffer.begin(), buffer.end());
 			nalUnits.push_back(std::move(unit));
@@ -256,6 +358,7 @@ ESFile::Result ESFile::ReadAccessUnitU32Length(AccessUnit &out) {
 
 			if (m_decoder->GetBaseNalUnitType() == BaseDecNalUnitType::Slice) {
 				out.m_pictureType = m_decoder->GetBasePictureType();
+				out.m_idr = m_decoder->IsIDR();
 				out.m_poc = GenerateIncreasingPOC();
 				out.m_qp = m_decoder->GetQP();
 				out.m_nalUnits = std::move(nalUnits);
@@ -274,19 +377,21 @@ ESFile::Result ESFile::ReadAccessUnitU32Length(AccessUnit &out) {
 // Create a POC that always increases across IDR
 //
 uint64_t ESFile::GenerateIncreasingPOC() {
-	uint64_t decoded_poc = m_decoder->GetPictureOrderCount();
+	const int64_t decoded_poc = m_decoder->GetPictureOrderCount();
 
 	// If we see the start of an IDR and the POC goes backwards, then
 	// offset the generated POC by the highest POC seen so far
 	//
-	if(m_decoder->GetBasePictureType() == BaseDecPictType::IDR && decoded_poc < m_poc_highest) {
+	if(m_decoder->IsIDR() && decoded_poc < m_poc_highest) {
 		m_poc_offset = m_poc_highest;
 	}
 
-	const uint64_t poc = decoded_poc + m_poc_offset;
+	const int64_t poc = decoded_poc + m_poc_offset;
 
-	if(poc > m_poc_highest) {
-		m_poc_highest = poc + m_decoder->GetPictureOrderCountIncrement();
+	// Highest is one picture on from the latest POC, so that the next IDR follows it
+	const int64_t next_poc = poc + m_decoder->GetPictureOrderCountIncrement();
+	if(next_poc > m_poc_highest) {
+		m_poc_highest = next_poc;
 	}
 
 	return poc;
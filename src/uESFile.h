@@ -41,6 +41,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 
 #define BITSTREAM_BUFFER_SIZE (1024 * 1024)
 
@@ -71,8 +72,13 @@ public:
 
 	struct NalUnit
 	{
+		NalUnit(uint32_t type = 0, utility::DataBuffer data = utility::DataBuffer(),
+		        BaseDecNalUnitType::Enum baseType = BaseDecNalUnitType::Unknown)
+		    : m_type(type), m_data(std::move(data)), m_baseType(baseType) {}
+
 		uint32_t			m_type;
 		utility::DataBuffer	m_data;
+		BaseDecNalUnitType::Enum m_baseType;
 	};
 
 	struct AccessUnit
@@ -80,15 +86,26 @@ public:
 		int64_t				  m_poc =0;
 		int32_t				  m_qp =0;
 		BaseDecPictType::Enum m_pictureType;
+		bool				  m_idr = false;
 		uint32_t              m_temporalId =0;
 		std::vector<NalUnit>  m_nalUnits;
 		int32_t m_size =0;
 	};
 
+	// Where an IDR access unit starts, and what is needed to start decoding there
+	struct IndexEntry
+	{
+		uint64_t			 m_offset = 0;		// Byte offset of access unit
+		uint32_t			 m_accessUnit = 0;	// Number of access units before it
+		std::vector<NalUnit> m_parameterSets;	// Parameter sets seen before it
+	};
+
 	ESFile();
 	~ESFile();
 
 	bool Open(const std::string& path, BaseDecoder::Codec type);
+	// Read from an open stream, such as a pipe - takes ownership of 'file'
+	bool Open(FILE* file, BaseDecoder::Codec type);
 	bool Reset();
 	void Close();
 
@@ -98,6 +115,14 @@ public:
 
 	Result NextAccessUnit(AccessUnit& out);
 
+	// Read the whole stream, recording each IDR access unit, and the total number of access units - the stream is left
+	// at its start. Only for files that can seek.
+	Result IndexIDR(std::vector<IndexEntry>& index, uint32_t& numAccessUnits);
+
+	// Carry on from an indexed access unit as if the stream started there. The parameter sets from the index are given to
+	// the parser, and put in front of the access unit if it has none of its own.
+	bool Seek(const IndexEntry& entry);
+
 	// Query information gathered from SPS
 	uint32_t GetPictureWidth() const;
 	uint32_t GetPictureHeight() const;
@@ -113,6 +138,8 @@ private:
 	// Create a POC that always increases across IDR 
 	uint64_t GenerateIncreasingPOC();
 
+	static bool IsParameterSet(const NalUnit& unit);
+
 	FILE*	m_file;
 	BaseDecoder::Codec	m_type;
 	std::unique_ptr<utility::BaseDecoder> m_decoder;
@@ -122,6 +149,9 @@ private:
 	// Offset for POCs from decoder to keep them increasing across IDRs
 	int64_t m_poc_offset;
 
+	// Parameter sets to go in front of the next access unit, after a Seek()
+	std::vector<NalUnit> m_pendingParameterSets;
+
 	unsigned char * mpucBuffer;
 	int miBufferFullness;
 	int miBufferPointer;
@@ -0,0 +1,240 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+// TestDecode.cpp
+//
+// Check that reconstructing pictures in bands of rows, and decoding planes as parallel tasks, match a serial whole plane
+// decode, over sequences encoded in process
+//
+
+#include "Decoder.hpp"
+#include "Dithering.hpp"
+#include "Downsampling.hpp"
+#include "Encoder.hpp"
+#include "Expand.hpp"
+
+#include "BitstreamStatistic.hpp"
+#include "Image.hpp"
+#include "Packet.hpp"
+#include "Parameters.hpp"
+#include "Surface.hpp"
+
+#include "Diagnostics.hpp"
+
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+// Statistics the encoder reports to - defined by the encoder application
+thread_local PsnrStatistic goPsnr;
+thread_local uint8_t gaucMd5Digest[lctm::MAX_NUM_PLANES][16];
+thread_local ReportStructure goReportStructure;
+thread_local std::priority_queue<ReportStructure, std::vector<ReportStructure, std::allocator<ReportStructure>>, ReportStructureComp>
+    goReportQueue;
+
+using namespace lctm;
+
+// An encoded picture, and the base it is decoded against
+//
+struct Picture {
+	Packet enhancement;
+	Image base;
+	bool idr;
+};
+
+static const unsigned num_pictures = 8;
+static const unsigned idr_period = 4;
+
+static Random random_;
+
+// Gradients and blocks - still on the left, so that the temporal buffer carries residuals from picture to picture, and
+// moving with noise on the right, so that there are fresh residuals in every sub-layer
+//
+static Image source_picture(const ImageDescription &description, unsigned n) {
+	Surface planes[3];
+	for (unsigned plane = 0; plane < description.num_planes(); ++plane) {
+		const unsigned half = description.width(plane) / 2;
+		planes[plane] = Surface::build_from<uint8_t>()
+		                    .generate(description.width(plane), description.height(plane),
+		                              [&](unsigned x, unsigned y) -> uint8_t {
+			                              const unsigned t = x < half ? 0 : n;
+			                              int v = (int)(((x + 2 * t) * 7 + (y + t) * 3) & 0xff) / (int)(plane + 1);
+			                              if (((x / 16 + y / 16 + t / 2) & 1) != 0)
+				                              v += 40;
+			                              if (x >= half)
+				                              v += (int)(random_.rand() % 9);
+			                              return (uint8_t)(v > 255 ? 255 : v);
+		                              })
+		                    .finish();
+	}
+	return Image("source", description, n, planes);
+}
+
+// Encode a short sequence - the base is the downsampled source with its low bits dropped, standing in for a base codec
+//
+static std::vector<Picture> encode_sequence(unsigned width, unsigned height, const std::string &json) {
+	const ImageDescription description(IMAGE_FORMAT_YUV420P8, width, height);
+	const Parameters parameters = Parameters::build().set_json(json).finish();
+	Encoder encoder(description, parameters);
+
+	std::vector<Image> source;
+	for (unsigned n = 0; n < num_pictures; ++n)
+		source.push_back(ExpandImage(source_picture(description, n), encoder.enhancement_image_description()));
+
+	std::vector<std::unique_ptr<Image>> initial;
+	for (unsigned n = 0; n < 5; ++n)
+		initial.push_back(std::unique_ptr<Image>(new Image(source[n])));
+	encoder.initialise_config(parameters, initial);
+
+	const ScalingMode scaling_mode_level1 = parameters["scaling_mode_level1"].get_enum<ScalingMode>(ScalingMode_None);
+	const ScalingMode scaling_mode_level2 = parameters["scaling_mode_level2"].get_enum<ScalingMode>(ScalingMode_2D);
+
+	std::vector<Picture> sequence;
+	for (unsigned n = 0; n < num_pictures; ++n) {
+		std::vector<std::unique_ptr<Image>> src;
+		src.push_back(std::unique_ptr<Image>(new Image(source[n])));
+		if (n + 1 < num_pictures)
+			src.push_back(std::unique_ptr<Image>(new Image(source[n + 1])));
+
+		const Image intermediate = DownsampleImage(source[n], Downsample_Lanczos3, Downsample_Lanczos3, scaling_mode_level2,
+		                                           encoder.intermediate_image_description().bit_depth());
+		const Image downsampled = DownsampleImage(intermediate, Downsample_Lanczos3, Downsample_Lanczos3, scaling_mode_level1,
+		                                          encoder.base_image_description().bit_depth());
+
+		Surface base_planes[3];
+		for (unsigned plane = 0; plane < downsampled.description().num_planes(); ++plane) {
+			const auto view = downsampled.plane(plane).view_as<uint8_t>();
+			base_planes[plane] = Surface::build_from<uint8_t>()
+			                         .generate(view.width(), view.height(),
+			                                   [&](unsigned x, unsigned y) -> uint8_t { return view.read(x, y) & 0xf0; })
+			                         .finish();
+		}
+
+		const Image base("base", downsampled.description(), n, base_planes);
+		const bool idr = (n % idr_period) == 0;
+		const Packet enhancement = encoder.encode(src, intermediate, base, idr ? BaseFrame_IDR : BaseFrame_Pred, idr, n, "");
+		sequence.push_back(Picture{enhancement, base, idr});
+	}
+
+	return sequence;
+}
+
+// Decode a sequence with a configured decoder - returning the size and checksum of every output plane
+//
+static std::vector<uint64_t> decode_sequence(const std::vector<Picture> &sequence, std::function<void(Decoder &)> configure) {
+	Decoder decoder;
+	configure(decoder);
+
+	std::vector<uint64_t> checksums;
+	for (const Picture &picture : sequence) {
+		Surface symbols[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS];
+		decoder.initialize_decode(picture.enhancement, symbols);
+		decoder.set_idr(picture.idr);
+
+		const Image output = decoder.decode(picture.base, symbols, Image(), false, false, false, true);
+		for (unsigned plane = 0; plane < output.description().num_planes(); ++plane) {
+			checksums.push_back(output.plane(plane).width());
+			checksums.push_back(output.plane(plane).height());
+			checksums.push_back(output.plane(plane).checksum());
+		}
+	}
+
+	return checksums;
+}
+
+// Bands down to fewer rows than the reach of the 4 tap upsampling kernel, heights that leave a short last band, and a
+// band taller than the picture
+//
+static void check_stripes(const std::vector<Picture> &sequence, const std::vector<uint64_t> &expected) {
+	const unsigned stripe_rows[] = {1, 4, 6, 20, 64, 1000};
+
+	for (const unsigned rows : stripe_rows) {
+		for (unsigned num_threads = 1; num_threads <= 3; num_threads += 2) {
+			const std::vector<uint64_t> banded = decode_sequence(sequence, [&](Decoder &decoder) {
+				decoder.set_stripe_rows(rows);
+				decoder.set_num_threads(num_threads);
+			});
+			CHECK(banded == expected);
+		}
+	}
+}
+
+// Planes, and the two sub-layers of each plane, as parallel tasks - each plane's temporal buffer is carried from picture
+// to picture by its own sub-layer 2 task
+//
+static void check_parallel_planes(const std::vector<Picture> &sequence, const std::vector<uint64_t> &expected) {
+	for (unsigned num_threads = 2; num_threads <= 8; num_threads *= 2) {
+		for (unsigned rows = 0; rows <= 16; rows += 16) {
+			const std::vector<uint64_t> parallel = decode_sequence(sequence, [&](Decoder &decoder) {
+				decoder.set_parallel_planes(true);
+				decoder.set_num_threads(num_threads);
+				decoder.set_stripe_rows(rows);
+			});
+			CHECK(parallel == expected);
+		}
+	}
+}
+
+int main() {
+	random_.srand(1234);
+
+	// Step widths of sub-layer 1 and sub-layer 2 - the encoder takes the latter as "cq_step_width_loq_0"
+	const std::string step_widths = R"("cq_step_width_loq_1":300,"cq_step_width_loq_0":400)";
+	const std::string residuals = step_widths + R"(,"num_processed_planes":3,"temporal_enabled":true)";
+
+	// Temporal prediction is on throughout. 2D and 1D scaling, both LoQs scaled, and a picture size that needs a
+	// conformance window - 138 rows are not a whole number of any band height. Then enhancement of luma only, with
+	// chroma passed through.
+	const struct {
+		unsigned width, height;
+		std::string json;
+	} sequences[] = {
+	    {256, 144, "{" + residuals + "}"},
+	    {256, 144, "{" + residuals + R"(,"scaling_mode_level2":"1d"})"},
+	    {256, 144, "{" + residuals + R"(,"scaling_mode_level1":"2d"})"},
+	    {250, 138, "{" + residuals + "}"},
+	    {256, 144, "{" + step_widths + R"(,"num_processed_planes":1,"temporal_enabled":true})"},
+	};
+
+	for (const auto &s : sequences) {
+		const std::vector<Picture> sequence = encode_sequence(s.width, s.height, s.json);
+		const std::vector<uint64_t> expected = decode_sequence(sequence, [](Decoder &) {});
+
+		check_stripes(sequence, expected);
+		check_parallel_planes(sequence, expected);
+	}
+
+	INFO("Banded and parallel plane decoding bit-exact");
+	return 0;
+}
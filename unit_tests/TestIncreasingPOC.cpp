@@ -0,0 +1,324 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+// TestIncreasingPOC.cpp
+//
+// Check that ESFile keeps POCs increasing across the IDRs of HEVC and EVC streams that are joined from parts which each
+// start again at POC 0 - as segmented encodes produce
+//
+
+#include "uESFile.h"
+
+#include "Diagnostics.hpp"
+#include "Misc.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace lctm;
+using namespace vnova::utility;
+
+// Exp-Golomb and fixed length fields, most significant bit first
+//
+class BitWriter {
+public:
+	void bits(uint32_t value, unsigned num_bits) {
+		for (unsigned i = num_bits; i-- > 0;)
+			bit((value >> i) & 1);
+	}
+	void flag(bool value) { bit(value ? 1 : 0); }
+	void ue(uint32_t value) {
+		unsigned num_bits = 0;
+		while (((uint64_t)value + 1) >> (num_bits + 1))
+			++num_bits;
+		bits(0, num_bits);
+		bits(value + 1, num_bits + 1);
+	}
+	void se(int32_t value) { ue(value > 0 ? 2 * value - 1 : -2 * value); }
+
+	// rbsp_trailing_bits(), then a couple of bytes standing in for slice data - the parsers load the next byte as they
+	// finish one
+	std::vector<uint8_t> finish() {
+		bit(1);
+		while (num_bits_)
+			bit(0);
+		bytes_.push_back(0xaa);
+		bytes_.push_back(0x55);
+		return bytes_;
+	}
+
+private:
+	void bit(unsigned b) {
+		current_ = (uint8_t)((current_ << 1) | b);
+		if (++num_bits_ == 8) {
+			bytes_.push_back(current_);
+			current_ = 0;
+			num_bits_ = 0;
+		}
+	}
+
+	std::vector<uint8_t> bytes_;
+	uint8_t current_ = 0;
+	unsigned num_bits_ = 0;
+};
+
+static const unsigned kLog2MaxPocLsb = 8;
+
+// One picture of a part, in decoding order
+struct Picture {
+	unsigned poc;
+	bool reference;
+};
+
+// Pictures in output order - each is a reference for the next
+//
+static std::vector<Picture> low_delay(unsigned count) {
+	std::vector<Picture> pictures;
+	for (unsigned p = 0; p < count; ++p)
+		pictures.push_back({p, true});
+	return pictures;
+}
+
+// Groups of 4 pictures, each group's last picture sent first - so the highest POC of a part is not its last picture
+//
+static std::vector<Picture> random_access(unsigned count) {
+	std::vector<Picture> pictures = {{0, true}};
+	for (unsigned first = 1; first < count; first += 4) {
+		const unsigned last = std::min(first + 3, count - 1);
+		pictures.push_back({last, true});
+		for (unsigned p = first; p < last; ++p)
+			pictures.push_back({p, false});
+	}
+	return pictures;
+}
+
+//// HEVC - Annex B byte stream
+//
+static void write_hevc_nal(FILE *file, unsigned nal_unit_type, const std::vector<uint8_t> &rbsp) {
+	std::vector<uint8_t> nal = {0, 0, 0, 1, (uint8_t)(nal_unit_type << 1), 1};
+
+	// Emulation prevention
+	unsigned zeros = 0;
+	for (const uint8_t b : rbsp) {
+		if (zeros >= 2 && b <= 3) {
+			nal.push_back(3);
+			zeros = 0;
+		}
+		nal.push_back(b);
+		zeros = b ? 0 : zeros + 1;
+	}
+
+	CHECK(fwrite(nal.data(), 1, nal.size(), file) == nal.size());
+}
+
+static void write_hevc_part(FILE *file, const std::vector<Picture> &pictures) {
+	write_hevc_nal(file, 32, BitWriter().finish()); // VPS - not parsed
+
+	BitWriter sps;
+	sps.bits(0, 4);  // sps_video_parameter_set_id
+	sps.bits(0, 3);  // sps_max_sub_layers_minus1
+	sps.flag(true);  // sps_temporal_id_nesting_flag
+	sps.bits(0, 2);  // general_profile_space
+	sps.flag(false); // general_tier_flag
+	sps.bits(1, 5);  // general_profile_idc
+	sps.bits(0x60000000, 32);
+	sps.bits(0x9, 4);
+	sps.bits(0, 32);
+	sps.bits(0, 12);
+	sps.bits(93, 8); // general_level_idc
+	sps.ue(0);       // sps_seq_parameter_set_id
+	sps.ue(1);       // chroma_format_idc
+	sps.ue(352);     // pic_width_in_luma_samples
+	sps.ue(288);     // pic_height_in_luma_samples
+	sps.flag(false); // conformance_window_flag
+	sps.ue(0);       // bit_depth_luma_minus8
+	sps.ue(0);       // bit_depth_chroma_minus8
+	sps.ue(kLog2MaxPocLsb - 4);
+	sps.flag(true); // sps_sub_layer_ordering_info_present_flag
+	sps.ue(4);      // sps_max_dec_pic_buffering_minus1
+	sps.ue(3);      // sps_max_num_reorder_pics
+	sps.ue(0);      // sps_max_latency_increase_plus1
+	sps.ue(0);      // log2_min_luma_coding_block_size_minus3
+	sps.ue(3);      // log2_diff_max_min_luma_coding_block_size
+	sps.ue(0);      // log2_min_luma_transform_block_size_minus2
+	sps.ue(3);      // log2_diff_max_min_luma_transform_block_size
+	sps.ue(0);      // max_transform_hierarchy_depth_inter
+	sps.ue(0);      // max_transform_hierarchy_depth_intra
+	sps.flag(false); // scaling_list_enabled_flag
+	sps.flag(false); // amp_enabled_flag
+	sps.flag(false); // sample_adaptive_offset_enabled_flag
+	sps.flag(false); // pcm_enabled_flag
+	sps.ue(0);       // num_short_term_ref_pic_sets
+	write_hevc_nal(file, 33, sps.finish());
+
+	BitWriter pps;
+	pps.ue(0);      // pps_pic_parameter_set_id
+	pps.ue(0);      // pps_seq_parameter_set_id
+	pps.bits(0, 7); // dependent_slice_segments_enabled_flag to cabac_init_present_flag
+	pps.ue(0);      // num_ref_idx_l0_default_active_minus1
+	pps.ue(0);      // num_ref_idx_l1_default_active_minus1
+	pps.se(0);      // init_qp_minus26
+	pps.bits(0, 3); // constrained_intra_pred_flag to cu_qp_delta_enabled_flag
+	pps.se(0);      // pps_cb_qp_offset
+	pps.se(0);      // pps_cr_qp_offset
+	pps.bits(0, 9); // pps_slice_chroma_qp_offsets_present_flag to pps_scaling_list_data_present_flag
+	pps.flag(false); // lists_modification_present_flag
+	pps.ue(0);       // log2_parallel_merge_level_minus2
+	pps.flag(false); // slice_segment_header_extension_present_flag
+	write_hevc_nal(file, 34, pps.finish());
+
+	for (const Picture &picture : pictures) {
+		const bool idr = picture.poc == 0;
+		const unsigned nal_unit_type = idr ? 19 : (picture.reference ? 1 : 0); // IDR_W_RADL, TRAIL_R or TRAIL_N
+
+		BitWriter slice;
+		slice.flag(true); // first_slice_segment_in_pic_flag
+		if (idr)
+			slice.flag(false); // no_output_of_prior_pics_flag
+		slice.ue(0);           // slice_pic_parameter_set_id
+		slice.ue(idr ? 2 : 1); // slice_type
+		if (!idr) {
+			slice.bits(picture.poc, kLog2MaxPocLsb); // slice_pic_order_cnt_lsb
+			slice.flag(false);                      // short_term_ref_pic_set_sps_flag
+		}
+		write_hevc_nal(file, nal_unit_type, slice.finish());
+	}
+}
+
+//// EVC - 32 bit length before each NAL unit
+//
+static void write_evc_nal(FILE *file, unsigned nal_unit_type, const std::vector<uint8_t> &rbsp) {
+	std::vector<uint8_t> nal = {(uint8_t)((nal_unit_type + 1) << 1), 0};
+	nal.insert(nal.end(), rbsp.begin(), rbsp.end());
+
+	const uint32_t length = (uint32_t)nal.size();
+	CHECK(fwrite(&length, sizeof(length), 1, file) == 1);
+	CHECK(fwrite(nal.data(), 1, nal.size(), file) == nal.size());
+}
+
+static void write_evc_part(FILE *file, const std::vector<Picture> &pictures) {
+	BitWriter sps;
+	sps.ue(0);       // sps_seq_parameter_set_id
+	sps.bits(0, 8);  // profile_idc
+	sps.bits(60, 8); // level_idc
+	sps.bits(0, 32); // toolset_idc_h
+	sps.bits(0, 32); // toolset_idc_l
+	sps.ue(1);       // chroma_format_idc
+	sps.ue(352);     // pic_width_in_luma_samples
+	sps.ue(288);     // pic_height_in_luma_samples
+	sps.ue(0);       // bit_depth_luma_minus8
+	sps.ue(0);       // bit_depth_chroma_minus8
+	sps.bits(0, 10); // sps_btt_flag to sps_rpl_flag
+	sps.flag(true);  // sps_pocs_flag
+	sps.bits(0, 2);  // sps_dquant_flag, sps_dra_flag
+	sps.ue(kLog2MaxPocLsb - 4);
+	sps.ue(2); // log2_sub_gop_length
+	sps.ue(4); // max_num_ref_pics
+	write_evc_nal(file, 24, sps.finish());
+
+	BitWriter pps;
+	pps.ue(0);      // pps_pic_parameter_set_id
+	pps.ue(0);      // pps_seq_parameter_set_id
+	pps.ue(0);      // num_ref_idx_default_active_minus1[0]
+	pps.ue(0);      // num_ref_idx_default_active_minus1[1]
+	pps.ue(0);      // additional_lt_poc_lsb_len
+	pps.flag(false); // rpl1_idx_present_flag
+	pps.flag(true);  // single_tile_in_pic_flag
+	pps.ue(0);       // tile_id_len_minus1
+	pps.bits(0, 4);  // explicit_tile_id_flag to cu_qp_delta_enabled_flag
+	write_evc_nal(file, 25, pps.finish());
+
+	for (const Picture &picture : pictures) {
+		const bool idr = picture.poc == 0;
+
+		BitWriter slice;
+		slice.ue(0);           // slice_pic_parameter_set_id
+		slice.ue(idr ? 2 : 1); // slice_type
+		if (idr)
+			slice.flag(false); // no_output_of_prior_pics_flag
+		else
+			slice.bits(picture.poc, kLog2MaxPocLsb); // slice_pic_order_cnt_lsb
+		write_evc_nal(file, idr ? 1 : 0, slice.finish());
+	}
+}
+
+// Join parts with the given numbers of pictures, read them back, and check that each part's POCs follow on from all of
+// the part before
+//
+static void check_joined(BaseDecoder::Codec codec, std::vector<Picture> (*structure)(unsigned),
+                         const std::vector<unsigned> &counts) {
+	const std::string filename = make_temporary_filename("_poc.bin");
+	{
+		FILE *file = CHECK(fopen(filename.c_str(), "wb"));
+		for (const unsigned count : counts) {
+			if (codec == BaseDecoder::HEVC)
+				write_hevc_part(file, structure(count));
+			else
+				write_evc_part(file, structure(count));
+		}
+		fclose(file);
+	}
+
+	ESFile es_file;
+	CHECK(es_file.Open(filename, codec));
+
+	unsigned offset = 0;
+	for (const unsigned count : counts) {
+		for (const Picture &picture : structure(count)) {
+			ESFile::AccessUnit au;
+			CHECK(es_file.NextAccessUnit(au) == ESFile::Success);
+			CHECK(au.m_idr == (picture.poc == 0));
+			CHECK(au.m_poc == (int64_t)(offset + picture.poc));
+		}
+		offset += count;
+	}
+
+	ESFile::AccessUnit au;
+	CHECK(es_file.NextAccessUnit(au) == ESFile::EndOfFile);
+
+	es_file.Close();
+	::remove(filename.c_str());
+}
+
+int main() {
+	const std::vector<unsigned> counts = {9, 8, 2, 7, 16};
+
+	for (const BaseDecoder::Codec codec : {BaseDecoder::HEVC, BaseDecoder::EVC}) {
+		check_joined(codec, low_delay, counts);
+		check_joined(codec, random_access, counts);
+	}
+
+	INFO("POCs increase across joined IDRs");
+	return 0;
+}
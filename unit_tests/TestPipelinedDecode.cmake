@@ -0,0 +1,109 @@
+# TestPipelinedDecode.cmake
+#
+# Decode the same stream with and without --pipeline_depth, and check the pipelined decodes give the same
+# output and the same per-picture report lines - pts, picture type, base and enhancement sizes, PSNR and MD5s -
+# so that each picture's report travels through the pipeline with that picture.
+#
+# Run as a script: cmake -DENCODER=<ModelEncoder> -DDECODER=<ModelDecoder> -DWORK_DIR=<dir> -P TestPipelinedDecode.cmake
+#
+# The stream is encoded with the codec API x265 base encoder, and decoded against a prepared YUV base - the test is
+# skipped if libx265 cannot be loaded.
+#
+
+set(WIDTH 160)
+set(HEIGHT 144)
+set(FRAMES 12)
+set(DEPTHS 0 1 3)
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+set(SOURCE "${WORK_DIR}/pipelined_source.yuv")
+set(BASE "${WORK_DIR}/pipelined_base.yuv")
+
+# Synthetic 4:2:0 pictures - printable bytes so that file(WRITE) can produce them, with the pattern
+# moving from frame to frame so that there is something to predict.
+#
+set(ALPHABET "0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[]^_abcdefghijklmnopqrstuvwxyz{|}~!#$%&'()*+,-./")
+string(APPEND ALPHABET "${ALPHABET}${ALPHABET}")
+math(EXPR LAST_FRAME "${FRAMES} - 1")
+
+function(write_pictures FILENAME PICTURE_WIDTH PICTURE_HEIGHT STEP)
+  math(EXPR ROWS_PER_FRAME "${PICTURE_HEIGHT} * 3 / 2 - 1")
+  file(WRITE "${FILENAME}" "")
+  foreach(FRAME RANGE ${LAST_FRAME})
+	set(DATA "")
+	foreach(ROW RANGE ${ROWS_PER_FRAME})
+	  math(EXPR OFFSET "(${ROW} * 7 + ${FRAME} * ${STEP}) % 90")
+	  string(SUBSTRING "${ALPHABET}" ${OFFSET} ${PICTURE_WIDTH} LINE)
+	  string(APPEND DATA "${LINE}")
+	endforeach()
+	file(APPEND "${FILENAME}" "${DATA}")
+  endforeach()
+endfunction()
+
+write_pictures("${SOURCE}" ${WIDTH} ${HEIGHT} 3)
+
+# Prepared base at the base resolution (2D scaling) - it need not be the base encoder's reconstruction, only the
+# same for every decode
+math(EXPR BASE_WIDTH "${WIDTH} / 2")
+math(EXPR BASE_HEIGHT "${HEIGHT} / 2")
+write_pictures("${BASE}" ${BASE_WIDTH} ${BASE_HEIGHT} 5)
+
+execute_process(
+  COMMAND "${ENCODER}" -w ${WIDTH} -h ${HEIGHT} -f yuv420p -r 50 --base_encoder x265 --base_codec_api --qp 32
+	--intra_period 8 -i "${SOURCE}" -o "${WORK_DIR}/pipelined.lvc"
+  WORKING_DIRECTORY "${WORK_DIR}"
+  RESULT_VARIABLE RESULT
+  OUTPUT_FILE "${WORK_DIR}/pipelined_encode.log"
+  ERROR_FILE "${WORK_DIR}/pipelined_encode.log")
+if(NOT RESULT EQUAL 0)
+  file(READ "${WORK_DIR}/pipelined_encode.log" LOG)
+  if(LOG MATCHES "Cannot (find|load) (base codec|x265) library")
+	message("SKIPPED: x265 codec API base encoder is not available")
+	return()
+  endif()
+  message(FATAL_ERROR "Encode failed (${RESULT}) - see ${WORK_DIR}/pipelined_encode.log")
+endif()
+
+foreach(DEPTH ${DEPTHS})
+  execute_process(
+	COMMAND "${DECODER}" -b yuv --base_yuv "${BASE}" --input_yuv "${SOURCE}" --report --pipeline_depth ${DEPTH}
+	  -i "${WORK_DIR}/pipelined.lvc" -o "${WORK_DIR}/pipelined_decode_${DEPTH}.yuv"
+	WORKING_DIRECTORY "${WORK_DIR}"
+	RESULT_VARIABLE RESULT
+	OUTPUT_FILE "${WORK_DIR}/pipelined_decode_${DEPTH}.log"
+	ERROR_FILE "${WORK_DIR}/pipelined_decode_${DEPTH}_stderr.log")
+  if(NOT RESULT EQUAL 0)
+	message(FATAL_ERROR "Decode with --pipeline_depth ${DEPTH} failed (${RESULT}) - see ${WORK_DIR}/pipelined_decode_${DEPTH}_stderr.log")
+  endif()
+
+  # Report lines of each picture, as written to stdout
+  file(STRINGS "${WORK_DIR}/pipelined_decode_${DEPTH}.log" REPORT_${DEPTH} REGEX "^(DEC\\.|\\[MD5Y)")
+  file(STRINGS "${WORK_DIR}/pipelined_decode_${DEPTH}.log" PICTURES REGEX "^DEC\\.")
+  list(LENGTH PICTURES PICTURE_COUNT)
+  if(NOT PICTURE_COUNT EQUAL FRAMES)
+	message(FATAL_ERROR "Decode with --pipeline_depth ${DEPTH} reported ${PICTURE_COUNT} pictures, expected ${FRAMES}")
+  endif()
+endforeach()
+
+file(SIZE "${WORK_DIR}/pipelined_decode_0.yuv" DECODED_SIZE)
+math(EXPR EXPECTED_SIZE "${WIDTH} * ${HEIGHT} * 3 / 2 * ${FRAMES}")
+if(NOT DECODED_SIZE EQUAL EXPECTED_SIZE)
+  message(FATAL_ERROR "Decode has ${DECODED_SIZE} bytes, expected ${EXPECTED_SIZE}")
+endif()
+
+foreach(DEPTH ${DEPTHS})
+  if(DEPTH EQUAL 0)
+	continue()
+  endif()
+
+  execute_process(
+	COMMAND "${CMAKE_COMMAND}" -E compare_files "${WORK_DIR}/pipelined_decode_${DEPTH}.yuv" "${WORK_DIR}/pipelined_decode_0.yuv"
+	RESULT_VARIABLE RESULT)
+  if(NOT RESULT EQUAL 0)
+	message(FATAL_ERROR "Decode with --pipeline_depth ${DEPTH} does not match the decode without pipelining")
+  endif()
+
+  if(NOT REPORT_${DEPTH} STREQUAL REPORT_0)
+	message(FATAL_ERROR "Report lines with --pipeline_depth ${DEPTH} do not match those without pipelining")
+  endif()
+endforeach()
@@ -0,0 +1,76 @@
+# TestSegmentedEncode.cmake
+#
+# Encode a sequence as several segments in parallel, decode the result serially, and check it
+# matches the encoder's reconstruction - the POCs and timestamps must stay increasing across the IDRs
+# that join segments.
+#
+# Run as a script: cmake -DENCODER=<ModelEncoder> -DDECODER=<ModelDecoder> -DWORK_DIR=<dir> -P TestSegmentedEncode.cmake
+#
+# Needs the external HM encoder next to ModelEncoder - the test is skipped if it has not been built.
+#
+
+get_filename_component(BIN_DIR "${ENCODER}" DIRECTORY)
+if(NOT EXISTS "${BIN_DIR}/external_codecs/HM/TAppEncoder" AND NOT EXISTS "${BIN_DIR}/external_codecs/HM/TAppEncoder.exe")
+  message("SKIPPED: no external HM encoder in ${BIN_DIR}/external_codecs/HM")
+  return()
+endif()
+
+set(WIDTH 64)
+set(HEIGHT 64)
+set(FRAMES 34)
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+set(SOURCE "${WORK_DIR}/segmented_source.yuv")
+
+# Synthetic 4:2:0 source - printable bytes so that file(WRITE) can produce it, with the pattern
+# moving from frame to frame so that there is something to predict.
+#
+set(ALPHABET "0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[]^_abcdefghijklmnopqrstuvwxyz{|}~!#$%&'()*+,-./")
+string(APPEND ALPHABET "${ALPHABET}${ALPHABET}")
+math(EXPR ROWS_PER_FRAME "${HEIGHT} * 3 / 2 - 1")
+math(EXPR LAST_FRAME "${FRAMES} - 1")
+
+file(WRITE "${SOURCE}" "")
+foreach(FRAME RANGE ${LAST_FRAME})
+  set(DATA "")
+  foreach(ROW RANGE ${ROWS_PER_FRAME})
+	math(EXPR OFFSET "(${ROW} * 7 + ${FRAME} * 3) % 90")
+	string(SUBSTRING "${ALPHABET}" ${OFFSET} ${WIDTH} LINE)
+	string(APPEND DATA "${LINE}")
+  endforeach()
+  file(APPEND "${SOURCE}" "${DATA}")
+endforeach()
+
+execute_process(
+  COMMAND "${ENCODER}" -w ${WIDTH} -h ${HEIGHT} -f yuv420p -r 50 --base_encoder hevc --qp 32 --intra_period 16
+	--segment_parallel 2 -i "${SOURCE}" -o "${WORK_DIR}/segmented.lvc" --output_recon "${WORK_DIR}/segmented_recon.yuv"
+  WORKING_DIRECTORY "${WORK_DIR}"
+  RESULT_VARIABLE RESULT
+  OUTPUT_FILE "${WORK_DIR}/segmented_encode.log"
+  ERROR_FILE "${WORK_DIR}/segmented_encode.log")
+if(NOT RESULT EQUAL 0)
+  message(FATAL_ERROR "Segmented encode failed (${RESULT}) - see ${WORK_DIR}/segmented_encode.log")
+endif()
+
+execute_process(
+  COMMAND "${DECODER}" -b hevc -i "${WORK_DIR}/segmented.lvc" -o "${WORK_DIR}/segmented_decode.yuv"
+  WORKING_DIRECTORY "${WORK_DIR}"
+  RESULT_VARIABLE RESULT
+  OUTPUT_FILE "${WORK_DIR}/segmented_decode.log"
+  ERROR_FILE "${WORK_DIR}/segmented_decode.log")
+if(NOT RESULT EQUAL 0)
+  message(FATAL_ERROR "Serial decode failed (${RESULT}) - see ${WORK_DIR}/segmented_decode.log")
+endif()
+
+file(SIZE "${WORK_DIR}/segmented_decode.yuv" DECODED_SIZE)
+math(EXPR EXPECTED_SIZE "${WIDTH} * ${HEIGHT} * 3 / 2 * ${FRAMES}")
+if(NOT DECODED_SIZE EQUAL EXPECTED_SIZE)
+  message(FATAL_ERROR "Serial decode has ${DECODED_SIZE} bytes, expected ${EXPECTED_SIZE}")
+endif()
+
+execute_process(
+  COMMAND "${CMAKE_COMMAND}" -E compare_files "${WORK_DIR}/segmented_decode.yuv" "${WORK_DIR}/segmented_recon.yuv"
+  RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+  message(FATAL_ERROR "Serial decode of the segmented encode does not match the encoder reconstruction")
+endif()
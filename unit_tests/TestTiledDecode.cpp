@@ -0,0 +1,271 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+// TestTiledDecode.cpp
+//
+// Check that entropy decoding the tiles of tiled encoded data on a pool of threads matches decoding them in order
+//
+
+#include "Deserializer.hpp"
+#include "Dimensions.hpp"
+#include "Dithering.hpp"
+#include "Serializer.hpp"
+
+#include "Parallel.hpp"
+
+#include "BitstreamPacker.hpp"
+#include "BitstreamUnpacker.hpp"
+#include "Surface.hpp"
+
+#include "Diagnostics.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace lctm;
+
+typedef Surface Symbols[MAX_NUM_PLANES][MAX_NUM_LOQS][MAX_NUM_LAYERS];
+
+static Random random_;
+
+// 4:2:0 DDS with custom tiles - small enough for edge tiles to be partial at both LoQs
+//
+static SignaledConfiguration tiled_configuration(CompressionType size_compression, bool entropy_enabled_compression) {
+	SignaledConfiguration configuration = {};
+
+	GlobalConfiguration &global = configuration.global_configuration;
+	global.colourspace = Colourspace_YUV420;
+	global.num_image_planes = 3;
+	global.num_processed_planes = 3;
+	global.num_residual_layers = 16;
+	global.transform_block_size = 4;
+	global.resolution_width = 200;
+	global.resolution_height = 136;
+	global.temporal_enabled = 1;
+	global.scaling_mode[LOQ_LEVEL_1] = ScalingMode_None;
+	global.scaling_mode[LOQ_LEVEL_2] = ScalingMode_2D;
+	global.tile_dimensions_type = TileDimensions_Custom;
+	global.tile_width = 64;
+	global.tile_height = 32;
+	global.compression_type_entropy_enabled_per_tile = entropy_enabled_compression;
+	global.compression_type_size_per_tile = size_compression;
+
+	configuration.picture_configuration.enhancement_enabled = true;
+	configuration.picture_configuration.temporal_signalling_present = true;
+	return configuration;
+}
+
+// Sparse residuals, with some layers left empty so that tiles without entropy coded data are covered
+//
+static Surface random_residuals(unsigned width, unsigned height, unsigned layer) {
+	const bool empty = (layer % 5) == 3;
+	return Surface::build_from<int16_t>()
+	    .generate(width, height,
+	              [&](unsigned, unsigned) -> int16_t {
+		              if (empty || (random_.rand() & 7) != 0)
+			              return 0;
+		              return (int16_t)((random_.rand() & 0x1ff) - 0x100);
+	              })
+	    .finish();
+}
+
+// Temporal signal in runs
+//
+static Surface random_temporal(unsigned width, unsigned height) {
+	uint8_t value = 0;
+	return Surface::build_from<uint8_t>()
+	    .generate(width, height,
+	              [&](unsigned, unsigned) -> uint8_t {
+		              if ((random_.rand() & 15) == 0)
+			              value ^= 1;
+		              return value;
+	              })
+	    .finish();
+}
+
+static Packet encode(const SignaledConfiguration &configuration, Symbols &symbols) {
+	Dimensions dimensions;
+	dimensions.set(configuration, configuration.global_configuration.resolution_width,
+	               configuration.global_configuration.resolution_height);
+
+	const unsigned num_layers = configuration.global_configuration.num_residual_layers;
+	for (unsigned plane = 0; plane < configuration.global_configuration.num_processed_planes; ++plane) {
+		for (unsigned loq = 0; loq < MAX_NUM_LOQS; ++loq) {
+			const unsigned width = dimensions.layer_width(plane, loq);
+			const unsigned height = dimensions.layer_height(plane, loq);
+			for (unsigned layer = 0; layer < num_layers; ++layer)
+				symbols[plane][loq][layer] = random_residuals(width, height, layer);
+			if (loq == LOQ_LEVEL_2)
+				symbols[plane][loq][num_layers] = random_temporal(width, height);
+		}
+	}
+
+	BitstreamPacker b;
+	Serializer().emit_encoded_data_tiled(configuration, b, symbols, num_layers);
+	return b.finish();
+}
+
+static void decode(const SignaledConfiguration &configuration, const Packet &packet, unsigned num_threads, bool interleave,
+                   Symbols &symbols) {
+	SignaledConfiguration dst_configuration = configuration;
+	Deserializer deserializer(packet, dst_configuration, symbols, num_threads, interleave);
+
+	PacketView view(packet);
+	BitstreamUnpacker b(view);
+	deserializer.parse_encoded_data_tiled(dst_configuration, b, configuration.global_configuration.num_processed_planes,
+	                                      symbols);
+}
+
+static void check_same(const SignaledConfiguration &configuration, const Symbols &expected, const Symbols &decoded,
+                       unsigned num_layers) {
+	for (unsigned plane = 0; plane < configuration.global_configuration.num_processed_planes; ++plane) {
+		for (unsigned loq = 0; loq < MAX_NUM_LOQS; ++loq) {
+			for (unsigned layer = 0; layer < num_layers; ++layer) {
+				// Layers folded into the interleaved coefficients are left empty
+				CHECK(decoded[plane][loq][layer].empty() == expected[plane][loq][layer].empty());
+				if (expected[plane][loq][layer].empty())
+					continue;
+				CHECK(decoded[plane][loq][layer].width() == expected[plane][loq][layer].width() &&
+				      decoded[plane][loq][layer].height() == expected[plane][loq][layer].height());
+				CHECK(decoded[plane][loq][layer].checksum() == expected[plane][loq][layer].checksum());
+			}
+		}
+	}
+}
+
+// Every job runs once, and the first failure comes back to the caller
+//
+static void check_parallel_for() {
+	for (unsigned num_threads = 1; num_threads <= 8; num_threads *= 2) {
+		std::vector<std::atomic<unsigned>> runs(1000);
+		for (auto &r : runs)
+			r = 0;
+		parallel_for(static_cast<unsigned>(runs.size()), num_threads, [&](unsigned i) { runs[i]++; });
+		for (const auto &r : runs)
+			CHECK(r == 1);
+
+		bool caught = false;
+		try {
+			parallel_for(100, num_threads, [&](unsigned i) {
+				if (i == 42)
+					throw std::runtime_error("job failed");
+			});
+		} catch (const std::runtime_error &) {
+			caught = true;
+		}
+		CHECK(caught);
+	}
+}
+
+static void check_parallel_ordered() {
+	for (unsigned num_threads = 1; num_threads <= 8; num_threads *= 2) {
+		// Consumed in order, each after it is produced, and never more than 2 * num_threads ahead
+		std::vector<std::atomic<unsigned>> produced(200);
+		for (auto &p : produced)
+			p = 0;
+		std::atomic<unsigned> consumed(0);
+		std::atomic<unsigned> ahead(0);
+		parallel_ordered(
+		    static_cast<unsigned>(produced.size()), num_threads,
+		    [&](unsigned i) {
+			    if (i - consumed > ahead)
+				    ahead = i - consumed;
+			    produced[i]++;
+		    },
+		    [&](unsigned i) {
+			    CHECK(i == consumed && produced[i] == 1);
+			    consumed++;
+		    });
+		CHECK(consumed == produced.size());
+		CHECK(ahead <= 2 * num_threads);
+
+		// Errors from either side come back to the caller
+		for (unsigned consumer = 0; consumer < 2; ++consumer) {
+			bool caught = false;
+			try {
+				parallel_ordered(
+				    100, num_threads,
+				    [&](unsigned i) {
+					    if (!consumer && i == 42)
+						    throw std::runtime_error("job failed");
+				    },
+				    [&](unsigned i) {
+					    if (consumer && i == 42)
+						    throw std::runtime_error("consumer failed");
+				    });
+			} catch (const std::runtime_error &) {
+				caught = true;
+			}
+			CHECK(caught);
+		}
+	}
+}
+
+int main() {
+	check_parallel_for();
+	check_parallel_ordered();
+
+	random_.srand(1234);
+
+	const CompressionType size_compressions[] = {CompressionType_None, CompressionType_Prefix, CompressionType_Prefix_OnDiff};
+
+	for (const CompressionType size_compression : size_compressions) {
+		for (unsigned entropy_enabled_compression = 0; entropy_enabled_compression < 2; ++entropy_enabled_compression) {
+			const SignaledConfiguration configuration = tiled_configuration(size_compression, entropy_enabled_compression);
+			const unsigned num_layers = configuration.global_configuration.num_residual_layers;
+
+			Symbols source;
+			const Packet packet = encode(configuration, source);
+
+			for (unsigned interleave = 0; interleave < 2; ++interleave) {
+				Symbols serial;
+				decode(configuration, packet, 1, interleave, serial);
+
+				// Residual layers survive the round trip
+				if (!interleave)
+					check_same(configuration, source, serial, num_layers);
+
+				for (unsigned num_threads = 2; num_threads <= 8; num_threads *= 2) {
+					Symbols parallel;
+					decode(configuration, packet, num_threads, interleave, parallel);
+
+					// Everything, including the packed temporal masks, matches the serial decode
+					check_same(configuration, serial, parallel, num_layers + 1);
+				}
+			}
+		}
+	}
+
+	INFO("Parallel tile decode bit-exact");
+	return 0;
+}
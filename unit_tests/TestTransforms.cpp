@@ -31,63 +31,129 @@
 // THE POSSIBILITY OF SUCH DAMAGE.
 //
 //
-// Contributors: Sam Littlewood (sam.littlewood@v-nova.com)
+// TestTransforms.cpp
 //
+// Check the SSE4.1/AVX2 forward and inverse DD/DDS transforms (2D and 1D) are bit-exact with the plain C ones
 //
 
+#include "Dithering.hpp"
+#include "InverseTransformDD.hpp"
 #include "InverseTransformDDS.hpp"
-#include "TransformDDS.hpp"
-
 #include "InverseTransformDDS_1D.hpp"
-#include "TransformDDS_1D.hpp"
-
-#include "InverseTransformDD.hpp"
-#include "TransformDD.hpp"
-
 #include "InverseTransformDD_1D.hpp"
+#include "TransformDD.hpp"
+#include "TransformDDS.hpp"
+#include "TransformDDS_1D.hpp"
 #include "TransformDD_1D.hpp"
 
-#include "Temporal.hpp"
+#include "CpuFeatures.hpp"
 
-#include "Misc.hpp"
 #include "Surface.hpp"
-#include "YUVReader.hpp"
-#include "YUVWriter.hpp"
 
 #include "Diagnostics.hpp"
+#include "Misc.hpp"
 
 using namespace lctm;
 
-int main(int argc, char **argv) {
+static bool ran_simd = false;
+
+// Values in [-range, range) - kept small enough that no transform output wraps
+//
+static Surface random_plane(unsigned width, unsigned height, int range) {
+	static Random random;
+	return Surface::build_from<int16_t>()
+	    .generate(width, height,
+	              [&](unsigned, unsigned) -> int16_t { return (int16_t)((int)(random.rand() % (2 * range)) - range); })
+	    .finish();
+}
 
-	// Reference coefficients
-	Surface reference_coefficients[16];
-	for (unsigned l = 0; l < 16; ++l) {
-		auto reader = CreateYUVReader(format("data/coeffs-P0Q1L%d_480x270_16bit.y", l));
-		auto img = reader->read(0);
-		reference_coefficients[l] = img.plane(0);
+enum Transform { Transform_DD, Transform_DDS, Transform_DD_1D, Transform_DDS_1D };
+
+static unsigned num_layers(Transform transform) {
+	return (transform == Transform_DD || transform == Transform_DD_1D) ? 4 : 16;
+}
+
+static void forward(Transform transform, const Surface &residuals, Surface layers[16]) {
+	switch (transform) {
+	case Transform_DD:
+		TransformDD().process(residuals, ENCODE_ALL, layers);
+		break;
+	case Transform_DDS:
+		TransformDDS().process(residuals, ENCODE_ALL, layers);
+		break;
+	case Transform_DD_1D:
+		TransformDD_1D().process(residuals, ENCODE_ALL, layers);
+		break;
+	case Transform_DDS_1D:
+		TransformDDS_1D().process(residuals, ENCODE_ALL, layers);
+		break;
 	}
+}
 
-	// Reference residuals
-	Surface reference_residuals;
-	{
-		auto reader = CreateYUVReader("data/residuals-P0Q1L0_1920x1080_16bit.y");
-		auto img = reader->read(0);
-		reference_residuals = img.plane(0);
+static Surface inverse(Transform transform, unsigned width, unsigned height, const Surface layers[16]) {
+	switch (transform) {
+	case Transform_DD:
+		return InverseTransformDD().process(width, height, layers);
+	case Transform_DDS:
+		return InverseTransformDDS().process(width, height, layers);
+	case Transform_DD_1D:
+		return InverseTransformDD_1D().process(width, height, layers);
+	case Transform_DDS_1D:
+		return InverseTransformDDS_1D().process(width, height, layers);
 	}
+	return Surface();
+}
 
-	// DDS
-	{
-		// ceoffs -> residuals
-		Surface residuals = InverseTransformDDS().process(1920, 1080, reference_coefficients);
-		CHECK(residuals.checksum() == reference_residuals.checksum());
+// Forward and inverse transforms of one random plane with plain C, then again with SSE4.1, and with SSE4.1 and AVX2 -
+// each SIMD set the CPU has is checked against the plain C results
+//
+static void check_transform(Transform transform, unsigned width, unsigned height) {
+	const unsigned masks[] = {CpuFeature_SSE41, CpuFeature_SSE41 | CpuFeature_AVX2};
+	const unsigned block = (transform == Transform_DD || transform == Transform_DD_1D) ? 2 : 4;
+	const unsigned layers = num_layers(transform);
+
+	const Surface residuals = random_plane(width, height, 0x4000);
+	Surface coefficients[16];
+	for (unsigned l = 0; l < layers; ++l)
+		coefficients[l] = random_plane(width / block, height / block, 0x800);
 
-		// residuals -> coeffs
-		Surface coefficients[16];
+	set_cpu_features_mask(0);
+	Surface expected_layers[16];
+	forward(transform, residuals, expected_layers);
+	const Surface expected_residuals = inverse(transform, width, height, coefficients);
+	set_cpu_features_mask(~0U);
 
-		TransformDDS().process(residuals, coefficients);
+	for (const unsigned mask : masks) {
+		if ((cpu_features() & mask) != mask)
+			continue;
+		ran_simd = true;
 
-		for (unsigned l = 0; l < 16; ++l)
-			CHECK(coefficients[l].checksum() == reference_coefficients[l].checksum());
+		set_cpu_features_mask(mask);
+		Surface simd_layers[16];
+		forward(transform, residuals, simd_layers);
+		for (unsigned l = 0; l < layers; ++l) {
+			CHECK(simd_layers[l].width() == expected_layers[l].width() && simd_layers[l].height() == expected_layers[l].height());
+			CHECK(simd_layers[l].checksum() == expected_layers[l].checksum());
+		}
+
+		const Surface simd_residuals = inverse(transform, width, height, coefficients);
+		CHECK(simd_residuals.width() == expected_residuals.width() && simd_residuals.height() == expected_residuals.height());
+		CHECK(simd_residuals.checksum() == expected_residuals.checksum());
+		set_cpu_features_mask(~0U);
 	}
 }
+
+int main() {
+	for (unsigned t = Transform_DD; t <= Transform_DDS_1D; ++t) {
+		// Widths that leave every vector tail length, then a picture sized plane
+		for (unsigned width = 4; width <= 132; width += 4)
+			check_transform((Transform)t, width, 8);
+		check_transform((Transform)t, 480, 272);
+	}
+
+	if (ran_simd)
+		INFO("Transforms bit-exact");
+	else
+		INFO("Transforms - no SIMD support, nothing compared");
+	return 0;
+}
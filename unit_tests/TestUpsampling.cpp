@@ -0,0 +1,261 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// TestUpsampling.cpp
+//
+// Check the three plane UpsamplingDPI path is bit-exact with a plain scalar upsample + predicted average + residual add,
+// and that the SSE4.1/AVX2 upsampling kernels match the plain C ones
+//
+
+#include "Dithering.hpp"
+#include "Upsampling.hpp"
+#include "UpsamplingDPI.hpp"
+
+#include "CpuFeatures.hpp"
+
+#include "Surface.hpp"
+
+#include "Diagnostics.hpp"
+#include "Misc.hpp"
+
+#include <functional>
+
+using namespace lctm;
+
+static Surface random_plane(unsigned width, unsigned height) {
+	static Random random;
+	return Surface::build_from<int16_t>()
+	    .generate(width, height, [&](unsigned, unsigned) -> int16_t { return (int16_t)((random.rand() & 0x7fff) - 0x4000); })
+	    .finish();
+}
+
+// Reference kernels - kept as the straightforward scalar form of the original decoder, independent of the
+// vectorised and fused code in Upsampling.cpp and PredictedResidual.cpp
+//
+typedef int32_t Kernel[4];
+
+static void reference_kernel(Kernel &kernel, Upsample upsample, const unsigned *coefficients) {
+	static const Kernel kernels[] = {
+	    {0, 16384, 0, 0},            // Upsample_Nearest
+	    {0, 12288, 4096, 0},         // Upsample_Linear
+	    {-1382, 14285, 3942, -461},  // Upsample_Cubic
+	    {-2360, 15855, 4165, -1276}, // Upsample_ModifiedCubic
+	};
+
+	if (upsample <= Upsample_ModifiedCubic) {
+		for (unsigned i = 0; i < 4; ++i)
+			kernel[i] = kernels[upsample][i];
+	} else {
+		kernel[0] = -(int32_t)coefficients[0];
+		kernel[1] = (int32_t)coefficients[1];
+		kernel[2] = (int32_t)coefficients[2];
+		kernel[3] = -(int32_t)coefficients[3];
+	}
+}
+
+// Output sample 'o' of a 2x upsample along one axis of 'size' samples: odd outputs use the kernel forwards,
+// even outputs use it reversed, and source positions are clamped to the edges.
+//
+static int16_t reference_sample(const Kernel &kernel, unsigned o, int size, const std::function<int32_t(int)> &src) {
+	const bool odd = (o & 1) != 0;
+	const int s = odd ? (int)(o - 1) / 2 : (int)o / 2 - 1;
+	int32_t sum = 0x2000;
+	for (int k = 0; k < 4; ++k)
+		sum += (odd ? kernel[k] : kernel[3 - k]) * src(clamp(s + k - 1, 0, size - 1));
+	return (int16_t)(sum >> 14);
+}
+
+static Surface reference(const Surface &src, bool is_1d, Upsample upsample, bool predicted_average, const unsigned *coefficients) {
+	Kernel kernel;
+	reference_kernel(kernel, upsample, coefficients);
+
+	const auto base = src.view_as<int16_t>();
+	const int width = (int)src.width();
+	const int height = (int)src.height();
+
+	// Vertical pass (2D only)
+	Surface vertical = src;
+	if (!is_1d) {
+		vertical = Surface::build_from<int16_t>()
+		               .generate(width, height * 2,
+		                         [&](unsigned x, unsigned y) -> int16_t {
+			                         return reference_sample(kernel, y, height, [&](int i) -> int32_t { return base.read(x, i); });
+		                         })
+		               .finish();
+	}
+
+	// Horizontal pass
+	const auto v = vertical.view_as<int16_t>();
+	const Surface upsampled =
+	    Surface::build_from<int16_t>()
+	        .generate(width * 2, vertical.height(),
+	                  [&](unsigned x, unsigned y) -> int16_t {
+		                  return reference_sample(kernel, x, width, [&](int i) -> int32_t { return v.read(i, y); });
+	                  })
+	        .finish();
+
+	if (!predicted_average)
+		return upsampled;
+
+	// Adjust each 2x2 (or 2x1) block so that it averages to the base pel
+	const auto up = upsampled.view_as<int16_t>();
+	return Surface::build_from<int16_t>()
+	    .generate(upsampled.width(), upsampled.height(),
+	              [&](unsigned x, unsigned y) -> int16_t {
+		              int32_t adjust;
+		              if (is_1d) {
+			              const int32_t sum = up.read(x & ~1u, y) + up.read(x | 1u, y);
+			              adjust = base.read(x / 2, y) - ((sum + 1) >> 1);
+		              } else {
+			              const int32_t sum = up.read(x & ~1u, y & ~1u) + up.read(x | 1u, y & ~1u) + up.read(x & ~1u, y | 1u) +
+			                                  up.read(x | 1u, y | 1u);
+			              adjust = base.read(x / 2, y / 2) - ((sum + 2) >> 2);
+		              }
+		              return (int16_t)clamp(up.read(x, y) + adjust, -32767, 32767);
+	              })
+	    .finish();
+}
+
+// Upsample with whatever SIMD kernels 'mask' allows - whole plane, and fused with residuals
+//
+static void upsample_with_features(Surface (&dst)[3], unsigned mask, const Surface &src, const Surface &residuals,
+                                   bool is_1d, Upsample upsample, const unsigned *coefficients) {
+	set_cpu_features_mask(mask);
+	if (is_1d) {
+		dst[0] = Upsampling_1D().process(src, upsample, coefficients);
+		dst[1] = UpsamplingReconstruct_1D().process(src, residuals, upsample, coefficients, false);
+		dst[2] = UpsamplingReconstruct_1D().process(src, residuals, upsample, coefficients, true);
+	} else {
+		dst[0] = Upsampling().process(src, upsample, coefficients);
+		dst[1] = UpsamplingReconstruct().process(src, residuals, upsample, coefficients, false);
+		dst[2] = UpsamplingReconstruct().process(src, residuals, upsample, coefficients, true);
+	}
+	set_cpu_features_mask(~0U);
+}
+
+// SIMD kernels against plain C, for every feature level this CPU has
+//
+static void check_simd(const Surface &src, const unsigned *coefficients) {
+	const unsigned masks[] = {CpuFeature_SSE41, CpuFeature_SSE41 | CpuFeature_AVX2};
+
+	for (unsigned u = Upsample_Nearest; u <= Upsample_AdaptiveCubic; ++u) {
+		const Upsample upsample = (Upsample)u;
+		for (unsigned is_1d = 0; is_1d < 2; ++is_1d) {
+			const Surface residuals = random_plane(src.width() * 2, is_1d ? src.height() : src.height() * 2);
+
+			Surface expected[3];
+			upsample_with_features(expected, 0, src, residuals, is_1d, upsample, coefficients);
+
+			for (const unsigned mask : masks) {
+				if ((cpu_features() & mask) != mask)
+					continue;
+
+				Surface simd[3];
+				upsample_with_features(simd, mask, src, residuals, is_1d, upsample, coefficients);
+				for (unsigned i = 0; i < 3; ++i)
+					CHECK(simd[i].checksum() == expected[i].checksum());
+			}
+		}
+	}
+}
+
+// Add residuals (if any) as the decoder's Add does
+//
+static Surface reference_add(const Surface &upsampled, const Surface &residuals) {
+	if (residuals.empty())
+		return upsampled;
+
+	const auto a = upsampled.view_as<int16_t>();
+	const auto b = residuals.view_as<int16_t>();
+	return Surface::build_from<int16_t>()
+	    .generate(upsampled.width(), upsampled.height(),
+	              [&](unsigned x, unsigned y) -> int16_t { return (int16_t)(a.read(x, y) + b.read(x, y)); })
+	    .finish();
+}
+
+int main() {
+	const unsigned coefficients[4] = {1382, 14285, 3942, 461};
+
+	// Luma, plus odd sized chroma to cover the vector kernel tails - and planes short of a whole number of bands
+	Surface src_planes[3];
+	src_planes[0] = random_plane(134, 70);
+	src_planes[1] = random_plane(67, 35);
+	src_planes[2] = random_plane(67, 35);
+
+	for (unsigned u = Upsample_Nearest; u <= Upsample_AdaptiveCubic; ++u) {
+		const Upsample upsample = (Upsample)u;
+		for (unsigned is_1d = 0; is_1d < 2; ++is_1d) {
+			// Residuals for two of the planes - the third has none
+			Surface residuals[3];
+			for (unsigned plane = 0; plane < 2; ++plane)
+				residuals[plane] = random_plane(src_planes[plane].width() * 2,
+				                                src_planes[plane].height() * (is_1d ? 1 : 2));
+
+			for (unsigned predicted_average = 0; predicted_average < 2; ++predicted_average) {
+				for (unsigned num_threads = 1; num_threads <= 4; num_threads *= 2) {
+					Surface dst_planes[3];
+					if (is_1d)
+						UpsamplingDPI_1D().process(dst_planes, src_planes, residuals, upsample, predicted_average, coefficients,
+						                           num_threads);
+					else
+						UpsamplingDPI().process(dst_planes, src_planes, residuals, upsample, predicted_average, coefficients,
+						                        num_threads);
+
+					for (unsigned plane = 0; plane < 3; ++plane) {
+						const Surface expected = reference_add(
+						    reference(src_planes[plane], is_1d, upsample, predicted_average, coefficients), residuals[plane]);
+						CHECK(dst_planes[plane].width() == expected.width() &&
+						      dst_planes[plane].height() == expected.height());
+						CHECK(dst_planes[plane].checksum() == expected.checksum());
+					}
+				}
+			}
+		}
+	}
+
+	// Empty planes are passed through
+	{
+		Surface mono_planes[3], no_residuals[3], dst_planes[3];
+		mono_planes[0] = src_planes[0];
+		UpsamplingDPI().process(dst_planes, mono_planes, no_residuals, Upsample_ModifiedCubic, true, coefficients);
+		CHECK(!dst_planes[0].empty() && dst_planes[1].empty() && dst_planes[2].empty());
+	}
+
+	// Widths that leave every vector tail length
+	for (unsigned width = 33; width <= 48; ++width)
+		check_simd(random_plane(width, 9), coefficients);
+	check_simd(src_planes[0], coefficients);
+
+	INFO("UpsamplingDPI bit-exact");
+	return 0;
+}
@@ -37,8 +37,10 @@
 //
 #pragma once
 
+#include <cassert>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "Config.hpp"
 #include "Packet.hpp"
@@ -63,8 +65,42 @@ public:
 	~BitstreamUnpacker();
 
 	// Read 0..32 bits into unsigned integer - with optional debug label
-	uint32_t u(unsigned nbits);
+	uint32_t u(unsigned nbits) { return read(nbits); }
+#if BITSTREAM_DEBUG
 	uint32_t u(unsigned nbits, const char *label);
+#else
+	uint32_t u(unsigned nbits, const char *) { return read(nbits); }
+#endif
+
+	// Look at the next 0..32 bits without consuming them - bits beyond the end of the data read as zero
+	uint32_t peek(unsigned nbits) {
+		assert(nbits <= 32);
+		if (nbits == 0)
+			return 0;
+		if (cache_bits_ < nbits)
+			refill();
+		return (uint32_t)(cache_ >> (64 - nbits));
+	}
+
+	// Consume bits previously examined with peek()
+	void skip(unsigned nbits) {
+		assert((bit_offset_ + nbits) <= bit_size());
+		bit_offset_ += nbits;
+		if (nbits < cache_bits_) {
+			cache_ <<= nbits;
+			cache_bits_ -= nbits;
+		} else {
+			reposition();
+		}
+	}
+
+	// Read 0..32 bits
+	uint32_t read(unsigned nbits) {
+		assert((bit_offset_ + nbits) <= bit_size());
+		const uint32_t r = peek(nbits);
+		skip(nbits);
+		return r;
+	}
 
 	// Read a single byte
 	uint8_t byte();
@@ -74,17 +110,24 @@ public:
 
 	unsigned bit_offset() const { return bit_offset_; }
 
-	unsigned bit_size() const { return view_.size() * 8; }
+	unsigned bit_size() const { return size_ * 8; }
 
 	unsigned remaining_bits() const { return bit_size() - bit_offset(); }
 
 	bool empty() const { return remaining_bits() == 0; }
 
+#if BITSTREAM_DEBUG
 	void push_context_label(const std::string &s);
 	void pop_context_label();
+#else
+	void push_context_label(const char *) {}
+	void push_context_label(const std::string &) {}
+	void pop_context_label() {}
+#endif
 
 	class ScopedContextLabel {
 	public:
+		ScopedContextLabel(BitstreamUnpacker &b, const char *l) : b_(b) { b_.push_context_label(l); }
 		ScopedContextLabel(BitstreamUnpacker &b, const std::string &l) : b_(b) { b_.push_context_label(l); }
 
 		~ScopedContextLabel() { b_.pop_context_label(); }
@@ -94,12 +137,25 @@ public:
 	};
 
 private:
+	// Top up the cache with whole bytes from the source
+	void refill();
+
+	// Reload the cache from the current bit offset
+	void reposition();
+
 	// Data source
 	const PacketView &view_;
+	const uint8_t *data_ = nullptr;
+	unsigned size_ = 0;
 
 	// Current bit offset in source
 	unsigned bit_offset_ = 0;
 
+	// Bits following bit_offset_, MSB first - 'cache_bits_' are valid, and end at source byte 'fill_byte_'
+	uint64_t cache_ = 0;
+	unsigned cache_bits_ = 0;
+	unsigned fill_byte_ = 0;
+
 	// Stack of context labels for debugging trace
 	std::vector<std::string> context_;
 };
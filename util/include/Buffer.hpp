@@ -63,4 +63,14 @@ std::unique_ptr<Buffer> CreateBufferVector(unsigned size);
 std::unique_ptr<Buffer> CreateBufferAligned(const uint8_t *data, unsigned size);
 std::unique_ptr<Buffer> CreateBufferAligned(unsigned size);
 
+// Aligned buffer whose memory comes from, and goes back to, a process wide pool of free blocks bucketed by size
+//
+// Contents are undefined on creation, as for CreateBufferAligned(). Safe to use from multiple threads.
+std::unique_ptr<Buffer> CreateBufferPooled(unsigned size);
+
+// Buffer that is a private mapping of 'size' bytes of an open file, from byte 'file_offset' - no copy is made until written
+//
+// Writes go to private pages and never reach the file. Returns nullptr if the file cannot be mapped on this platform.
+std::unique_ptr<Buffer> CreateBufferMapped(int fd, uint64_t file_offset, unsigned size);
+
 } // namespace lctm
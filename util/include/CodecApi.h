@@ -83,7 +83,8 @@ typedef struct Codec {
 
 	int32_t (*create_context)(CodecContext *context, const char *json_configuration, CodecError *error);
 
-	//
+	// Encoders return packets in decode order: pull_packet() copies the next one into 'data' and returns its size, or just
+	// returns the size if 'data' is null or 'length' is too small. pull_image() then gives the reconstruction of that packet.
 	int32_t (*push_packet)(CodecContext context, const uint8_t *data, size_t length, CodecMetadata metadata, int8_t eos, CodecError *error);
 	int32_t (*pull_packet)(CodecContext context, const uint8_t *data, size_t length, CodecMetadata *metadata, int8_t* eos, CodecError *error);
 
@@ -128,5 +129,6 @@ enum PropertyID {
 	PropertyID_PictureOrderCount = 2,
 	PropertyID_QP = 3,
 	PropertyID_FrameType = 4, // 0=I 1=P 2=B
+	PropertyID_IDR = 5, // Non-zero for an instantaneous decoder refresh picture
 };
 
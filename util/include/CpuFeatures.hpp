@@ -0,0 +1,75 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// CpuFeatures.hpp
+//
+// Runtime detection of the instruction set extensions used by the optional SIMD kernels
+//
+#pragma once
+
+#include "Config.hpp"
+
+#if defined __OPT_SIMD__ && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define LCEVC_SIMD_X86 1
+#else
+#define LCEVC_SIMD_X86 0
+#endif
+
+// Per function instruction set enables - MSVC allows intrinsics anywhere, GCC and Clang need the target named
+//
+#if defined(_MSC_VER)
+#define LCEVC_TARGET_SSE41
+#define LCEVC_TARGET_AVX2
+#else
+#define LCEVC_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define LCEVC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace lctm {
+
+enum CpuFeature {
+	CpuFeature_SSE41 = 1 << 0,
+	CpuFeature_AVX2 = 1 << 1,
+};
+
+// Features supported by this CPU and OS, restricted by any mask set below
+//
+unsigned cpu_features();
+
+// Restrict the features that will be reported - used to compare SIMD kernels against the plain C versions
+//
+void set_cpu_features_mask(unsigned mask);
+
+inline bool cpu_has(CpuFeature feature) { return (cpu_features() & feature) != 0; }
+
+} // namespace lctm
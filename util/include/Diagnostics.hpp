@@ -40,6 +40,7 @@
 #pragma once
 
 #include <cstdio>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -104,6 +105,21 @@ void _raise(const char *file, int line, const char *func, const std::string &mes
 		lctm::_raise(__FILE__, __LINE__, __FUNCTION__, msg);                                                                       \
 	} while (0)
 
+//// DiagnosticsError
+//
+// Thrown by a failed CHECK(), ERR() or FATAL() when built with DIAGNOSTICS_ERR_THROWS - the message has already been
+// logged, and exit_code() is what the process would otherwise have exited with.
+//
+class DiagnosticsError : public std::runtime_error {
+public:
+	DiagnosticsError(const std::string &message, int exit_code) : std::runtime_error(message), exit_code_(exit_code) {}
+
+	int exit_code() const { return exit_code_; }
+
+private:
+	int exit_code_;
+};
+
 //// Temporary debugging
 //
 // D(fmt, ...)
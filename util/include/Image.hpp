@@ -205,4 +205,9 @@ private:
 std::istream &operator>>(std::istream &in, ImageFormat &v);
 std::istream &operator>>(std::istream &in, Colourspace &v);
 
+// Y4M colourspace ('C' header parameter) of an image format, and back - IMAGE_FORMAT_NONE if the colourspace is not known
+//
+std::string Y4MColourspace(ImageFormat format);
+ImageFormat Y4MImageFormat(const std::string &colourspace);
+
 } // namespace lctm
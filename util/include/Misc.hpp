@@ -148,9 +148,26 @@ uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l);
 //
 uint64_t system_timestamp();
 
-// Generate a temporary filename given a suffix
+// Generate a temporary filename given a suffix - each call gives a different name
 std::string make_temporary_filename(const std::string &suffix);
 
+// Create a named pipe - false if this platform does not have them
+bool make_fifo(const std::string &name);
+
+// Open the reading end of a named pipe without waiting for a writer. A writing end is held open as well, in 'hold_fd', so that
+// reads wait for the real writer rather than seeing end of file before it has opened the pipe - false if the pipe cannot be opened.
+bool open_fifo_reader(const std::string &name, int &read_fd, int &hold_fd);
+
+// Close the writing end held by open_fifo_reader() - once the real writer has finished, or has failed without opening the
+// pipe, readers see end of file.
+void release_fifo_reader(int hold_fd);
+
+// Open a named pipe for reading through a thread that drains it, so the writer never waits on the reader - unread data
+// beyond a limit goes to a temporary file rather than memory. Reads block until data arrives, and the stream can seek back
+// over recently read bytes. 'hold_fd' is as for open_fifo_reader(), and the stream sees end of file only once it has been
+// released. Closing the stream waits for the end of the pipe - nullptr if this platform does not have pipes.
+FILE *open_fifo_spooled(const std::string &name, int &hold_fd);
+
 // Wrap a string in a istringstream and extract into type
 //
 template <typename T> T extract(const std::string &s) {
@@ -0,0 +1,174 @@
+// The copyright in this software is being made available under the BSD
+// License, included below. This software may be subject to other third party
+// and contributor rights, including patent rights, and no such rights are
+// granted under this license.
+//
+// Copyright (c) 2022, ISO/IEC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice,
+//    this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of the ISO/IEC nor the names of its contributors may
+//    be used to endorse or promote products derived from this software without
+//    specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+// THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Parallel.hpp
+//
+// Minimal fork/join helpers for running independent jobs across a few worker threads
+//
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lctm {
+
+// Call fn(i) for every i in [0, count), spread over up to 'num_threads' threads (including the caller).
+//
+// Jobs are handed out in index order from a shared counter. The first exception raised by any job is
+// rethrown on the calling thread once all workers have joined.
+//
+template <typename F> void parallel_for(unsigned count, unsigned num_threads, F fn) {
+	if (num_threads > count)
+		num_threads = count;
+
+	if (num_threads <= 1) {
+		for (unsigned i = 0; i < count; ++i)
+			fn(i);
+		return;
+	}
+
+	std::atomic<unsigned> next(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+
+	auto worker = [&]() {
+		for (;;) {
+			const unsigned i = next++;
+			if (i >= count)
+				return;
+			try {
+				fn(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+					error = std::current_exception();
+				next = count;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned t = 1; t < num_threads; ++t)
+		threads.emplace_back(worker);
+	worker();
+	for (auto &t : threads)
+		t.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+// Call produce(i) for every i in [0, count) on up to 'num_threads' worker threads, and consume(i) on the calling
+// thread in index order, each as soon as its produce(i) has finished.
+//
+// Workers take jobs in order, staying no more than 2 * num_threads jobs ahead of the consumer, so only a few
+// results are waiting at any time. The first exception raised by either function stops further jobs, and is
+// rethrown on the calling thread once all workers have joined.
+//
+template <typename P, typename C> void parallel_ordered(unsigned count, unsigned num_threads, P produce, C consume) {
+	if (num_threads > count)
+		num_threads = count;
+
+	if (num_threads <= 1) {
+		for (unsigned i = 0; i < count; ++i) {
+			produce(i);
+			consume(i);
+		}
+		return;
+	}
+
+	const unsigned window = 2 * num_threads;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::vector<bool> done(count, false);
+	unsigned next = 0, consumed = 0;
+	std::exception_ptr error;
+
+	auto worker = [&]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			changed.wait(lock, [&]() { return error || next >= count || next < consumed + window; });
+			if (error || next >= count)
+				return;
+			const unsigned i = next++;
+			lock.unlock();
+			try {
+				produce(i);
+				lock.lock();
+				done[i] = true;
+			} catch (...) {
+				lock.lock();
+				if (!error)
+					error = std::current_exception();
+			}
+			changed.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t < num_threads; ++t)
+		threads.emplace_back(worker);
+
+	for (unsigned i = 0; i < count; ++i) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [&]() { return error || done[i]; });
+			if (error)
+				break;
+		}
+		try {
+			consume(i);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+				error = std::current_exception();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			consumed = i + 1;
+		}
+		changed.notify_all();
+	}
+
+	for (auto &t : threads)
+		t.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+} // namespace lctm
@@ -45,6 +45,10 @@
 #include <cassert>
 #include <cstring>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 
 namespace lctm {
 
@@ -96,6 +100,10 @@ public:
 	SurfaceBuilder &contents(const T *data, unsigned width, unsigned height, unsigned stride = 0);
 	SurfaceBuilder &contents(const std::vector<T> data, unsigned width, unsigned height, unsigned stride = 0);
 
+	// From a region of a shared buffer - no copy is made
+	SurfaceBuilder &contents_bpp(const std::shared_ptr<Buffer> &buffer, unsigned offset, unsigned width, unsigned height,
+	                             unsigned bpp, unsigned stride = 0);
+
 	// From new data
 	SurfaceBuilder &reserve(unsigned width, unsigned height, unsigned stride = 0);
 	SurfaceBuilder &reserve_bpp(unsigned width, unsigned height, unsigned bpp, unsigned stride = 0);
@@ -174,7 +182,7 @@ public:
 
 	unsigned empty() const { return !buffer_; }
 
-	// Debug dumps
+	// Debug dumps - enable or query dumping to the calling thread's current SurfaceDumps
 	static void set_dump_surfaces(bool b);
 	static bool get_dump_surfaces();
 
@@ -220,6 +228,47 @@ private:
 	unsigned stride_ = 0;
 };
 
+class Image;
+class YUVWriter;
+
+//// SurfaceDumps
+//
+// Destination for debug dumps - one YUV writer per dump name, opened on first use, with names given an optional prefix.
+//
+// Dumps go to the set made current on the calling thread by a SurfaceDumps::Scope, otherwise to a process wide default
+// set with no prefix. Dumping starts disabled.
+//
+class SurfaceDumps {
+public:
+	SurfaceDumps(const std::string &prefix = "");
+	~SurfaceDumps();
+
+	bool enabled() const { return enabled_; }
+	void set_enabled(bool enabled) { enabled_ = enabled; }
+
+	// Append image to the video for its name
+	void write(const std::string &name, const Image &image, bool decorate);
+
+	static SurfaceDumps &current();
+
+	// Make a set current on this thread for the lifetime of the scope - a null set leaves the current one in place
+	class Scope {
+	public:
+		Scope(SurfaceDumps *dumps);
+		~Scope();
+
+	private:
+		SurfaceDumps *previous_;
+	};
+
+private:
+	const std::string prefix_;
+	bool enabled_ = false;
+
+	std::mutex mutex_;
+	std::map<std::string, std::unique_ptr<YUVWriter>> writers_;
+};
+
 // Templated definitions
 #include "SurfaceImpl.hpp"
 
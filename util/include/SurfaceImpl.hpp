@@ -67,7 +67,7 @@ template <typename T>
 SurfaceBuilder<T> &SurfaceBuilder<T>::contents(const T *data, unsigned width, unsigned height, unsigned data_stride) {
 	surface_->bpp_ = sizeof(T);
 	surface_->stride_ = width * sizeof(T);
-	surface_->buffer_ = std::shared_ptr<Buffer>(CreateBufferAligned(height * surface_->stride_));
+	surface_->buffer_ = std::shared_ptr<Buffer>(CreateBufferPooled(height * surface_->stride_));
 	surface_->offset_ = 0;
 	surface_->width_ = width;
 	surface_->height_ = height;
@@ -97,10 +97,23 @@ SurfaceBuilder<T> &SurfaceBuilder<T>::contents(const T *data, unsigned width, un
 	return *this;
 }
 
+template <typename T>
+SurfaceBuilder<T> &SurfaceBuilder<T>::contents_bpp(const std::shared_ptr<Buffer> &buffer, unsigned offset, unsigned width,
+                                                   unsigned height, unsigned bpp, unsigned stride) {
+	surface_->bpp_ = bpp;
+	surface_->stride_ = stride ? stride : (width * bpp);
+	surface_->buffer_ = buffer;
+	surface_->offset_ = offset;
+	surface_->width_ = width;
+	surface_->height_ = height;
+
+	return *this;
+}
+
 template <typename T> SurfaceBuilder<T> &SurfaceBuilder<T>::reserve(unsigned width, unsigned height, unsigned stride) {
 	surface_->bpp_ = sizeof(T);
 	surface_->stride_ = stride ? stride : (width * sizeof(T));
-	surface_->buffer_ = std::shared_ptr<Buffer>(CreateBufferAligned(height * surface_->stride_));
+	surface_->buffer_ = std::shared_ptr<Buffer>(CreateBufferPooled(height * surface_->stride_));
 	surface_->offset_ = 0;
 	surface_->width_ = width;
 	surface_->height_ = height;
@@ -114,7 +127,7 @@ template <typename T>
 SurfaceBuilder<T> &SurfaceBuilder<T>::reserve_bpp(unsigned width, unsigned height, unsigned bpp, unsigned stride) {
 	surface_->bpp_ = bpp;
 	surface_->stride_ = stride ? stride : (width * bpp);
-	surface_->buffer_ = std::shared_ptr<Buffer>(CreateBufferAligned(height * surface_->stride_));
+	surface_->buffer_ = std::shared_ptr<Buffer>(CreateBufferPooled(height * surface_->stride_));
 	surface_->offset_ = 0;
 	surface_->width_ = width;
 	surface_->height_ = height;
@@ -261,6 +274,8 @@ template <typename T, unsigned S> unsigned SurfaceView<T, S>::width() const { re
 
 template <typename T, unsigned S> unsigned SurfaceView<T, S>::height() const { return surface_.height_; }
 
+template <typename T, unsigned S> unsigned SurfaceView<T, S>::stride() const { return mapped_stride_; }
+
 template <typename T, unsigned S> unsigned SurfaceView<T, S>::size() const { return surface_.height_ * surface_.stride_; };
 
 template <typename T, unsigned S> unsigned SurfaceView<T, S>::row_size() const { return surface_.width_ * surface_.bpp_; };
@@ -40,8 +40,11 @@
 #include "Image.hpp"
 #include "Misc.hpp"
 
+#include <climits>
+#include <deque>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace lctm {
 
@@ -52,36 +55,91 @@ public:
 	unsigned length() const { return length_; }
 	float rate() const { return rate_; }
 
+	// Is there a picture at 'position'? - for a stream, this reads ahead until it knows
+	bool has_frame(unsigned position) const;
+
 	// Read into Image
+	//
+	// Streams (standard input) are read in order - pictures can be read again until they are a few positions behind the
+	// latest.
 	Image read(unsigned position, uint64_t timestamp = 0) const;
+
+	// Make the planes of read images views into a mapping of the file, rather than copies - falls back to copying if
+	// the file cannot be mapped, or has padded rows
+	void set_memory_mapped(bool b) { memory_mapped_ = b; }
 	void update_data(const ImageDescription &image_description);
 
+	// True if pictures are read from a stream (standard input or a pipe), rather than a file that can be read from any position
+	bool is_stream() const { return source_ == SOURCE_STREAM; }
+
+	// Read just part of a file - position 0 becomes picture 'first', and there are at most 'count' pictures
+	void set_window(unsigned first, unsigned count);
+
 private:
 	friend std::unique_ptr<YUVReader> CreateYUVReader(const std::string &name);
 	friend std::unique_ptr<YUVReader> CreateYUVReader(const std::string &name, unsigned rate);
 	friend std::unique_ptr<YUVReader> CreateYUVReader(const std::string &name, const ImageDescription &image_description,
 	                                                  unsigned rate);
+	friend std::unique_ptr<YUVReader> CreateYUVReader(FILE *stream, const std::string &name,
+	                                                  const ImageDescription &image_description, unsigned rate);
+
+	enum Source { SOURCE_RAW_FILE, SOURCE_Y4M_FILE, SOURCE_STREAM };
 
 	YUVReader(const std::string &name, float rate, FILE *file, uintmax_t fileSize);
 	YUVReader(const std::string &name, const ImageDescription &image_description, unsigned length, float rate, FILE *file,
 	          uintmax_t fileSize);
 
+	static std::unique_ptr<YUVReader> open_y4m(const std::string &name, FILE *file, uintmax_t fileSize);
+	static std::unique_ptr<YUVReader> open_stdin(const ImageDescription &image_description, float rate);
+
+	uint64_t frame_offset(unsigned position) const;
 	void set_position(unsigned position) const;
+	bool read_mapped(unsigned position, std::vector<Surface> &surfaces) const;
+	bool read_stream_picture() const;
+	bool stream_is_y4m() const;
+	size_t read_stream(uint8_t *data, size_t size) const;
 
 	std::string name_;
 	uintmax_t fileSize_;
 
 	ImageDescription image_description_;
-	unsigned length_;
+	mutable unsigned length_; // UINT_MAX for a stream, until its end is reached
 	float rate_;
 
 	UniquePtrFile file_;
 
 	mutable unsigned position_ = 0;
+
+	bool memory_mapped_ = false;
+
+	Source source_ = SOURCE_RAW_FILE;
+
+	// Y4M files - file offset of each picture's data
+	std::vector<uint64_t> frame_offsets_;
+
+	// Part of file being read, from set_window()
+	unsigned window_first_ = 0;
+	unsigned window_count_ = UINT_MAX;
+
+	// Streams - the most recently read pictures, and the position of the first of them
+	mutable std::deque<Image> retained_;
+	mutable unsigned retained_first_ = 0;
 };
 
+// Readers for raw YUV or Y4M files, or "-" for standard input - Y4M is recognised by its header, and its picture
+// description and rate are taken from there
+//
 std::unique_ptr<YUVReader> CreateYUVReader(const std::string &name);
 std::unique_ptr<YUVReader> CreateYUVReader(const std::string &name, unsigned rate);
 std::unique_ptr<YUVReader> CreateYUVReader(const std::string &name, const ImageDescription &image_description, unsigned rate);
 
+// Reader for raw pictures from an open stream, such as a pipe - takes ownership of 'stream'
+//
+std::unique_ptr<YUVReader> CreateYUVReader(FILE *stream, const std::string &name, const ImageDescription &image_description,
+                                           unsigned rate);
+
+// If the named file, or "-" for standard input, is Y4M, get its picture description and rate
+//
+bool ProbeY4M(const std::string &name, ImageDescription &image_description, float &rate);
+
 } // namespace lctm
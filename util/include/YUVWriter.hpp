@@ -41,13 +41,20 @@
 
 #include "Image.hpp"
 #include "Misc.hpp"
+#include "RingBuffer.hpp"
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace lctm {
 
 class YUVWriter {
 public:
+	~YUVWriter();
+
 	void write(const Image &image);
 
 	// Special cases for debugging - treat surfaces as planes of image
@@ -57,6 +64,20 @@ public:
 
 	void close();
 
+	// Hand writes to an I/O thread, with up to 'queue_depth' pictures waiting for it (0 = write synchronously)
+	//
+	// Written surfaces are held by the queue, and must not be modified afterwards.
+	void set_asynchronous(unsigned queue_depth);
+
+	// Wait until everything written so far is in the file
+	void flush();
+
+	// Write Y4M rather than raw YUV - the default for names ending in .y4m - with the given picture rate in the header
+	//
+	// The header has no rate unless one is set.
+	void set_y4m(bool b) { y4m_ = b; }
+	void set_rate(float rate) { rate_ = rate; }
+
 	std::string filename() const { return filename_; }
 
 	ImageDescription image_description() const { return image_description_; }
@@ -68,12 +89,29 @@ private:
 	YUVWriter(const std::string &name);
 	YUVWriter(const std::string &name, const ImageDescription &image_description, bool decorate);
 
+	void open();
+	void write_y4m_header();
 	void write_surface(const Surface &surface);
+	void write_planes(std::vector<Surface> planes);
+	void write_batch(const std::vector<std::vector<Surface>> &batch);
+	void io_thread();
+	void stop();
 
 	ImageDescription image_description_;
 	std::string filename_;
 
 	UniquePtrFile file_;
+
+	bool y4m_ = false;
+	bool y4m_header_written_ = false;
+	float rate_ = 0.0f;
+
+	// Asynchronous writes - an empty set of planes stops the thread
+	std::unique_ptr<RingBuffer<std::vector<Surface>>> queue_;
+	std::thread io_thread_;
+	std::mutex pending_mutex_;
+	std::condition_variable written_;
+	unsigned pending_ = 0;
 };
 
 std::unique_ptr<YUVWriter> CreateYUVWriter(const std::string &name);
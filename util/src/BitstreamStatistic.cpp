@@ -42,6 +42,10 @@
 
 #include "Diagnostics.hpp"
 
+// Trace of BITSTREAM_DEBUG builds - one for the process, shared by every BitstreamPacker and BitstreamUnpacker
+BitstreamStatistic goStat;
+FILE *goBits = NULL;
+
 int BitstreamStatistic::Reset() {
 	for (int i = 0; i < STATISTIC_CATEGORIES; i++) {
 		strcpy(mcCategory[i], "");
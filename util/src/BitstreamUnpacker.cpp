@@ -45,6 +45,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <memory>
 
 // global precompiler defines
@@ -55,14 +56,6 @@
 #endif
 
 namespace {
-// Bit shifts that are defined for shift >= bit-width
-//
-inline uint32_t shl32(uint32_t v, unsigned c) { return (c < 32) ? (v << c) : 0; }
-inline uint32_t shr32(uint32_t v, unsigned c) { return (c < 32) ? (v >> c) : 0; }
-
-// 'width' bitmask
-inline uint32_t mask32(unsigned width) { return (1 << width) - 1; }
-
 const int BITS_PER_BYTE = 8;
 const int BITS_COUNT_MASK = 7;
 const int BITS_COUNT_SHIFT = 3;
@@ -70,7 +63,8 @@ const int BITS_COUNT_SHIFT = 3;
 
 namespace lctm {
 
-BitstreamUnpacker::BitstreamUnpacker(const PacketView &view) : view_(view) {
+BitstreamUnpacker::BitstreamUnpacker(const PacketView &view)
+    : view_(view), data_(view.size() ? view.data() : nullptr), size_(view.size()) {
 #if BITSTREAM_DEBUG
 	fprintf(goBits, "========  ========  ========  ========  ========  ========  ========  ========  ========  ========  \n");
 	fprintf(goBits, "BitstreamUnpacker::emit    (%8d)\n", view.size());
@@ -83,43 +77,45 @@ BitstreamUnpacker::BitstreamUnpacker(const PacketView &view) : view_(view) {
 
 BitstreamUnpacker::~BitstreamUnpacker() {}
 
-// Read 0..32 bits into unsigned integer
+// Top up cache to at least 57 bits
 //
-uint32_t BitstreamUnpacker::u(unsigned num_bits) {
-	assert(num_bits <= 32);
-	assert((bit_offset_ + num_bits) <= bit_size());
-
-	uint32_t r = 0;
-
-	while (num_bits) {
-		// Index and bit
-#if defined __OPT_MODULO__
-		const unsigned bit_used = bit_offset_ & BITS_COUNT_MASK;
-#else
-		const unsigned bit_used = bit_offset_ % BITS_PER_BYTE;
-#endif
-#if defined __OPT_DIVISION__
-		unsigned idx = bit_offset_ >> BITS_COUNT_SHIFT;
-#else
-		unsigned idx = bit_offset_ / BITS_PER_BYTE;
-#endif
-
-		const unsigned data = view_.data()[idx];
-		const unsigned bit_left = BITS_PER_BYTE - bit_used;
-
-		// How many bits can be read from this byte?
-		// const unsigned n = std::min(BITS_PER_BYTE - bit, num_bits);
-		const unsigned n = LCEVC_MIN(bit_left, num_bits);
-
-		// Extract bits and merge into result
-		// r = shl32(r, n) | (shr32(data, (BITS_PER_BYTE - bit) - n) & mask32(n));
-		r = (r << n) | ((data >> (bit_left - n)) & ((1 << n) - 1));
-
-		bit_offset_ += n;
-		num_bits -= n;
+// Bytes past the end of the source are treated as zero - peek() may look beyond the end, but skip() may not
+//
+void BitstreamUnpacker::refill() {
+	if (fill_byte_ + 8 <= size_) {
+		// Load a big endian word, and merge as many whole bytes as fit - any trailing partial byte is loaded again
+		// at the same position by the next refill
+		const uint8_t *p = data_ + fill_byte_;
+		const uint64_t word = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+		                      ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+		cache_ |= word >> cache_bits_;
+		const unsigned num_bytes = (63 - cache_bits_) >> BITS_COUNT_SHIFT;
+		fill_byte_ += num_bytes;
+		cache_bits_ += num_bytes * BITS_PER_BYTE;
+	} else {
+		// Near the end of source - one byte at a time
+		while (cache_bits_ <= 56) {
+			const uint64_t data = (fill_byte_ < size_) ? data_[fill_byte_] : 0;
+			cache_ |= data << (56 - cache_bits_);
+			cache_bits_ += BITS_PER_BYTE;
+			++fill_byte_;
+		}
 	}
+}
 
-	return r;
+// Discard cache and reload from bit_offset_ after a skip beyond the cached bits
+//
+void BitstreamUnpacker::reposition() {
+	fill_byte_ = bit_offset_ >> BITS_COUNT_SHIFT;
+	cache_ = 0;
+	cache_bits_ = 0;
+
+	const unsigned bit_used = bit_offset_ & BITS_COUNT_MASK;
+	if (bit_used) {
+		refill();
+		cache_ <<= bit_used;
+		cache_bits_ -= bit_used;
+	}
 }
 
 // Read a single of byte from stream - expects offset byte aligned
@@ -131,18 +127,13 @@ uint8_t BitstreamUnpacker::byte() {
 	assert((bit_offset_ % BITS_PER_BYTE) == 0);
 #endif
 	assert(BITS_PER_BYTE <= (bit_size() - bit_offset_));
-#if defined __OPT_DIVISION__
-	const unsigned idx = bit_offset_ >> BITS_COUNT_SHIFT;
-#else
-	const unsigned idx = bit_offset_ / BITS_PER_BYTE;
-#endif
-	bit_offset_ += BITS_PER_BYTE;
 
-//	CHECK(idx < view_.size());
-	if(idx < view_.size()) {
-		return view_.data()[idx];
+	if ((bit_offset_ >> BITS_COUNT_SHIFT) < size_) {
+		return (uint8_t)read(BITS_PER_BYTE);
 	} else {
 		WARN("Read beyond end of packet.");
+		bit_offset_ += BITS_PER_BYTE;
+		reposition();
 		return 0;
 	}
 }
@@ -163,10 +154,10 @@ Packet BitstreamUnpacker::bytes(unsigned num_bytes) {
 #endif
 
 	auto b = Packet::build().reserve(num_bytes);
-	for (unsigned i = 0; i < num_bytes; ++i)
-		b.data()[i] = view_.data()[idx + i];
+	if (num_bytes)
+		memcpy(b.data(), data_ + idx, num_bytes);
 
-	bit_offset_ += num_bytes * BITS_PER_BYTE;
+	skip(num_bytes * BITS_PER_BYTE);
 
 	return b.finish();
 }
@@ -174,32 +165,26 @@ Packet BitstreamUnpacker::bytes(unsigned num_bytes) {
 //// Debug shim
 //
 
+#if BITSTREAM_DEBUG
 // Read 0..32 bits into unsigned integer - includes a field label for tracing
 //
 uint32_t BitstreamUnpacker::u(unsigned num_bits, const char *label) {
 	uint32_t r = u(num_bits);
-#if BITSTREAM_DEBUG
 	unsigned o = bit_offset_;
 	char acString[128];
 	sprintf(acString, "u(%2u, \"%s%s\")", num_bits, join(context_, ".", true).c_str(), label);
 	fprintf(goBits, "%-64s => %4u (0x%02x)  [%8d]\n", acString, r, r, o);
 	fflush(goBits);
 	goStat.Update(acString, num_bits);
-#endif
 	return r;
 }
 
-void BitstreamUnpacker::push_context_label(const std::string &s) {
-#if BITSTREAM_DEBUG
-	context_.push_back(s);
-#endif
-}
+void BitstreamUnpacker::push_context_label(const std::string &s) { context_.push_back(s); }
 
 void BitstreamUnpacker::pop_context_label() {
-#if BITSTREAM_DEBUG
 	assert(!context_.empty());
 	context_.pop_back();
-#endif
 }
+#endif
 
 } // namespace lctm
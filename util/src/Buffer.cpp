@@ -44,14 +44,21 @@
 //
 #include "Buffer.hpp"
 
+#include "Config.hpp"
 #include "Diagnostics.hpp"
 
 #include <cassert>
 #include <cstring>
+#include <map>
+#include <mutex>
 #include <stdlib.h>
+#include <vector>
 
 #ifdef _WIN32
 #include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 namespace lctm {
@@ -107,37 +114,37 @@ std::unique_ptr<Buffer> CreateBufferVector(unsigned size) { return std::unique_p
 //
 // Create page aligned buffers
 //
+static const unsigned ALIGNMENT = 64;
 
-class BufferAligned : public Buffer {
-	const unsigned ALIGNMENT = 64;
-
-public:
-	BufferAligned(const uint8_t *data, unsigned size) : size_(size) {
-		size = (size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
+static void *allocate_aligned(size_t size) {
+	size = (size + (ALIGNMENT - 1)) & ~(size_t)(ALIGNMENT - 1);
 #ifdef _WIN32
-		bytes_ = _aligned_malloc(size, ALIGNMENT);
+	return _aligned_malloc(size, ALIGNMENT);
 #else
-		bytes_ = aligned_alloc(ALIGNMENT, size);
+	return aligned_alloc(ALIGNMENT, size);
 #endif
-		memcpy(bytes_, data, size);
-	}
+}
 
-	BufferAligned(unsigned size) : size_(size) {
-		size = (size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
+static void free_aligned(void *bytes) {
 #ifdef _WIN32
-		bytes_ = _aligned_malloc(size, ALIGNMENT);
+	_aligned_free(bytes);
 #else
-		bytes_ = aligned_alloc(ALIGNMENT, size);
+	free(bytes);
 #endif
+}
+
+class BufferAligned : public Buffer {
+public:
+	BufferAligned(const uint8_t *data, unsigned size) : size_(size) {
+		bytes_ = allocate_aligned(size);
+		memcpy(bytes_, data, size);
 	}
 
+	BufferAligned(unsigned size) : size_(size) { bytes_ = allocate_aligned(size); }
+
 	~BufferAligned() override {
 		if (bytes_) {
-#ifdef _WIN32
-			_aligned_free(bytes_);
-#else
-			free(bytes_);
-#endif
+			free_aligned(bytes_);
 			bytes_ = nullptr;
 		}
 	}
@@ -171,4 +178,181 @@ std::unique_ptr<Buffer> CreateBufferAligned(const uint8_t *data, unsigned size)
 
 std::unique_ptr<Buffer> CreateBufferAligned(unsigned size) { return std::unique_ptr<Buffer>(new BufferAligned(size)); }
 
+//// BufferPool
+//
+// Free lists of aligned blocks, keyed by bucketed size. A steady stream of same sized pictures allocates nothing once
+// the pool has grown to the working set of the process.
+//
+// Buckets that have not been asked for in the last STALE_ACQUIRES acquisitions are returned to the system, checked every
+// TRIM_INTERVAL acquisitions - so blocks left behind by a change of picture size do not stay for the life of the process.
+//
+class BufferPool {
+public:
+	// Round a request up to its bucket - cache lines for small blocks, pages for big ones
+	static size_t bucket_size(size_t size) {
+		const size_t granule = (size < 4096) ? ALIGNMENT : 4096;
+		return (size + (granule - 1)) & ~(granule - 1);
+	}
+
+	void *acquire(size_t size) {
+		std::vector<void *> trimmed;
+		void *bytes = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			const uint64_t acquires = ++acquires_;
+			Bucket &bucket = free_[size];
+			bucket.last_acquire = acquires;
+			if (!bucket.blocks.empty()) {
+				bytes = bucket.blocks.back();
+				bucket.blocks.pop_back();
+			}
+			if (acquires % TRIM_INTERVAL == 0)
+				trim(acquires, trimmed);
+		}
+		for (void *block : trimmed)
+			free_aligned(block);
+
+		return bytes ? bytes : allocate_aligned(size);
+	}
+
+	void release(void *bytes, size_t size) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		free_[size].blocks.push_back(bytes);
+	}
+
+	// Deliberately never destroyed, so that buffers owned by static objects can be released at exit
+	static BufferPool &instance() {
+		static BufferPool *pool = new BufferPool;
+		return *pool;
+	}
+
+private:
+	static const uint64_t TRIM_INTERVAL = 1024;
+	static const uint64_t STALE_ACQUIRES = 16384;
+
+	struct Bucket {
+		std::vector<void *> blocks;
+		uint64_t last_acquire = 0;
+	};
+
+	// Move the blocks of stale buckets to 'trimmed' - the caller frees them once the lock is dropped
+	void trim(uint64_t acquires, std::vector<void *> &trimmed) {
+		for (auto f = free_.begin(); f != free_.end();) {
+			if (acquires - f->second.last_acquire > STALE_ACQUIRES) {
+				trimmed.insert(trimmed.end(), f->second.blocks.begin(), f->second.blocks.end());
+				f = free_.erase(f);
+			} else
+				++f;
+		}
+	}
+
+	std::mutex mutex_;
+	std::map<size_t, Bucket> free_;
+	uint64_t acquires_ = 0;
+};
+
+//// BufferPooled
+//
+// Aligned buffer that takes its memory from the pool
+//
+class BufferPooled : public Buffer {
+public:
+	BufferPooled(unsigned size) : size_(size), capacity_(BufferPool::bucket_size(size)) {
+		bytes_ = (uint8_t *)BufferPool::instance().acquire(capacity_);
+	}
+
+	~BufferPooled() override { BufferPool::instance().release(bytes_, capacity_); }
+
+	void map_read(unsigned offset, unsigned size, const uint8_t *&mapped_data, unsigned &mapped_size) const override {
+		assert(offset <= size_);
+		assert(offset + size <= size_);
+
+		mapped_data = bytes_ + offset;
+		mapped_size = size;
+	}
+
+	void map_write(unsigned offset, unsigned size, uint8_t *&mapped_data, unsigned &mapped_size) override {
+		assert(offset <= size_);
+		assert(offset + size <= size_);
+
+		mapped_data = bytes_ + offset;
+		mapped_size = size;
+	}
+
+	void unmap() const override {}
+
+private:
+	size_t size_ = 0;
+	size_t capacity_ = 0;
+	uint8_t *bytes_ = nullptr;
+};
+
+std::unique_ptr<Buffer> CreateBufferPooled(unsigned size) {
+#if defined __OPT_BUFFER_POOL__
+	return std::unique_ptr<Buffer>(new BufferPooled(size));
+#else
+	return std::unique_ptr<Buffer>(new BufferAligned(size));
+#endif
+}
+
+//// BufferMapped
+//
+// Copy-on-write mapping of part of a file
+//
+#ifndef _WIN32
+class BufferMapped : public Buffer {
+public:
+	BufferMapped(void *mapping, size_t mapping_size, unsigned skip, unsigned size)
+	    : mapping_(mapping), mapping_size_(mapping_size), bytes_((uint8_t *)mapping + skip), size_(size) {}
+
+	~BufferMapped() override { munmap(mapping_, mapping_size_); }
+
+	void map_read(unsigned offset, unsigned size, const uint8_t *&mapped_data, unsigned &mapped_size) const override {
+		assert(offset <= size_);
+		assert(offset + size <= size_);
+
+		mapped_data = bytes_ + offset;
+		mapped_size = size;
+	}
+
+	void map_write(unsigned offset, unsigned size, uint8_t *&mapped_data, unsigned &mapped_size) override {
+		assert(offset <= size_);
+		assert(offset + size <= size_);
+
+		mapped_data = bytes_ + offset;
+		mapped_size = size;
+	}
+
+	void unmap() const override {}
+
+private:
+	void *mapping_ = nullptr;
+	size_t mapping_size_ = 0;
+	uint8_t *bytes_ = nullptr;
+	size_t size_ = 0;
+};
+#endif
+
+std::unique_ptr<Buffer> CreateBufferMapped(int fd, uint64_t file_offset, unsigned size) {
+#ifdef _WIN32
+	return nullptr;
+#else
+	// Mappings have to start on a page boundary
+	const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+	const uint64_t start = file_offset & ~(page_size - 1);
+	const unsigned skip = static_cast<unsigned>(file_offset - start);
+	const size_t mapping_size = static_cast<size_t>(skip) + size;
+
+	void *mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, static_cast<off_t>(start));
+	if (mapping == MAP_FAILED)
+		return nullptr;
+
+	// Contents are read front to back, soon - ask for read-ahead
+	madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+	madvise(mapping, mapping_size, MADV_WILLNEED);
+
+	return std::unique_ptr<Buffer>(new BufferMapped(mapping, mapping_size, skip, size));
+#endif
+}
+
 } // namespace lctm
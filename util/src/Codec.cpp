@@ -95,11 +95,11 @@ void CodecRelease(Codec* codec) {
 // Convert a codec error to a user string
 //
 string CodecErrorToString(Codec* codec, CodecError error) {
-	const size_t buffer_len = codec->get_error_message(error, 0, 0);
+	const size_t buffer_len = codec->get_error_message(error, 0, 0) + 1;
 	char *buffer = CHECK((static_cast<char *>(alloca(buffer_len))));
 	codec->get_error_message(error, buffer, buffer_len);
 	codec->release_error(error);
-	return string(buffer, buffer + buffer_len);
+	return string(buffer);
 }
 
 } // namespace lctm
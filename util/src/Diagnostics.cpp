@@ -40,6 +40,7 @@
 #include <cstdarg>
 #include <cstdio>
 #include <sstream>
+#include <stdexcept>
 
 namespace lctm {
 
@@ -70,8 +71,10 @@ std::string join(const std::vector<std::string> &list, const std::string &sepera
 
 void _check_failed(const char *file, int line, const char *func, const std::string &message) {
 	fprintf(stderr, "Error: %s:%d (%s) %s\n", file, line, func, message.c_str());
-#ifdef DIAGNOSTICS_CHECK_ABORTS
-	abort()
+#if defined DIAGNOSTICS_CHECK_ABORTS
+	abort();
+#elif defined DIAGNOSTICS_ERR_THROWS
+	throw DiagnosticsError(message, 10);
 #else
 	exit(10);
 #endif
@@ -79,7 +82,7 @@ void _check_failed(const char *file, int line, const char *func, const std::stri
 
 void _raise(const char *file, int line, const char *func, const std::string &message) {
 #ifdef DIAGNOSTICS_ERR_THROWS
-	throw std::runtime_error(message.c_str());
+	throw DiagnosticsError(message, 20);
 #else
 	exit(20);
 #endif
@@ -335,4 +335,44 @@ std::istream &operator>>(std::istream &in, Colourspace &v) {
 	return in;
 }
 
+// Y4M colourspaces - the first entry for a format is the one that is written
+//
+static const struct {
+	const char *colourspace;
+	ImageFormat format;
+} Y4MColourspaces[] = {
+    {"420jpeg", IMAGE_FORMAT_YUV420P8},   {"420", IMAGE_FORMAT_YUV420P8},        {"420mpeg2", IMAGE_FORMAT_YUV420P8},
+    {"420paldv", IMAGE_FORMAT_YUV420P8},  {"422", IMAGE_FORMAT_YUV422P8},        {"444", IMAGE_FORMAT_YUV444P8},
+    {"mono", IMAGE_FORMAT_Y8},
+
+    {"420p10", IMAGE_FORMAT_YUV420P10},   {"422p10", IMAGE_FORMAT_YUV422P10},    {"444p10", IMAGE_FORMAT_YUV444P10},
+    {"mono10", IMAGE_FORMAT_Y10},
+
+    {"420p12", IMAGE_FORMAT_YUV420P12},   {"422p12", IMAGE_FORMAT_YUV422P12},    {"444p12", IMAGE_FORMAT_YUV444P12},
+    {"mono12", IMAGE_FORMAT_Y12},
+
+    {"420p14", IMAGE_FORMAT_YUV420P14},   {"422p14", IMAGE_FORMAT_YUV422P14},    {"444p14", IMAGE_FORMAT_YUV444P14},
+    {"mono14", IMAGE_FORMAT_Y14},
+
+    {"420p16", IMAGE_FORMAT_YUV420P16},   {"422p16", IMAGE_FORMAT_YUV422P16},    {"444p16", IMAGE_FORMAT_YUV444P16},
+    {"mono16", IMAGE_FORMAT_Y16},
+};
+
+std::string Y4MColourspace(ImageFormat format) {
+	for (size_t i = 0; i < ARRAY_SIZE(Y4MColourspaces); ++i)
+		if (Y4MColourspaces[i].format == format)
+			return Y4MColourspaces[i].colourspace;
+
+	ERR("No Y4M colourspace for image format %d", format);
+	return "";
+}
+
+ImageFormat Y4MImageFormat(const std::string &colourspace) {
+	for (size_t i = 0; i < ARRAY_SIZE(Y4MColourspaces); ++i)
+		if (colourspace == Y4MColourspaces[i].colourspace)
+			return Y4MColourspaces[i].format;
+
+	return IMAGE_FORMAT_NONE;
+}
+
 } // namespace lctm
@@ -43,15 +43,21 @@
 #include "Misc.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include <limits.h>
 #include <sys/stat.h>
 #include <time.h>
 
 #if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <unistd.h>
 #elif defined(WIN32) || defined(WIN64)
@@ -364,9 +370,202 @@ uint64_t system_timestamp() {
 
 // Generate a temporary filename for storing
 std::string make_temporary_filename(const std::string &suffix) {
+	// Numbered, so that concurrent users of the same suffix get different files
+	static std::atomic<unsigned> sequence(0);
 	char name[256];
-	snprintf(name, sizeof(name), "_temp_%08d_%s", getpid(), suffix.c_str());
+	snprintf(name, sizeof(name), "_temp_%08d_%u_%s", getpid(), sequence++, suffix.c_str());
 	return name;
 }
 
+bool make_fifo(const std::string &name) {
+#if defined(__linux__)
+	return mkfifo(name.c_str(), 0600) == 0;
+#else
+	return false;
+#endif
+}
+
+bool open_fifo_reader(const std::string &name, int &read_fd, int &hold_fd) {
+#if defined(__linux__)
+	// A non-blocking open for reading succeeds without a writer, after which opening for writing does too
+	read_fd = open(name.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (read_fd < 0)
+		return false;
+	hold_fd = open(name.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (hold_fd < 0 || fcntl(read_fd, F_SETFL, fcntl(read_fd, F_GETFL) & ~O_NONBLOCK) < 0) {
+		if (hold_fd >= 0)
+			close(hold_fd);
+		close(read_fd);
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void release_fifo_reader(int hold_fd) {
+#if defined(__linux__)
+	if (hold_fd >= 0)
+		close(hold_fd);
+#endif
+}
+
+#if defined(__linux__)
+//// FifoSpool
+//
+// Drains a named pipe on a thread of its own, and hands the bytes back through a stdio stream. Up to SPILL_BYTES of
+// unread data are held in memory - beyond that, bytes go to a temporary file until the reader has caught up.
+//
+class FifoSpool {
+public:
+	FifoSpool(int fd, int spill_fd) : spill_fd_(spill_fd), thread_(&FifoSpool::drain, this, fd) {}
+	~FifoSpool() {
+		thread_.join();
+		if (spill_fd_ >= 0)
+			close(spill_fd_);
+	}
+
+	// Wait for at least one byte, or the end of the pipe
+	ssize_t read(char *data, size_t size) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		cond_.wait(lock, [this] { return position_ < end() || spill_read_ < spill_write_ || finished_; });
+
+		// Bring spilled bytes back once those in memory have been read
+		if (position_ == end() && spill_read_ < spill_write_ && !unspill())
+			return -1;
+
+		const size_t n = static_cast<size_t>(std::min<uint64_t>(size, end() - position_));
+		memcpy(data, bytes_.data() + (position_ - base_), n);
+		position_ += n;
+
+		// Drop bytes once more have been read than are waiting, keeping a few behind the read position to seek back over
+		const uint64_t consumed = position_ - base_;
+		if (consumed > KEEP_BYTES && consumed - KEEP_BYTES > bytes_.size() - consumed) {
+			bytes_.erase(0, static_cast<size_t>(consumed - KEEP_BYTES));
+			base_ = position_ - KEEP_BYTES;
+		}
+		return static_cast<ssize_t>(n);
+	}
+
+	// Only positions that are still held in memory can be sought to
+	int seek(off64_t *offset, int whence) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		int64_t target;
+		if (whence == SEEK_SET)
+			target = *offset;
+		else if (whence == SEEK_CUR)
+			target = static_cast<int64_t>(position_) + *offset;
+		else
+			return -1;
+
+		if (target < static_cast<int64_t>(base_) || target > static_cast<int64_t>(end()))
+			return -1;
+
+		position_ = static_cast<uint64_t>(target);
+		*offset = target;
+		return 0;
+	}
+
+private:
+	static const uint64_t KEEP_BYTES = 64 * 1024;
+	static const uint64_t SPILL_BYTES = 256 * 1024 * 1024;
+	static const size_t CHUNK_BYTES = 1024 * 1024;
+
+	uint64_t end() const { return base_ + bytes_.size(); }
+
+	// Move the next chunk of spilled bytes into memory - called with the lock held
+	bool unspill() {
+		const size_t n = static_cast<size_t>(std::min(static_cast<uint64_t>(CHUNK_BYTES), spill_write_ - spill_read_));
+		const size_t old_size = bytes_.size();
+		bytes_.resize(old_size + n);
+		if (pread(spill_fd_, &bytes_[old_size], n, static_cast<off_t>(spill_read_)) != static_cast<ssize_t>(n))
+			return false;
+		spill_read_ += n;
+
+		// Start the file again once it has all been read
+		if (spill_read_ == spill_write_) {
+			spill_read_ = spill_write_ = 0;
+			if (ftruncate(spill_fd_, 0) < 0)
+				return false;
+		}
+		return true;
+	}
+
+	void drain(int fd) {
+		std::vector<char> chunk(CHUNK_BYTES);
+		for (;;) {
+			const ssize_t n = ::read(fd, chunk.data(), chunk.size());
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			// Keep bytes in order - once spilling, carry on until the reader has taken everything from the file
+			if (spill_fd_ >= 0 && (spill_read_ < spill_write_ || end() - position_ > SPILL_BYTES)) {
+				if (pwrite(spill_fd_, chunk.data(), static_cast<size_t>(n), static_cast<off_t>(spill_write_)) != n)
+					break;
+				spill_write_ += static_cast<uint64_t>(n);
+			} else
+				bytes_.append(chunk.data(), static_cast<size_t>(n));
+			cond_.notify_all();
+		}
+		close(fd);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		finished_ = true;
+		cond_.notify_all();
+	}
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+
+	std::string bytes_;     // Bytes from 'base_' onwards
+	uint64_t base_ = 0;     // Stream position of first held byte
+	uint64_t position_ = 0; // Read position
+	bool finished_ = false;
+
+	int spill_fd_ = -1;       // Temporary file for bytes beyond SPILL_BYTES - follows those in memory
+	uint64_t spill_read_ = 0; // Range of the file not yet moved back into memory
+	uint64_t spill_write_ = 0;
+
+	std::thread thread_;
+};
+#endif
+
+FILE *open_fifo_spooled(const std::string &name, int &hold_fd) {
+#if defined(__linux__)
+	int fd;
+	if (!open_fifo_reader(name, fd, hold_fd))
+		return nullptr;
+
+	// Spill file is unlinked straight away, so it goes when closed - without one, everything is held in memory
+	const std::string spill_name = make_temporary_filename("spool.bin");
+	const int spill_fd = open(spill_name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (spill_fd >= 0)
+		unlink(spill_name.c_str());
+
+	cookie_io_functions_t functions;
+	functions.read = [](void *spool, char *data, size_t size) { return static_cast<FifoSpool *>(spool)->read(data, size); };
+	functions.write = nullptr;
+	functions.seek = [](void *spool, off64_t *offset, int whence) { return static_cast<FifoSpool *>(spool)->seek(offset, whence); };
+	functions.close = [](void *spool) {
+		delete static_cast<FifoSpool *>(spool);
+		return 0;
+	};
+
+	FifoSpool *spool = new FifoSpool(fd, spill_fd);
+	FILE *file = fopencookie(spool, "rb", functions);
+	if (!file) {
+		release_fifo_reader(hold_fd);
+		hold_fd = -1;
+		delete spool;
+	}
+	return file;
+#else
+	return nullptr;
+#endif
+}
+
 } // namespace lctm
@@ -54,26 +54,48 @@ Surface::Surface(const std::string name, uint64_t checksum, const std::shared_pt
                  unsigned height, unsigned stride)
     : name_(name), checksum_(checksum), buffer_(buffer), offset_(offset), width_(width), height_(height), stride_(stride) {}
 
-// Global debug state for surface dumping
+//// SurfaceDumps
 //
-static bool dump_surfaces = true;
-static std::map<std::string, std::unique_ptr<YUVWriter>> yuv_writers;
+static thread_local SurfaceDumps *current_dumps = nullptr;
 
-void Surface::set_dump_surfaces(bool b) { dump_surfaces = b; }
+SurfaceDumps::SurfaceDumps(const std::string &prefix) : prefix_(prefix) {}
 
-bool Surface::get_dump_surfaces() { return dump_surfaces; }
+SurfaceDumps::~SurfaceDumps() {}
+
+void SurfaceDumps::write(const std::string &name, const Image &image, bool decorate) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto &writer = writers_[name];
+	if (!writer)
+		writer = CreateYUVWriter(prefix_ + name, image.description(), decorate);
+
+	writer->write(image);
+}
+
+SurfaceDumps &SurfaceDumps::current() {
+	static SurfaceDumps process_dumps;
+	return current_dumps ? *current_dumps : process_dumps;
+}
+
+SurfaceDumps::Scope::Scope(SurfaceDumps *dumps) : previous_(current_dumps) {
+	if (dumps)
+		current_dumps = dumps;
+}
+
+SurfaceDumps::Scope::~Scope() { current_dumps = previous_; }
+
+void Surface::set_dump_surfaces(bool b) { SurfaceDumps::current().set_enabled(b); }
+
+bool Surface::get_dump_surfaces() { return SurfaceDumps::current().enabled(); }
 
 // Dump surface as 8bit p420, with dummy chroma planes
 //
 void Surface::dump_p420(const std::string &name) const {
-	if (!dump_surfaces)
+	if (!get_dump_surfaces())
 		return;
 
 	ImageDescription desc(IMAGE_FORMAT_YUV420P8, width(), height());
 
-	if (yuv_writers.find(name) == yuv_writers.end())
-		yuv_writers[name] = CreateYUVWriter(name, desc, true);
-
 	Surface planes[3];
 
 	if (bpp() == 1)
@@ -90,7 +112,7 @@ void Surface::dump_p420(const std::string &name) const {
 	memset(sb.data(0, 0), 0x80, sb.width() * sb.height());
 	planes[1] = planes[2] = sb.finish();
 
-	yuv_writers[name]->write(Image(name, desc, 0, planes));
+	SurfaceDumps::current().write(name, Image(name, desc, 0, planes), true);
 }
 
 // Dump surface as 8bpp, 10bpp, 12bpp, or 14bpp with correct chroma subsampling and proper chroma planes
@@ -98,32 +120,24 @@ void Surface::dump_p420(const std::string &name) const {
 void Surface::dump_yuv(const std::string &name, Surface (&planes)[3], ImageDescription desc, bool decorate) const {
 	if (desc.bit_depth() == 8) {
 		Surface converted[3];
-		if (yuv_writers.find(name) == yuv_writers.end())
-			yuv_writers[name] = CreateYUVWriter(name, desc, decorate);
 		for (unsigned p = 0; p < desc.num_planes(); p++)
 			converted[p] = ConvertToU8().process(planes[p], 7);
-		yuv_writers[name]->write(Image(name, desc, 0, converted));
+		SurfaceDumps::current().write(name, Image(name, desc, 0, converted), decorate);
 	} else if (desc.bit_depth() == 10) {
 		Surface converted[3];
-		if (yuv_writers.find(name) == yuv_writers.end())
-			yuv_writers[name] = CreateYUVWriter(name, desc, decorate);
 		for (unsigned p = 0; p < desc.num_planes(); p++)
 			converted[p] = ConvertToU16().process(planes[p], 5);
-		yuv_writers[name]->write(Image(name, desc, 0, converted));
+		SurfaceDumps::current().write(name, Image(name, desc, 0, converted), decorate);
 	} else if (desc.bit_depth() == 12) {
 		Surface converted[3];
-		if (yuv_writers.find(name) == yuv_writers.end())
-			yuv_writers[name] = CreateYUVWriter(name, desc, decorate);
 		for (unsigned p = 0; p < desc.num_planes(); p++)
 			converted[p] = ConvertToU16().process(planes[p], 3);
-		yuv_writers[name]->write(Image(name, desc, 0, converted));
+		SurfaceDumps::current().write(name, Image(name, desc, 0, converted), decorate);
 	} else if (desc.bit_depth() == 14) {
 		Surface converted[3];
-		if (yuv_writers.find(name) == yuv_writers.end())
-			yuv_writers[name] = CreateYUVWriter(name, desc, decorate);
 		for (unsigned p = 0; p < desc.num_planes(); p++)
 			converted[p] = ConvertToU16().process(planes[p], 1);
-		yuv_writers[name]->write(Image(name, desc, 0, converted));
+		SurfaceDumps::current().write(name, Image(name, desc, 0, converted), decorate);
 	} else {
 		INFO("Image Format not supported %4d bpp", desc.bit_depth());
 	}
@@ -132,7 +146,7 @@ void Surface::dump_yuv(const std::string &name, Surface (&planes)[3], ImageDescr
 // Dump surface as 8 or 16 bit Y
 //
 void Surface::dump(const std::string &name) const {
-	if (!dump_surfaces)
+	if (!get_dump_surfaces())
 		return;
 
 	ImageFormat fmt = IMAGE_FORMAT_NONE;
@@ -149,27 +163,21 @@ void Surface::dump(const std::string &name) const {
 
 	ImageDescription desc(fmt, width(), height());
 
-	if (yuv_writers.find(name) == yuv_writers.end())
-		yuv_writers[name] = CreateYUVWriter(name, desc, true);
-
 	Surface planes[3];
 
 	planes[0] = *this;
-	yuv_writers[name]->write(Image(name, desc, 0, planes));
+	SurfaceDumps::current().write(name, Image(name, desc, 0, planes), true);
 }
 
 // Dump array of layers/surfaces as 16 bit Y
 //
 void Surface::dump_layers(const Surface surface[], const std::string &name, const unsigned transform_block_size) {
-	if (!dump_surfaces)
+	if (!get_dump_surfaces())
 		return;
 
 	CHECK(surface[0].bpp() == 2); // only 16 bit supported at the moment
 	ImageDescription desc(IMAGE_FORMAT_Y16, surface[0].width() * transform_block_size, surface[0].height() * transform_block_size);
 
-	if (yuv_writers.find(name) == yuv_writers.end())
-		yuv_writers[name] = CreateYUVWriter(name, desc, true);
-
 	Surface planes[3];
 
 	if (transform_block_size == 2) {
@@ -234,7 +242,7 @@ void Surface::dump_layers(const Surface surface[], const std::string &name, cons
 		planes[0] = dst.finish();
 	}
 
-	yuv_writers[name]->write(Image(name, desc, 0, planes));
+	SurfaceDumps::current().write(name, Image(name, desc, 0, planes), true);
 }
 
 void Surface::dump_image(const std::string &name) const {
@@ -39,21 +39,150 @@
 //
 #include "YUVReader.hpp"
 
+#include <algorithm>
+#include <climits>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <regex>
 #include <string>
 
+#include "Buffer.hpp"
 #include "Diagnostics.hpp"
 #include "Image.hpp"
 #include "Misc.hpp"
 #include "Platform.hpp"
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 namespace lctm {
 
 using namespace std;
 
+// How many pictures a stream keeps after they have been read, so that they can be read again
+static const unsigned STREAM_RETAINED_PICTURES = 16;
+
+//// Y4M
+//
+static const char Y4M_MAGIC[] = "YUV4MPEG2 ";
+
+// Read a line, without the newline - returns false at end of file
+//
+static bool read_line(FILE *file, string &line) {
+	line.clear();
+	for (;;) {
+		const int c = getc(file);
+		if (c == EOF)
+			return !line.empty();
+		if (c == '\n')
+			return true;
+		if (line.size() > 1024)
+			ERR("Y4M header line is too long");
+		line.push_back(static_cast<char>(c));
+	}
+}
+
+// Parse the parameters that follow the Y4M magic
+//
+static void parse_y4m_header(const string &parameters, ImageDescription &description, float &rate) {
+	vector<string> parts;
+	split(parts, parameters, " ");
+
+	unsigned width = 0;
+	unsigned height = 0;
+	ImageFormat image_format = IMAGE_FORMAT_YUV420P8;
+
+	for (const auto &p : parts) {
+		if (p.empty())
+			continue;
+
+		switch (p[0]) {
+		case 'W':
+			width = stoi(p.substr(1));
+			break;
+		case 'H':
+			height = stoi(p.substr(1));
+			break;
+		case 'F': {
+			unsigned numerator = 0, denominator = 0;
+			if (sscanf(p.c_str() + 1, "%u:%u", &numerator, &denominator) == 2 && denominator != 0)
+				rate = (float)numerator / (float)denominator;
+			break;
+		}
+		case 'C':
+			image_format = Y4MImageFormat(p.substr(1));
+			if (image_format == IMAGE_FORMAT_NONE)
+				ERR("Unsupported Y4M colourspace: %s", p.c_str());
+			break;
+		default:
+			// Interlacing, aspect ratio and extensions do not affect the picture data
+			break;
+		}
+	}
+
+	if (width == 0 || height == 0)
+		ERR("Y4M header has no picture size");
+
+	description = ImageDescription(image_format, width, height);
+}
+
+// Read a Y4M header, if there is one - returns false, with the bytes that were read in 'consumed', if not
+//
+static bool read_y4m_header(FILE *file, ImageDescription &description, float &rate, string &consumed) {
+	char magic[sizeof(Y4M_MAGIC) - 1];
+	const size_t n = fread(magic, 1, sizeof(magic), file);
+	if (n != sizeof(magic) || memcmp(magic, Y4M_MAGIC, sizeof(magic)) != 0) {
+		consumed.assign(magic, n);
+		return false;
+	}
+
+	string parameters;
+	read_line(file, parameters);
+	parse_y4m_header(parameters, description, rate);
+	return true;
+}
+
+//// Standard input
+//
+// One stream for the whole process - its header is looked for once, by whichever probe or reader gets there first.
+//
+static struct {
+	bool probed = false;
+	bool y4m = false;
+	ImageDescription description;
+	float rate = 0.0f;
+	string prefix; // Bytes read while looking for a header that belong to the first picture
+} stdin_state;
+
+static void probe_stdin() {
+	if (stdin_state.probed)
+		return;
+	stdin_state.probed = true;
+
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+#endif
+
+	stdin_state.y4m = read_y4m_header(stdin, stdin_state.description, stdin_state.rate, stdin_state.prefix);
+}
+
+// Read bytes from standard input - returns the number read, which is only short at the end of the stream
+//
+static size_t read_stdin(uint8_t *data, size_t size) {
+	size_t n = 0;
+	if (!stdin_state.prefix.empty()) {
+		n = min(size, stdin_state.prefix.size());
+		memcpy(data, stdin_state.prefix.data(), n);
+		stdin_state.prefix.erase(0, n);
+	}
+
+	return n + fread(data + n, 1, size - n, stdin);
+}
+
 YUVReader::YUVReader(const std::string &name, float rate, FILE *file, uintmax_t fileSize)
     : name_(name), length_(0), rate_(rate), file_(file), fileSize_(fileSize) {}
 
@@ -62,6 +191,16 @@ YUVReader::YUVReader(const std::string &name, const ImageDescription &image_desc
     : name_(name), image_description_(image_description), length_(length), rate_(rate), file_(file), fileSize_(fileSize) {}
 
 void YUVReader::update_data(const ImageDescription &image_description) {
+	if (source_ != SOURCE_RAW_FILE) {
+		// Y4M has its own description, and streams have no size
+		if (stream_is_y4m() || source_ == SOURCE_Y4M_FILE) {
+			if (!(image_description == image_description_))
+				ERR("Picture description does not match Y4M header of %s", name_.c_str());
+		}
+		image_description_ = image_description;
+		return;
+	}
+
 	if (fileSize_ == static_cast<uintmax_t>(-1))
 		ERR("Cannot open YUV file");
 
@@ -72,23 +211,126 @@ void YUVReader::update_data(const ImageDescription &image_description) {
 		ERR("YUV file is too small");
 
 	image_description_ = image_description;
-	length_ = length;
+	length_ = (length > window_first_) ? std::min(length - window_first_, window_count_) : 0;
 
 	return;
 }
 
+void YUVReader::set_window(unsigned first, unsigned count) {
+	if (source_ == SOURCE_STREAM)
+		ERR("Cannot read part of a stream: %s", name_.c_str());
+
+	const unsigned length = (source_ == SOURCE_Y4M_FILE)
+	                            ? static_cast<unsigned>(frame_offsets_.size())
+	                            : static_cast<unsigned>(fileSize_ / image_description_.byte_size());
+	window_first_ = first;
+	window_count_ = count;
+	length_ = (length > window_first_) ? std::min(length - window_first_, window_count_) : 0;
+}
+
+// File offset of picture data
+uint64_t YUVReader::frame_offset(unsigned position) const {
+	if (source_ == SOURCE_Y4M_FILE)
+		return frame_offsets_[window_first_ + position];
+
+	return (uint64_t)(window_first_ + position) * (uint64_t)image_description_.byte_size();
+}
+
 void YUVReader::set_position(unsigned position) const {
 	CHECK(position < length_);
 	position_ = position;
-	CHECK(fseeko(file_.get(), (uint64_t)position_ * (uint64_t)image_description_.byte_size(), SEEK_SET) == 0);
+	CHECK(fseeko(file_.get(), frame_offset(position_), SEEK_SET) == 0);
+}
+
+bool YUVReader::has_frame(unsigned position) const {
+	if (source_ == SOURCE_STREAM) {
+		while (retained_first_ + retained_.size() <= position)
+			if (!read_stream_picture())
+				break;
+	}
+
+	return position < length_;
+}
+
+// Standard input may carry a Y4M header - other streams are raw pictures
+//
+bool YUVReader::stream_is_y4m() const { return !file_ && stdin_state.y4m; }
+
+size_t YUVReader::read_stream(uint8_t *data, size_t size) const {
+	if (!file_)
+		return read_stdin(data, size);
+
+	return fread(data, 1, size, file_.get());
+}
+
+// Read the next picture of a stream into the retained pictures - returns false at the end of the stream
+//
+bool YUVReader::read_stream_picture() const {
+	if (length_ != UINT_MAX)
+		return false;
+
+	const unsigned position = retained_first_ + static_cast<unsigned>(retained_.size());
+
+	if (stream_is_y4m()) {
+		string header;
+		if (!read_line(stdin, header)) {
+			length_ = position;
+			return false;
+		}
+		if (header.compare(0, 5, "FRAME") != 0)
+			ERR("Bad Y4M frame header in %s", name_.c_str());
+	}
+
+	std::vector<Surface> surfaces;
+	for (unsigned p = 0; p < image_description_.num_planes(); ++p) {
+		auto b = Surface::build_from<int8_t>();
+		b.reserve_bpp(image_description_.width(p), image_description_.height(p), image_description_.byte_depth(),
+		              image_description_.row_stride(p));
+		for (unsigned y = 0; y < image_description_.height(p); ++y) {
+			const size_t n = read_stream(reinterpret_cast<uint8_t *>(b.data(0, y)), image_description_.row_size(p));
+			if (n == 0 && p == 0 && y == 0 && !stream_is_y4m()) {
+				// Clean end of raw stream
+				length_ = position;
+				return false;
+			}
+			if (n != image_description_.row_size(p))
+				ERR("Truncated picture %d in %s", position, name_.c_str());
+		}
+		surfaces.push_back(b.finish());
+	}
+
+	retained_.push_back(Image(format("%s:%d", name_.c_str(), position), image_description_, 0, surfaces));
+	if (retained_.size() > STREAM_RETAINED_PICTURES) {
+		retained_.pop_front();
+		retained_first_++;
+	}
+
+	return true;
 }
 
 // Get image from frame position
 Image YUVReader::read(unsigned position, uint64_t timestamp) const {
-	set_position(position);
-
 	std::vector<Surface> surfaces;
 
+	if (source_ == SOURCE_STREAM) {
+		if (!has_frame(position))
+			ERR("No picture %d in %s", position, name_.c_str());
+		if (position < retained_first_)
+			ERR("Cannot go back to picture %d of %s", position, name_.c_str());
+
+		position_ = position;
+		const Image &image = retained_[position - retained_first_];
+		for (unsigned p = 0; p < image_description_.num_planes(); ++p)
+			surfaces.push_back(image.plane(p));
+
+		return Image(format("%s:%d", name_.c_str(), position_), image_description_, timestamp, surfaces);
+	}
+
+	if (memory_mapped_ && read_mapped(position, surfaces))
+		return Image(format("%s:%d", name_.c_str(), position_), image_description_, timestamp, surfaces);
+
+	set_position(position);
+
 	for (unsigned p = 0; p < image_description_.num_planes(); ++p) {
 		auto b = Surface::build_from<int8_t>();
 		b.reserve_bpp(image_description_.width(p), image_description_.height(p), image_description_.byte_depth(),
@@ -108,6 +350,35 @@ Image YUVReader::read(unsigned position, uint64_t timestamp) const {
 	return Image(format("%s:%d", name_.c_str(), position_), image_description_, timestamp, surfaces);
 }
 
+// Get planes from frame position as views into a mapping of the frame's bytes
+//
+// Returns false if the frame cannot be mapped
+bool YUVReader::read_mapped(unsigned position, std::vector<Surface> &surfaces) const {
+	CHECK(position < length_);
+
+	for (unsigned p = 0; p < image_description_.num_planes(); ++p)
+		if (!image_description_.rows_are_contiguous(p))
+			return false;
+
+	const std::shared_ptr<Buffer> buffer(
+	    CreateBufferMapped(fileno(file_.get()), frame_offset(position), image_description_.byte_size()).release());
+	if (!buffer)
+		return false;
+
+	position_ = position;
+
+	unsigned offset = 0;
+	for (unsigned p = 0; p < image_description_.num_planes(); ++p) {
+		surfaces.push_back(Surface::build_from<int8_t>()
+		                       .contents_bpp(buffer, offset, image_description_.width(p), image_description_.height(p),
+		                                     image_description_.byte_depth(), image_description_.row_stride(p))
+		                       .finish());
+		offset += image_description_.plane_size(p);
+	}
+
+	return true;
+}
+
 // Parse the picture details from the filename
 //
 // Uses roughly the same conventions as Vooya and YUVDeluxe
@@ -185,27 +456,120 @@ static ImageDescription ParseYUVFilename(const string &name, float *pRate) {
 	return ImageDescription(image_format, width, height);
 }
 
+// Open a Y4M file, after its header, and find each picture
+//
+std::unique_ptr<YUVReader> YUVReader::open_y4m(const std::string &name, FILE *file, uintmax_t fileSize) {
+	unique_ptr<YUVReader> reader(new YUVReader(name, 0.0f, file, fileSize));
+	reader->source_ = SOURCE_Y4M_FILE;
+
+	string consumed;
+	CHECK(fseeko(file, 0, SEEK_SET) == 0);
+	CHECK(read_y4m_header(file, reader->image_description_, reader->rate_, consumed));
+
+	string header;
+	while (read_line(file, header)) {
+		if (header.compare(0, 5, "FRAME") != 0)
+			ERR("Bad Y4M frame header in %s", name.c_str());
+
+		const uint64_t offset = ftello(file);
+		if (offset + reader->image_description_.byte_size() > fileSize) {
+			WARN("Truncated picture at end of %s", name.c_str());
+			break;
+		}
+		reader->frame_offsets_.push_back(offset);
+		CHECK(fseeko(file, offset + reader->image_description_.byte_size(), SEEK_SET) == 0);
+	}
+
+	reader->length_ = static_cast<unsigned>(reader->frame_offsets_.size());
+	if (reader->length_ == 0)
+		ERR("Y4M file has no pictures");
+
+	return reader;
+}
+
+// Open standard input - the description is taken from a Y4M header, if there is one
+//
+std::unique_ptr<YUVReader> YUVReader::open_stdin(const ImageDescription &image_description, float rate) {
+	probe_stdin();
+
+	unique_ptr<YUVReader> reader(new YUVReader("stdin", stdin_state.y4m ? stdin_state.description : image_description,
+	                                           UINT_MAX, stdin_state.y4m ? stdin_state.rate : rate, nullptr, 0));
+	reader->source_ = SOURCE_STREAM;
+	return reader;
+}
+
+// Open a file, and return true if it starts with a Y4M header
+//
+static FILE *open_file(const std::string &name, bool &is_y4m) {
+	FILE *file = std::fopen(name.c_str(), "rb");
+	if (!file)
+		ERR("Cannot open YUV file");
+
+	char magic[sizeof(Y4M_MAGIC) - 1];
+	is_y4m = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, Y4M_MAGIC, sizeof(magic)) == 0;
+	CHECK(fseeko(file, 0, SEEK_SET) == 0);
+	return file;
+}
+
+bool ProbeY4M(const std::string &name, ImageDescription &image_description, float &rate) {
+	if (name == "-") {
+		probe_stdin();
+		if (stdin_state.y4m) {
+			image_description = stdin_state.description;
+			rate = stdin_state.rate;
+		}
+		return stdin_state.y4m;
+	}
+
+	if (file_size(name) == static_cast<uintmax_t>(-1))
+		return false;
+
+	bool is_y4m = false;
+	UniquePtrFile file(open_file(name, is_y4m));
+	if (!is_y4m)
+		return false;
+
+	string consumed;
+	return read_y4m_header(file.get(), image_description, rate, consumed);
+}
+
 // Open file for reading, given explicit format
 //
 std::unique_ptr<YUVReader> CreateYUVReader(const std::string &name, const ImageDescription &description, unsigned rate) {
+	if (name == "-")
+		return YUVReader::open_stdin(description, (float)rate);
+
 	// Is file there?
 	const uintmax_t fileSize = file_size(name);
 	if (fileSize == static_cast<uintmax_t>(-1))
 		return 0;
 
+	bool is_y4m = false;
+	UniquePtrFile yuvFile(open_file(name, is_y4m));
+
+	if (is_y4m) {
+		unique_ptr<YUVReader> reader(YUVReader::open_y4m(name, yuvFile.release(), fileSize));
+		if (!(reader->description() == description))
+			ERR("Picture description does not match Y4M header of %s", name.c_str());
+		return reader;
+	}
+
 	// Figure length
 	unsigned length = static_cast<unsigned>(fileSize / description.byte_size());
 
 	if (length == 0)
 		ERR("YUV file is too small");
 
-	UniquePtrFile yuvFile(std::fopen(name.c_str(), "rb"));
-
-	if (yuvFile)
-		return unique_ptr<YUVReader>(new YUVReader(name, description, length, (float)rate, yuvFile.release(), fileSize));
+	return unique_ptr<YUVReader>(new YUVReader(name, description, length, (float)rate, yuvFile.release(), fileSize));
+}
 
-	ERR("Cannot open YUV file");
-	return 0;
+// Read raw pictures from an open stream
+//
+std::unique_ptr<YUVReader> CreateYUVReader(FILE *stream, const std::string &name, const ImageDescription &description,
+                                           unsigned rate) {
+	unique_ptr<YUVReader> reader(new YUVReader(name, description, UINT_MAX, (float)rate, stream, 0));
+	reader->source_ = YUVReader::SOURCE_STREAM;
+	return reader;
 }
 
 // Open file for reading, format is inferred from filename
@@ -214,6 +578,8 @@ unique_ptr<YUVReader> CreateYUVReader(const string &name) {
 	// Does it have a sensible name?
 	float rate = 25.0f;
 	ImageDescription description = ParseYUVFilename(name, &rate);
+	if (description.format() == IMAGE_FORMAT_NONE)
+		ProbeY4M(name, description, rate);
 	if (description.format() == IMAGE_FORMAT_NONE)
 		ERR("Cannot parse YUV filename");
 
@@ -223,19 +589,21 @@ unique_ptr<YUVReader> CreateYUVReader(const string &name) {
 // Create Dummy Reader, will be filled later
 //
 unique_ptr<YUVReader> CreateYUVReader(const string &name, unsigned rate) {
+	if (name == "-")
+		return YUVReader::open_stdin(ImageDescription(), (float)rate);
+
 	// Is file there?
 	const uintmax_t fileSize = file_size(name);
 	if (fileSize == static_cast<uintmax_t>(-1))
 		return 0;
 
-	UniquePtrFile yuvFile(std::fopen(name.c_str(), "rb"));
+	bool is_y4m = false;
+	UniquePtrFile yuvFile(open_file(name, is_y4m));
 
-	if (yuvFile) {
-		return unique_ptr<YUVReader>(new YUVReader(name, (float)rate, yuvFile.release(), fileSize));
-	}
+	if (is_y4m)
+		return YUVReader::open_y4m(name, yuvFile.release(), fileSize);
 
-	ERR("Cannot open YUV file");
-	return 0;
+	return unique_ptr<YUVReader>(new YUVReader(name, (float)rate, yuvFile.release(), fileSize));
 };
 
 } // namespace lctm
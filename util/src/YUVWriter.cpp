@@ -36,34 +36,110 @@
 // YUVWriter.cpp
 //
 #include "YUVWriter.hpp"
+#include "Platform.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <deque>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 namespace lctm {
 
-YUVWriter::YUVWriter(const std::string &basename) : filename_(basename) {}
+// Most pictures the I/O thread will gather into one write
+static const unsigned MAX_BATCH = 8;
+
+// Header that starts each Y4M picture
+static const char Y4M_FRAME[] = "FRAME\n";
+
+YUVWriter::YUVWriter(const std::string &basename) : filename_(basename), y4m_(file_extension(basename) == "y4m") {
+	// Claim standard output straight away, before anything else can write to it
+	if (filename_ == "-")
+		open();
+}
 
 YUVWriter::YUVWriter(const std::string &basename, const ImageDescription &image_description, bool decorate)
     : image_description_(image_description) {
 
-	if (decorate && file_extension(basename).empty())
+	if (decorate && basename != "-" && file_extension(basename).empty())
 		filename_ = image_description_.make_name(basename);
 	else
 		filename_ = basename;
 
-	file_.reset(std::fopen(filename_.c_str(), "wb"));
+	y4m_ = file_extension(filename_) == "y4m";
+
+	open();
+}
+
+YUVWriter::~YUVWriter() { stop(); }
 
-	if (!file_) {
-		ERR("Cannot open %s for writing", filename_.c_str());
+// Open the output file - "-" is standard output
+//
+void YUVWriter::open() {
+	if (filename_ != "-") {
+		y4m_header_written_ = false;
+		file_.reset(std::fopen(filename_.c_str(), "wb"));
+		if (!file_)
+			ERR("Cannot open %s for writing", filename_.c_str());
+		return;
 	}
+
+	// Standard output can only be opened once
+	if (file_)
+		return;
+
+	// Write pictures to a copy of the stdout descriptor, and send anything else that goes to stdout - from this process
+	// or any child processes - to stderr instead
+	std::fflush(stdout);
+#ifdef _WIN32
+	const int fd = _dup(_fileno(stdout));
+	_dup2(_fileno(stderr), _fileno(stdout));
+	_setmode(fd, _O_BINARY);
+#else
+	const int fd = dup(fileno(stdout));
+	dup2(fileno(stderr), fileno(stdout));
+#endif
+	file_.reset(fdopen(fd, "wb"));
+	if (!file_)
+		ERR("Cannot open standard output for writing");
 }
 
 void YUVWriter::update_data(const ImageDescription &image_description) {
+	flush();
+
+	if (y4m_header_written_ && !(image_description == image_description_))
+		WARN("Y4M output format cannot change");
+
 	image_description_ = image_description;
 
-	file_.reset(std::fopen(filename_.c_str(), "wb"));
+	open();
+}
 
-	if (!file_) {
-		ERR("Cannot open %s for writing", filename_.c_str());
+void YUVWriter::write_y4m_header() {
+	// Rates are written exactly if they are whole, else to 1/1000 - and left out if not known
+	std::string rate;
+	if (rate_ > 0.0f) {
+		const bool whole = rate_ == (float)(unsigned)rate_;
+		rate = format(" F%u:%u", whole ? (unsigned)rate_ : (unsigned)(rate_ * 1000.0f + 0.5f), whole ? 1 : 1000);
 	}
+
+	if (fprintf(file_.get(), "YUV4MPEG2 W%u H%u%s Ip A1:1 C%s\n", image_description_.width(), image_description_.height(),
+	            rate.c_str(), Y4MColourspace(image_description_.format()).c_str()) < 0)
+		ERR("Cannot write to %s", filename_.c_str());
+
+	std::fflush(file_.get());
+	y4m_header_written_ = true;
 }
 
 void YUVWriter::write_surface(const Surface &surface) {
@@ -86,21 +162,162 @@ void YUVWriter::write(const Image &image) {
 	if (!(image.description() == image_description_))
 		WARN("WARNING: Output format changed!");
 
+	std::vector<Surface> planes;
 	for (unsigned p = 0; p < image_description_.num_planes(); ++p)
-		write_surface(image.plane(p));
+		planes.push_back(image.plane(p));
 
-	std::fflush(file_.get());
+	write_planes(planes);
 }
 
 void YUVWriter::write(const Surface &surface) {
 	CHECK(image_description_.num_planes() == 1);
 
-	write_surface(surface);
+	write_planes({surface});
+}
+
+void YUVWriter::write_planes(std::vector<Surface> planes) {
+	if (y4m_ && !y4m_header_written_) {
+		flush();
+		write_y4m_header();
+	}
+
+	if (queue_) {
+		{
+			std::lock_guard<std::mutex> lock(pending_mutex_);
+			pending_++;
+		}
+		queue_->push(planes);
+		return;
+	}
+
+	if (y4m_ && std::fwrite(Y4M_FRAME, sizeof(Y4M_FRAME) - 1, 1, file_.get()) != 1)
+		ERR("Cannot write to %s", filename_.c_str());
+
+	for (const auto &plane : planes)
+		write_surface(plane);
 
 	std::fflush(file_.get());
 }
 
+#ifndef _WIN32
+// writev() all of 'iov', carrying on after partial writes
+//
+static bool write_vectors(int fd, std::vector<struct iovec> &iov) {
+	size_t first = 0;
+	while (first < iov.size()) {
+		const ssize_t r = writev(fd, &iov[first], static_cast<int>(std::min(iov.size() - first, (size_t)IOV_MAX)));
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		// Step over what was written - may stop part way into a vector
+		size_t written = static_cast<size_t>(r);
+		while (written > 0) {
+			if (written >= iov[first].iov_len) {
+				written -= iov[first].iov_len;
+				++first;
+			} else {
+				iov[first].iov_base = static_cast<uint8_t *>(iov[first].iov_base) + written;
+				iov[first].iov_len -= written;
+				written = 0;
+			}
+		}
+	}
+	return true;
+}
+#endif
+
+// Write several pictures - with one gathered write where possible
+//
+void YUVWriter::write_batch(const std::vector<std::vector<Surface>> &batch) {
+#ifdef _WIN32
+	for (const auto &planes : batch) {
+		if (y4m_ && std::fwrite(Y4M_FRAME, sizeof(Y4M_FRAME) - 1, 1, file_.get()) != 1)
+			ERR("Cannot write to %s", filename_.c_str());
+		for (const auto &plane : planes)
+			write_surface(plane);
+	}
+	std::fflush(file_.get());
+#else
+	std::deque<SurfaceView<int8_t>> views;
+	std::vector<struct iovec> iov;
+	for (const auto &planes : batch) {
+		if (y4m_)
+			iov.push_back({const_cast<char *>(Y4M_FRAME), sizeof(Y4M_FRAME) - 1});
+		for (const auto &plane : planes) {
+			views.emplace_back(plane);
+			const auto &v = views.back();
+			if (v.rows_are_contiguous()) {
+				iov.push_back({const_cast<int8_t *>(v.data()), v.size()});
+			} else {
+				for (unsigned y = 0; y < v.height(); ++y)
+					iov.push_back({const_cast<int8_t *>(v.data(0, y)), v.row_size()});
+			}
+		}
+	}
+
+	if (!write_vectors(fileno(file_.get()), iov))
+		ERR("Cannot write to %s", filename_.c_str());
+#endif
+}
+
+void YUVWriter::io_thread() {
+	bool stopping = false;
+	while (!stopping) {
+		// Wait for a picture, then take any others that are already queued
+		std::vector<std::vector<Surface>> batch(1);
+		queue_->pop(batch[0]);
+		std::vector<Surface> planes;
+		while (batch.size() < MAX_BATCH && queue_->pop_timeout(planes))
+			batch.push_back(planes);
+
+		while (!batch.empty() && batch.back().empty()) {
+			batch.pop_back();
+			stopping = true;
+		}
+
+		write_batch(batch);
+
+		{
+			std::lock_guard<std::mutex> lock(pending_mutex_);
+			pending_ -= static_cast<unsigned>(batch.size());
+		}
+		written_.notify_all();
+	}
+}
+
+void YUVWriter::set_asynchronous(unsigned queue_depth) {
+	stop();
+
+	if (queue_depth == 0)
+		return;
+
+	// Anything written synchronously is already out of the FILE's buffer - from here on the I/O thread writes to the descriptor
+	std::fflush(file_.get());
+	queue_.reset(new RingBuffer<std::vector<Surface>>(queue_depth));
+	io_thread_ = std::thread(&YUVWriter::io_thread, this);
+}
+
+void YUVWriter::flush() {
+	std::unique_lock<std::mutex> lock(pending_mutex_);
+	while (pending_ > 0)
+		written_.wait(lock);
+}
+
+void YUVWriter::stop() {
+	if (!queue_)
+		return;
+
+	flush();
+	queue_->push(std::vector<Surface>());
+	io_thread_.join();
+	queue_.reset();
+}
+
 void YUVWriter::close() {
+	stop();
 	std::fflush(file_.get());
 	file_.reset(nullptr);
 }